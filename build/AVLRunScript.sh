@@ -39,7 +39,7 @@ function check_test {
     termination='.out'
 
 
-    tests=("init" "search" "minmax" "succ_pred" "rotations" "insert" "delete" "list_insert" "list_delete")
+    tests=("init" "search" "minmax" "succ_pred" "rotations" "insert" "delete" "list_insert" "list_delete" "adopt" "stats" "journal" "hash" "bloom" "finger" "memory" "balance" "weight" "tombstone" "split" "parallel" "walk" "cache" "view" "aggregate" "interval" "values" "append" "trace")
 
     for i in ${!tests[@]}
     do
@@ -68,7 +68,7 @@ function check_test {
     fi
 
 
-    tests=("inorder_key" "level_key" "range_key")
+    tests=("build_map" "snapshot" "inorder_key" "level_key" "range_key")
 
     for i in ${!tests[@]}
     do
@@ -0,0 +1,901 @@
+#include "./include/AVLTree.h"
+#include "./include/Cipher.h"
+#include "./include/Range.h"
+#include "./include/Func.h"
+#include "./include/Snapshot.h"
+#include "./include/Hash.h"
+#include "./include/Bloom.h"
+#include "./include/Finger.h"
+#include "./include/Tombstone.h"
+#include "./include/Parallel.h"
+#include "./include/Cache.h"
+#include "./include/KeyView.h"
+#include "./include/Aggregate.h"
+#include "./include/Interval.h"
+#include "./include/ValueIndex.h"
+#include "./include/Trace.h"
+#include "./utils/Bench.h"
+
+#include <unistd.h>
+
+#define BENCH_MIN 1000
+#define BENCH_MAX 1000000
+#define BENCH_OPS 100000
+#define BENCH_QUERIES 1000
+#define BENCH_SEED 42
+#define BENCH_CLUSTER 64
+#define BENCH_TOMBSTONES 0.25
+#define BENCH_CACHE_BOUNDS 4
+#define BENCH_CACHE_QUERIES 128
+#define BENCH_CACHE_UPDATES 32
+#define BENCH_VIEW_READS 32
+#define BENCH_AGGREGATE_QUERIES 256
+#define BENCH_INTERVAL_QUERIES 256
+#define BENCH_INTERVAL_WIDTH 64
+#define BENCH_VALUE_QUERIES 256
+#define BENCH_VALUE_SCANS 16
+#define BENCH_APPENDS 4
+#define BENCH_APPEND_WORDS 64
+
+#define WORDS_FILE "bench_words.txt"
+#define TRACE_FILE "bench_trace.json"
+#define CIPHER_FILE "bench_cipher.txt"
+#define PLAIN_FILE "bench_plain.txt"
+#define SNAP_FILE "bench_tree.snap"
+
+// Ratios of duplicate keys measured for each distribution.
+static const double dupRatios[] = {0.0, 0.5, 0.9};
+
+// Accumulated time of each measured operation.
+typedef struct Timings {
+	uint64_t insert, search, succ, pred, range, inorder, level, delete;
+	size_t ranges;
+} Timings;
+
+uint64_t bench_round(Tree *tree, const int *keys, const int *lookups, size_t size,
+					 size_t distinct, Rng *rng, Timings *time, size_t *sink) {
+	int64_t value = 0;
+	size_t before = heapInUse();
+
+	uint64_t start = nowNs();
+	for (size_t i = 0; i < size; i++, value++)
+		insertNode(tree, (void *)(keys + i), &value);
+	time->insert += nowNs() - start;
+
+	size_t bytes = heapInUse() - before;
+
+	start = nowNs();
+	for (size_t i = 0; i < size; i++)
+		*sink += search(tree, tree->root, (void *)(lookups + i)) != NULL;
+	time->search += nowNs() - start;
+
+	start = nowNs();
+	for (TreeNode *node = minimum(tree->root); node; node = successor(node))
+		(*sink)++;
+	time->succ += nowNs() - start;
+
+	start = nowNs();
+	for (TreeNode *node = maximum(tree->root); node; node = predecessor(node))
+		(*sink)++;
+	time->pred += nowNs() - start;
+
+	// Each range covers about 1% of the key space.
+	size_t queries = size < BENCH_QUERIES ? size : BENCH_QUERIES;
+	int width = (int)(distinct / 100);
+	start = nowNs();
+	for (size_t i = 0; i < queries; i++) {
+		int left = (int)(nextRng(rng) % distinct), right = left + width;
+		Range *range = rangeKeyQuery(tree, (const char *)&left, (const char *)&right);
+		*sink += range->size;
+		destroyRange(range);
+	}
+	time->range += nowNs() - start;
+	time->ranges += queries;
+
+	start = nowNs();
+	Range *range = inorderKeyQuery(tree);
+	time->inorder += nowNs() - start;
+	*sink += range->size;
+	destroyRange(range);
+
+	start = nowNs();
+	range = levelKeyQuery(tree);
+	time->level += nowNs() - start;
+	*sink += range->size;
+	destroyRange(range);
+
+	start = nowNs();
+	for (size_t i = 0; i < size; i++)
+		deleteNode(tree, (void *)(keys + i));
+	time->delete += nowNs() - start;
+
+	return bytes;
+}
+
+void bench_hashed(Report *report, const int *keys, const int *lookups, size_t size,
+				  Dist dist, double dup, size_t *sink) {
+	Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	setTreeHash(tree, hashInt);
+	int64_t value = 0;
+	size_t before = heapInUse();
+
+	uint64_t start = nowNs();
+	for (size_t i = 0; i < size; i++, value++)
+		insertNode(tree, (void *)(keys + i), &value);
+	uint64_t insert = nowNs() - start;
+	double perKey = (double)(heapInUse() - before) / (double)size;
+
+	start = nowNs();
+	for (size_t i = 0; i < size; i++)
+		*sink += search(tree, tree->root, (void *)(lookups + i)) != NULL;
+	uint64_t found = nowNs() - start;
+
+	start = nowNs();
+	for (size_t i = 0; i < size; i++)
+		deleteNode(tree, (void *)(keys + i));
+	uint64_t delete = nowNs() - start;
+
+	reportResult(report, "insertNode_hashed", size, dist, dup, size, insert, perKey);
+	reportResult(report, "search_hashed", size, dist, dup, size, found, perKey);
+	reportResult(report, "deleteNode_hashed", size, dist, dup, size, delete, perKey);
+	destroyTree(tree);
+}
+
+void bench_bloom(Report *report, size_t size, Dist dist, size_t *sink) {
+	// Even keys are inserted, 40% of the lookups are for odd (missing) keys.
+	int *keys = generateKeys(dist, size, size, BENCH_SEED);
+	int *lookups = generateKeys(dist, size, size, BENCH_SEED + 1);
+	for (size_t i = 0; i < size; i++) {
+		keys[i] *= 2;
+		lookups[i] = lookups[i] * 2 + (i % 5 < 2);
+	}
+
+	// Without the filter, then with its scalar and AVX2 probes (when the CPU has AVX2).
+	const char *names[] = {"search_miss40", "search_miss40_bloom_scalar", "search_miss40_bloom_avx2"};
+	for (int bloom = 0; bloom < 3; bloom++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		if (bloom) setTreeBloom(tree, hashInt, BLOOM_BITS_PER_KEY);
+		if (bloom && !setBloomSimd(tree, bloom == 2)) {
+			destroyTree(tree);
+			continue;
+		}
+		int64_t value = 0;
+		for (size_t i = 0; i < size; i++, value++)
+			insertNode(tree, keys + i, &value);
+
+		uint64_t start = nowNs();
+		for (size_t i = 0; i < size; i++)
+			*sink += search(tree, tree->root, lookups + i) != NULL;
+		uint64_t found = nowNs() - start;
+
+		BloomStats stats;
+		getBloomStats(tree, &stats);
+		reportResult(report, names[bloom], size, dist, 0,
+					 size, found, (double)stats.bytes / (double)size);
+		destroyTree(tree);
+	}
+
+	free(keys);
+	free(lookups);
+}
+
+void bench_finger(Report *report, size_t size, size_t *sink) {
+	// Sequential stream: keys in order. Clustered stream: runs of close keys
+	// (random steps of at most BENCH_CLUSTER / 2) around uniformly spread centers.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	int *sequential = generateKeys(DIST_SEQUENTIAL, size, size, BENCH_SEED);
+	int *clustered = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED + 1);
+	Rng rng;
+	seedRng(&rng, BENCH_SEED);
+	for (size_t i = 0; i < size; i++)
+		if (i % BENCH_CLUSTER)
+			clustered[i] = clustered[i - 1] + (int)(nextRng(&rng) % (BENCH_CLUSTER + 1)) - BENCH_CLUSTER / 2;
+
+	Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	int64_t value = 0;
+	for (size_t i = 0; i < size; i++, value++)
+		insertNode(tree, keys + i, &value);
+
+	const int *streams[] = {sequential, clustered};
+	const char *names[][2] = {{"search_sequential", "fingerSearch_sequential"},
+							  {"search_clustered", "fingerSearch_clustered"}};
+	for (int stream = 0; stream < 2; stream++) {
+		const int *lookups = streams[stream];
+		Dist dist = stream ? DIST_UNIFORM : DIST_SEQUENTIAL;
+
+		uint64_t start = nowNs();
+		for (size_t i = 0; i < size; i++)
+			*sink += search(tree, tree->root, (void *)(lookups + i)) != NULL;
+		uint64_t root = nowNs() - start;
+
+		Finger finger;
+		initFinger(&finger, tree);
+		start = nowNs();
+		for (size_t i = 0; i < size; i++)
+			*sink += fingerSearch(&finger, (void *)(lookups + i)) != NULL;
+		uint64_t near = nowNs() - start;
+
+		reportResult(report, names[stream][0], size, dist, 0, size, root, 0);
+		reportResult(report, names[stream][1], size, dist, 0, size, near, 0);
+	}
+
+	destroyTree(tree);
+	free(keys);
+	free(sequential);
+	free(clustered);
+}
+
+// Rotations done by the fix ups of a tree, counted only with `make bench STATS=1`.
+size_t countRotations(Tree *tree) {
+	TreeStats stats;
+	getTreeStats(tree, &stats);
+	size_t total = 0;
+	for (int type = 0; type < ROTATE_TYPES; type++)
+		total += stats.rotations[type];
+	return total;
+}
+
+void bench_balance(Report *report, size_t size, Dist dist, size_t *sink) {
+	// Ingest, then a churn (each step deletes an old key and inserts a new one),
+	// then deletes of all the keys left. New keys are negative, never seen before.
+	const char *names[BALANCE_TYPES] = {"avl", "wavl", "weight"};
+	const char *phases[] = {"insertNode", "churn", "deleteNode"};
+	int *keys = generateKeys(dist, size, size, BENCH_SEED);
+	int *fresh = generateKeys(dist, size, size, BENCH_SEED + 2);
+	for (size_t i = 0; i < size; i++)
+		fresh[i] = -1 - fresh[i];
+
+	for (int balance = 0; balance < BALANCE_TYPES; balance++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		setTreeBalance(tree, (Balance)balance);
+		uint64_t ns[3];
+		size_t rotations[3], ops[3] = {size, 2 * size, size};
+		int64_t value = 0;
+
+		uint64_t start = nowNs();
+		for (size_t i = 0; i < size; i++, value++)
+			insertNode(tree, keys + i, &value);
+		ns[0] = nowNs() - start;
+		rotations[0] = countRotations(tree);
+
+		start = nowNs();
+		for (size_t i = 0; i < size; i++, value++) {
+			deleteNode(tree, keys + i);
+			insertNode(tree, fresh + i, &value);
+		}
+		ns[1] = nowNs() - start;
+		rotations[1] = countRotations(tree) - rotations[0];
+
+		start = nowNs();
+		for (size_t i = 0; i < size; i++)
+			deleteNode(tree, fresh + i);
+		ns[2] = nowNs() - start;
+		rotations[2] = countRotations(tree) - rotations[0] - rotations[1];
+		*sink += tree->size + 1;
+
+		TreeStats stats;
+		getTreeStats(tree, &stats);
+		for (int phase = 0; phase < 3; phase++) {
+			char op[64];
+			snprintf(op, sizeof(op), "%s_%s", phases[phase], names[balance]);
+			reportResult(report, op, size, dist, 0, ops[phase], ns[phase], 0);
+			if (!stats.enabled) continue;
+			snprintf(op, sizeof(op), "rotations_%s_%s", phases[phase], names[balance]);
+			reportCount(report, op, size, dist, ops[phase], rotations[phase]);
+		}
+		destroyTree(tree);
+	}
+
+	free(keys);
+	free(fresh);
+}
+
+// Depth of a key (root is 1), found without `search`, which counts the accesses in weighted mode.
+size_t keyDepth(Tree *tree, int key) {
+	size_t depth = 1;
+	for (TreeNode *node = tree->root; node; depth++) {
+		int comp = compareInt(node->elem, &key);
+		if (!comp) return depth;
+		node = comp > 0 ? node->left : node->right;
+	}
+	return 0;
+}
+
+void bench_weight(Report *report, size_t size, Dist dist, size_t *sink) {
+	// The same balanced tree, searched as is and in weighted mode.
+	int *keys = generateKeys(DIST_SEQUENTIAL, size, size, BENCH_SEED);
+	int *lookups = generateKeys(dist, size, size, BENCH_SEED + 1);
+	Balance policies[] = {BALANCE_AVL, BALANCE_WEIGHT};
+	const char *names[][2] = {{"search_avl", "depth_search_avl"},
+							  {"search_weight", "depth_search_weight"}};
+
+	for (int policy = 0; policy < 2; policy++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		int64_t value = 0;
+		for (size_t i = 0; i < size; i++, value++)
+			insertNode(tree, keys + i, &value);
+		setTreeBalance(tree, policies[policy]);
+
+		uint64_t start = nowNs();
+		for (size_t i = 0; i < size; i++)
+			*sink += search(tree, tree->root, lookups + i) != NULL;
+		uint64_t found = nowNs() - start;
+
+		// Depth met by each lookup of a second pass, as the tree adapts.
+		size_t depth = 0;
+		for (size_t i = 0; i < size; i++) {
+			depth += keyDepth(tree, lookups[i]);
+			*sink += search(tree, tree->root, lookups + i) != NULL;
+		}
+
+		reportResult(report, names[policy][0], size, dist, 0, size, found, 0);
+		reportCount(report, names[policy][1], size, dist, size, depth);
+		destroyTree(tree);
+	}
+
+	free(keys);
+	free(lookups);
+}
+
+void bench_tombstone(Report *report, size_t size, size_t *sink) {
+	// A delete-heavy window: half of the keys are deleted, each under the write
+	// lock, eagerly, lazily (compacted inline) and lazily with a compactor thread.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	const char *names[] = {"deleteNode_eager", "deleteNode_lazy", "deleteNode_lazy_background"};
+
+	for (int mode = 0; mode < 3; mode++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		int64_t value = 0;
+		for (size_t i = 0; i < size; i++, value++)
+			insertNode(tree, keys + i, &value);
+		if (mode) setTreeTombstones(tree, BENCH_TOMBSTONES);
+
+		pthread_rwlock_t lock;
+		pthread_rwlock_init(&lock, NULL);
+		Compactor *compactor = (mode == 2) ? startCompactor(tree, &lock) : NULL;
+		Histogram hist;
+		initHistogram(&hist);
+
+		uint64_t start = nowNs();
+		for (size_t i = 0; i < size / 2; i++) {
+			uint64_t begin = nowNs();
+			pthread_rwlock_wrlock(&lock);
+			deleteNode(tree, keys + i);
+			pthread_rwlock_unlock(&lock);
+			recordLatency(&hist, nowNs() - begin);
+		}
+		uint64_t elapsed = nowNs() - start;
+
+		stopCompactor(compactor);
+		*sink += tree->size;
+		reportResult(report, names[mode], size, DIST_UNIFORM, 0, size / 2, elapsed, 0);
+		reportLatency(report, names[mode], &hist, elapsed);
+		destroyTree(tree);
+		pthread_rwlock_destroy(&lock);
+	}
+
+	free(keys);
+}
+
+void bench_range_delete(Report *report, size_t size, size_t *sink) {
+	// The middle half of the keys is removed: key by key, at once, or moved to a new tree.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	const char *names[] = {"deleteNode_range", "deleteRange", "extractRange"};
+	int left = (int)(size / 4), right = (int)(size / 4 * 3) - 1;
+
+	for (int mode = 0; mode < 3; mode++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		int64_t value = 0;
+		for (size_t i = 0; i < size; i++, value++)
+			insertNode(tree, keys + i, &value);
+		size_t before = tree->size;
+
+		uint64_t start = nowNs();
+		Tree *range = NULL;
+		if (mode == 0) {
+			for (int key = left; key <= right; key++)
+				while (search(tree, tree->root, &key)) deleteNode(tree, &key);
+		} else if (mode == 1) {
+			deleteRange(tree, &left, &right);
+		} else {
+			range = extractRange(tree, &left, &right);
+		}
+		uint64_t elapsed = nowNs() - start;
+
+		size_t removed = before - tree->size;
+		reportResult(report, names[mode], size, DIST_UNIFORM, 0, removed ? removed : 1, elapsed, 0);
+		*sink += removed;
+		destroyTree(range);
+		destroyTree(tree);
+	}
+
+	free(keys);
+}
+
+void bench_parallel_query(Report *report, size_t size, size_t *sink) {
+	// Whole tree and middle half exports, by one thread and by one thread per core.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	setTreeValueWidth(tree, sizeof(int64_t));
+	int64_t value = 0;
+	for (size_t i = 0; i < size; i++, value++)
+		insertNode(tree, keys + i, &value);
+
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = cores > 1 ? (int)cores : 1;
+	int left = (int)(size / 4), right = (int)(size / 4 * 3);
+	const char *names[] = {"inorderKeyQuery_export", "inorderKeyQuery_parallel",
+						   "rangeKeyQuery_export", "rangeKeyQuery_parallel"};
+
+	for (int mode = 0; mode < 4; mode++) {
+		const char *low = (const char *)&left, *high = (const char *)&right;
+		uint64_t start = nowNs();
+		Range *range = NULL;
+		switch (mode) {
+			case 0: range = inorderKeyQuery(tree); break;
+			case 1: range = inorderKeyQueryParallel(tree, threads); break;
+			case 2: range = rangeKeyQuery(tree, low, high); break;
+			default: range = rangeKeyQueryParallel(tree, low, high, threads); break;
+		}
+		uint64_t elapsed = nowNs() - start;
+
+		reportResult(report, names[mode], size, DIST_UNIFORM, 0, range->size ? range->size : 1, elapsed, 0);
+		*sink += range->size;
+		destroyRange(range);
+	}
+
+	destroyTree(tree);
+	free(keys);
+}
+
+void bench_cache(Report *report, size_t size, size_t *sink) {
+	// The same few range queries over and over, one insert every BENCH_CACHE_UPDATES queries,
+	// each query rebuilt and with a query cache. The hits and misses are reported too.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	const char *names[] = {"rangeKeyQuery_uncached", "rangeKeyQuery_cached"};
+	int bounds[BENCH_CACHE_BOUNDS][2];
+	for (int i = 0; i < BENCH_CACHE_BOUNDS; i++) {
+		bounds[i][0] = (int)(size / (BENCH_CACHE_BOUNDS + 1) * i);
+		bounds[i][1] = bounds[i][0] + (int)(size / 8);
+	}
+
+	for (int mode = 0; mode < 2; mode++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		setTreeValueWidth(tree, sizeof(int64_t));
+		int64_t value = 0;
+		for (size_t i = 0; i < size; i++, value++)
+			insertNode(tree, keys + i, &value);
+		if (mode) setTreeCache(tree, CACHE_ENTRIES);
+
+		uint64_t start = nowNs();
+		for (size_t i = 0; i < BENCH_CACHE_QUERIES; i++) {
+			if (i % BENCH_CACHE_UPDATES == BENCH_CACHE_UPDATES - 1)
+				insertNode(tree, keys + i % size, &value);
+			const int *bound = bounds[i % BENCH_CACHE_BOUNDS];
+			Range *range = rangeKeyQuery(tree, (const char *)&bound[0], (const char *)&bound[1]);
+			*sink += range->size;
+			destroyRange(range);
+		}
+		uint64_t elapsed = nowNs() - start;
+
+		reportResult(report, names[mode], size, DIST_UNIFORM, 0, BENCH_CACHE_QUERIES, elapsed, 0);
+		if (mode) {
+			CacheStats stats;
+			getCacheStats(tree, &stats);
+			reportCount(report, "cache_hits", size, DIST_UNIFORM, BENCH_CACHE_QUERIES, stats.hits);
+			reportCount(report, "cache_misses", size, DIST_UNIFORM, BENCH_CACHE_QUERIES, stats.misses);
+		}
+		destroyTree(tree);
+	}
+
+	free(keys);
+}
+
+void bench_view(Report *report, size_t size, size_t *sink) {
+	// A trickle of inserts, each followed by a read of the whole in-order sequence,
+	// through the query cache (rebuilt after each insert) and through a view.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	const char *names[] = {"inorderKeyQuery_trickle", "keyViewRange_trickle"};
+
+	for (int mode = 0; mode < 2; mode++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		setTreeValueWidth(tree, sizeof(int64_t));
+		int64_t value = 0;
+		for (size_t i = 0; i < size; i++, value++)
+			insertNode(tree, keys + i, &value);
+		if (!mode) setTreeCache(tree, CACHE_ENTRIES);
+		KeyView *view = mode ? createKeyView(tree, NULL, NULL) : NULL;
+
+		uint64_t start = nowNs();
+		for (size_t i = 0; i < BENCH_VIEW_READS; i++) {
+			insertNode(tree, keys + i % size, &value);
+			Range *range = mode ? keyViewRange(view) : inorderKeyQuery(tree);
+			*sink += range->size;
+			destroyRange(range);
+		}
+		uint64_t elapsed = nowNs() - start;
+
+		reportResult(report, names[mode], size, DIST_UNIFORM, 0, BENCH_VIEW_READS, elapsed, 0);
+		destroyTree(tree);
+	}
+
+	free(keys);
+}
+
+void bench_aggregate(Report *report, size_t size, size_t *sink) {
+	// Inserts and range sums of the values over an eighth of the keys, by a walk of
+	// the range query and by the aggregates kept in the nodes.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	const char *inserts[] = {"insertNode_plain", "insertNode_aggregate"};
+	const char *names[] = {"rangeSum_scan", "rangeAggregate"};
+
+	for (int mode = 0; mode < 2; mode++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		setTreeValueWidth(tree, sizeof(int64_t));
+		if (mode) setTreeAggregate(tree, &offsetMonoid);
+		int64_t value = 0;
+		uint64_t start = nowNs();
+		for (size_t i = 0; i < size; i++, value++)
+			insertNode(tree, keys + i, &value);
+		reportResult(report, inserts[mode], size, DIST_UNIFORM, 0, size, nowNs() - start, 0);
+
+		start = nowNs();
+		for (size_t i = 0; i < BENCH_AGGREGATE_QUERIES; i++) {
+			int left = keys[i % size], right = left + (int)(size / 8);
+			if (mode) {
+				OffsetSummary sum;
+				rangeAggregate(tree, &left, &right, &sum);
+				*sink += (size_t)sum.letters;
+				continue;
+			}
+			Range *range = rangeKeyQuery(tree, (const char *)&left, (const char *)&right);
+			for (size_t j = 0; j < range->size; j++) *sink += (size_t)range->index[j];
+			destroyRange(range);
+		}
+		reportResult(report, names[mode], size, DIST_UNIFORM, 0, BENCH_AGGREGATE_QUERIES, nowNs() - start, 0);
+		destroyTree(tree);
+	}
+
+	free(keys);
+}
+
+void bench_interval(Report *report, size_t size, size_t *sink) {
+	// Words of 1 to 8 letters one after the other, then the words overlapping a few
+	// bytes found by a walk of the spans and by the overlap and stabbing queries.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	const char *words[] = {"a", "be", "sea", "deer", "eagle", "falcon", "gazelle", "hedgehog"};
+	Tree *tree = createIntervalTree();
+	int64_t offset = 0;
+	for (size_t i = 0; i < size; i++)
+		insertWordInterval(tree, words[keys[i] % 8], &offset);
+
+	uint64_t start = nowNs();
+	for (size_t i = 0; i < BENCH_INTERVAL_QUERIES; i++) {
+		int64_t from = keys[i % size] * offset / (int64_t)size;
+		for (TreeNode *entry = minimum(tree->root); entry; entry = entry->next) {
+			const Interval *span = (const Interval *)entry->elem;
+			*sink += span->start < from + BENCH_INTERVAL_WIDTH && span->end > from;
+		}
+	}
+	reportResult(report, "overlap_scan", size, DIST_UNIFORM, 0, BENCH_INTERVAL_QUERIES, nowNs() - start, 0);
+
+	start = nowNs();
+	for (size_t i = 0; i < BENCH_INTERVAL_QUERIES; i++) {
+		int64_t from = keys[i % size] * offset / (int64_t)size;
+		*sink += overlapQuery(tree, from, from + BENCH_INTERVAL_WIDTH, NULL, NULL);
+	}
+	reportResult(report, "overlapQuery", size, DIST_UNIFORM, 0, BENCH_INTERVAL_QUERIES, nowNs() - start, 0);
+
+	start = nowNs();
+	for (size_t i = 0; i < BENCH_INTERVAL_QUERIES; i++)
+		*sink += stabQuery(tree, keys[i % size] * offset / (int64_t)size, NULL, NULL);
+	reportResult(report, "stabQuery", size, DIST_UNIFORM, 0, BENCH_INTERVAL_QUERIES, nowNs() - start, 0);
+
+	destroyTree(tree);
+	free(keys);
+}
+
+void bench_values(Report *report, size_t size, size_t *sink) {
+	// Reverse lookups, the key whose value (offset) is the greatest one not above
+	// a random offset, by a walk of every entry (fewer of them) and through the value index.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	int64_t value = 0;
+	for (size_t i = 0; i < size; i++) {
+		insertNode(tree, keys + i, &value);
+		value += 1 + keys[i] % 8;
+	}
+
+	uint64_t start = nowNs();
+	for (size_t i = 0; i < BENCH_VALUE_SCANS; i++) {
+		int64_t offset = keys[i % size] * value / (int64_t)size;
+		TreeNode *best = NULL;
+		for (TreeNode *entry = minimum(tree->root); entry; entry = entry->next) {
+			int64_t at = *(int64_t *)entry->value;
+			if (at <= offset && (!best || at > *(int64_t *)best->value)) best = entry;
+		}
+		*sink += best ? (size_t)*(int *)best->elem : 0;
+	}
+	reportResult(report, "valueLookup_scan", size, DIST_UNIFORM, 0, BENCH_VALUE_SCANS, nowNs() - start, 0);
+
+	setTreeValueIndex(tree, compareIdx);
+	start = nowNs();
+	for (size_t i = 0; i < BENCH_VALUE_QUERIES; i++) {
+		int64_t offset = keys[i % size] * value / (int64_t)size;
+		TreeNode *best = valueFloor(tree, &offset);
+		*sink += best ? (size_t)*(int *)best->elem : 0;
+	}
+	reportResult(report, "valueFloor", size, DIST_UNIFORM, 0, BENCH_VALUE_QUERIES, nowNs() - start, 0);
+
+	destroyTree(tree);
+	free(keys);
+}
+
+void bench_append(Report *report, size_t size, size_t *sink) {
+	// A log of words growing by a few words at a time (the last one cut in two),
+	// indexed again from scratch and by resuming the build after each append.
+	const char *names[] = {"buildTreeFromFile_append", "resumeBuild_append"};
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+
+	for (int mode = 0; mode < 2; mode++) {
+		writeWords(WORDS_FILE, keys, size);
+		Tree *tree = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+		Build *build = mode ? openBuild(WORDS_FILE, tree) : NULL;
+		if (!mode) buildTreeFromFile(WORDS_FILE, tree);
+
+		uint64_t elapsed = 0;
+		for (size_t i = 0; i < BENCH_APPENDS; i++) {
+			FILE *out = fopen(WORDS_FILE, "a");
+			if (!out) break;
+			for (size_t j = 0; j < BENCH_APPEND_WORDS; j++) fprintf(out, "APPEND%zu ", j);
+			fprintf(out, "CUT");
+			fclose(out);
+
+			uint64_t start = nowNs();
+			if (mode) {
+				resumeBuild(build);
+			} else {
+				destroyTree(tree);
+				tree = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+				buildTreeFromFile(WORDS_FILE, tree);
+			}
+			elapsed += nowNs() - start;
+		}
+
+		reportResult(report, names[mode], size, DIST_UNIFORM, 0, BENCH_APPENDS, elapsed, 0);
+		*sink += tree->size;
+		closeBuild(build);
+		destroyTree(tree);
+	}
+
+	remove(WORDS_FILE);
+	free(keys);
+}
+
+void bench_trace(Report *report, size_t size, size_t *sink) {
+	// The word file built without and during a trace, the gap is the cost of
+	// the traced scopes (none without `make bench TRACE=1`).
+	const char *names[] = {"buildTreeFromFile_untraced", "buildTreeFromFile_traced"};
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	writeWords(WORDS_FILE, keys, size);
+
+	for (int traced = 0; traced < 2; traced++) {
+		Tree *tree = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+		if (traced) startTrace(TRACE_FILE);
+		uint64_t start = nowNs();
+		buildTreeFromFile(WORDS_FILE, tree);
+		uint64_t elapsed = nowNs() - start;
+		if (traced) stopTrace();
+
+		reportResult(report, names[traced], size, DIST_UNIFORM, 0, size, elapsed, 0);
+		*sink += tree->size;
+		destroyTree(tree);
+	}
+
+	remove(TRACE_FILE);
+	remove(WORDS_FILE);
+	free(keys);
+}
+
+void sumValue(void *ctx, void *acc, TreeNode *entry) {
+	*(int64_t *)acc += *(int64_t *)entry->value;
+}
+
+void addSum(void *ctx, void *acc, const void *other) {
+	*(int64_t *)acc += *(const int64_t *)other;
+}
+
+void bench_walk(Report *report, size_t size, size_t *sink) {
+	// Sum of the values and destroy, by one thread and by one thread per core.
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = cores > 1 ? (int)cores : 1;
+	const char *names[][2] = {{"reduce_sequential", "destroyTree"},
+							  {"treeReduceParallel", "destroyTreeParallel"}};
+
+	for (int parallel = 0; parallel < 2; parallel++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		int64_t value = 0;
+		for (size_t i = 0; i < size; i++, value++)
+			insertNode(tree, keys + i, &value);
+		size_t entries = tree->size;
+
+		int64_t sum = 0;
+		uint64_t start = nowNs();
+		if (parallel) {
+			treeReduceParallel(tree, &sum, sizeof(sum), sumValue, addSum, NULL, threads);
+		} else {
+			for (TreeNode *entry = minimum(tree->root); entry; entry = entry->next)
+				sumValue(NULL, &sum, entry);
+		}
+		uint64_t reduce = nowNs() - start;
+
+		start = nowNs();
+		if (parallel) destroyTreeParallel(tree, threads);
+		else destroyTree(tree);
+		uint64_t destroy = nowNs() - start;
+
+		reportResult(report, names[parallel][0], size, DIST_UNIFORM, 0, entries, reduce, 0);
+		reportResult(report, names[parallel][1], size, DIST_UNIFORM, 0, entries, destroy, 0);
+		*sink += (size_t)sum;
+	}
+
+	free(keys);
+}
+
+void bench_tree(Report *report, size_t size, Dist dist, double dup, size_t *sink) {
+	size_t distinct = (size_t)((double)size * (1.0 - dup));
+	if (!distinct) distinct = 1;
+
+	int *keys = generateKeys(dist, size, distinct, BENCH_SEED);
+	int *lookups = generateKeys(dist, size, distinct, BENCH_SEED + 1);
+
+	// Small trees are measured several times for stable numbers.
+	size_t rounds = size < BENCH_OPS ? BENCH_OPS / size : 1;
+	Timings time;
+	memset(&time, 0, sizeof(time));
+	Rng rng;
+	seedRng(&rng, BENCH_SEED);
+	size_t bytes = 0;
+
+	for (size_t round = 0; round < rounds; round++) {
+		Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		setTreeValueWidth(tree, sizeof(int64_t));
+		bytes = bench_round(tree, keys, lookups, size, distinct, &rng, &time, sink);
+		destroyTree(tree);
+	}
+
+	double perKey = (double)bytes / (double)size;
+	size_t ops = size * rounds;
+	reportResult(report, "insertNode", size, dist, dup, ops, time.insert, perKey);
+	reportResult(report, "search", size, dist, dup, ops, time.search, perKey);
+	reportResult(report, "successor", size, dist, dup, rounds * distinct, time.succ, perKey);
+	reportResult(report, "predecessor", size, dist, dup, rounds * distinct, time.pred, perKey);
+	reportResult(report, "rangeKeyQuery", size, dist, dup, time.ranges, time.range, perKey);
+	reportResult(report, "inorderKeyQuery", size, dist, dup, rounds, time.inorder, perKey);
+	reportResult(report, "levelKeyQuery", size, dist, dup, rounds, time.level, perKey);
+	reportResult(report, "deleteNode", size, dist, dup, ops, time.delete, perKey);
+
+	// Point operations again, with the hash index.
+	bench_hashed(report, keys, lookups, size, dist, dup, sink);
+
+	free(keys);
+	free(lookups);
+}
+
+void bench_cipher(Report *report, size_t size, size_t *sink) {
+	int *keys = generateKeys(DIST_UNIFORM, size, size, BENCH_SEED);
+	writeWords(WORDS_FILE, keys, size);
+	free(keys);
+
+	Tree *tree = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+	setTreeValueWidth(tree, sizeof(int64_t));
+	size_t before = heapInUse();
+
+	uint64_t start = nowNs();
+	buildTreeFromFile(WORDS_FILE, tree);
+	uint64_t build = nowNs() - start;
+	double perKey = (double)(heapInUse() - before) / (double)size;
+
+	Range *key = inorderKeyQuery(tree);
+	struct stat info;
+	size_t bytes = stat(WORDS_FILE, &info) == 0 ? (size_t)info.st_size : 0;
+
+	start = nowNs();
+	encrypt(WORDS_FILE, CIPHER_FILE, key);
+	uint64_t enc = nowNs() - start;
+
+	start = nowNs();
+	decrypt(CIPHER_FILE, PLAIN_FILE, key);
+	uint64_t dec = nowNs() - start;
+
+	// Startup from a snapshot, compared with the build from the text above.
+	setTreeIO(tree, packStr, unpackStr, packIdx, unpackIdx);
+	start = nowNs();
+	saveTree(tree, SNAP_FILE);
+	uint64_t save = nowNs() - start;
+
+	start = nowNs();
+	Tree *loaded = loadTree(SNAP_FILE, &tree->lambda);
+	uint64_t load = nowNs() - start;
+	*sink += loaded ? loaded->size : 0;
+	destroyTree(loaded);
+
+	*sink += key->size;
+	reportResult(report, "buildTreeFromFile", size, DIST_UNIFORM, 0, size, build, perKey);
+	reportResult(report, "saveTree", size, DIST_UNIFORM, 0, size, save, perKey);
+	reportResult(report, "loadTree", size, DIST_UNIFORM, 0, size, load, perKey);
+	reportResult(report, "encrypt", size, DIST_UNIFORM, 0, bytes, enc, perKey);
+	reportResult(report, "decrypt", size, DIST_UNIFORM, 0, bytes, dec, perKey);
+
+	destroyRange(key);
+	destroyTree(tree);
+	remove(WORDS_FILE);
+	remove(CIPHER_FILE);
+	remove(PLAIN_FILE);
+	remove(SNAP_FILE);
+}
+
+void usage(const char *name) {
+	printf("Usage: %s [--min N] [--max N] [--out FILE]\n", name);
+	printf("  Sizes go from --min to --max by factors of 10 (default %d to %d).\n",
+		   BENCH_MIN, BENCH_MAX);
+}
+
+int main(int argc, char **argv) {
+	size_t minSize = BENCH_MIN, maxSize = BENCH_MAX;
+	FILE *out = stdout;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--min") && i + 1 < argc) {
+			minSize = strtoull(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--max") && i + 1 < argc) {
+			maxSize = strtoull(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+			out = fopen(argv[++i], "w");
+			if (!out) {
+				printf("[ERR]: opening output file.\n");
+				return 1;
+			}
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!minSize) minSize = 1;
+
+	Report report;
+	size_t sink = 0;
+	openReport(&report, out, "avl-treemap");
+
+	for (size_t size = minSize; size <= maxSize; size *= 10) {
+		for (int dist = 0; dist < DIST_COUNT; dist++)
+			for (size_t dup = 0; dup < sizeof(dupRatios) / sizeof(dupRatios[0]); dup++)
+				bench_tree(&report, size, (Dist)dist, dupRatios[dup], &sink);
+		for (int dist = 0; dist < DIST_COUNT; dist++)
+			bench_bloom(&report, size, (Dist)dist, &sink);
+		for (int dist = 0; dist < DIST_COUNT; dist++)
+			bench_balance(&report, size, (Dist)dist, &sink);
+		bench_weight(&report, size, DIST_UNIFORM, &sink);
+		bench_weight(&report, size, DIST_ZIPFIAN, &sink);
+		bench_finger(&report, size, &sink);
+		bench_tombstone(&report, size, &sink);
+		bench_range_delete(&report, size, &sink);
+		bench_parallel_query(&report, size, &sink);
+		bench_walk(&report, size, &sink);
+		bench_cache(&report, size, &sink);
+		bench_view(&report, size, &sink);
+		bench_aggregate(&report, size, &sink);
+		bench_interval(&report, size, &sink);
+		bench_values(&report, size, &sink);
+		bench_append(&report, size, &sink);
+		bench_trace(&report, size, &sink);
+		bench_cipher(&report, size, &sink);
+	}
+
+	closeReport(&report);
+	if (out != stdout) fclose(out);
+
+	// Keep the results alive, so the measured calls aren't optimized away.
+	return sink == 0;
+}
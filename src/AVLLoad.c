@@ -0,0 +1,244 @@
+#include <pthread.h>
+
+#include "./include/AVLTree.h"
+#include "./include/Range.h"
+#include "./include/Func.h"
+#include "./include/Journal.h"
+#include "./utils/Bench.h"
+
+#define LOAD_OPS 1000000
+#define LOAD_KEYS 100000
+#define LOAD_SPAN 100
+#define LOAD_SEED 7
+#define MAX_THREADS 256
+
+// Operations replayed by the load generator.
+typedef enum LoadOp { LOAD_READ, LOAD_INSERT, LOAD_DELETE, LOAD_RANGE, LOAD_OPS_COUNT } LoadOp;
+
+static const char *opNames[LOAD_OPS_COUNT] = {"search", "insertNode", "deleteNode", "rangeKeyQuery"};
+
+// Workload shared by every thread.
+typedef struct Workload {
+	Tree *tree;
+	Journal *journal;             /* Updates are committed to it, or NULL.   */
+	const char *journalPath;
+	pthread_rwlock_t lock;        /* Readers share the tree, writers own it. */
+	unsigned mix[LOAD_OPS_COUNT]; /* Percentage of each operation.           */
+	size_t ops, keys, span;
+	Dist dist;
+	Zipf zipf;
+} Workload;
+
+// State of one client thread.
+typedef struct Client {
+	Workload *load;
+	size_t ops;
+	uint64_t seed;
+	size_t sink;
+	Histogram hist[LOAD_OPS_COUNT];
+} Client;
+
+int next_key(Workload *load, Rng *rng, size_t *sequence) {
+	switch (load->dist) {
+		case DIST_SEQUENTIAL:
+			return (int)((*sequence)++ % load->keys);
+		case DIST_UNIFORM:
+			return (int)(nextRng(rng) % load->keys);
+		default:
+			// Scatter the hot ranks over the key space, like the benchmarks.
+			return (int)((nextZipf(&load->zipf, rng) * 0x9E3779B97F4A7C15ull) % load->keys);
+	}
+}
+
+LoadOp next_op(Workload *load, Rng *rng) {
+	unsigned pick = (unsigned)(nextRng(rng) % 100), sum = 0;
+	for (int op = 0; op < LOAD_OPS_COUNT; op++) {
+		sum += load->mix[op];
+		if (pick < sum) return (LoadOp)op;
+	}
+	return LOAD_READ;
+}
+
+void* run_client(void *arg) {
+	Client *client = (Client *)arg;
+	Workload *load = client->load;
+	Rng rng;
+	seedRng(&rng, client->seed);
+	size_t sequence = (size_t)client->seed;
+
+	for (int op = 0; op < LOAD_OPS_COUNT; op++)
+		initHistogram(client->hist + op);
+
+	for (size_t i = 0; i < client->ops; i++) {
+		LoadOp op = next_op(load, &rng);
+		int key = next_key(load, &rng, &sequence);
+		int64_t value = (int64_t)i;
+
+		// Latency includes waiting for the lock, as seen by a caller of the service.
+		uint64_t start = nowNs();
+		switch (op) {
+			case LOAD_READ:
+				pthread_rwlock_rdlock(&load->lock);
+				client->sink += search(load->tree, load->tree->root, &key) != NULL;
+				pthread_rwlock_unlock(&load->lock);
+				break;
+			case LOAD_INSERT:
+				pthread_rwlock_wrlock(&load->lock);
+				insertNode(load->tree, &key, &value);
+				pthread_rwlock_unlock(&load->lock);
+				// Durable before answering, the fsync is shared with the other writers.
+				if (load->journal) commitJournal(load->journal);
+				break;
+			case LOAD_DELETE:
+				pthread_rwlock_wrlock(&load->lock);
+				deleteNode(load->tree, &key);
+				pthread_rwlock_unlock(&load->lock);
+				if (load->journal) commitJournal(load->journal);
+				break;
+			default: {
+				int right = key + (int)load->span;
+				pthread_rwlock_rdlock(&load->lock);
+				Range *range = rangeKeyQuery(load->tree, (const char *)&key, (const char *)&right);
+				pthread_rwlock_unlock(&load->lock);
+				client->sink += range ? range->size : 0;
+				destroyRange(range);
+				break;
+			}
+		}
+		recordLatency(client->hist + op, nowNs() - start);
+	}
+
+	return NULL;
+}
+
+void usage(const char *name) {
+	printf("Usage: %s [--threads N] [--ops N] [--keys N] [--span N]\n", name);
+	printf("          [--dist sequential|uniform|zipfian] [--out FILE] [--journal FILE]\n");
+	printf("          [--read P] [--insert P] [--delete P] [--range P]\n");
+	printf("  The percentages of the mix must add up to 100 (default 50/25/15/10).\n");
+}
+
+int parse_args(int argc, char **argv, Workload *load, size_t *threads, FILE **out) {
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 >= argc) return 0;
+		const char *arg = argv[i], *val = argv[++i];
+
+		if (!strcmp(arg, "--threads")) *threads = strtoull(val, NULL, 10);
+		else if (!strcmp(arg, "--ops")) load->ops = strtoull(val, NULL, 10);
+		else if (!strcmp(arg, "--keys")) load->keys = strtoull(val, NULL, 10);
+		else if (!strcmp(arg, "--span")) load->span = strtoull(val, NULL, 10);
+		else if (!strcmp(arg, "--read")) load->mix[LOAD_READ] = (unsigned)atoi(val);
+		else if (!strcmp(arg, "--insert")) load->mix[LOAD_INSERT] = (unsigned)atoi(val);
+		else if (!strcmp(arg, "--delete")) load->mix[LOAD_DELETE] = (unsigned)atoi(val);
+		else if (!strcmp(arg, "--range")) load->mix[LOAD_RANGE] = (unsigned)atoi(val);
+		else if (!strcmp(arg, "--journal")) load->journalPath = val;
+		else if (!strcmp(arg, "--dist")) {
+			if (!strcmp(val, "sequential")) load->dist = DIST_SEQUENTIAL;
+			else if (!strcmp(val, "uniform")) load->dist = DIST_UNIFORM;
+			else if (!strcmp(val, "zipfian")) load->dist = DIST_ZIPFIAN;
+			else return 0;
+		} else if (!strcmp(arg, "--out")) {
+			*out = fopen(val, "w");
+			if (!*out) return 0;
+		} else {
+			return 0;
+		}
+	}
+
+	unsigned total = 0;
+	for (int op = 0; op < LOAD_OPS_COUNT; op++) total += load->mix[op];
+	return total == 100 && *threads && *threads <= MAX_THREADS && load->keys;
+}
+
+int main(int argc, char **argv) {
+	Workload load;
+	memset(&load, 0, sizeof(load));
+	load.ops = LOAD_OPS;
+	load.keys = LOAD_KEYS;
+	load.span = LOAD_SPAN;
+	load.dist = DIST_ZIPFIAN;
+	load.mix[LOAD_READ] = 50;
+	load.mix[LOAD_INSERT] = 25;
+	load.mix[LOAD_DELETE] = 15;
+	load.mix[LOAD_RANGE] = 10;
+	size_t threads = 1;
+	FILE *out = stdout;
+
+	if (!parse_args(argc, argv, &load, &threads, &out)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Preload every key once, in random order.
+	if (load.journalPath) {
+		// Start from an empty journal, its snapshot is kept next to it.
+		Func funcs = {{createInt, createIdx}, {destroyInt, destroyIdx}, compareInt,
+					  {packInt, packIdx, unpackInt, unpackIdx}, NULL, NULL, {NULL, NULL, NULL, NULL}, sizeof(int64_t)};
+		char snapshot[4096];
+		snprintf(snapshot, sizeof(snapshot), "%s.snap", load.journalPath);
+		remove(load.journalPath);
+		remove(snapshot);
+		load.journal = openJournal(load.journalPath, snapshot, &funcs);
+		if (!load.journal) return 1;
+		load.tree = load.journal->tree;
+	} else {
+		load.tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		setTreeValueWidth(load.tree, sizeof(int64_t));
+	}
+	int *keys = generateKeys(DIST_UNIFORM, load.keys, load.keys, LOAD_SEED);
+	for (size_t i = 0; i < load.keys; i++) {
+		int64_t value = (int64_t)i;
+		insertNode(load.tree, keys + i, &value);
+	}
+	free(keys);
+	if (load.journal) commitJournal(load.journal);
+	if (load.dist == DIST_ZIPFIAN) initZipf(&load.zipf, load.keys, ZIPF_THETA);
+	pthread_rwlock_init(&load.lock, NULL);
+
+	Client *clients = calloc(threads, sizeof(Client));
+	pthread_t *ids = calloc(threads, sizeof(pthread_t));
+	if (!clients || !ids) {
+		printf("[ERR]: at calloc...\n");
+		return 1;
+	}
+
+	uint64_t start = nowNs();
+	for (size_t t = 0; t < threads; t++) {
+		clients[t].load = &load;
+		clients[t].ops = load.ops / threads + (t < load.ops % threads);
+		clients[t].seed = LOAD_SEED + t + 1;
+		pthread_create(ids + t, NULL, run_client, clients + t);
+	}
+	for (size_t t = 0; t < threads; t++)
+		pthread_join(ids[t], NULL);
+	uint64_t elapsed = nowNs() - start;
+
+	// Merge the per thread histograms.
+	Report report;
+	openReport(&report, out, "avl-load");
+	size_t sink = 0;
+	for (int op = 0; op < LOAD_OPS_COUNT; op++) {
+		Histogram hist;
+		initHistogram(&hist);
+		for (size_t t = 0; t < threads; t++)
+			mergeHistogram(&hist, clients[t].hist + op);
+		reportLatency(&report, opNames[op], &hist, elapsed);
+	}
+	for (size_t t = 0; t < threads; t++)
+		sink += clients[t].sink;
+	closeReport(&report);
+	fprintf(stderr, "threads %zu, keys %zu, final size %zu (%zu hits)\n",
+			threads, load.keys, load.tree->size, sink);
+	if (load.journal) {
+		fprintf(stderr, "journal: %llu updates, %zu group commits\n",
+				(unsigned long long)load.journal->durable, load.journal->syncs);
+		closeJournal(load.journal);
+	}
+
+	if (out != stdout) fclose(out);
+	pthread_rwlock_destroy(&load.lock);
+	destroyTree(load.tree);
+	free(clients);
+	free(ids);
+	return 0;
+}
@@ -2,6 +2,19 @@
 #include "./include/Cipher.h"
 #include "./include/Range.h"
 #include "./include/Func.h"
+#include "./include/Snapshot.h"
+#include "./include/Journal.h"
+#include "./include/Hash.h"
+#include "./include/Bloom.h"
+#include "./include/Finger.h"
+#include "./include/Tombstone.h"
+#include "./include/Parallel.h"
+#include "./include/Cache.h"
+#include "./include/KeyView.h"
+#include "./include/Aggregate.h"
+#include "./include/Interval.h"
+#include "./include/ValueIndex.h"
+#include "./include/Trace.h"
 
 #define ASSERT(f, cond, msg) if (!(cond)) { failed(f, msg); return; } else passed(f, msg);
 
@@ -514,6 +527,149 @@ void test_list_delete(Tree **tree) {
 	fclose(f);
 }
 
+void test_adopt(void) {
+	FILE *f = fopen("outputs/output_adopt.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *tree = createTree(createInt, destroyInt,
+							createInt, destroyInt, compareInt);
+
+	if (tree == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	int values[] = {4, 2, 6, 1, 3, 5, 7};
+	int *adopted[7];
+	for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); i++) {
+		adopted[i] = createInt(values + i);
+		insertNodeAdopt(tree, adopted[i], createInt(values + i));
+	}
+
+	ASSERT(f, tree->size == 7, "Adopt-01");
+	ASSERT(f, tree->root->elem == adopted[0], "Adopt-02");
+	ASSERT(f, minimum(tree->root)->elem == adopted[3], "Adopt-03");
+	ASSERT(f, maximum(tree->root)->elem == adopted[6], "Adopt-04");
+
+	int *dup = createInt(values + 1);
+	insertNodeAdopt(tree, dup, createInt(values));
+	ASSERT(f, search(tree, tree->root, values + 1)->end->elem == dup, "Adopt-05");
+
+	void *elem = NULL, *value = NULL;
+	ASSERT(f, deleteNodeExtract(tree, values + 1, &elem, &value) == 1, "Extract-01");
+	ASSERT(f, elem == dup && *((int*)value) == 4, "Extract-02");
+	destroyInt(elem);
+	destroyInt(value);
+
+	ASSERT(f, deleteNodeExtract(tree, values, &elem, &value) == 1, "Extract-03");
+	ASSERT(f, elem == adopted[0] && *((int*)value) == 4, "Extract-04");
+	ASSERT(f, *((int*)tree->root->elem) == 5, "Extract-05");
+	ASSERT(f, tree->root->prev->next == tree->root, "Extract-06");
+	ASSERT(f, tree->size == 6, "Extract-07");
+	destroyInt(elem);
+	destroyInt(value);
+
+	int missing = 10;
+	ASSERT(f, deleteNodeExtract(tree, &missing, &elem, &value) == 0, "Extract-08");
+
+	// Data allocated by the caller with malloc is released by the provided delete functions.
+	int *key = malloc(sizeof(int)), *val = malloc(sizeof(int));
+	*key = 12;
+	*val = 21;
+	ASSERT(f, insertNodeAdopt(tree, key, val) == 1 && tree->size == 7, "Adopt-06");
+	ASSERT(f, deleteNodeExtract(tree, key, &elem, &value) == 1 && elem == key && value == val, "Extract-09");
+	free(elem);
+	free(value);
+
+	// The tree releases the adopted data it still holds.
+	key = malloc(sizeof(int));
+	*key = 13;
+	ASSERT(f, insertNodeAdopt(tree, key, createInt(&missing)) == 1, "Adopt-07");
+
+	// Extracted data outlives its tree.
+	ASSERT(f, deleteNodeExtract(tree, values + 2, &elem, &value) == 1, "Extract-10");
+	destroyTree(tree);
+	ASSERT(f, *((int*)elem) == 6 && *((int*)value) == 6, "Extract-11");
+	destroyInt(elem);
+	destroyInt(value);
+
+	Tree *words = createTree(createStr, destroyStr, createInt, destroyInt, compareStr);
+	char *word = strdup("tree"), name[] = "tree";
+	ASSERT(f, insertNodeAdopt(words, word, createInt(&missing)) == 1 && search(words, words->root, name), "Adopt-08");
+	destroyTree(words);
+
+	fprintf(f, "\nAll tests for Adopt Extract passed!\n");
+	fclose(f);
+}
+
+// Searches of one reader thread, the stats count them concurrently.
+void* stats_reader(void *arg) {
+	Tree *tree = (Tree *)arg;
+	for (int i = 0; i < 1000; i++) {
+		int key = i % 7 + 1;
+		search(tree, tree->root, &key);
+	}
+	return NULL;
+}
+
+void test_stats(void) {
+	FILE *f = fopen("outputs/output_stats.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *tree = createTree(createInt, destroyInt,
+							createInt, destroyInt, compareInt);
+
+	if (tree == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	int values[] = {1, 2, 3, 4, 5, 6, 7, 7, 7};
+	for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); i++)
+		insertNode(tree, values + i, values + i);
+	ASSERT(f, search(tree, tree->root, values + 6) != NULL, "Stats-01");
+
+	TreeStats stats;
+	getTreeStats(tree, &stats);
+	ASSERT(f, stats.keys == 7 && stats.entries == 9, "Stats-02");
+	ASSERT(f, stats.height == 3, "Stats-03");
+	ASSERT(f, stats.depth[0] == 1 && stats.depth[1] == 2 && stats.depth[2] == 4, "Stats-04");
+	ASSERT(f, stats.longestChain == 3 && stats.chains[0] == 6 && stats.chains[1] == 1, "Stats-05");
+	ASSERT(f, !stats.enabled || stats.ops[STAT_INSERT] == 9, "Stats-06");
+	ASSERT(f, !stats.enabled || stats.ops[STAT_SEARCH] == 1, "Stats-07");
+	ASSERT(f, !stats.enabled || stats.rotations[ROTATE_RR] == 4, "Stats-08");
+	ASSERT(f, !stats.enabled || stats.nodeBytes == 9 * sizeof(TreeNode), "Stats-09");
+
+	deleteNode(tree, values);
+	getTreeStats(tree, &stats);
+	ASSERT(f, !stats.enabled || (stats.frees == 1 && stats.ops[STAT_DELETE] == 1), "Stats-10");
+	ASSERT(f, !stats.enabled || stats.compares[STAT_DELETE] > 0, "Stats-11");
+
+	// Concurrent readers lose no counts.
+	pthread_t readers[4];
+	for (int i = 0; i < 4; i++) pthread_create(&readers[i], NULL, stats_reader, tree);
+	for (int i = 0; i < 4; i++) pthread_join(readers[i], NULL);
+	TreeStats after;
+	getTreeStats(tree, &after);
+	ASSERT(f, !stats.enabled || (after.ops[STAT_SEARCH] == stats.ops[STAT_SEARCH] + 4000
+		&& after.compares[STAT_SEARCH] - stats.compares[STAT_SEARCH] == after.totalCompares - stats.totalCompares), "Stats-12");
+
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Stats passed!\n");
+	fclose(f);
+}
+
 void test_free(Tree **tree1, Tree **tree2) {
 	if ((*tree1) != NULL && (*tree1)->root != NULL) {
 		destroyTreeNode((*tree1), (*tree1)->root->left->left);
@@ -578,6 +734,7 @@ void test_build_tree(Tree **tree) {
 		createIdx,
 		destroyIdx,
 		compareStr);
+	setTreeValueWidth(*tree, sizeof(int64_t));
 	
 	buildTreeFromFile("inputs/key.txt", (*tree));
 
@@ -598,6 +755,1997 @@ void test_build_tree(Tree **tree) {
 	}
 }
 
+void test_build_map(Tree **tree) {
+	FILE *f = fopen("outputs/output_build_map.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *mapped = createTree(borrowElem, releaseElem,
+							  borrowElem, releaseElem, compareView);
+	Corpus *corpus = buildTreeFromMap("inputs/key.txt", mapped);
+
+	if (corpus == NULL || mapped->root == NULL) {
+		fprintf(f, "Invalid tree!\n");
+		destroyTree(mapped);
+		unmapCorpus(corpus);
+		fclose(f);
+		return;
+	}
+
+	ASSERT(f, mapped->size == corpus->count, "BuildMap-01");
+	ASSERT(f, *tree == NULL || mapped->size == (*tree)->size, "BuildMap-02");
+
+	View word = {"ESPECIALLY", 10};
+	TreeNode *found = search(mapped, mapped->root, &word);
+	ASSERT(f, found != NULL && ((View *)found->elem)->length == 10, "BuildMap-03");
+	ASSERT(f, ((View *)found->elem)->data >= corpus->data &&
+			  ((View *)found->elem)->data < corpus->data + corpus->size, "BuildMap-04");
+
+	word.length = 5;
+	ASSERT(f, search(mapped, mapped->root, &word) == NULL, "BuildMap-05");
+
+	TreeNode *pass = minimum(mapped->root);
+	int sorted = 1;
+	while (pass && pass->next) {
+		sorted &= compareView(pass->elem, pass->next->elem) <= 0;
+		pass = pass->next;
+	}
+	ASSERT(f, sorted, "BuildMap-06");
+
+	destroyTree(mapped);
+	unmapCorpus(corpus);
+
+	fprintf(f, "\nAll tests for BuildMap passed!\n");
+	fclose(f);
+}
+
+void test_snapshot(Tree **tree) {
+	FILE *f = fopen("outputs/output_snapshot.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	if (*tree == NULL || (*tree)->root == NULL) {
+		fprintf(f, "Invalid tree!\n");
+		fclose(f);
+		return;
+	}
+
+	setTreeIO(*tree, packStr, unpackStr, packIdx, unpackIdx);
+	ASSERT(f, saveTree(*tree, "outputs/key_tree.snap") == 0, "Snapshot-01");
+
+	Tree *loaded = loadTree("outputs/key_tree.snap", &(*tree)->lambda);
+	ASSERT(f, loaded != NULL && loaded->size == (*tree)->size, "Snapshot-02");
+	ASSERT(f, loaded->root->height == (*tree)->root->height ||
+			  loaded->root->height == (*tree)->root->height - 1, "Snapshot-03");
+
+	TreeNode *pass = minimum((*tree)->root), *copy = minimum(loaded->root);
+	int same = 1;
+	while (pass && copy) {
+		same &= compareStr(pass->elem, copy->elem) == 0;
+		same &= *(int64_t *)pass->value == *(int64_t *)copy->value;
+		same &= (pass->end == pass) == (copy->end == copy);
+		pass = pass->next;
+		copy = copy->next;
+	}
+	ASSERT(f, same && pass == NULL && copy == NULL, "Snapshot-04");
+
+	char word[] = "ESPECIALLY";
+	TreeNode *found = search(loaded, loaded->root, word);
+	ASSERT(f, found != NULL && (found->parent == NULL || found->parent->left == found ||
+			  found->parent->right == found), "Snapshot-05");
+
+	Range *key = inorderKeyQuery(*tree), *copyKey = inorderKeyQuery(loaded);
+	ASSERT(f, key->size == copyKey->size &&
+			  !memcmp(key->index, copyKey->index, key->size * sizeof(*key->index)), "Snapshot-06");
+	free(key->index);
+	free(key);
+	free(copyKey->index);
+	free(copyKey);
+	destroyTree(loaded);
+
+	// Flip one byte of the payload, the checksum must reject the file.
+	FILE *snap = fopen("outputs/key_tree.snap", "r+b");
+	fseek(snap, sizeof(SnapshotHeader) + 20, SEEK_SET);
+	int byte = fgetc(snap);
+	fseek(snap, sizeof(SnapshotHeader) + 20, SEEK_SET);
+	fputc(byte ^ 0x20, snap);
+	fclose(snap);
+	ASSERT(f, loadTree("outputs/key_tree.snap", &(*tree)->lambda) == NULL, "Snapshot-07");
+
+	// Counts in the header beyond what the payload can hold are rejected before any allocation,
+	// the checksum of the payload (restored) doesn't cover them.
+	SnapshotHeader header;
+	snap = fopen("outputs/key_tree.snap", "r+b");
+	fseek(snap, sizeof(SnapshotHeader) + 20, SEEK_SET);
+	fputc(byte, snap);
+	fseek(snap, 0, SEEK_SET);
+	int read = fread(&header, sizeof(header), 1, snap) == 1;
+	header.keys = header.entries = UINT64_MAX / 2;
+	fseek(snap, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, snap);
+	fclose(snap);
+	ASSERT(f, read && loadTree("outputs/key_tree.snap", &(*tree)->lambda) == NULL, "Snapshot-08");
+
+	fprintf(f, "\nAll tests for Snapshot passed!\n");
+	fclose(f);
+}
+
+void test_hash(void) {
+	FILE *f = fopen("outputs/output_hash.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *tree = createTree(createInt, destroyInt,
+							createInt, destroyInt, compareInt);
+	Tree *plain = createTree(createInt, destroyInt,
+							 createInt, destroyInt, compareInt);
+
+	int values[] = {4, 2, 6, 1, 3, 5, 7, 7};
+	for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); i++)
+		insertNode(tree, values + i, values + i);
+
+	// Index a tree that already holds keys.
+	setTreeHash(tree, hashInt);
+	ASSERT(f, tree->index != NULL && tree->index->count == 7, "Hash-01");
+	ASSERT(f, search(tree, tree->root, values + 6) == maximum(tree->root), "Hash-02");
+	int missing = 8;
+	ASSERT(f, search(tree, tree->root, &missing) == NULL, "Hash-03");
+
+	// The root has two children, its key moves to another node.
+	deleteNode(tree, values);
+	ASSERT(f, tree->index->count == 6 && search(tree, tree->root, values) == NULL, "Hash-04");
+	ASSERT(f, *(int *)search(tree, tree->root, values + 5)->elem == 5, "Hash-05");
+	for (size_t i = 1; i < sizeof(values)/sizeof(values[0]); i++)
+		deleteNode(tree, values + i);
+	ASSERT(f, tree->size == 0 && tree->index->count == 0, "Hash-06");
+
+	// Random updates give the same answers with and without the index.
+	srand(3);
+	int same = 1;
+	for (int i = 0; i < 4000; i++) {
+		int key = rand() % 200;
+		if (rand() % 3) {
+			insertNode(tree, &key, &i);
+			insertNode(plain, &key, &i);
+		} else {
+			deleteNode(tree, &key);
+			deleteNode(plain, &key);
+		}
+		same &= tree->size == plain->size;
+	}
+	TreeStats stats;
+	getTreeStats(tree, &stats);
+	for (int key = 0; key < 200; key++) {
+		TreeNode *hashed = search(tree, tree->root, &key), *found = search(plain, plain->root, &key);
+		same &= (hashed == NULL) == (found == NULL);
+		same &= !hashed || *(int *)hashed->end->value == *(int *)found->end->value;
+	}
+	ASSERT(f, same && tree->index->count == stats.keys, "Hash-07");
+
+	setTreeHash(tree, NULL);
+	ASSERT(f, tree->index == NULL && search(tree, tree->root, plain->root->elem) != NULL, "Hash-08");
+
+	destroyTree(tree);
+	destroyTree(plain);
+
+	fprintf(f, "\nAll tests for Hash passed!\n");
+	fclose(f);
+}
+
+void test_bloom(void) {
+	FILE *f = fopen("outputs/output_bloom.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *tree = createTree(createInt, destroyInt,
+							createInt, destroyInt, compareInt);
+	setTreeBloom(tree, hashInt, 10);
+	ASSERT(f, tree->bloom != NULL, "Bloom-01");
+
+	// Even keys are in the tree, odd keys are missing.
+	for (int key = 0; key < 8000; key += 2)
+		insertNode(tree, &key, &key);
+	int found = 1, missing = 1;
+	for (int key = 0; key < 8000; key += 2)
+		found &= search(tree, tree->root, &key) != NULL;
+	for (int key = 1; key < 8000; key += 2)
+		missing &= search(tree, tree->root, &key) == NULL;
+	ASSERT(f, found && missing, "Bloom-02");
+
+	BloomStats stats;
+	getBloomStats(tree, &stats);
+	ASSERT(f, stats.negatives + stats.falsePositives == 4000, "Bloom-03");
+	ASSERT(f, stats.falsePositiveRate < 0.05 && stats.rebuilds > 0, "Bloom-04");
+	ASSERT(f, stats.bytes >= 4000 * 10 / 8 && stats.keys == 4000, "Bloom-05");
+
+	// After many deletes the filter is built again from the keys left.
+	for (int key = 0; key < 6000; key += 2)
+		deleteNode(tree, &key);
+	getBloomStats(tree, &stats);
+	ASSERT(f, tree->size == 1000 && stats.keys < 4000, "Bloom-06");
+	found = 1;
+	for (int key = 6000; key < 8000; key += 2)
+		found &= search(tree, tree->root, &key) != NULL;
+	int deleted = 4000;
+	ASSERT(f, found && search(tree, tree->root, &deleted) == NULL, "Bloom-07");
+
+	// Both probes answer the same, the AVX2 one only runs on a CPU that has it.
+	int same = setBloomSimd(tree, 0);
+	int simd = setBloomSimd(tree, 1);
+	for (int key = 0; same && simd && key < 8000; key++) {
+		setBloomSimd(tree, 0);
+		int scalar = bloomMayContain(tree->bloom, &key);
+		setBloomSimd(tree, 1);
+		same &= scalar == bloomMayContain(tree->bloom, &key);
+	}
+	ASSERT(f, same && (simd || !tree->bloom->simd), "Bloom-09");
+
+	setTreeBloom(tree, NULL, 0);
+	getBloomStats(tree, &stats);
+	ASSERT(f, tree->bloom == NULL && stats.bytes == 0, "Bloom-08");
+	ASSERT(f, !setBloomSimd(tree, 0), "Bloom-10");
+
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Bloom passed!\n");
+	fclose(f);
+}
+
+void test_finger(void) {
+	FILE *f = fopen("outputs/output_finger.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *tree = createTree(createInt, destroyInt,
+							createInt, destroyInt, compareInt);
+	Finger finger;
+	initFinger(&finger, tree);
+	int key = 1;
+	ASSERT(f, fingerSearch(&finger, &key) == NULL, "Finger-01");
+
+	// Even keys are in the tree, some of them twice.
+	for (key = 0; key < 2000; key += 2) {
+		insertNode(tree, &key, &key);
+		if (key % 10 == 0) insertNode(tree, &key, &key);
+	}
+
+	// Forward and backward sweeps find the same nodes as `search`.
+	int same = 1;
+	for (key = -1; key <= 2000; key++)
+		same &= fingerSearch(&finger, &key) == search(tree, tree->root, &key);
+	for (key = 2000; key >= -1; key--)
+		same &= fingerSearch(&finger, &key) == search(tree, tree->root, &key);
+	ASSERT(f, same, "Finger-02");
+	ASSERT(f, finger.descents == 1 && finger.near == 4003, "Finger-03");
+
+	// Far jumps climb up to the root, and still find the keys.
+	same = 1;
+	for (int i = 0; i < 1000; i++) {
+		key = (i * 7919) % 2001;
+		same &= fingerSearch(&finger, &key) == search(tree, tree->root, &key);
+	}
+	ASSERT(f, same && finger.descents > 1, "Finger-04");
+
+	// Deletes may free the node of the finger, it starts again from the root.
+	key = 1002;
+	fingerSearch(&finger, &key);
+	deleteNode(tree, &key);
+	size_t descents = finger.descents;
+	ASSERT(f, fingerSearch(&finger, &key) == NULL && finger.descents == descents + 1, "Finger-05");
+	key = 1004;
+	ASSERT(f, fingerSearch(&finger, &key) == search(tree, tree->root, &key), "Finger-06");
+
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Finger passed!\n");
+	fclose(f);
+}
+
+// Size-capped allocator, it refuses to go over its budget.
+typedef struct Budget {
+	size_t used, cap;
+} Budget;
+
+void* budgetAlloc(void *ctx, size_t size) {
+	Budget *budget = (Budget *)ctx;
+	if (budget->used + size > budget->cap) return NULL;
+	budget->used += size;
+	return malloc(size);
+}
+
+void budgetRelease(void *ctx, void *ptr, size_t size) {
+	((Budget *)ctx)->used -= size;
+	free(ptr);
+}
+
+void map_count(void *ctx, void *acc, TreeNode *entry) {
+	(*(size_t *)acc)++;
+}
+
+void combine_count(void *ctx, void *acc, const void *other) {
+	*(size_t *)acc += *(const size_t *)other;
+}
+
+void test_memory(void) {
+	FILE *f = fopen("outputs/output_memory.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Budget budget = { 0, 1 << 20 };
+	Allocator alloc = { budgetAlloc, NULL, budgetRelease, &budget };
+	Tree *tree = createTreeAlloc(createInt, destroyInt, createIdx, destroyIdx, compareInt, &alloc);
+	size_t live, peak;
+	getTreeMemory(tree, &live, &peak);
+	ASSERT(f, tree != NULL && live == sizeof(Tree) && budget.used == live, "Memory-01");
+
+	// Nodes come from the allocator, payloads from malloc, both are counted.
+	const size_t payload = sizeof(int) + sizeof(int64_t);
+	int64_t value = 0;
+	for (int key = 0; key < 100; key++, value++)
+		insertNode(tree, &key, &value);
+	getTreeMemory(tree, &live, &peak);
+	ASSERT(f, live == budget.used + 100 * payload && budget.used == sizeof(Tree) + 100 * sizeof(TreeNode), "Memory-02");
+
+	// Query ranges come from the allocator too, they count their own bytes.
+	size_t before = live, used = budget.used;
+	Range *range = inorderKeyQuery(tree);
+	getTreeMemory(tree, &live, &peak);
+	ASSERT(f, range->size == 100 && live == before && budget.used == used + range->memory.live, "Memory-03");
+	destroyRange(range);
+	getTreeMemory(tree, &live, &peak);
+	ASSERT(f, live == before && budget.used == used, "Memory-04");
+
+	// Extracted data leaves the tree memory, it may outlive the tree.
+	void *elem = NULL, *data = NULL;
+	int key = 50;
+	deleteNodeExtract(tree, &key, &elem, &data);
+	getTreeMemory(tree, &live, &peak);
+	ASSERT(f, tree->size == 99 && live == budget.used + 99 * payload && live < before, "Memory-05");
+
+	// Over budget, inserts fail and the tree (without indexes) is left as it was.
+	budget.cap = budget.used;
+	for (key = 100; key < 110; key++)
+		insertNode(tree, &key, &value);
+	getTreeMemory(tree, &live, &peak);
+	ASSERT(f, tree->size == 99 && live == budget.used + 99 * payload && budget.used <= budget.cap, "Memory-06");
+
+	// Query ranges, cached or not, may outlive the tree too.
+	budget.cap = 1 << 20;
+	setTreeCache(tree, 4);
+	range = inorderKeyQuery(tree);
+	for (key = 0; key < 100; key++)
+		deleteNode(tree, &key);
+	getTreeMemory(tree, &live, &peak);
+	ASSERT(f, live == sizeof(Tree) + tree->cache->capacity * sizeof(CacheEntry) + sizeof(QueryCache) &&
+			  peak >= before, "Memory-07");
+
+	destroyTree(tree);
+	ASSERT(f, range->size == 99 && budget.used == range->memory.live, "Memory-08");
+	destroyRange(range);
+	ASSERT(f, budget.used == 0 && *((int*)elem) == 50 && *((int64_t*)data) == 50, "Memory-09");
+	destroyInt(elem);
+	destroyIdx(data);
+
+	// The room of the indexes, views and aggregates is reserved before the insert changes the tree.
+	tree = createTreeAlloc(createInt, destroyInt, createIdx, destroyIdx, compareInt, &alloc);
+	setTreeValueWidth(tree, sizeof(int64_t));
+	int set = setTreeHash(tree, hashInt) && setTreeValueIndex(tree, compareIdx) &&
+			  setTreeAggregate(tree, &offsetMonoid) && setTreeBloom(tree, hashInt, 10);
+	KeyView *view = createKeyView(tree, NULL, NULL);
+	ASSERT(f, set && view != NULL, "Memory-10");
+
+	// Each insert has room for its node and summary only, growth is refused sooner or later.
+	for (key = 0, value = 0; key < 100; key++, value++)
+		insertNode(tree, &key, &value);
+	size_t node = sizeof(TreeNode) + 2 * tree->aggregate->stride, refused = 0;
+	for (; key < 1000 && !refused; key++, value++) {
+		budget.cap = budget.used + node;
+		size_t size = tree->size;
+		insertNode(tree, &key, &value);
+		refused = tree->size == size;
+	}
+	key--;
+	OffsetSummary sum;
+	Range *viewed = (budget.cap = 1 << 20, keyViewRange(view));
+	range = inorderKeyQuery(tree);
+	ASSERT(f, refused && !search(tree, tree->root, &key) && rangeAggregate(tree, NULL, NULL, &sum) == 0 &&
+			  (size_t)sum.count == tree->size && range->size == tree->size && viewed->size == tree->size &&
+			  valueRangeQuery(tree, NULL, NULL, NULL, NULL) == tree->size, "Memory-11");
+	destroyRange(range);
+	destroyRange(viewed);
+
+	// With room again, the same insert is made.
+	insertNode(tree, &key, &value);
+	ASSERT(f, search(tree, tree->root, &key) && view->size == tree->size && tree->values->size == tree->size,
+		   "Memory-12");
+
+	// Refused setters leave the tree without the structure, queries return NULL.
+	setTreeHash(tree, NULL);
+	setTreeBloom(tree, NULL, 0);
+	setTreeAggregate(tree, NULL);
+	setTreeValueIndex(tree, NULL);
+	budget.cap = budget.used;
+	set = setTreeHash(tree, hashInt) || setTreeBloom(tree, hashInt, 10) || setTreeCache(tree, 4) ||
+		  setTreeAggregate(tree, &offsetMonoid) || setTreeValueIndex(tree, compareIdx);
+	ASSERT(f, !set && !tree->index && !tree->bloom && !tree->cache && !tree->aggregate && !tree->values &&
+			  budget.used == budget.cap, "Memory-13");
+	ASSERT(f, !inorderKeyQuery(tree) && !inorderKeyQueryParallel(tree, 4) && !keyViewRange(view) &&
+			  !createKeyView(tree, NULL, NULL) && budget.used == budget.cap, "Memory-14");
+
+	// Parallel walks fall back to the calling thread, refused compactions keep the tombstones.
+	size_t count = 0;
+	treeReduceParallel(tree, &count, sizeof(count), map_count, combine_count, NULL, 4);
+	setTreeTombstones(tree, 0.5);
+	for (key = 0; key < 10; key++)
+		deleteNode(tree, &key);
+	setTreeTombstones(tree, 0);
+	ASSERT(f, count == tree->size && tree->tombstones == 10 && tree->maxTombstones == 0.5 &&
+			  budget.used == budget.cap, "Memory-15");
+	destroyTreeParallel(tree, 4);
+	ASSERT(f, budget.used == 0, "Memory-16");
+
+	fprintf(f, "\nAll tests for Memory passed!\n");
+	fclose(f);
+}
+
+// Check the rank rule of a weak AVL tree, the links and the order of the keys.
+int check_ranks(TreeNode *node) {
+	if (!node) return 1;
+
+	int leftRank = node->left ? node->left->height : 0;
+	int rightRank = node->right ? node->right->height : 0;
+	if (!node->left && !node->right && node->height != 1) return 0;
+	if (node->height - leftRank < 1 || node->height - leftRank > 2) return 0;
+	if (node->height - rightRank < 1 || node->height - rightRank > 2) return 0;
+	if (node->left && (node->left->parent != node ||
+					   compareInt(node->left->elem, node->elem) >= 0)) return 0;
+	if (node->right && (node->right->parent != node ||
+						compareInt(node->right->elem, node->elem) <= 0)) return 0;
+
+	return check_ranks(node->left) && check_ranks(node->right);
+}
+
+// Check that two trees list the same entries, in the same order.
+int same_entries(Tree *first, Tree *second) {
+	if (first->size != second->size) return 0;
+
+	TreeNode *one = first->root ? minimum(first->root) : NULL;
+	TreeNode *two = second->root ? minimum(second->root) : NULL;
+	for (; one && two; one = one->next, two = two->next)
+		if (compareInt(one->elem, two->elem) || compareInt(one->value, two->value)) return 0;
+
+	return !one && !two;
+}
+
+void test_balance(void) {
+	FILE *f = fopen("outputs/output_balance.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *avl = createTree(createInt, destroyInt, createInt, destroyInt, compareInt);
+	Tree *wavl = createTree(createInt, destroyInt, createInt, destroyInt, compareInt);
+	ASSERT(f, avl->balance == BALANCE_AVL && setTreeBalance(wavl, BALANCE_WAVL) == 0 &&
+			  setTreeBalance(wavl, BALANCE_TYPES) == -1, "Balance-01");
+
+	// Same inserts in both trees, in a scattered order and with duplicates.
+	for (int i = 0; i < 4000; i++) {
+		int key = (i * 7919) % 4000, value = i;
+		insertNode(avl, &key, &value);
+		insertNode(wavl, &key, &value);
+		if (key % 7 == 0) {
+			insertNode(avl, &key, &value);
+			insertNode(wavl, &key, &value);
+		}
+	}
+	ASSERT(f, check_ranks(avl->root) && check_ranks(wavl->root), "Balance-02");
+	ASSERT(f, same_entries(avl, wavl), "Balance-03");
+
+	// Deletes and inserts interleaved, the ranks stay valid at every step.
+	int valid = 1;
+	for (int i = 0; i < 3000; i++) {
+		int key = (i * 2003) % 4000;
+		deleteNode(avl, &key);
+		deleteNode(wavl, &key);
+		if (i % 3 == 0) {
+			key += 4000;
+			insertNode(avl, &key, &i);
+			insertNode(wavl, &key, &i);
+		}
+		valid &= check_ranks(wavl->root);
+	}
+	ASSERT(f, valid && same_entries(avl, wavl), "Balance-04");
+
+	// The height of a weak AVL tree is at most 2 log2(n).
+	TreeStats stats;
+	getTreeStats(wavl, &stats);
+	ASSERT(f, stats.keys == 2430 && stats.height <= 22, "Balance-05");
+
+	// Ranks may be higher than heights, AVL is back only for an empty tree.
+	ASSERT(f, setTreeBalance(wavl, BALANCE_AVL) == -1, "Balance-06");
+	for (int key = 0; key < 8000; key++) {
+		while (search(wavl, wavl->root, &key)) deleteNode(wavl, &key);
+		valid &= check_ranks(wavl->root);
+	}
+	ASSERT(f, valid && isEmpty(wavl) && setTreeBalance(wavl, BALANCE_AVL) == 0, "Balance-07");
+
+	destroyTree(avl);
+	destroyTree(wavl);
+
+	fprintf(f, "\nAll tests for Balance passed!\n");
+	fclose(f);
+}
+
+// Check the links, the order of the keys and, in weighted mode, the order of the counts.
+int check_links(TreeNode *node) {
+	for (TreeNode *head = node ? minimum(node) : NULL; head; head = head->end->next) {
+		if (head->left && (head->left->parent != head || head->left->height > head->height ||
+						   compareInt(head->left->elem, head->elem) >= 0)) return 0;
+		if (head->right && (head->right->parent != head || head->right->height > head->height ||
+							compareInt(head->right->elem, head->elem) <= 0)) return 0;
+		if (head->end->next && compareInt(head->end->next->elem, head->elem) <= 0) return 0;
+	}
+	return 1;
+}
+
+// Depth of a key (root is 1) found without `search`, which counts the accesses in weighted mode.
+int key_depth(Tree *tree, int key) {
+	int depth = 1;
+	for (TreeNode *node = tree->root; node; depth++) {
+		int comp = compareInt(node->elem, &key);
+		if (!comp) return depth;
+		node = comp > 0 ? node->left : node->right;
+	}
+	return 0;
+}
+
+// Node of a key in an int tree, found without counting an access.
+TreeNode* key_node(Tree *tree, int key) {
+	for (TreeNode *node = tree->root; node;) {
+		int comp = compareInt(node->elem, &key);
+		if (!comp) return node;
+		node = comp > 0 ? node->left : node->right;
+	}
+	return NULL;
+}
+
+// Number of entries listed by an inorder query, tombstones are skipped.
+size_t query_size(Tree *tree) {
+	Range *range = inorderKeyQuery(tree);
+	size_t size = range ? range->size : 0;
+	destroyRange(range);
+	return size;
+}
+
+void test_tombstone(void) {
+	FILE *f = fopen("outputs/output_tombstone.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// Values are indexes, as the range queries expect.
+	Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	Tree *eager = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	setTreeHash(tree, hashInt);
+	setTreeTombstones(tree, 0.25);
+
+	// Same inserts in both trees, the multiples of 10 twice.
+	for (int key = 0; key < 1000; key++) {
+		int64_t value = key;
+		insertNode(tree, &key, &value);
+		insertNode(eager, &key, &value);
+		if (key % 10 == 0) {
+			insertNode(tree, &key, &value);
+			insertNode(eager, &key, &value);
+		}
+	}
+
+	// Lazy deletes only mark the entries, the tree isn't changed.
+	TreeNode *root = tree->root;
+	for (int key = 1; key < 200; key += 2) {
+		deleteNode(tree, &key);
+		deleteNode(eager, &key);
+	}
+	int key = 1;
+	ASSERT(f, tree->root == root && tree->size == 1100 && tree->tombstones == 100 &&
+			  search(tree, tree->root, &key) == NULL, "Tombstone-01");
+
+	// A key with duplicates is found until its last entry is deleted.
+	key = 10;
+	deleteNode(tree, &key);
+	deleteNode(eager, &key);
+	ASSERT(f, search(tree, tree->root, &key) != NULL, "Tombstone-02");
+	deleteNode(tree, &key);
+	deleteNode(eager, &key);
+	ASSERT(f, search(tree, tree->root, &key) == NULL && tree->tombstones == 102, "Tombstone-03");
+
+	// Queries skip the tombstones.
+	Finger finger;
+	initFinger(&finger, tree);
+	int left = 0, right = 300;
+	Range *lazyRange = rangeKeyQuery(tree, (const char *)&left, (const char *)&right);
+	Range *eagerRange = rangeKeyQuery(eager, (const char *)&left, (const char *)&right);
+	int same = lazyRange->size == eagerRange->size && query_size(tree) == query_size(eager);
+	destroyRange(lazyRange);
+	destroyRange(eagerRange);
+	key = 1;
+	ASSERT(f, same && fingerSearch(&finger, &key) == NULL, "Tombstone-04");
+
+	// An insert of a buried key takes the place of its tombstone.
+	int64_t value = key;
+	insertNode(tree, &key, &value);
+	insertNode(eager, &key, &value);
+	ASSERT(f, search(tree, tree->root, &key) != NULL && tree->tombstones == 101 &&
+			  tree->size == 1100, "Tombstone-05");
+
+	// An extract frees the tombstones of the key, then removes a live entry.
+	key = 20;
+	deleteNode(tree, &key);
+	deleteNode(eager, &key);
+	void *elem = NULL, *extracted = NULL;
+	int removed = deleteNodeExtract(tree, &key, &elem, &extracted);
+	deleteNode(eager, &key);
+	ASSERT(f, removed && *(int *)elem == 20 && search(tree, tree->root, &key) == NULL &&
+			  tree->tombstones == 101 && tree->size == 1098, "Tombstone-06");
+	destroyInt(elem);
+	destroyIdx(extracted);
+
+	// Past a quarter of tombstones the tree is compacted, balanced again.
+	for (key = 200; key < 600; key++) {
+		deleteNode(tree, &key);
+		deleteNode(eager, &key);
+	}
+	ASSERT(f, tree->tombstones < 275 && tree->size < 1098 && check_ranks(tree->root) &&
+			  query_size(tree) == query_size(eager), "Tombstone-07");
+
+	// Back to eager deletes, the tombstones are compacted first.
+	setTreeTombstones(tree, 0);
+	TreeStats stats;
+	getTreeStats(eager, &stats);
+	ASSERT(f, tree->tombstones == 0 && same_entries(tree, eager) &&
+			  tree->index->count == stats.keys, "Tombstone-08");
+
+	// A background thread compacts the tree, the deletes only wake it up.
+	pthread_rwlock_t lock;
+	pthread_rwlock_init(&lock, NULL);
+	setTreeTombstones(tree, 0.1);
+	Compactor *compactor = startCompactor(tree, &lock);
+	for (key = 600; key < 1000; key++) {
+		pthread_rwlock_wrlock(&lock);
+		deleteNode(tree, &key);
+		pthread_rwlock_unlock(&lock);
+		deleteNode(eager, &key);
+	}
+	size_t runs = 0;
+	for (int spin = 0; spin < 1000000 && !runs; spin++) {
+		pthread_mutex_lock(&compactor->mutex);
+		runs = compactor->runs;
+		pthread_mutex_unlock(&compactor->mutex);
+		sched_yield();
+	}
+	stopCompactor(compactor);
+	pthread_rwlock_destroy(&lock);
+	setTreeTombstones(tree, 0);
+	ASSERT(f, runs > 0 && tree->compactor == NULL && same_entries(tree, eager), "Tombstone-09");
+
+	destroyTree(tree);
+	destroyTree(eager);
+
+	fprintf(f, "\nAll tests for Tombstone passed!\n");
+	fclose(f);
+}
+
+// Build a tree of the keys [0, count), the multiples of 5 twice, with a policy.
+Tree* split_tree(Balance balance, int count) {
+	Tree *tree = createTree(createInt, destroyInt, createInt, destroyInt, compareInt);
+	setTreeBalance(tree, balance);
+	for (int i = 0; i < count; i++) {
+		int key = (i * 7919) % count;
+		insertNode(tree, &key, &i);
+		if (key % 5 == 0) insertNode(tree, &key, &i);
+	}
+	return tree;
+}
+
+// Check the shape of a tree with its policy, and its threaded list.
+int check_split(Tree *tree) {
+	if (tree->root && tree->root->parent) return 0;
+	if (tree->balance == BALANCE_WEIGHT ? !check_links(tree->root) : !check_ranks(tree->root)) return 0;
+
+	size_t entries = 0;
+	TreeNode *entry = tree->root ? minimum(tree->root) : NULL;
+	for (TreeNode *prev = NULL; entry; prev = entry, entry = entry->next, entries++)
+		if (entry->prev != prev) return 0;
+	return entries == tree->size;
+}
+
+void test_split(void) {
+	FILE *f = fopen("outputs/output_split.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// The same range deleted at once and key by key, under each policy.
+	int valid = 1;
+	for (Balance balance = BALANCE_AVL; balance < BALANCE_TYPES; balance++) {
+		Tree *tree = split_tree(balance, 3000), *eager = split_tree(balance, 3000);
+		int left = 1000, right = 1999;
+		size_t deleted = deleteRange(tree, &left, &right);
+		for (int key = left; key <= right; key++) deleteNode(eager, &key);
+		for (int key = left; key <= right; key += 5) deleteNode(eager, &key);
+		valid &= deleted == 1200 && check_split(tree) && same_entries(tree, eager);
+		destroyTree(tree);
+		destroyTree(eager);
+	}
+	ASSERT(f, valid, "Split-01");
+
+	// Open bounds reach the ends of the tree, empty ranges change nothing.
+	Tree *tree = split_tree(BALANCE_AVL, 1000);
+	int left = 900, right = 100;
+	ASSERT(f, deleteRange(tree, &left, &right) == 0 && deleteRange(tree, NULL, &right) == 122 &&
+			  deleteRange(tree, &left, NULL) == 120 && check_split(tree) && tree->size == 958, "Split-02");
+	ASSERT(f, deleteRange(tree, NULL, NULL) == 958 && isEmpty(tree) && tree->size == 0, "Split-03");
+	destroyTree(tree);
+
+	// Random ranges keep the ranks of a WAVL tree valid, with the index and filter updated.
+	tree = split_tree(BALANCE_WAVL, 5000);
+	setTreeHash(tree, hashInt);
+	setTreeBloom(tree, hashInt, 10);
+	srand(41);
+	for (int i = 0; i < 200 && tree->root; i++) {
+		left = rand() % 5000;
+		right = left + rand() % 50;
+		deleteRange(tree, &left, &right);
+		valid &= check_split(tree) && search(tree, tree->root, &left) == NULL &&
+				 search(tree, tree->root, &right) == NULL;
+	}
+	TreeStats stats;
+	getTreeStats(tree, &stats);
+	ASSERT(f, valid && tree->index->count == stats.keys, "Split-04");
+	destroyTree(tree);
+
+	// An extract moves the range to a new tree, the nodes move between the memories.
+	tree = split_tree(BALANCE_AVL, 2000);
+	Tree *eager = split_tree(BALANCE_AVL, 2000);
+	size_t before = 0, live = 0, moved = 0;
+	getTreeMemory(tree, &before, NULL);
+	left = 500, right = 1499;
+	Tree *range = extractRange(tree, &left, &right);
+	getTreeMemory(tree, &live, NULL);
+	getTreeMemory(range, &moved, NULL);
+	ASSERT(f, range->size == 1200 && check_split(range) && check_split(tree) &&
+			  tree->size == 1200 && live + moved == before + sizeof(Tree), "Split-05");
+
+	// The extracted entries are the ones deleted from the other tree.
+	for (int key = 0; key < 2000; key++) {
+		if (key < left || key > right) while (search(eager, eager->root, &key)) deleteNode(eager, &key);
+	}
+	ASSERT(f, same_entries(range, eager), "Split-06");
+	destroyTree(range);
+	destroyTree(eager);
+
+	// Lazy deletes in the range leave their tombstones behind.
+	setTreeTombstones(tree, 0.5);
+	left = 100;
+	deleteNode(tree, &left);
+	deleteNode(tree, &left);
+	right = 200;
+	range = extractRange(tree, &left, &right);
+	ASSERT(f, range->size == 120 && range->tombstones == 0 && tree->tombstones == 0 &&
+			  tree->size == 1078 && check_split(range) && check_split(tree), "Split-07");
+	destroyTree(range);
+	destroyTree(tree);
+
+	// The payloads move with their nodes, the source may be destroyed first.
+	tree = split_tree(BALANCE_AVL, 100);
+	left = 10, right = 20;
+	range = extractRange(tree, &left, &right);
+	destroyTree(tree);
+	getTreeMemory(range, &moved, NULL);
+	ASSERT(f, range->size == 14 && check_split(range) &&
+			  moved == sizeof(Tree) + 14 * (sizeof(TreeNode) + 2 * sizeof(int)), "Split-08");
+	destroyTree(range);
+
+	fprintf(f, "\nAll tests for Split passed!\n");
+	fclose(f);
+}
+
+// Check that two ranges hold the same values, the second one sized exactly when `exact`.
+int same_range(Range *first, Range *second, int exact) {
+	if (!first || !second) return first == second;
+	if (first->size != second->size) return 0;
+	if (exact && second->capacity != (second->size ? second->size : 1)) return 0;
+	return !memcmp(first->index, second->index, sizeof(*first->index) * first->size);
+}
+
+// Create an int value through a wrapper, the tree only sees another function.
+void* wrapInt(void *value) {
+	return createInt(value);
+}
+
+void test_parallel(void) {
+	FILE *f = fopen("outputs/output_parallel.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// Values are indexes, the multiples of 3 twice.
+	Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	setTreeValueWidth(tree, sizeof(int64_t));
+	ASSERT(f, inorderKeyQueryParallel(tree, 4) == NULL, "Parallel-01");
+	for (int i = 0; i < 5000; i++) {
+		int key = (i * 7919) % 5000;
+		int64_t value = i;
+		insertNode(tree, &key, &value);
+		if (key % 3 == 0) insertNode(tree, &key, &value);
+	}
+
+	// The in-order query gives the same values with any number of threads.
+	int valid = 1;
+	Range *expected = inorderKeyQuery(tree);
+	for (int threads = 0; threads <= 16; threads += 4) {
+		Range *range = inorderKeyQueryParallel(tree, threads);
+		valid &= same_range(expected, range, threads > 1);
+		destroyRange(range);
+	}
+	destroyRange(expected);
+	ASSERT(f, valid, "Parallel-02");
+
+	// Range queries too, with bounds inside, outside and between the keys.
+	int bounds[][2] = {{0, 4999}, {-10, 10}, {1234, 4321}, {4990, 6000}, {700, 700}, {300, 200}, {6000, 7000}};
+	for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++) {
+		const char *left = (const char *)&bounds[i][0], *right = (const char *)&bounds[i][1];
+		expected = rangeKeyQuery(tree, left, right);
+		Range *range = rangeKeyQueryParallel(tree, left, right, 8);
+		valid &= same_range(expected, range, 1);
+		destroyRange(expected);
+		destroyRange(range);
+	}
+	ASSERT(f, valid, "Parallel-03");
+
+	// Tombstones are skipped, as in the sequential queries.
+	setTreeTombstones(tree, 0.5);
+	for (int key = 100; key < 400; key++) deleteNode(tree, &key);
+	int left = 0, right = 1000;
+	expected = rangeKeyQuery(tree, (const char *)&left, (const char *)&right);
+	Range *range = rangeKeyQueryParallel(tree, (const char *)&left, (const char *)&right, 3);
+	ASSERT(f, tree->tombstones && same_range(expected, range, 1), "Parallel-04");
+	destroyRange(expected);
+	destroyRange(range);
+
+	destroyTree(tree);
+
+	// Trees with int values (createInt) are read with the width of their values.
+	tree = createTree(createInt, destroyInt, createInt, destroyInt, compareInt);
+	for (int key = 0; key < 100; key++) {
+		int value = key + 26;
+		insertNode(tree, &key, &value);
+	}
+	expected = inorderKeyQuery(tree);
+	range = inorderKeyQueryParallel(tree, 4);
+	KeyView *view = createKeyView(tree, NULL, NULL);
+	Range *viewed = keyViewRange(view);
+	valid = expected->size == 100 && same_range(expected, range, 1) && same_range(expected, viewed, 0);
+	for (size_t i = 0; i < expected->size; i++) valid &= expected->index[i] == (int)i % LETTER_LEN;
+	ASSERT(f, valid, "Parallel-05");
+	destroyRange(expected);
+	destroyRange(range);
+	destroyRange(viewed);
+	destroyTree(tree);
+
+	// The width doesn't depend on the create function, a wrapper of createInt is read as int too.
+	tree = createTree(createInt, destroyInt, wrapInt, destroyInt, compareInt);
+	for (int key = 0; key < 100; key++) {
+		int value = key + 26;
+		insertNode(tree, &key, &value);
+	}
+	expected = inorderKeyQuery(tree);
+	range = inorderKeyQueryParallel(tree, 4);
+	valid = expected->size == 100 && same_range(expected, range, 1);
+	for (size_t i = 0; i < expected->size; i++) valid &= expected->index[i] == (int)i % LETTER_LEN;
+	ASSERT(f, valid, "Parallel-06");
+	destroyRange(expected);
+	destroyRange(range);
+	destroyTree(tree);
+
+	// Offsets past 2^31 are read whole once the tree is told its values are 64-bit, extracted trees keep it.
+	tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	valid = setTreeValueWidth(tree, sizeof(int64_t)) == 0 && setTreeValueWidth(tree, 2) == -1;
+	for (int key = 0; key < 100; key++) {
+		int64_t value = ((int64_t)1 << 32) + key;
+		insertNode(tree, &key, &value);
+	}
+	Tree *half = extractRange(tree, NULL, &(int){ 49 });
+	expected = inorderKeyQuery(tree);
+	range = inorderKeyQuery(half);
+	valid &= expected->size == 50 && range->size == 50;
+	for (size_t i = 0; valid && i < 50; i++) {
+		valid &= range->index[i] == (int)((((int64_t)1 << 32) + (int64_t)i) % LETTER_LEN);
+		valid &= expected->index[i] == (int)((((int64_t)1 << 32) + (int64_t)i + 50) % LETTER_LEN);
+	}
+	ASSERT(f, valid, "Parallel-07");
+	destroyRange(expected);
+	destroyRange(range);
+	destroyTree(half);
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Parallel passed!\n");
+	fclose(f);
+}
+
+// Sum and count of the live entries, shared by the threads of a traversal.
+typedef struct Totals {
+	int64_t keys, values, entries;
+} Totals;
+
+void visit_totals(void *ctx, TreeNode *entry) {
+	Totals *totals = (Totals *)ctx;
+	__atomic_add_fetch(&totals->keys, *(int *)entry->elem, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&totals->values, *(int64_t *)entry->value, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&totals->entries, 1, __ATOMIC_RELAXED);
+}
+
+void map_totals(void *ctx, void *acc, TreeNode *entry) {
+	Totals *totals = (Totals *)acc;
+	totals->keys += *(int *)entry->elem;
+	totals->values += *(int64_t *)entry->value;
+	totals->entries++;
+}
+
+void combine_totals(void *ctx, void *acc, const void *other) {
+	Totals *totals = (Totals *)acc;
+	const Totals *add = (const Totals *)other;
+	totals->keys += add->keys;
+	totals->values += add->values;
+	totals->entries += add->entries;
+}
+
+// Allocator counting its bytes atomically, threads release nodes together.
+void* atomicAlloc(void *ctx, size_t size) {
+	__atomic_add_fetch((size_t *)ctx, size, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+void atomicRelease(void *ctx, void *ptr, size_t size) {
+	__atomic_sub_fetch((size_t *)ctx, size, __ATOMIC_RELAXED);
+	free(ptr);
+}
+
+void test_walk(void) {
+	FILE *f = fopen("outputs/output_walk.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// Keys [0, 3000) once, and key 7 with a long duplicate chain.
+	size_t used = 0;
+	Allocator alloc = { atomicAlloc, NULL, atomicRelease, &used };
+	Tree *tree = createTreeAlloc(createInt, destroyInt, createIdx, destroyIdx, compareInt, &alloc);
+	Totals expected = { 0, 0, 0 };
+	for (int i = 0; i < 3000; i++) {
+		int key = (i * 7919) % 3000;
+		int64_t value = i;
+		insertNode(tree, &key, &value);
+		expected.keys += key, expected.values += i, expected.entries++;
+	}
+	for (int64_t value = 0; value < 5000; value++) {
+		int key = 7;
+		insertNode(tree, &key, &value);
+		expected.keys += key, expected.values += value, expected.entries++;
+	}
+
+	// Every entry is visited once, whatever the number of threads.
+	int valid = 1;
+	for (int threads = 0; threads <= 8; threads += 2) {
+		Totals totals = { 0, 0, 0 };
+		treeForEachParallel(tree, visit_totals, &totals, threads);
+		valid &= !memcmp(&totals, &expected, sizeof(totals));
+	}
+	ASSERT(f, valid, "Walk-01");
+
+	// The reduce folds the accumulators of the threads into the result.
+	for (int threads = 1; threads <= 8; threads++) {
+		Totals totals = { 0, 0, 0 };
+		treeReduceParallel(tree, &totals, sizeof(totals), map_totals, combine_totals, NULL, threads);
+		valid &= !memcmp(&totals, &expected, sizeof(totals));
+	}
+	ASSERT(f, valid, "Walk-02");
+
+	// Tombstones are skipped.
+	setTreeTombstones(tree, 0.5);
+	for (int key = 1000; key < 1010; key++) {
+		deleteNode(tree, &key);
+		expected.keys -= key, expected.entries--;
+	}
+	Totals totals = { 0, 0, 0 };
+	treeReduceParallel(tree, &totals, sizeof(totals), map_totals, combine_totals, NULL, 4);
+	ASSERT(f, tree->tombstones == 10 && totals.keys == expected.keys &&
+			  totals.entries == expected.entries, "Walk-03");
+
+	// A parallel destroy releases every node and payload.
+	destroyTreeParallel(tree, 4);
+	ASSERT(f, used == 0, "Walk-04");
+
+	fprintf(f, "\nAll tests for Walk passed!\n");
+	fclose(f);
+}
+
+void test_cache(void) {
+	FILE *f = fopen("outputs/output_cache.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	setTreeCache(tree, 2);
+	for (int i = 0; i < 1000; i++) {
+		int key = (i * 7919) % 1000;
+		int64_t value = i;
+		insertNode(tree, &key, &value);
+	}
+
+	// The second query shares the result of the first one.
+	CacheStats stats;
+	Range *first = inorderKeyQuery(tree), *second = inorderKeyQuery(tree);
+	getCacheStats(tree, &stats);
+	ASSERT(f, first && first == second && first->size == 1000 &&
+			  stats.hits == 1 && stats.misses == 1, "Cache-01");
+	destroyRange(second);
+
+	// Range results are kept by the values of the bounds, not their addresses.
+	int left = 100, right = 199, sameLeft = 100, sameRight = 199, otherRight = 299;
+	Range *range = rangeKeyQuery(tree, (const char *)&left, (const char *)&right);
+	Range *same = rangeKeyQueryParallel(tree, (const char *)&sameLeft, (const char *)&sameRight, 4);
+	Range *other = rangeKeyQuery(tree, (const char *)&left, (const char *)&otherRight);
+	getCacheStats(tree, &stats);
+	ASSERT(f, range == same && range != other && range->size == 100 && other->size == 200 &&
+			  stats.hits == 2 && stats.misses == 3 && stats.evictions == 1 &&
+			  stats.entries == 2, "Cache-02");
+	destroyRange(same);
+	destroyRange(other);
+
+	// An insert changes the version, the results held stay as they were.
+	int key = 150;
+	int64_t value = 7;
+	insertNode(tree, &key, &value);
+	Range *updated = rangeKeyQuery(tree, (const char *)&left, (const char *)&right);
+	getCacheStats(tree, &stats);
+	ASSERT(f, updated != range && updated->size == 101 && range->size == 100 &&
+			  stats.stale == 1, "Cache-03");
+	destroyRange(range);
+	destroyRange(updated);
+
+	// Deletes too, for each query.
+	Range *level = levelKeyQuery(tree);
+	deleteNode(tree, &key);
+	deleteNode(tree, &key);
+	Range *inorder = inorderKeyQuery(tree), *levelAfter = levelKeyQuery(tree);
+	ASSERT(f, inorder != first && inorder->size == 999 && first->size == 1000 &&
+			  levelAfter != level, "Cache-04");
+	destroyRange(first);
+	destroyRange(inorder);
+	destroyRange(level);
+	destroyRange(levelAfter);
+
+	// Without the cache every query builds its own result.
+	setTreeCache(tree, 0);
+	first = inorderKeyQuery(tree);
+	second = inorderKeyQuery(tree);
+	getCacheStats(tree, &stats);
+	ASSERT(f, first != second && same_range(first, second, 0) && stats.capacity == 0, "Cache-05");
+	destroyRange(first);
+	destroyRange(second);
+
+	// Results still held when the cache is dropped are freed by their owners.
+	size_t live;
+	getTreeMemory(tree, &live, NULL);
+	setTreeCache(tree, CACHE_ENTRIES);
+	first = inorderKeyQuery(tree);
+	setTreeCache(tree, 0);
+	destroyRange(first);
+	size_t after;
+	getTreeMemory(tree, &after, NULL);
+	ASSERT(f, live == after, "Cache-06");
+
+	destroyTree(tree);
+
+	// Bounds of borrowed words are kept with their bytes, the caller may reuse its buffer.
+	char text[] = "ant bee cat dog eel fox";
+	tree = createTree(borrowElem, releaseElem, createIdx, destroyIdx, compareView);
+	setTreeValueWidth(tree, sizeof(int64_t));
+	setTreeCache(tree, CACHE_ENTRIES);
+	View words[6];
+	for (int i = 0; i < 6; i++) {
+		int64_t index = i;
+		words[i] = (View){ text + 4 * i, 3 };
+		insertNode(tree, &words[i], &index);
+	}
+	char bounds[] = "bee dog";
+	View low = { bounds, 3 }, high = { bounds + 4, 3 };
+	first = rangeKeyQuery(tree, (const char *)&low, (const char *)&high);
+	memset(bounds, 'z', 7);
+	View again[] = { { "bee", 3 }, { "dog", 3 } };
+	second = rangeKeyQuery(tree, (const char *)&again[0], (const char *)&again[1]);
+	ASSERT(f, first == second && first->size == 3, "Cache-07");
+	destroyRange(first);
+	destroyRange(second);
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Cache passed!\n");
+	fclose(f);
+}
+
+// Check that a view holds the same values as the query of its bounds.
+int check_view(Tree *tree, KeyView *view, int *left, int *right) {
+	Range *expected = (left || right) ? rangeKeyQuery(tree, (const char *)left, (const char *)right)
+									  : inorderKeyQuery(tree);
+	Range *range = keyViewRange(view);
+	int valid = (expected ? same_range(expected, range, 1) : range->size == 0) && range->size == view->size;
+	destroyRange(expected);
+	destroyRange(range);
+	return valid;
+}
+
+void test_view(void) {
+	FILE *f = fopen("outputs/output_view.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// A view made before the inserts and a bounded one made after them, both with duplicates.
+	Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	setTreeValueWidth(tree, sizeof(int64_t));
+	KeyView *all = createKeyView(tree, NULL, NULL);
+	for (int i = 0; i < 3000; i++) {
+		int key = (i * 7919) % 1000;
+		int64_t value = i;
+		insertNode(tree, &key, &value);
+	}
+	int left = 250, right = 600;
+	KeyView *part = createKeyView(tree, &left, &right);
+	ASSERT(f, all->size == 3000 && check_view(tree, all, NULL, NULL) &&
+			  part->size == 1053 && check_view(tree, part, &left, &right), "View-01");
+
+	// Eager deletes, with and without the hash index, take the last entry of a key.
+	setTreeHash(tree, hashInt);
+	for (int i = 0; i < 1500; i++) {
+		int key = (i * 31) % 1000;
+		deleteNode(tree, &key);
+		if (i % 3 == 0) {
+			int64_t value = -i;
+			insertNode(tree, &key, &value);
+		}
+	}
+	ASSERT(f, check_view(tree, all, NULL, NULL) && check_view(tree, part, &left, &right), "View-02");
+
+	// Tombstones leave the views, revived ones come back in place.
+	setTreeTombstones(tree, 0.5);
+	for (int key = 200; key < 700; key += 2) deleteNode(tree, &key);
+	for (int key = 300; key < 400; key += 4) {
+		int64_t value = key * 3;
+		insertNode(tree, &key, &value);
+	}
+	ASSERT(f, tree->tombstones && check_view(tree, all, NULL, NULL) &&
+			  check_view(tree, part, &left, &right), "View-03");
+	setTreeTombstones(tree, 0);
+
+	// Range deletes and extracts cut the views too.
+	int low = 500, high = 550, from = 0, to = 100;
+	deleteRange(tree, &low, &high);
+	Tree *out = extractRange(tree, &from, &to);
+	int elem = 0;
+	void *gone = NULL, *value = NULL;
+	deleteNodeExtract(tree, &right, &gone, &value);
+	destroyInt(gone);
+	destroyIdx(value);
+	ASSERT(f, check_view(tree, all, NULL, NULL) && check_view(tree, part, &left, &right), "View-04");
+	destroyTree(out);
+
+	// Emptied views stay usable, and follow the WAVL policy the same way.
+	deleteRange(tree, NULL, NULL);
+	ASSERT(f, all->size == 0 && part->size == 0 && check_view(tree, all, NULL, NULL), "View-05");
+	destroyKeyView(part);
+	setTreeBalance(tree, BALANCE_WAVL);
+	for (int i = 0; i < 2000; i++) {
+		elem = (i * 7919) % 700;
+		int64_t index = i;
+		insertNode(tree, &elem, &index);
+		if (i % 5 == 0) deleteNode(tree, &elem);
+	}
+	ASSERT(f, tree->balance == BALANCE_WAVL && tree->views == all &&
+			  check_view(tree, all, NULL, NULL), "View-06");
+
+	destroyTree(tree);
+
+	// Bounds of borrowed words are kept with their bytes, the caller may reuse its buffer.
+	char text[] = "ant bee cat dog eel fox cow";
+	tree = createTree(borrowElem, releaseElem, createIdx, destroyIdx, compareView);
+	setTreeValueWidth(tree, sizeof(int64_t));
+	View words[7];
+	for (int i = 0; i < 7; i++) words[i] = (View){ text + 4 * i, 3 };
+	for (int i = 0; i < 6; i++) {
+		int64_t index = i;
+		insertNode(tree, &words[i], &index);
+	}
+	char bounds[] = "bee dog";
+	View first = { bounds, 3 }, last = { bounds + 4, 3 };
+	KeyView *wordView = createKeyView(tree, &first, &last);
+	memset(bounds, 'z', 7);
+	int64_t index = 6;
+	insertNode(tree, &words[6], &index);
+	Range *range = keyViewRange(wordView);
+	ASSERT(f, wordView && range->size == 4 && range->index[1] == 2 && range->index[2] == 6, "View-07");
+	destroyRange(range);
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for View passed!\n");
+	fclose(f);
+}
+
+// Polynomial hash of the values in key order, a monoid that isn't commutative.
+typedef struct Sequence {
+	uint64_t hash, scale;
+} Sequence;
+
+void identity_sequence(void *ctx, void *acc) {
+	((Sequence *)acc)->hash = 0;
+	((Sequence *)acc)->scale = 1;
+}
+
+void map_sequence(void *ctx, void *acc, TreeNode *entry) {
+	Sequence *seq = (Sequence *)acc;
+	seq->hash = seq->hash * 31 + (uint64_t)*(int64_t *)entry->value;
+	seq->scale *= 31;
+}
+
+void combine_sequence(void *ctx, void *acc, const void *other) {
+	Sequence *seq = (Sequence *)acc;
+	const Sequence *add = (const Sequence *)other;
+	seq->hash = seq->hash * add->scale + add->hash;
+	seq->scale *= add->scale;
+}
+
+// Check the aggregates kept by a tree against a walk of its entries, for several ranges.
+int check_aggregate(Tree *tree) {
+	int bounds[][2] = {{0, 999}, {-5, 5}, {100, 350}, {351, 351}, {990, 2000}, {500, 400}, {0, 0}};
+	for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]) + 2; i++) {
+		// The last two ranges have no left and no right bound.
+		int *left = (i == sizeof(bounds) / sizeof(bounds[0])) ? NULL : &bounds[i % 7][0];
+		int *right = (i == sizeof(bounds) / sizeof(bounds[0]) + 1) ? NULL : &bounds[i % 7][1];
+		OffsetSummary expected = {0, 0, INT64_MAX, INT64_MIN}, sum;
+		Sequence sequence = {0, 1}, result;
+		for (TreeNode *entry = tree->root ? minimum(tree->root) : NULL; entry; entry = entry->next) {
+			int key = *(int *)entry->elem;
+			if (entry->dead || (left && key < *left) || (right && key > *right)) continue;
+			int64_t value = *(int64_t *)entry->value;
+			expected.count++;
+			expected.letters += value % LETTER_LEN;
+			if (value < expected.min) expected.min = value;
+			if (value > expected.max) expected.max = value;
+			map_sequence(NULL, &sequence, entry);
+		}
+
+		if (tree->aggregate->monoid.map == map_sequence) {
+			if (rangeAggregate(tree, left, right, &result) || result.hash != sequence.hash) return 0;
+		} else if (rangeAggregate(tree, left, right, &sum) || memcmp(&sum, &expected, sizeof(sum))) return 0;
+	}
+	return 1;
+}
+
+void test_aggregate(void) {
+	FILE *f = fopen("outputs/output_aggregate.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *tree = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+	OffsetSummary sum;
+	ASSERT(f, rangeAggregate(tree, NULL, NULL, &sum) == -1, "Aggregate-01");
+
+	// The aggregates follow the inserts, duplicates and rotations of each policy.
+	int valid = 1;
+	Monoid monoid = {sizeof(Sequence), identity_sequence, map_sequence, combine_sequence, NULL};
+	for (Balance balance = BALANCE_AVL; balance < BALANCE_TYPES; balance++) {
+		Tree *other = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		setTreeBalance(other, balance);
+		setTreeAggregate(other, &monoid);
+		for (int i = 0; i < 3000; i++) {
+			int key = (i * 7919) % 1000;
+			int64_t value = i * 13;
+			insertNode(other, &key, &value);
+			// Weighted trees rotate on searches too.
+			if (balance == BALANCE_WEIGHT && i % 3 == 0) search(other, other->root, &key);
+		}
+		valid &= check_aggregate(other);
+
+		// Deletes, eager and lazy, with the aggregates kept during the changes.
+		setTreeAggregate(other, &offsetMonoid);
+		for (int i = 0; i < 2500; i++) {
+			int key = (i * 31) % 1000;
+			deleteNode(other, &key);
+		}
+		valid &= check_aggregate(other);
+		setTreeTombstones(other, 0.5);
+		for (int key = 200; key < 700; key += 3) deleteNode(other, &key);
+		for (int key = 300; key < 400; key += 2) {
+			int64_t value = key;
+			insertNode(other, &key, &value);
+		}
+		valid &= other->tombstones && check_aggregate(other);
+		setTreeTombstones(other, 0);
+		valid &= check_aggregate(other);
+		setTreeAggregate(other, &monoid);
+		for (int i = 0; i < 500; i++) {
+			int key = (i * 613) % 1000;
+			int64_t value = i;
+			insertNode(other, &key, &value);
+		}
+
+		// Range deletes and extracts split and join the tree.
+		int low = 120, high = 180, from = 800, to = 900;
+		deleteRange(other, &low, &high);
+		Tree *out = extractRange(other, &from, &to);
+		valid &= check_aggregate(other) && out->size;
+		destroyTree(out);
+		destroyTree(other);
+	}
+	ASSERT(f, valid, "Aggregate-02");
+
+	// The offset summary of a range holds its entries, letters and offsets.
+	for (int i = 0; i < 100; i++) {
+		int key = i / 2;
+		int64_t value = 1000 - i;
+		insertNode(tree, &key, &value);
+	}
+	setTreeAggregate(tree, &offsetMonoid);
+	int left = 10, right = 19;
+	rangeAggregate(tree, &left, &right, &sum);
+	ASSERT(f, sum.count == 20 && sum.min == 961 && sum.max == 980, "Aggregate-03");
+
+	// Dropping the aggregates frees them.
+	size_t with, without;
+	getTreeMemory(tree, &with, NULL);
+	setTreeAggregate(tree, NULL);
+	getTreeMemory(tree, &without, NULL);
+	ASSERT(f, without < with && rangeAggregate(tree, &left, &right, &sum) == -1, "Aggregate-04");
+
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Aggregate passed!\n");
+	fclose(f);
+}
+
+// Spans found by a query, with their order checked.
+typedef struct Overlaps {
+	size_t count;
+	int64_t last;
+	int sorted;
+} Overlaps;
+
+void collect_overlap(void *ctx, TreeNode *entry) {
+	Overlaps *found = (Overlaps *)ctx;
+	int64_t start = ((Interval *)entry->elem)->start;
+	if (start < found->last) found->sorted = 0;
+	found->last = start;
+	found->count++;
+}
+
+// Check the overlap queries of an interval tree against a walk of its spans.
+int check_overlaps(Tree *tree, int64_t limit) {
+	for (int64_t from = -3; from < limit; from += 1 + limit / 97) {
+		for (int64_t width = 1; width < limit; width *= 4) {
+			size_t expected = 0;
+			for (TreeNode *entry = tree->root ? minimum(tree->root) : NULL; entry; entry = entry->next) {
+				Interval *span = (Interval *)entry->elem;
+				if (!entry->dead && span->start < from + width && span->end > from) expected++;
+			}
+			Overlaps found = {0, INT64_MIN, 1};
+			if (overlapQuery(tree, from, from + width, collect_overlap, &found) != expected) return 0;
+			if (found.count != expected || !found.sorted) return 0;
+		}
+	}
+	return 1;
+}
+
+void test_interval(void) {
+	FILE *f = fopen("outputs/output_interval.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// The words of a file follow each other, each one starts where the last one ends.
+	Tree *tree = createIntervalTree();
+	buildIntervalsFromFile("inputs/key.txt", tree);
+	Tree *words = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+	buildTreeFromFile("inputs/key.txt", words);
+	int64_t end = tree->root ? ((Interval *)maximum(tree->root)->elem)->end : 0;
+	ASSERT(f, tree->size == words->size && end > 0 && check_overlaps(tree, end + 3), "Interval-01");
+
+	// A byte is held by one word, the ones past the end by none.
+	int valid = 1;
+	for (int64_t point = 0; point < end; point++) valid &= stabQuery(tree, point, NULL, NULL) == 1;
+	ASSERT(f, valid && !stabQuery(tree, end, NULL, NULL) && !stabQuery(tree, -1, NULL, NULL), "Interval-02");
+
+	// Inserted words get the offsets of `insertWord`.
+	Tree *other = createIntervalTree();
+	int64_t offset = 0;
+	insertWordInterval(other, "redact", &offset);
+	insertWordInterval(other, "this", &offset);
+	insertWordInterval(other, "word", &offset);
+	Overlaps found = {0, INT64_MIN, 1};
+	ASSERT(f, offset == 14 && overlapQuery(other, 5, 11, collect_overlap, &found) == 3 && found.last == 10 && !overlapQuery(other, 6, 6, NULL, NULL), "Interval-03");
+	destroyTree(other);
+
+	// Nested and repeated spans, with the greatest ends kept through the rotations of each policy.
+	valid = 1;
+	char label[] = "span";
+	for (Balance balance = BALANCE_AVL; balance < BALANCE_TYPES; balance++) {
+		other = createIntervalTree();
+		setTreeBalance(other, balance);
+		for (int i = 0; i < 2000; i++) {
+			Interval span = {(i * 7919) % 1000, 0};
+			span.end = span.start + 1 + (i * 31) % (i % 10 ? 5 : 300);
+			insertNode(other, &span, label);
+			if (balance == BALANCE_WEIGHT && i % 3 == 0) search(other, other->root, &span);
+		}
+		valid &= check_overlaps(other, 1300);
+
+		// Eager and lazy deletes drop the spans from the greatest ends.
+		for (int i = 0; i < 1500; i += 2) {
+			Interval span = {(i * 7919) % 1000, 0};
+			span.end = span.start + 1 + (i * 31) % (i % 10 ? 5 : 300);
+			deleteNode(other, &span);
+		}
+		valid &= check_overlaps(other, 1300);
+		setTreeTombstones(other, 0.5);
+		for (int i = 1; i < 1500; i += 2) {
+			Interval span = {(i * 7919) % 1000, 0};
+			span.end = span.start + 1 + (i * 31) % (i % 10 ? 5 : 300);
+			deleteNode(other, &span);
+		}
+		valid &= other->tombstones && check_overlaps(other, 1300);
+		setTreeTombstones(other, 0);
+		valid &= check_overlaps(other, 1300);
+		destroyTree(other);
+	}
+	ASSERT(f, valid, "Interval-04");
+
+	// Only a tree keeping the greatest ends answers.
+	ASSERT(f, !overlapQuery(words, 0, 100, NULL, NULL) && !stabQuery(NULL, 0, NULL, NULL), "Interval-05");
+
+	destroyTree(words);
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Interval passed!\n");
+	fclose(f);
+}
+
+// Check the value index of a tree against a walk of its live entries.
+int check_values(Tree *tree) {
+	size_t live = 0, indexed = 0;
+	for (TreeNode *entry = tree->root ? minimum(tree->root) : NULL; entry; entry = entry->next) {
+		if (entry->dead) continue;
+		live++;
+		TreeNode *found = valueSearch(tree, entry->value);
+		if (!found || compareIdx(found->value, entry->value)) return 0;
+	}
+
+	// The index holds each live entry once, in value order.
+	ValueIndex *index = tree->values;
+	TreeNode *last = NULL;
+	for (size_t i = 0; i < index->count; i++) {
+		for (size_t j = 0; j < index->chunks[i]->count; j++, indexed++) {
+			TreeNode *entry = index->chunks[i]->entries[j];
+			if (entry->dead || (last && compareIdx(last->value, entry->value) > 0)) return 0;
+			TreeNode *pass = tree->root ? minimum(tree->root) : NULL;
+			while (pass && pass != entry) pass = pass->next;
+			if (!pass) return 0;
+			last = entry;
+		}
+	}
+	return live == indexed && index->size == live;
+}
+
+// Counts the entries visited by a value range query, with their order checked.
+void collect_value(void *ctx, TreeNode *entry) {
+	Overlaps *found = (Overlaps *)ctx;
+	int64_t value = *(int64_t *)entry->value;
+	if (value < found->last) found->sorted = 0;
+	found->last = value;
+	found->count++;
+}
+
+void test_values(void) {
+	FILE *f = fopen("outputs/output_values.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// The word at a byte of the file, found from its offset.
+	Tree *tree = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+	buildTreeFromFile("inputs/key.txt", tree);
+	ASSERT(f, !valueSearch(tree, &(int64_t){0}) && !valueRangeQuery(tree, NULL, NULL, NULL, NULL), "Values-01");
+	setTreeValueIndex(tree, compareIdx);
+	ASSERT(f, tree->lambda.compareVal == compareIdx && check_values(tree), "Values-02");
+
+	int valid = 1;
+	for (TreeNode *entry = minimum(tree->root); entry; entry = entry->next) {
+		int64_t offset = *(int64_t *)entry->value, end = offset + (int64_t)strlen(entry->elem);
+		for (int64_t byte = offset; byte < end; byte++) valid &= valueFloor(tree, &byte) == entry;
+	}
+	ASSERT(f, valid && !valueFloor(tree, &(int64_t){-1}), "Values-03");
+
+	// Range lookups by value visit the entries in value order.
+	valid = 1;
+	for (int64_t low = -10; low < 600; low += 37) {
+		int64_t high = low + 50;
+		size_t expected = 0;
+		for (TreeNode *entry = minimum(tree->root); entry; entry = entry->next) {
+			int64_t value = *(int64_t *)entry->value;
+			expected += value >= low && value <= high;
+		}
+		Overlaps found = {0, INT64_MIN, 1};
+		valid &= valueRangeQuery(tree, &low, &high, collect_value, &found) == expected && found.sorted;
+	}
+	ASSERT(f, valid && valueRangeQuery(tree, NULL, NULL, NULL, NULL) == tree->size, "Values-04");
+
+	// The index follows the inserts, deletes, revives and range cuts, eager and lazy.
+	valid = 1;
+	for (Balance balance = BALANCE_AVL; balance < BALANCE_TYPES; balance++) {
+		Tree *other = createTree(createInt, destroyInt, createIdx, destroyIdx, compareInt);
+		setTreeBalance(other, balance);
+		setTreeValueIndex(other, compareIdx);
+		for (int i = 0; i < 3000; i++) {
+			int key = (i * 7919) % 1000;
+			int64_t value = (i * 31) % 500;
+			insertNode(other, &key, &value);
+		}
+		valid &= check_values(other);
+		for (int i = 0; i < 2500; i += 2) {
+			int key = (i * 613) % 1000;
+			deleteNode(other, &key);
+		}
+		valid &= check_values(other);
+		setTreeTombstones(other, 0.5);
+		for (int i = 1; i < 2500; i += 2) {
+			int key = (i * 613) % 1000;
+			deleteNode(other, &key);
+		}
+		for (int key = 0; key < 1000; key += 7) {
+			int64_t value = key;
+			insertNode(other, &key, &value);
+		}
+		valid &= check_values(other);
+		setTreeTombstones(other, 0);
+		int low = 100, high = 200, from = 700, to = 800;
+		deleteRange(other, &low, &high);
+		Tree *out = extractRange(other, &from, &to);
+		valid &= check_values(other) && !out->values && out->lambda.compareVal == compareIdx;
+		destroyTree(out);
+		destroyTree(other);
+	}
+	ASSERT(f, valid, "Values-05");
+
+	// A loaded tree indexes its values when its functions compare them.
+	Func funcs = {{createStr, createIdx}, {destroyStr, destroyIdx}, compareStr,
+				  {packStr, packIdx, unpackStr, unpackIdx}, NULL, compareIdx, {NULL, NULL, NULL, NULL}, sizeof(int64_t)};
+	setTreeIO(tree, packStr, unpackStr, packIdx, unpackIdx);
+	Tree *loaded = saveTree(tree, "outputs/values.snap") ? NULL : loadTree("outputs/values.snap", &funcs);
+	ASSERT(f, loaded && loaded->values && check_values(loaded), "Values-06");
+	if (loaded) destroyTree(loaded);
+	remove("outputs/values.snap");
+
+	// Dropping the index frees it.
+	size_t with, without;
+	getTreeMemory(tree, &with, NULL);
+	setTreeValueIndex(tree, NULL);
+	getTreeMemory(tree, &without, NULL);
+	ASSERT(f, without < with && !tree->values && !valueFloor(tree, &(int64_t){10}), "Values-07");
+
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Values passed!\n");
+	fclose(f);
+}
+
+// Check that two word trees list the same live entries, in the same order.
+int same_words(Tree *first, Tree *second) {
+	TreeNode *one = first->root ? minimum(first->root) : NULL;
+	TreeNode *two = second->root ? minimum(second->root) : NULL;
+	for (;; one = one->next, two = two->next) {
+		while (one && one->dead) one = one->next;
+		while (two && two->dead) two = two->next;
+		if (!one || !two) break;
+		if (compareStr(one->elem, two->elem) || compareIdx(one->value, two->value)) return 0;
+	}
+
+	return !one && !two;
+}
+
+// Append bytes to a file.
+void append_bytes(const char *file, const char *data, size_t length) {
+	FILE *out = fopen(file, "ab");
+	if (!out) return;
+	fwrite(data, 1, length, out);
+	fclose(out);
+}
+
+void test_append(void) {
+	FILE *f = fopen("outputs/output_append.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	FILE *in = fopen("inputs/key.txt", "rb");
+	char text[4096];
+	size_t length = in ? fread(text, 1, sizeof(text), in) : 0;
+	if (in) fclose(in);
+
+	// An empty log builds an empty tree, a missing one no handle.
+	remove("outputs/append.txt");
+	ASSERT(f, openBuild("outputs/append.txt", NULL) == NULL, "Append-01");
+	append_bytes("outputs/append.txt", "", 0);
+	Tree *tree = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+	Build *build = openBuild("outputs/append.txt", tree);
+	ASSERT(f, build && !tree->size && resumeBuild(build) == 0, "Append-02");
+
+	// Appends cut anywhere, in the middle of a word too, give the tree of the whole file.
+	int valid = 1;
+	size_t cuts[] = {1, 2, 5, 6, 17, 40, 41, 64, 100, 101, 250, 333, length};
+	size_t at = 0;
+	for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]) && at < length; i++) {
+		size_t to = cuts[i] < length ? cuts[i] : length;
+		if (to <= at) continue;
+		append_bytes("outputs/append.txt", text + at, to - at);
+		at = to;
+		valid &= resumeBuild(build) >= 0;
+
+		Tree *whole = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+		buildTreeFromFile("outputs/append.txt", whole);
+		valid &= same_words(tree, whole) && build->done + build->tail == at;
+		destroyTree(whole);
+	}
+	// Further appends start past the first pages of the file.
+	for (size_t copy = 0; copy < 20; copy++) {
+		for (size_t from = 0; from < length; from += 373) {
+			append_bytes("outputs/append.txt", text + from, from + 373 < length ? 373 : length - from);
+			valid &= resumeBuild(build) >= 0;
+		}
+	}
+	Tree *whole = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+	buildTreeFromFile("outputs/append.txt", whole);
+	valid &= same_words(tree, whole) && build->done > 4096;
+	destroyTree(whole);
+	ASSERT(f, valid && at == length, "Append-03");
+
+	// A call without new bytes reads nothing, the cut word stays as it is.
+	size_t size = tree->size;
+	ASSERT(f, resumeBuild(build) == 0 && tree->size == size, "Append-04");
+
+	// A word cut in two by the end of the file is replaced by the whole word.
+	append_bytes("outputs/append.txt", " HIGH", 5);
+	resumeBuild(build);
+	append_bytes("outputs/append.txt", "LIGHT ", 6);
+	long words = resumeBuild(build);
+	char joined[] = "HIGHLIGHT", cut[] = "HIGH", redact[] = "REDACT";
+	ASSERT(f, words == 1 && search(tree, tree->root, joined) && !search(tree, tree->root, cut) && !build->tail, "Append-05");
+
+	// Lazy deletes give the same entries.
+	Tree *lazy = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+	setTreeTombstones(lazy, 0.5);
+	Build *other = openBuild("outputs/append.txt", lazy);
+	append_bytes("outputs/append.txt", "RED", 3);
+	resumeBuild(build);
+	resumeBuild(other);
+	append_bytes("outputs/append.txt", "ACT.", 4);
+	resumeBuild(build);
+	resumeBuild(other);
+	ASSERT(f, same_words(tree, lazy) && search(lazy, lazy->root, redact), "Append-06");
+	closeBuild(other);
+	destroyTree(lazy);
+
+	// A shorter file can't be resumed.
+	FILE *reset = fopen("outputs/append.txt", "wb");
+	if (reset) fclose(reset);
+	ASSERT(f, resumeBuild(build) == -1 && resumeBuild(NULL) == -1, "Append-07");
+
+	closeBuild(build);
+	destroyTree(tree);
+	remove("outputs/append.txt");
+
+	fprintf(f, "\nAll tests for Append passed!\n");
+	fclose(f);
+}
+
+// Inserts of one thread in its own tree, traced in the ring of the thread.
+void* trace_worker(void *arg) {
+	Tree *tree = createTree(createInt, destroyInt, createInt, destroyInt, compareInt);
+	for (int i = 0; i < 500; i++) insertNode(tree, &i, &i);
+	*(int *)arg = (int)tree->size;
+	destroyTree(tree);
+	return NULL;
+}
+
+// Read a whole trace file, NULL if it can't be read.
+char* read_trace(const char *path) {
+	FILE *in = fopen(path, "rb");
+	if (!in) return NULL;
+	fseek(in, 0, SEEK_END);
+	long length = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	char *text = calloc(1, length + 1);
+	if (text && fread(text, 1, length, in) != (size_t)length) text[0] = '\0';
+	fclose(in);
+	return text;
+}
+
+// Number of events of a trace file.
+long count_events(const char *text) {
+	long count = 0;
+	for (const char *at = text; (at = strstr(at, "\"ph\":\"X\"")); at++) count++;
+	return count;
+}
+
+void test_trace(void) {
+	FILE *f = fopen("outputs/output_trace.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// Without AVL_TRACE (`make TRACE=1`) the traces are written, but empty.
+	ASSERT(f, stopTrace() == -1 && startTrace(NULL) == -1, "Trace-01");
+	ASSERT(f, startTrace("outputs/trace.json") == 0 && startTrace("outputs/other.json") == -1, "Trace-02");
+
+	// Phases and queries of the calling thread, inserts of two others.
+	Tree *tree = createTree(createStr, destroyStr, createIdx, destroyIdx, compareStr);
+	buildTreeFromFile("inputs/key.txt", tree);
+	char word[] = "the";
+	search(tree, tree->root, word);
+	destroyRange(inorderKeyQuery(tree));
+	destroyTree(tree);
+
+	pthread_t threads[2];
+	int sizes[2] = {0, 0};
+	for (int i = 0; i < 2; i++) pthread_create(&threads[i], NULL, trace_worker, &sizes[i]);
+	for (int i = 0; i < 2; i++) pthread_join(threads[i], NULL);
+
+	long events = stopTrace();
+	char *text = read_trace("outputs/trace.json");
+	ASSERT(f, events >= 0 && text && !strncmp(text, "{\"traceEvents\":[", 16) && count_events(text) == events, "Trace-03");
+	int valid = !TRACE_ENABLED || (strstr(text, "\"name\":\"buildTreeFromFile\"") && strstr(text, "\"name\":\"insertNode\"")
+		&& strstr(text, "\"name\":\"inorderKeyQuery\"") && strstr(text, "\"tid\":2") && strstr(text, "\"tid\":3"));
+	free(text);
+	ASSERT(f, valid && sizes[0] == 500 && sizes[1] == 500, "Trace-04");
+
+	// A stopped trace can't be stopped again, the next one starts empty.
+	ASSERT(f, stopTrace() == -1, "Trace-05");
+	ASSERT(f, startTrace("outputs/trace.json") == 0 && stopTrace() == 0, "Trace-06");
+
+	// A full ring keeps the last TRACE_EVENTS events of its thread.
+	startTrace("outputs/trace.json");
+	tree = createTree(createInt, destroyInt, createInt, destroyInt, compareInt);
+	for (int i = 0; i < TRACE_EVENTS; i++) insertNode(tree, &i, &i);
+	destroyTree(tree);
+	events = stopTrace();
+	ASSERT(f, events == (TRACE_ENABLED ? TRACE_EVENTS : 0), "Trace-07");
+
+	remove("outputs/trace.json");
+
+	fprintf(f, "\nAll tests for Trace passed!\n");
+	fclose(f);
+}
+
+void test_weight(void) {
+	FILE *f = fopen("outputs/output_weight.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Tree *avl = createTree(createInt, destroyInt, createInt, destroyInt, compareInt);
+	Tree *weight = createTree(createInt, destroyInt, createInt, destroyInt, compareInt);
+
+	// Any tree can become a weighted tree, its heights are valid counts.
+	int key = 5000, value = 0;
+	insertNode(weight, &key, &value);
+	insertNode(avl, &key, &value);
+	ASSERT(f, setTreeBalance(weight, BALANCE_WEIGHT) == 0 &&
+			  setTreeBalance(weight, BALANCE_WAVL) == -1, "Weight-01");
+
+	// Same inserts in both trees, in a scattered order and with duplicates.
+	for (int i = 0; i < 4000; i++) {
+		key = (i * 7919) % 4000, value = i;
+		insertNode(avl, &key, &value);
+		insertNode(weight, &key, &value);
+		if (key % 7 == 0) {
+			insertNode(avl, &key, &value);
+			insertNode(weight, &key, &value);
+		}
+	}
+	ASSERT(f, check_links(weight->root) && same_entries(avl, weight), "Weight-02");
+
+	// A key searched often climbs up to the root, with its duplicate chain.
+	key = 1400;
+	TreeNode *found = NULL;
+	for (int i = 0; i < 10; i++)
+		found = search(weight, weight->root, &key);
+	ASSERT(f, found == weight->root && found->end != found &&
+			  *(int *)found->end->elem == 1400 && same_entries(avl, weight), "Weight-03");
+	key = -1;
+	ASSERT(f, search(weight, weight->root, &key) == NULL && weight->root == found, "Weight-04");
+
+	// Under skewed lookups the hot keys are near the root.
+	int hot[] = {17, 1234, 2048, 3999};
+	for (int i = 0; i < 1000; i++) {
+		key = (i % 10 < 9) ? hot[i % 4] : (i * 31) % 4000;
+		search(avl, avl->root, &key);
+		search(weight, weight->root, &key);
+	}
+	int avlDepth = 0, weightDepth = 0;
+	for (int i = 0; i < 4; i++) {
+		avlDepth += key_depth(avl, hot[i]);
+		weightDepth += key_depth(weight, hot[i]);
+	}
+	ASSERT(f, weightDepth <= 10 && weightDepth < avlDepth && check_links(weight->root) &&
+			  same_entries(avl, weight), "Weight-05");
+
+	// Deletes keep the order of the keys and of the counts, and the chains.
+	for (int i = 0; i < 3000; i++) {
+		key = (i * 2003) % 4000;
+		deleteNode(avl, &key);
+		deleteNode(weight, &key);
+	}
+	ASSERT(f, check_links(weight->root) && same_entries(avl, weight), "Weight-06");
+
+	for (key = 0; key <= 5000; key++)
+		while (search(weight, weight->root, &key)) deleteNode(weight, &key);
+	ASSERT(f, isEmpty(weight) && setTreeBalance(weight, BALANCE_AVL) == 0, "Weight-07");
+
+	// A deleted hot key leaves its count behind, the key taking its node keeps its own.
+	setTreeBalance(weight, BALANCE_WEIGHT);
+	for (key = 0; key < 1000; key++) insertNode(weight, &key, &value);
+	key = 500;
+	for (int i = 0; i < 20; i++) search(weight, weight->root, &key);
+	TreeNode *hotNode = key_node(weight, key);
+	int next = *(int *)minimum(hotNode->right)->elem, hotCount = hotNode->height;
+	int nextCount = key_node(weight, next)->height, wasRoot = hotNode == weight->root;
+	deleteNode(weight, &key);
+	ASSERT(f, wasRoot && key_node(weight, next)->height == nextCount && nextCount < hotCount &&
+			  check_links(weight->root) && !key_node(weight, key), "Weight-08");
+
+	// Compactions of the tombstones keep the counts, the hot key stays at the root.
+	setTreeTombstones(weight, 0.25);
+	key = 300;
+	for (int i = 0; i < 30; i++) search(weight, weight->root, &key);
+	hotCount = key_node(weight, key)->height;
+	size_t removals = weight->removals;
+	for (key = 600; key < 1000; key++) deleteNode(weight, &key);
+	key = 300;
+	ASSERT(f, weight->removals > removals && weight->tombstones < 400 && key_node(weight, key) == weight->root &&
+			  weight->root->height == hotCount && check_links(weight->root), "Weight-09");
+
+	destroyTree(avl);
+	destroyTree(weight);
+
+	fprintf(f, "\nAll tests for Weight passed!\n");
+	fclose(f);
+}
+
+void test_journal(void) {
+	FILE *f = fopen("outputs/output_journal.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	Func funcs = {{createStr, createIdx}, {destroyStr, destroyIdx}, compareStr,
+				  {packStr, packIdx, unpackStr, unpackIdx}, hashStr, NULL, {NULL, NULL, NULL, NULL}, sizeof(int64_t)};
+	char words[][8] = {"DELTA", "ALPHA", "CHARLIE", "BRAVO", "ALPHA", "ECHO", "FOXTROT"};
+	remove("outputs/words.journal");
+	remove("outputs/words.snap");
+
+	Journal *journal = openJournal("outputs/words.journal", "outputs/words.snap", &funcs);
+	ASSERT(f, journal != NULL && journal->tree->size == 0, "Journal-01");
+
+	Tree *tree = journal->tree;
+	for (int64_t i = 0; i < 5; i++)
+		insertNode(tree, words[i], &i);
+	deleteNode(tree, words[2]);
+	deleteNode(tree, words[5]);
+	ASSERT(f, commitJournal(journal) == 0 && journal->durable == 6, "Journal-02");
+	closeJournal(journal);
+	destroyTree(tree);
+
+	// Replay on open.
+	journal = openJournal("outputs/words.journal", "outputs/words.snap", &funcs);
+	tree = journal ? journal->tree : NULL;
+	ASSERT(f, tree != NULL && tree->size == 4, "Journal-03");
+	TreeNode *found = search(tree, tree->root, words[1]);
+	ASSERT(f, search(tree, tree->root, words[2]) == NULL && found != NULL &&
+			  found->end != found && *(int64_t *)found->end->value == 4, "Journal-04");
+
+	// Compaction leaves an empty journal on top of a fresh snapshot.
+	ASSERT(f, compactJournal(journal) == 0, "Journal-05");
+	FILE *log = fopen("outputs/words.journal", "rb");
+	fseek(log, 0, SEEK_END);
+	ASSERT(f, ftell(log) == (long)sizeof(JournalHeader), "Journal-06");
+	fclose(log);
+
+	int64_t value = 5;
+	insertNode(tree, words[5], &value);
+	closeJournal(journal);
+	destroyTree(tree);
+
+	// A torn record at the end is cut off.
+	log = fopen("outputs/words.journal", "ab");
+	fwrite("\x30\0\0\0\1", 1, 5, log);
+	fclose(log);
+
+	journal = openJournal("outputs/words.journal", "outputs/words.snap", &funcs);
+	tree = journal ? journal->tree : NULL;
+	ASSERT(f, tree != NULL && tree->size == 5 && search(tree, tree->root, words[5]) != NULL,
+		   "Journal-07");
+
+	value = 6;
+	insertNode(tree, words[6], &value);
+	closeJournal(journal);
+	destroyTree(tree);
+
+	journal = openJournal("outputs/words.journal", "outputs/words.snap", &funcs);
+	tree = journal ? journal->tree : NULL;
+	ASSERT(f, tree != NULL && tree->size == 6 && search(tree, tree->root, words[6]) != NULL,
+		   "Journal-08");
+	closeJournal(journal);
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Journal passed!\n");
+	fclose(f);
+}
+
 void test_inorder_key(Tree **tree) {
 	Range *key = inorderKeyQuery((*tree));
 
@@ -649,6 +2797,26 @@ int main(void) {
 	test_list_insert(&tree2);
 	test_list_delete(&tree2);
 	test_free(&tree1, &tree2);
+	test_adopt();
+	test_stats();
+	test_journal();
+	test_hash();
+	test_bloom();
+	test_finger();
+	test_memory();
+	test_balance();
+	test_weight();
+	test_tombstone();
+	test_split();
+	test_parallel();
+	test_walk();
+	test_cache();
+	test_view();
+	test_aggregate();
+	test_interval();
+	test_values();
+	test_append();
+	test_trace();
 
 	Tree *tree = NULL;
 	tree = createTree(
@@ -657,8 +2825,11 @@ int main(void) {
 		createIdx,
 		destroyIdx,
 		compareStr);
+	setTreeValueWidth(tree, sizeof(int64_t));
 
 	test_build_tree(&tree);
+	test_build_map(&tree);
+	test_snapshot(&tree);
 	test_inorder_key(&tree);
 	test_level_key(&tree);
 	test_range_key(&tree);
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "Func.h"
 
@@ -16,6 +17,8 @@ typedef struct TreeNode {
     void *elem;               // Pointer to element.
     void *value;              // Pointer to value.
     int height;           	  // Node height.
+    int dead;                 // Tombstone, the entry was deleted lazily.
+    size_t payload;           // Bytes of the element and value counted in the tree memory.
 
     struct TreeNode *parent;  // Parent node.
     struct TreeNode *left;    // Left child.
@@ -24,29 +27,110 @@ typedef struct TreeNode {
     struct TreeNode *end;     // Pointer to end node.
     struct TreeNode *next;    // Pointer to next node.
     struct TreeNode *prev;    // Pointer to previous node.
+
+    void *summary;            // Aggregates of a head (see setTreeAggregate), or NULL.
 } TreeNode;
 
+#define STATS_DEPTH 64
+#define STATS_CHAINS 32
+
+// Operations with their own counters.
+typedef enum StatOp { STAT_SEARCH, STAT_INSERT, STAT_DELETE, STAT_OPS } StatOp;
+// Rotations done by the AVL fix up, by unbalanced case.
+typedef enum StatRotate { ROTATE_LL, ROTATE_RR, ROTATE_LR, ROTATE_RL, ROTATE_TYPES } StatRotate;
+
+// Balancing policy of a tree, all keep the node layout and the threaded list.
+// AVL keeps heights exact, WAVL (weak AVL, rank balanced) relaxes them after
+// deletes and does at most two rotations per insert or delete. WEIGHT keeps
+// the keys ordered by access count (a treap whose priority is the count), so
+// the keys found most often by `search` sit near the root. Its searches update
+// the counts and may rotate, they need the write lock.
+typedef enum Balance { BALANCE_AVL, BALANCE_WAVL, BALANCE_WEIGHT, BALANCE_TYPES } Balance;
+
+// Runtime statistics of a tree (counters are filled only when built with AVL_STATS).
+typedef struct TreeStats {
+    int    enabled;                   /* 1 if the counters below are maintained.          */
+    size_t ops[STAT_OPS];             /* Calls of search, insert and delete.              */
+    size_t compares[STAT_OPS];        /* COMPARE calls made by each operation.            */
+    size_t totalCompares;             /* COMPARE calls made by all tree functions.        */
+    size_t rotations[ROTATE_TYPES];   /* Fix up rotations by case.                        */
+    size_t allocations;               /* Tree nodes allocated.                            */
+    size_t frees;                     /* Tree nodes released.                             */
+    size_t nodeBytes;                 /* Bytes currently used by tree nodes.              */
+    size_t peakNodeBytes;             /* Maximum of `nodeBytes`.                          */
+
+    // Computed from the tree shape when taking the snapshot.
+    size_t height;                    /* Height of the tree.                              */
+    size_t keys;                      /* Distinct keys (nodes of the AVL tree).           */
+    size_t entries;                   /* Entries including duplicates.                    */
+    size_t longestChain;              /* Entries of the longest duplicate chain.          */
+    size_t depth[STATS_DEPTH];        /* Keys found at each depth (root is depth 0).      */
+    size_t chains[STATS_CHAINS];      /* Keys with [2^i, 2^(i+1)) entries in their chain. */
+} TreeStats;
+
 typedef struct Tree {
     TreeNode *root;                 /* Pointer to first node in the dictionary. */
 	Func 	 lambda;               /* Choose function depending on request.   */
     size_t 	 size;                /* The number of nodes in the dictionary. */
+    struct Journal *journal;     /* Journal logging the updates, or NULL.   */
+    struct HashIndex *index;     /* Hash index of the keys, or NULL.        */
+    struct BloomFilter *bloom;   /* Bloom filter of the keys, or NULL.      */
+    size_t   removals;          /* Tree nodes unlinked, fingers check it.  */
+    Memory   memory;           /* Bytes allocated by the tree allocator.  */
+    Balance  balance;         /* Balancing policy, AVL by default.       */
+    size_t   tombstones;      /* Entries deleted lazily, still linked.   */
+    double   maxTombstones;   /* Ratio of tombstones that starts a compaction, 0 for eager deletes. */
+    struct Compactor *compactor; /* Thread running the compactions, or NULL. */
+    size_t   version;           /* Changes of the tree, cached results check it. */
+    struct QueryCache *cache;    /* Cache of the query results, or NULL.   */
+    struct KeyView *views;       /* Views updated by each change, or NULL. */
+    struct Aggregate *aggregate; /* Monoid summarized in each node, or NULL. */
+    struct ValueIndex *values;   /* Ordered index of the values, or NULL.  */
+#ifdef AVL_STATS
+    TreeStats stats;             /* Counters of the operations done on the tree. */
+#endif
 } Tree;
 
 // Similar to lambda functions.
 // Requests: create, delete, and compare elements and values.
 #define CREATE tree->lambda.create
 #define DELETE tree->lambda.delete
+
+// Statistics counters, they compile to nothing without AVL_STATS.
+// Concurrent readers count too, the counters are updated with relaxed atomics,
+// and each operation counts its compares from those of its own thread.
+#ifdef AVL_STATS
+extern _Thread_local size_t statCompares;
+#define COMPARE (statCompares++, STAT_INC(tree, totalCompares), tree->lambda.compare)
+#define STAT_INC(tree, field) __atomic_add_fetch(&(tree)->stats.field, 1, __ATOMIC_RELAXED)
+#define STAT_ADD(tree, field, n) __atomic_add_fetch(&(tree)->stats.field, (n), __ATOMIC_RELAXED)
+#define STAT_SUB(tree, field, n) __atomic_sub_fetch(&(tree)->stats.field, (n), __ATOMIC_RELAXED)
+#define STAT_OP_BEGIN(tree) size_t statMark = statCompares
+#define STAT_OP_END(tree, op) (STAT_INC(tree, ops[op]), STAT_ADD(tree, compares[op], statCompares - statMark))
+#else
 #define COMPARE tree->lambda.compare
+#define STAT_INC(tree, field) ((void)0)
+#define STAT_ADD(tree, field, n) ((void)0)
+#define STAT_SUB(tree, field, n) ((void)0)
+#define STAT_OP_BEGIN(tree) ((void)0)
+#define STAT_OP_END(tree, op) ((void)0)
+#endif
 
 // Create a new tree with the provided functions for:
 // element creation, deletion, value creation, deletion, and comparison.
 Tree* 			createTree			(Create createElem, Delete deleteElem,
 									 Create createVal,  Delete deleteVal,
 									 Compare compare);
+// Create a new tree whose memory (nodes, payloads, ranges) comes from an allocator.
+Tree* 			createTreeAlloc		(Create createElem, Delete deleteElem,
+									 Create createVal,  Delete deleteVal,
+									 Compare compare,   const Allocator *alloc);
 // Destroy the entire tree, including all nodes and associated data.
 void 			destroyTree			(Tree *tree);
 // Create a new tree node with the given element and value.
 TreeNode* 		createTreeNode		(Tree *tree, void *elem, void *value);
+// Create a new tree node that adopts the given element and value (no copies).
+TreeNode* 		createTreeNodeAdopt	(Tree *tree, void *elem, void *value);
 // Destroy a specific tree node and its associated data.
 void 		    destroyTreeNode		(Tree *tree, TreeNode *del);
 // Check if the tree is empty (contains no nodes).
@@ -63,12 +147,24 @@ TreeNode* 		successor			(TreeNode *root);
 TreeNode* 		predecessor			(TreeNode *root);
 // Insert a new node with the provided element and value into the tree.
 void 			insertNode			(Tree *tree, void *elem, void *value);
+// Insert a new node that takes ownership of the provided element and value (see `allocPayload`).
+int 			insertNodeAdopt		(Tree *tree, void *elem, void *value);
 // Delete a node with a specific element from the tree.
 void 			deleteNode			(Tree *tree, void *elem);
+// Delete a node with a specific element and hand its element and value to the caller (see `freePayload`).
+int 			deleteNodeExtract	(Tree *tree, void *elem, void **outElem, void **outValue);
+// Set the balancing policy of a tree (AVL, WAVL or WEIGHT).
+int 			setTreeBalance		(Tree *tree, Balance balance);
+// Set the width of the integer values read by the key queries (int by default).
+int 			setTreeValueWidth	(Tree *tree, size_t width);
 // Update the height of a tree node, used for AVL balancing.
 void 			updateHeight		(TreeNode *fix_node);
 // Get the balance factor of a tree node, used for AVL balancing.
 int 			getBalanceTree	    (TreeNode *fix_node);
+// Take a snapshot of the tree statistics (counters and shape).
+void 			getTreeStats		(Tree *tree, TreeStats *out);
+// Get the bytes allocated by the tree allocator, now and at most.
+void 			getTreeMemory		(Tree *tree, size_t *live, size_t *peak);
 // Perform a left rotation on the tree to maintain AVL balance.
 void 			avlRotateLeft		(Tree *tree, TreeNode *fix_node);
 // Perform a right rotation on the tree to maintain AVL balance.
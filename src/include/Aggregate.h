@@ -0,0 +1,68 @@
+#pragma once
+
+#ifndef _AGGREGATE_H_
+#define _AGGREGATE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "AVLTree.h"
+#include "Parallel.h"
+
+// Set an accumulator to the identity of a monoid.
+typedef void (*Identity)(void *ctx, void *acc);
+
+// User-defined monoid summarizing the live entries of a tree, in key order.
+// `map` adds one entry to an accumulator, `combine` appends another accumulator
+// (the entries of `other` come after the ones of `acc`), both must be associative
+// with `identity` as neutral element.
+typedef struct Monoid {
+	size_t size;               /* Bytes of an accumulator.                      */
+	Identity identity;         /* Function setting the empty accumulator.       */
+	Map map;                   /* Function adding an entry to an accumulator.   */
+	Combine combine;           /* Function appending an accumulator to another. */
+	void *ctx;                 /* State of the functions.                       */
+} Monoid;
+
+// Aggregates kept in each head node: its chain, then its sub-tree.
+typedef struct Aggregate {
+	Monoid monoid;             /* The monoid summarized.                        */
+	size_t stride;             /* Bytes of an accumulator, 16-byte aligned.     */
+	Memory *memory;            /* Memory of the tree, the summaries come from it. */
+} Aggregate;
+
+// Summary of 64-bit index values (see createIdx), the payload of the word trees.
+typedef struct OffsetSummary {
+	int64_t count;             /* Live entries.                                 */
+	int64_t letters;           /* Sum of the values modulo LETTER_LEN.          */
+	int64_t min;               /* Smallest value (offset), INT64_MAX if none.   */
+	int64_t max;               /* Greatest value (offset), INT64_MIN if none.   */
+} OffsetSummary;
+
+// Monoid of OffsetSummary.
+extern const Monoid offsetMonoid;
+
+// Keep the aggregates of a monoid in each node of a tree, NULL drops them (0 if refused).
+int 		setTreeAggregate	(Tree *tree, const Monoid *monoid);
+// Aggregate the live entries with a key in [left, right] (NULL for no bound) in O(log n).
+int 		rangeAggregate		(Tree *tree, void *left, void *right, void *result);
+// Aggregate of the live entries of the sub-tree of a head node, NULL if it has none.
+const void* nodeAggregate		(Tree *tree, TreeNode *node);
+// Allocate the aggregates of a new node before it is linked, 0 if refused.
+int 		reserveSummary		(Tree *tree, TreeNode *node);
+// Compute the chain aggregate of a head node again, after its chain changed.
+void 		refreshChain		(Tree *tree, TreeNode *head);
+// Add an entry appended to a duplicate chain and update the aggregates above it.
+void 		appendChain			(Tree *tree, TreeNode *head, TreeNode *entry);
+// Compute the sub-tree aggregate of a node from its children and its chain.
+void 		refreshNode			(Tree *tree, TreeNode *node);
+// Compute the sub-tree aggregates from a node up to the top of its tree.
+void 		refreshPath			(Tree *tree, TreeNode *node);
+// Compute every aggregate of a tree again, in O(n).
+void 		rebuildAggregates	(Tree *tree);
+// Free the aggregates of a node.
+void 		releaseSummary		(Tree *tree, TreeNode *node);
+
+#endif /* _AGGREGATE_H_ */
@@ -0,0 +1,70 @@
+#pragma once
+
+#ifndef _BLOOM_H_
+#define _BLOOM_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// The AVX2 probe is compiled for x86 whatever the flags, and picked at run time.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BLOOM_AVX2
+#include <immintrin.h>
+#endif
+
+#include "AVLTree.h"
+
+#define BLOOM_BLOCK_WORDS 8          /* 64-bit words in a block, one cache line.       */
+#define BLOOM_BLOCK_BITS 512        /* Bits in a block.                                */
+#define BLOOM_BITS_PER_KEY 10      /* Default size, about 1% false positives.         */
+#define BLOOM_MIN_KEYS 1024       /* Keys the smallest filter is sized for.          */
+
+// Blocked Bloom filter: a key sets one bit in each word of a single cache line.
+typedef struct BloomFilter {
+	uint64_t *blocks;          /* Blocks of BLOOM_BLOCK_WORDS words, 64-byte aligned. */
+	void *raw;                 /* Allocation holding the aligned blocks.               */
+	size_t count;              /* Number of blocks (a power of 2).                     */
+	Memory *memory;            /* Memory of the tree, the blocks come from it.         */
+	Hash hash;                 /* Function hashing the keys.                           */
+	size_t bitsPerKey;         /* Bits of filter per key, when sized.                  */
+	size_t capacity;           /* Keys the filter was sized for.                       */
+	size_t keys;               /* Keys added since the last build.                     */
+	size_t deletes;            /* Keys removed since the last build, still set.        */
+	size_t rebuilds;           /* Builds after growing or after deletes.               */
+	int simd;                  /* Probe the keys with AVX2, see setBloomSimd.          */
+
+	// Lookups of missing keys, updated by concurrent readers (relaxed atomics).
+	size_t negatives;          /* Rejected by the filter, the tree wasn't descended.   */
+	size_t falsePositives;     /* Accepted by the filter, but not in the tree.         */
+} BloomFilter;
+
+// Memory use and measured accuracy of a Bloom filter.
+typedef struct BloomStats {
+	size_t bytes;              /* Memory used by the blocks.                           */
+	size_t keys;               /* Keys set in the filter, removed ones included.       */
+	size_t rebuilds;           /* Builds after growing or after deletes.               */
+	size_t negatives;          /* Lookups of missing keys answered by the filter.      */
+	size_t falsePositives;     /* Lookups of missing keys that descended the tree.     */
+	double falsePositiveRate;  /* falsePositives / lookups of missing keys.            */
+} BloomStats;
+
+// Put a Bloom filter in front of the tree lookups, a NULL hash drops it (0 if refused).
+int 		setTreeBloom		(Tree *tree, Hash hash, size_t bitsPerKey);
+// Probe the keys with AVX2 or with scalar code (0 if there is no filter or no AVX2).
+int 		setBloomSimd		(Tree *tree, int simd);
+// Check if a key may be in the tree, 0 means it is surely missing.
+int 		bloomMayContain		(BloomFilter *filter, void *elem);
+// Add the key of a new head node to the filter.
+void 		bloomAdd			(Tree *tree, TreeNode *node);
+// Count a key removed from the tree, the filter is rebuilt after enough of them.
+void 		bloomRemove			(Tree *tree);
+// Count a lookup of a missing key, rejected by the filter or not.
+void 		bloomMiss			(BloomFilter *filter, int rejected);
+// Take a snapshot of the memory use and accuracy of the filter.
+void 		getBloomStats		(Tree *tree, BloomStats *out);
+// Free the memory of a Bloom filter.
+void 		destroyBloom		(BloomFilter *filter);
+
+#endif /* _BLOOM_H_ */
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "AVLTree.h"
+#include "Range.h"
+
+#define CACHE_ENTRIES 16             /* Default number of results kept. */
+
+// Queries whose results are cached.
+typedef enum QueryType { QUERY_LEVEL, QUERY_INORDER, QUERY_RANGE, QUERY_TYPES } QueryType;
+
+// Result of a query, valid while the tree has the same version.
+typedef struct CacheEntry {
+	QueryType type;            /* Query that built the result.                 */
+	void *left;                /* Copy of the left bound, or NULL.             */
+	void *right;               /* Copy of the right bound, or NULL.            */
+	size_t bytes;              /* Bytes of the copies, counted in the tree memory. */
+	size_t version;            /* `tree->version` when the result was built.   */
+	size_t lastUse;            /* Clock of the last hit, for the evictions.    */
+	Range *range;              /* The shared result, or NULL for a free entry. */
+} CacheEntry;
+
+// Bounded cache of query results, shared by the readers of a tree.
+typedef struct QueryCache {
+	CacheEntry *entries;       /* Entries of the cache.                        */
+	size_t capacity;           /* Number of entries.                           */
+	Memory *memory;            /* Memory of the tree, the entries come from it. */
+	Delete release;            /* Element function freeing the bound copies.   */
+	size_t clock;              /* Counts the lookups, orders the entries.      */
+	size_t hits;               /* Lookups answered by a cached result.         */
+	size_t misses;             /* Lookups whose result was built.              */
+	size_t evictions;          /* Results dropped to store another one.        */
+	size_t stale;              /* Results dropped after the tree changed.      */
+	pthread_mutex_t lock;      /* Protects the fields above.                   */
+} QueryCache;
+
+// Use and effect of a query cache.
+typedef struct CacheStats {
+	size_t capacity;           /* Results the cache can keep.                  */
+	size_t entries;            /* Results kept now, stale ones included.       */
+	size_t hits;               /* Lookups answered by a cached result.         */
+	size_t misses;             /* Lookups whose result was built.              */
+	size_t evictions;          /* Results dropped to store another one.        */
+	size_t stale;              /* Results dropped after the tree changed.      */
+	double hitRate;            /* hits / lookups.                              */
+} CacheStats;
+
+// Keep the results of the key queries of a tree, a capacity of 0 drops the cache (0 if refused).
+int 		setTreeCache		(Tree *tree, size_t capacity);
+// Find the result of a query built at the current version, shared with the caller.
+Range* 		cacheLookup			(Tree *tree, QueryType type, void *left, void *right);
+// Keep the result of a query built at the current version, shared with the caller.
+Range* 		cacheStore			(Tree *tree, QueryType type, void *left, void *right, Range *range);
+// Take a snapshot of the use of the cache.
+void 		getCacheStats		(Tree *tree, CacheStats *out);
+// Free the memory of a query cache, the results shared with callers stay valid.
+void 		destroyCache		(QueryCache *cache);
+
+#endif /* _CACHE_H_ */
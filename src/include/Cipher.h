@@ -6,9 +6,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "AVLTree.h"
 #include "Range.h"
+#include "Token.h"
 
 // Vigenere keys E(0) / D(26)
 #define ENCRYPT 0
@@ -18,8 +23,40 @@
 #define WORD_SEPARATOR ",.? \n\r"
 #define TO_UPPER(c) ((c >= 'a' && c <= 'z') ? (c - 'a' + 'A') : c)
 
+// Input file mapped in memory, words are views into the mapping (no copies).
+typedef struct Corpus {
+	const char *data;     /* Mapped content of the file.      */
+	size_t size;         /* Size of the mapping.             */
+	View *words;        /* Views of each word in the file.  */
+	int64_t *offsets;  /* Offset associated with each word. */
+	size_t count;     /* Number of words in the file.      */
+} Corpus;
+
+// Resumable build of an append-only file, each call reads the bytes appended since the last one.
+typedef struct Build {
+	char *file;           /* Copy of the path of the file.                       */
+	Tree *tree;           /* Tree receiving the words.                           */
+	size_t done;          /* Bytes whose words are in the tree for good.         */
+	int64_t offset;       /* Offset of the first word after them.                */
+	size_t tail;          /* Bytes of the last word, cut off by the end of file. */
+} Build;
+
 // Reads data from the specified file and constructs an AVL tree.
 void 		buildTreeFromFile		(const char * file, Tree *tree);
+// Builds an AVL tree from the specified file, and keeps where the build stopped.
+Build* 		openBuild				(const char * file, Tree *tree);
+// Adds the words appended to the file since the last call, returns their number or -1.
+long 		resumeBuild				(Build *build);
+// Releases a build handle, the tree is kept.
+void 		closeBuild				(Build *build);
+// Maps the specified file in memory and constructs an AVL tree of borrowed word views.
+Corpus* 	buildTreeFromMap		(const char * file, Tree *tree);
+// Maps the specified file in memory and splits it into word views.
+Corpus* 	mapCorpus				(const char * file);
+// Stores a word span as the next view of a corpus (tokenizer callback).
+void 		collectSpan				(void *ctx, const Span *span);
+// Releases the views and unmaps the file, trees using it must be destroyed first.
+void 		unmapCorpus				(Corpus *corpus);
 // Reads the input file, encrypts its contents using the provided element as a key,
 // and saves the encrypted data to the output file (Vigenere CODE - encryptCharacter).
 void 		printKey				(const char * file, Range *elem);
@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef _FINGER_H_
+#define _FINGER_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVLTree.h"
+
+// Search handle remembering the last visited node, one per thread (or caller).
+typedef struct Finger {
+	Tree *tree;             /* Tree searched through the finger.                     */
+	TreeNode *node;        /* Last visited tree node, or NULL.                      */
+	size_t removals;      /* `tree->removals` when `node` was stored.              */
+	size_t near;         /* Lookups answered without going up to the root.        */
+	size_t descents;    /* Lookups that fell back to a descent from the root.    */
+} Finger;
+
+// Bind a finger to a tree, the first search starts from the root.
+void 		initFinger			(Finger *finger, Tree *tree);
+// Search for an element starting from the last visited node.
+TreeNode* 	fingerSearch		(Finger *finger, void *elem);
+
+#endif /* _FINGER_H_ */
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #define LENGTH_ELEMENT 5
 
@@ -17,6 +18,41 @@ typedef void* 	 (*Create)		 (void *elem);
 typedef void 	 (*Delete)		 (void *elem);
 // Compare function for comparing keys.
 typedef int      (*Compare)		 (void *elem1, void *elem2);
+// Pack function for serializing elements, returns the size (nothing is written if buffer is NULL).
+typedef size_t   (*Pack)		 (void *elem, void *buffer);
+// Unpack function for rebuilding an element from its serialized bytes.
+typedef void*    (*Unpack)		 (const void *buffer, size_t size);
+// Hash function for keys, equal keys (for the compare function) have equal hashes.
+typedef uint64_t (*Hash)		 (void *elem);
+// Allocator functions, `ctx` is the state of the allocator (arena, pool, budget).
+// Sizes are handed back on resize and release, so allocators need no headers.
+typedef void*    (*Alloc)		 (void *ctx, size_t size);
+typedef void*    (*Resize)		 (void *ctx, void *ptr, size_t oldSize, size_t size);
+typedef void     (*Release)		 (void *ctx, void *ptr, size_t size);
+
+// Allocator of the memory of a tree, malloc/realloc/free for NULL functions.
+// Concurrent readers of a tree allocate query ranges, so it must be thread safe then.
+// Payloads come from malloc, they are only counted. A refusal fails the call that asked
+// for the memory (insert, setter, query), the tree is left as it was.
+typedef struct Allocator {
+    Alloc alloc;                   /* Function to allocate memory, NULL when out of budget */
+    Resize resize;                 /* Function to resize memory (optional, alloc + copy + release) */
+    Release release;               /* Function to release memory */
+    void *ctx;                     /* State passed to the functions */
+} Allocator;
+
+// Memory allocated through an allocator, counted in bytes.
+typedef struct Memory {
+    const Allocator *allocator;    /* Allocator of the memory (NULL for malloc) */
+    size_t live;                   /* Bytes currently allocated */
+    size_t peak;                   /* Maximum of `live` */
+} Memory;
+
+// Borrowed string, a word stored as a (pointer, length) view into a buffer it doesn't own.
+typedef struct View {
+    const char *data;              /* Start of the word inside the buffer */
+    size_t length;                 /* Number of characters in the word */
+} View;
 
 // Structure to hold function pointers.
 
@@ -34,8 +70,34 @@ typedef struct Functions {
     } delete;
 
     Compare compare;               /* Function to compare two keys */
+
+    // Structure for serializing elements (optional, used by snapshots).
+    struct {
+        Pack packElem;             /* Function to serialize an elem object */
+        Pack packVal;              /* Function to serialize a value object */
+        Unpack unpackElem;         /* Function to rebuild an elem object */
+        Unpack unpackVal;          /* Function to rebuild a value object */
+    } io;
+
+    Hash hash;                     /* Function to hash a key (optional, used by the hash index) */
+
+    Compare compareVal;            /* Function to compare two values (optional, used by the value index) */
+
+    Allocator alloc;               /* Allocator of the tree memory (optional, malloc by default) */
+
+    size_t valueWidth;             /* Bytes of the integer values read by the key queries (optional, int by default) */
 } Func;
 
+// Functions for allocating through an allocator, counting the bytes.
+void*     memAlloc        (Memory *memory, size_t size);
+void*     memResize       (Memory *memory, void *ptr, size_t oldSize, size_t size);
+void      memFree         (Memory *memory, void *ptr, size_t size);
+void      memTransfer     (Memory *from, Memory *to, size_t size);
+// Functions for allocating payloads (elements and values), counted by the trees holding them.
+// Payloads are heap blocks, the provided delete functions release malloc'd data too.
+size_t    payloadBytes    (void);
+void*     allocPayload    (size_t size);
+void      freePayload     (void *payload);
 // Functions for creating, destroying, and comparing integers.
 void*     createInt       (void* value);
 void      destroyInt      (void *value);
@@ -44,8 +106,25 @@ int       compareInt      (void *value1, void *value2);
 void*     createStr       (void *str);
 void      destroyStr      (void *str);
 int       compareStr      (void *str1, void *str2);
-// Functions for creating and destroying integer indexes.
+// Functions for creating and destroying 64-bit integer indexes.
 void*     createIdx       (void *index);
 void      destroyIdx      (void *index);
+int       compareIdx      (void *index1, void *index2);
+// Functions for serializing integers, strings and 64-bit integer indexes.
+size_t    packInt         (void *value, void *buffer);
+void*     unpackInt       (const void *buffer, size_t size);
+size_t    packStr         (void *str, void *buffer);
+void*     unpackStr       (const void *buffer, size_t size);
+size_t    packIdx         (void *index, void *buffer);
+void*     unpackIdx       (const void *buffer, size_t size);
+// Functions for hashing integers, strings and string views.
+uint64_t  hashInt         (void *value);
+uint64_t  hashStr         (void *str);
+uint64_t  hashView        (void *view);
+// Functions for borrowing data owned by someone else (no copy, no free).
+void*     borrowElem      (void *elem);
+void      releaseElem     (void *elem);
+// Function for comparing string views, the whole word is compared.
+int       compareView     (void *view1, void *view2);
 
 #endif /* _FUNC_H_ */
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "AVLTree.h"
+
+#define HASH_MIN_CAPACITY 16
+// Fibonacci hashing spreads weak hashes (e.g. small integers) over the table.
+#define HASH_SPREAD 0x9E3779B97F4A7C15ull
+
+// Slot of the hash index, empty when `node` is NULL.
+typedef struct HashSlot {
+	uint64_t hash;          /* Hash of the key, compared before the key itself. */
+	TreeNode *node;        /* Head of the duplicate chain holding the key.      */
+} HashSlot;
+
+// Open addressing (linear probing) index from the keys to their tree nodes.
+typedef struct HashIndex {
+	HashSlot *slots;        /* Table of `capacity` slots (a power of 2).    */
+	size_t capacity;       /* Number of slots.                             */
+	size_t count;         /* Keys in the index.                           */
+	int shift;           /* 64 - log2(capacity), for Fibonacci hashing.  */
+	Memory *memory;     /* Memory of the tree, the slots come from it.  */
+} HashIndex;
+
+// Set the hash function of a tree and index its keys, NULL drops the index (0 if refused).
+int 		setTreeHash			(Tree *tree, Hash hash);
+// Find the head node holding a key in the index.
+TreeNode* 	hashFind			(Tree *tree, void *elem);
+// Make room for one more key before an insert, 0 if the insert must fail.
+int 		hashReserve			(Tree *tree);
+// Add a new head node to the index.
+void 		hashInsert			(Tree *tree, TreeNode *node);
+// Remove a head node from the index.
+void 		hashRemove			(Tree *tree, TreeNode *node);
+// Exchange the slots of two head nodes whose keys are being swapped.
+void 		hashSwap			(Tree *tree, TreeNode *first, TreeNode *second);
+// Free the memory of a hash index.
+void 		destroyHashIndex	(HashIndex *index);
+
+#endif /* _HASH_H_ */
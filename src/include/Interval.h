@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef _INTERVAL_H_
+#define _INTERVAL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "AVLTree.h"
+#include "Parallel.h"
+#include "Aggregate.h"
+
+// Span of bytes [start, end) covered by a word, the key of an interval tree.
+typedef struct Interval {
+	int64_t start;             /* Offset of the first byte.                     */
+	int64_t end;               /* Offset after the last byte.                   */
+} Interval;
+
+// Monoid of the greatest end of the intervals, INT64_MIN if none.
+extern const Monoid endMonoid;
+
+// Element functions of the interval keys, ordered by start then end.
+void* 		createInterval		(void *interval);
+void 		destroyInterval		(void *interval);
+int 		compareInterval		(void *interval1, void *interval2);
+
+// Create a tree of word spans keyed by start offset, each node keeps the greatest end below it.
+Tree* 		createIntervalTree	(void);
+// Insert a word as the span [offset, offset + strlen(word)), then move the offset past it.
+void 		insertWordInterval	(Tree *tree, const char *word, int64_t *offset);
+// Read the words of a file into an interval tree, with the offsets of `buildTreeFromFile`.
+void 		buildIntervalsFromFile	(const char *file, Tree *tree);
+// Visit the live spans overlapping [from, to) in start order, returns their number.
+size_t 		overlapQuery		(Tree *tree, int64_t from, int64_t to, Visit visit, void *ctx);
+// Visit the live spans holding the byte at `point` in start order, returns their number.
+size_t 		stabQuery			(Tree *tree, int64_t point, Visit visit, void *ctx);
+
+#endif /* _INTERVAL_H_ */
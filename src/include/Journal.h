@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "AVLTree.h"
+
+#define JOURNAL_MAGIC "AVLJ"
+#define JOURNAL_VERSION 1
+#define JOURNAL_BUFFER 4096
+
+// Updates logged in the journal.
+typedef enum JournalOp { JOURNAL_INSERT = 1, JOURNAL_DELETE = 2 } JournalOp;
+
+// Header of a journal file, followed by the records.
+// Record: size (u32) and checksum (u32) of the body, then the body: the operation (u8),
+// the element (u32 size + bytes) and, for inserts, the value (u32 size + bytes).
+typedef struct JournalHeader {
+	char magic[4];       /* JOURNAL_MAGIC.                                         */
+	uint32_t version;   /* JOURNAL_VERSION.                                       */
+	uint64_t base;     /* Checksum of the snapshot the records apply on, or 0.  */
+} JournalHeader;
+
+// Write-ahead journal of the updates of a tree.
+typedef struct Journal {
+	Tree *tree;                /* Tree whose updates are logged.                  */
+	char *path;                /* Journal file.                                   */
+	char *snapshot;            /* Snapshot file the journal applies on.           */
+	int fd;                    /* Journal file, opened for appending.             */
+
+	pthread_mutex_t lock;      /* Protects the fields below.                      */
+	pthread_cond_t synced;     /* Signaled at the end of each group commit.       */
+	char *pending;             /* Records appended since the last group commit.   */
+	size_t length;             /* Bytes used in `pending`.                        */
+	size_t capacity;           /* Size of `pending`.                              */
+	char *writing;             /* Records being written by the commit leader.     */
+	size_t writeCapacity;      /* Size of `writing`.                              */
+	uint64_t appended;         /* Records appended.                               */
+	uint64_t durable;          /* Records written and synced to disk.             */
+	size_t syncs;              /* Group commits done (one fsync each).            */
+	int syncing;               /* A leader is writing and syncing a batch.        */
+	int failed;                /* A write failed, nothing is durable anymore.     */
+} Journal;
+
+// Load the snapshot and replay the journal on it, then log the updates of the tree.
+Journal* 	openJournal			(const char *path, const char *snapshot, const Func *funcs);
+// Log an update of the tree (called by the tree functions).
+int 		appendJournal		(Journal *journal, JournalOp op, void *elem, void *value);
+// Wait until every update logged so far is on disk, sharing the fsync with other writers.
+int 		commitJournal		(Journal *journal);
+// Save the tree in a fresh snapshot and start an empty journal on top of it.
+int 		compactJournal		(Journal *journal);
+// Commit the journal and detach it from the tree (the tree is not destroyed).
+int 		closeJournal		(Journal *journal);
+
+#endif /* _JOURNAL_H_ */
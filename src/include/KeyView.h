@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef _KEYVIEW_H_
+#define _KEYVIEW_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVLTree.h"
+#include "Range.h"
+
+#define VIEW_CHUNK 64                /* Entries of a full chunk. */
+
+// Consecutive entries of a view, in key order.
+typedef struct ViewChunk {
+	size_t count;                /* Entries used in the chunk.                     */
+	void *elems[VIEW_CHUNK];     /* Keys of the entries, owned by the tree.        */
+	int letters[VIEW_CHUNK];     /* Values of the entries (see `letterKey`).       */
+} ViewChunk;
+
+// Materialized in-order key query, updated by each change of the tree.
+typedef struct KeyView {
+	Tree *tree;                  /* Tree viewed.                                   */
+	void *left;                  /* Copy of the left bound, or NULL.               */
+	void *right;                 /* Copy of the right bound, or NULL.              */
+	size_t bytes;                /* Bytes of the copies, counted in the tree memory. */
+	ViewChunk **chunks;          /* Chunks of the view, in key order.              */
+	size_t count;                /* Chunks used.                                   */
+	size_t capacity;             /* Size of the chunk array.                       */
+	size_t size;                 /* Live entries of the view.                      */
+	ViewChunk *spare;            /* Free chunk for the next split, or NULL.        */
+	struct KeyView *next;        /* Next view of the tree.                         */
+} KeyView;
+
+// Register a view of the live entries with a key in [left, right] (NULL for no bound).
+KeyView* 	createKeyView		(Tree *tree, void *left, void *right);
+// Copy the values of a view to a Range, without walking the tree.
+Range* 		keyViewRange		(KeyView *view);
+// Unregister a view and free its memory.
+void 		destroyKeyView		(KeyView *view);
+// Make room in the views for a new entry, 0 if the insert must fail.
+int 		viewReserve			(Tree *tree, void *elem);
+// Add a live entry of the tree to its views.
+void 		viewInsert			(Tree *tree, TreeNode *entry);
+// Remove a live entry of the tree from its views.
+void 		viewRemove			(Tree *tree, void *elem);
+// Remove the entries with a key in [left, right] from the views (NULL for no bound).
+void 		viewRemoveRange		(Tree *tree, void *left, void *right);
+
+#endif /* _KEYVIEW_H_ */
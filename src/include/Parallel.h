@@ -0,0 +1,30 @@
+#pragma once
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "AVLTree.h"
+
+#define WALK_BATCH 64                 /* Entries of a chain visited before the rest can be stolen. */
+
+// Visit function of a parallel traversal, called once per live entry by any thread.
+typedef void  (*Visit)   (void *ctx, TreeNode *entry);
+// Map function of a parallel reduce, folds an entry into the accumulator of a thread.
+typedef void  (*Map)     (void *ctx, void *acc, TreeNode *entry);
+// Combine function of a parallel reduce, folds the accumulator `other` into `acc`.
+typedef void  (*Combine) (void *ctx, void *acc, const void *other);
+
+// Visit every live entry of a tree with several threads, in no particular order.
+void 		treeForEachParallel		(Tree *tree, Visit visit, void *ctx, int threads);
+// Reduce the live entries of a tree into `result` with several threads.
+void 		treeReduceParallel		(Tree *tree, void *result, size_t size, Map map,
+									 Combine combine, void *ctx, int threads);
+// Destroy the entire tree, the nodes are released by several threads.
+void 		destroyTreeParallel		(Tree *tree, int threads);
+
+#endif /* _PARALLEL_H_ */
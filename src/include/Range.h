@@ -11,6 +11,7 @@
 
 #define INIT_LEN 1
 #define LETTER_LEN 26
+#define RANGE_PIECES 8
 
 // Structure to represent a range of values.
 
@@ -18,13 +19,31 @@ typedef struct Range {
 	int *index;          /* Array of integer values.   */
 	size_t size;	    /* Current size of the range. */
 	size_t capacity;   /* Capacity of the range.     */	
+	Memory memory;    /* Bytes of the range, from the allocator of the tree queried. */
+	Allocator allocator; /* Copy of that allocator, the range may outlive the tree. */
+	size_t refs;      /* Owners of the range, the query cache included. */
 } Range;
 
+// The key queries return the values of the entries modulo LETTER_LEN. The values are read
+// as int, or as 64-bit indexes (`createIdx`) for the trees setting that width (`setTreeValueWidth`).
+// A query returns NULL when the allocator of the tree refuses its memory.
+
 // Function to perform a level-based key query on a tree.
 Range* 		levelKeyQuery		(Tree* tree);
 // Function to perform an inorder key query on a tree.
 Range* 		inorderKeyQuery		(Tree* tree);
 // Function to perform a range-based key query on a tree.
 Range* 		rangeKeyQuery		(Tree* tree, const char* const left, const char* const right);
+// Function to perform an inorder key query on a tree with several threads.
+Range* 		inorderKeyQueryParallel	(Tree* tree, int threads);
+// Function to perform a range-based key query on a tree with several threads.
+Range* 		rangeKeyQueryParallel	(Tree* tree, const char* const left, const char* const right, int threads);
+// Function to delete every entry with a key in [left, right] from a tree.
+size_t 		deleteRange			(Tree* tree, void* left, void* right);
+// Function to move every entry with a key in [left, right] to a new tree.
+Tree* 		extractRange		(Tree* tree, void* left, void* right);
+// Function to free a range returned by a query, before or after its tree is destroyed.
+// Ranges may be shared with the query cache of the tree (see setTreeCache), they are read-only.
+void 		destroyRange		(Range* range);
 
 #endif /* _RANGE_H_ */
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "AVLTree.h"
+
+#define SNAPSHOT_MAGIC "AVLT"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BUFFER (1 << 20)
+
+// Header of a snapshot file, followed by `bytes` of payload.
+// Payload: for each key in order, the chain length (u64), the key (u32 size + bytes),
+// then the value of each entry of the chain (u32 size + bytes). Native byte order.
+typedef struct SnapshotHeader {
+	char magic[4];          /* SNAPSHOT_MAGIC.                   */
+	uint32_t version;      /* SNAPSHOT_VERSION.                 */
+	uint64_t keys;        /* Distinct keys in the tree.        */
+	uint64_t entries;    /* Entries, duplicates included.     */
+	uint64_t bytes;     /* Size of the payload.              */
+	uint64_t checksum; /* FNV-1a 64 checksum of the payload. */
+} SnapshotHeader;
+
+// Set the functions used to serialize the elements and values of a tree.
+void 		setTreeIO			(Tree *tree, Pack packElem, Unpack unpackElem,
+								 Pack packVal, Unpack unpackVal);
+// Write the tree in a binary snapshot file, returns 0 on success and -1 otherwise.
+int 		saveTree			(Tree *tree, const char *path);
+// Rebuild a tree from a binary snapshot file in linear time (no comparisons).
+Tree* 		loadTree			(const char *path, const Func *funcs);
+
+#endif /* _SNAPSHOT_H_ */
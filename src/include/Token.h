@@ -0,0 +1,41 @@
+#pragma once
+
+#ifndef _TOKEN_H_
+#define _TOKEN_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Number of bytes classified at once by the vectorized tokenizer.
+#if defined(__AVX2__)
+#define TOKEN_BLOCK 32
+#elif defined(__SSE2__)
+#define TOKEN_BLOCK 16
+#else
+#define TOKEN_BLOCK 8
+#endif
+
+// A word found in a buffer, the buffer itself is never modified.
+typedef struct Span {
+	const char *word;     /* Start of the word inside the buffer.    */
+	size_t length;       /* Number of characters in the word.       */
+	int64_t offset;     /* Sum of the lengths of the previous words. */
+} Span;
+
+// Callback receiving each word found by the tokenizer.
+typedef void (*SpanFn)(void *ctx, const Span *span);
+
+// Splits a buffer into words separated by `WORD_SEPARATOR`, emitting a span for each one.
+// `offset` is the running offset, updated with the length of every emitted word.
+size_t 		tokenize			(const char *data, size_t length, int64_t *offset,
+								 SpanFn emit, void *ctx);
+// Returns a bit mask of the separators from the first `TOKEN_BLOCK` bytes of `data`.
+uint64_t 	separatorMask		(const char *data);
+
+#endif /* _TOKEN_H_ */
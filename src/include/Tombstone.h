@@ -0,0 +1,42 @@
+#pragma once
+
+#ifndef _TOMBSTONE_H_
+#define _TOMBSTONE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "AVLTree.h"
+
+#define TOMBSTONE_MIN 64              /* Tombstones below which no compaction starts. */
+
+// Background thread compacting a tree, it takes the lock of the tree owner.
+typedef struct Compactor {
+	Tree *tree;                  /* Tree compacted by the thread.                  */
+	pthread_rwlock_t *lock;      /* Lock of the tree, taken for writing.           */
+	pthread_t thread;            /* The compaction thread.                         */
+	pthread_mutex_t mutex;       /* Protects the fields below.                     */
+	pthread_cond_t wake;         /* Signaled when a compaction is due or to stop.  */
+	int pending;                 /* A compaction was asked for.                    */
+	int stop;                    /* The thread must exit.                          */
+	size_t runs;                 /* Compactions done by the thread.                */
+} Compactor;
+
+// Delete lazily: entries become tombstones, compacted past a ratio (0 deletes eagerly again).
+void 		setTreeTombstones	(Tree *tree, double ratio);
+// Mark the last live entry of an element as a tombstone.
+int 		buryEntry			(Tree *tree, void *elem);
+// Give a tombstone of a key the data of a new node, the node is freed.
+void 		reviveEntry			(Tree *tree, TreeNode *head, TreeNode *node);
+// Free the tombstones of one key, so its entries can be removed eagerly.
+void 		purgeEntry			(Tree *tree, void *elem);
+// Free every tombstone and rebuild the tree from the live keys, in O(n).
+size_t 		compactTree			(Tree *tree);
+// Run the compactions of a tree on a background thread, under the given lock.
+Compactor* 	startCompactor		(Tree *tree, pthread_rwlock_t *lock);
+// Stop the background thread and detach it from the tree.
+void 		stopCompactor		(Compactor *compactor);
+
+#endif /* _TOMBSTONE_H_ */
@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define TRACE_EVENTS 16384           /* Events kept by each thread, the oldest are overwritten. */
+
+// One timed call, a Chrome "complete" event.
+typedef struct TraceEvent {
+	const char *name;            /* Name of the phase or call (a string literal).  */
+	uint64_t start;              /* Start time in nanoseconds.                     */
+	uint64_t duration;           /* Duration in nanoseconds.                       */
+} TraceEvent;
+
+// Ring buffer of the events of one thread, only its thread writes to it.
+typedef struct TraceBuffer {
+	TraceEvent events[TRACE_EVENTS]; /* The ring of events.                        */
+	size_t written;              /* Events recorded, the ring holds the last ones. */
+	int tid;                     /* Thread number in the trace.                    */
+	int retired;                 /* The thread exited, freed by the next stop.     */
+	struct TraceBuffer *next;    /* Next buffer of the registry.                   */
+} TraceBuffer;
+
+// Scope being timed, closed when it goes out of scope.
+typedef struct TraceScope {
+	const char *name;            /* Name of the scope.                             */
+	uint64_t start;              /* Start time, 0 when tracing was off.            */
+} TraceScope;
+
+// Scoped tracing, it compiles to nothing without AVL_TRACE (see `make TRACE=1`).
+// Nested scopes get their own variable, named after their line.
+#ifdef AVL_TRACE
+#define TRACE_ENABLED 1
+#define TRACE_JOIN(a, b) a##b
+#define TRACE_VAR(line) TRACE_JOIN(traceScope, line)
+#define TRACE_SCOPE(name) TraceScope TRACE_VAR(__LINE__) __attribute__((cleanup(traceLeave))) = traceEnter(name)
+#else
+#define TRACE_ENABLED 0
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+
+// Start recording the traced scopes of every thread, written to `path` by `stopTrace`.
+int 		startTrace			(const char *path);
+// Stop recording and write the events as Chrome trace-event JSON, returns their number or -1.
+long 		stopTrace			(void);
+// Open a traced scope (see TRACE_SCOPE).
+TraceScope 	traceEnter			(const char *name);
+// Close a traced scope and record its event in the ring of the thread.
+void 		traceLeave			(TraceScope *scope);
+
+#endif /* _TRACE_H_ */
@@ -0,0 +1,50 @@
+#pragma once
+
+#ifndef _VALUEINDEX_H_
+#define _VALUEINDEX_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "AVLTree.h"
+#include "Parallel.h"
+
+#define VALUE_CHUNK 64               /* Entries of a full chunk. */
+
+// Consecutive entries of a value index, in value order.
+typedef struct ValueChunk {
+	size_t count;                /* Entries used in the chunk.                     */
+	TreeNode *entries[VALUE_CHUNK]; /* Entries of the tree, not copies.            */
+} ValueChunk;
+
+// Secondary index of the live entries of a tree, ordered by value.
+typedef struct ValueIndex {
+	ValueChunk **chunks;         /* Chunks of the index, in value order.           */
+	size_t count;                /* Chunks used.                                   */
+	size_t capacity;             /* Size of the chunk array.                       */
+	size_t size;                 /* Entries of the index.                          */
+	ValueChunk *spare;           /* Free chunk for the next split, or NULL.        */
+	Memory *memory;              /* Memory of the tree, the chunks come from it.   */
+} ValueIndex;
+
+// Set the value compare function of a tree and index its entries by value, NULL drops the index (0 if refused).
+int 		setTreeValueIndex	(Tree *tree, Compare compareVal);
+// Find the first live entry with a value, NULL if none.
+TreeNode* 	valueSearch			(Tree *tree, void *value);
+// Find the last live entry with a value not above the given one, NULL if none.
+TreeNode* 	valueFloor			(Tree *tree, void *value);
+// Visit the live entries with a value in [low, high] (NULL for no bound) in value order.
+size_t 		valueRangeQuery		(Tree *tree, void *low, void *high, Visit visit, void *ctx);
+// Free the memory of a value index.
+void 		destroyValueIndex	(ValueIndex *index);
+// Make room in the value index for a new entry, 0 if the insert must fail.
+int 		valueReserve		(Tree *tree);
+// Add a live entry of the tree to its value index.
+void 		valueInsert			(Tree *tree, TreeNode *entry);
+// Remove a live entry of the tree from its value index.
+void 		valueRemove			(Tree *tree, TreeNode *entry);
+// Point the index to the node now holding the data of another one.
+void 		valueMove			(Tree *tree, TreeNode *from, TreeNode *to);
+
+#endif /* _VALUEINDEX_H_ */
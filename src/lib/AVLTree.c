@@ -1,4 +1,12 @@
 #include "../include/AVLTree.h"
+#include "../include/Journal.h"
+#include "../include/Hash.h"
+#include "../include/Bloom.h"
+#include "../include/Tombstone.h"
+#include "../include/Cache.h"
+#include "../include/KeyView.h"
+#include "../include/Aggregate.h"
+#include "../include/ValueIndex.h"
 #include "../utils/Utils.h"
 
 /**
@@ -14,20 +22,77 @@
 Tree* createTree(Create createElem, Delete deleteElem,
                  Create createVal, Delete deleteVal,
                  Compare compare) {
-	// Allocate a new tree.
-    Tree *tree = (Tree *)malloc(sizeof(Tree));
+    return createTreeAlloc(createElem, deleteElem, createVal, deleteVal, compare, NULL);
+}
+
+/**
+ * @brief Create a tree object allocating its memory from an allocator.
+ * The tree, its nodes, its indexes and its query ranges come from the
+ * allocator. The payloads (elements and values) come from malloc, so they
+ * can be handed out and outlive the tree, and are counted with their nodes
+ * (see `payloadBytes`). `tree->memory` counts the tree, its nodes, its
+ * indexes and its payloads. A query range counts its own bytes, so it may
+ * be destroyed after the tree. A refused allocation fails the call that
+ * asked for it and leaves the tree as it was: an insert whose node, index
+ * slots, view or value chunks or aggregates are refused isn't made, the
+ * setters of the indexes return 0 and the queries return NULL.
+ * 
+ * @param createElem Function to create a element object.
+ * @param deleteElem Function to destroy a element object.
+ * @param createVal  Function to create a value object.
+ * @param deleteVal  Function to destroy a value object.
+ * @param compare    Function two compare two values/keys.
+ * @param alloc      The allocator (copied in the tree), or NULL for malloc.
+ * @return Tree* pointer to an allocated tree object or NULL.
+ */
+Tree* createTreeAlloc(Create createElem, Delete deleteElem,
+                      Create createVal, Delete deleteVal,
+                      Compare compare, const Allocator *alloc) {
+	// Allocate a new tree, counted in its own memory.
+    Memory memory = { alloc, 0, 0 };
+    Tree *tree = (Tree *)memAlloc(&memory, sizeof(Tree));
 
 	// Check if tree was allocated successfully.
     if (tree) {
+        // The tree keeps its own copy of the allocator.
+        memset(&tree->lambda.alloc, 0, sizeof(tree->lambda.alloc));
+        if (alloc) tree->lambda.alloc = *alloc;
+        tree->memory = memory;
+        tree->memory.allocator = &tree->lambda.alloc;
 		// Default values new tree allocated.
         tree->size = 0;
         tree->root = NULL;
+        tree->journal = NULL;
+        tree->index = NULL;
+        tree->bloom = NULL;
+        tree->removals = 0;
+        tree->balance = BALANCE_AVL;
+        tree->tombstones = 0;
+        tree->maxTombstones = 0;
+        tree->compactor = NULL;
+        tree->version = 0;
+        tree->cache = NULL;
+        tree->views = NULL;
+        tree->aggregate = NULL;
+        tree->values = NULL;
         // Assign function pointers using macros.
         CREATE.createElem = createElem;
     	CREATE.createVal = createVal;
         DELETE.deleteElem = deleteElem;
         DELETE.deleteVal = deleteVal;
-        COMPARE = compare;
+        tree->lambda.compare = compare;
+        // Serialization is optional, see setTreeIO.
+        memset(&tree->lambda.io, 0, sizeof(tree->lambda.io));
+        // Hashing is optional too, see setTreeHash.
+        tree->lambda.hash = NULL;
+        // And so is the value order, see setTreeValueIndex.
+        tree->lambda.compareVal = NULL;
+        // The key queries read int values by default, see setTreeValueWidth.
+        tree->lambda.valueWidth = sizeof(int);
+#ifdef AVL_STATS
+        memset(&tree->stats, 0, sizeof(tree->stats));
+        tree->stats.enabled = 1;
+#endif
     }
 
 	// Return the new allocated tree.
@@ -46,23 +111,70 @@ TreeNode* createTreeNode(Tree *tree, void *elem, void *value) {
 	// Check if input is valid.
 	if (!tree) return NULL;
 
-	// Allocate a new tree node on heap.
-	TreeNode *node = (TreeNode *)malloc(sizeof(TreeNode));
+	// Allocate a new tree node from the tree memory.
+	TreeNode *node = (TreeNode *)memAlloc(&tree->memory, sizeof(TreeNode));
 	
 	// Check if tree node was allocated successfully.
 	if (node) {
-		// Default values new tree node allocated.
+		// Default values new tree node allocated, the payloads are counted in the tree memory.
+		size_t mark = payloadBytes();
 		node->height = INIT_LEN;
+		node->dead = 0;
 		node->elem = CREATE.createElem(elem);
 		node->value = CREATE.createVal(value);
+		countPayload(tree, node, payloadBytes() - mark);
 		node->parent = NULL; node->left = NULL; node->right = NULL;
 		node->next = NULL; node->prev = NULL; node->end = NULL;
+		node->summary = NULL;
+		countNodeAlloc(tree);
+
+		// Handle [ERR]: out of memory for the payloads.
+		if (!node->elem || !node->value) {
+			destroyTreeNode(tree, node);
+			return NULL;
+		}
 	}
 	
 	// Return the new allocated tree node.
 	return node;
 }
 
+/**
+ * @brief Create a tree node object that adopts the given data.
+ * The node takes ownership of `elem` and `value` without copying them,
+ * they are released later through the tree delete functions. The size of
+ * the data isn't known, it isn't counted in the tree memory.
+ * 
+ * @param tree  Pointer to an tree object.
+ * @param elem  Pointer to the elem data owned by the caller until now.
+ * @param value Pointer to the value data owned by the caller until now.
+ * @return TreeNode* pointer to allocated tree node object or NULL.
+ */
+TreeNode* createTreeNodeAdopt(Tree *tree, void *elem, void *value) {
+	// Check if input is valid.
+	if (!tree) return NULL;
+
+	// Allocate a new tree node from the tree memory.
+	TreeNode *node = (TreeNode *)memAlloc(&tree->memory, sizeof(TreeNode));
+
+	// Check if tree node was allocated successfully.
+	if (node) {
+		// Default values new tree node, the data is moved not copied.
+		node->height = INIT_LEN;
+		node->dead = 0;
+		node->elem = elem;
+		node->value = value;
+		node->payload = 0;
+		node->parent = NULL; node->left = NULL; node->right = NULL;
+		node->next = NULL; node->prev = NULL; node->end = NULL;
+		node->summary = NULL;
+		countNodeAlloc(tree);
+	}
+
+	// Return the new allocated tree node.
+	return node;
+}
+
 /**
  * @brief Check if a tree object is empty.
  * 
@@ -107,10 +219,13 @@ void destroyTreeNode(Tree *tree, TreeNode *del) {
 	// Check if input is valid.
 	if (!tree || !del) return;
 	// Destroy content.
-	DELETE.deleteElem(del->elem);
-	DELETE.deleteVal(del->value);
+	if (del->elem) DELETE.deleteElem(del->elem);
+	if (del->value) DELETE.deleteVal(del->value);
+	uncountPayload(tree, del);
+	if (del->summary) releaseSummary(tree, del);
 	// Free memory tree node.
-	free(del);
+	countNodeFree(tree);
+	memFree(&tree->memory, del, sizeof(TreeNode));
 }
 
 /**
@@ -122,7 +237,8 @@ void destroyTree(Tree *tree) {
 	// Check if input is valid.
 	if (!tree) return;
 
-	TreeNode *minim = minimum(tree->root);
+	// An empty tree has no nodes to delete.
+	TreeNode *minim = tree->root ? minimum(tree->root) : NULL;
 	// Iterate through all tree nodes and delete them.
 	while (minim) {
 		TreeNode *delete = minim;
@@ -131,8 +247,16 @@ void destroyTree(Tree *tree) {
 		destroyTreeNode(tree, delete);
 	}
 
-	// Free memory tree.
-	free(tree);
+	// Free memory tree, the memory counters live in it.
+	destroyHashIndex(tree->index);
+	destroyBloom(tree->bloom);
+	destroyCache(tree->cache);
+	while (tree->views) destroyKeyView(tree->views);
+	if (tree->aggregate) memFree(&tree->memory, tree->aggregate, sizeof(Aggregate));
+	destroyValueIndex(tree->values);
+	Allocator alloc = tree->lambda.alloc;
+	Memory memory = { &alloc, tree->memory.live, tree->memory.peak };
+	memFree(&memory, tree, sizeof(Tree));
 }
 
 /**
@@ -184,18 +308,63 @@ TreeNode* predecessor(TreeNode *root) {
  * @return TreeNode* pointer to a tree node containing the elem data.
  */
 TreeNode* search(Tree *tree, TreeNode *root, void *elem) {
+	TRACE_SCOPE("search");
 	// Check if input is valid.
 	if (!tree || !root) return NULL;
 
 	// Find the desired tree node.
-	while (root) {
-		if (COMPARE(root->elem, elem) >= 1) root = root->left;
-		else if (COMPARE(root->elem, elem) <= -1) root = root->right;
-		else if (COMPARE(root->elem, elem) == 0) return root;
+	STAT_OP_BEGIN(tree);
+	TreeNode *found = findNode(tree, root, elem);
+	// A key whose head is a tombstone has no live entries.
+	if (found && found->dead) found = NULL;
+	// In weighted mode each search of the whole tree counts, hot keys climb up.
+	if (found && tree->balance == BALANCE_WEIGHT && root == tree->root) {
+		if (found->height < INT_MAX) found->height++;
+		raiseNode(tree, found);
 	}
+	STAT_OP_END(tree, STAT_SEARCH);
+
+	return found;
+}
+
+/**
+ * @brief Set the balancing policy of a tree.
+ * In WAVL mode the heights of the nodes are ranks, they may be higher than
+ * the real heights after deletes. In weighted mode they are access counts.
+ * Each policy accepts the trees of the previous ones (an AVL tree is a valid
+ * WAVL tree, heights and ranks are valid counts), the switch back needs an
+ * empty tree.
+ * 
+ * @param tree    Pointer to a tree object.
+ * @param balance The policy used by the next inserts and deletes.
+ * @return 0 on success, -1 if the policy can't be used on this tree.
+ */
+int setTreeBalance(Tree *tree, Balance balance) {
+	// Check if input is valid.
+	if (!tree || balance >= BALANCE_TYPES) return -1;
 
-	// Node wasn't found.
-	return NULL;
+	// The heights of a looser policy don't satisfy a stricter one, keep it while there are keys.
+	if (balance < tree->balance && tree->root) return -1;
+
+	tree->balance = balance;
+	return 0;
+}
+
+/**
+ * @brief Set the width of the integer values read by the key queries.
+ * The values are read as int by default, the trees holding 64-bit indexes
+ * (see `createIdx`) set `sizeof(int64_t)`.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param width `sizeof(int)` or `sizeof(int64_t)`.
+ * @return 0 on success, -1 if the width isn't supported.
+ */
+int setTreeValueWidth(Tree *tree, size_t width) {
+	// Check if input is valid.
+	if (!tree || (width != sizeof(int) && width != sizeof(int64_t))) return -1;
+
+	tree->lambda.valueWidth = width;
+	return 0;
 }
 
 /**
@@ -251,8 +420,8 @@ void avlRotateLeft(Tree *tree, TreeNode *root) {
 
 	// Update the parent nodes for y.
 	if (rotate->parent) {
-		// Check on which side y will be the children based on the prev parent of x.
-		if (COMPARE(rotate->elem, rotate->parent->elem) >= 1) {
+		// y takes the side of x under the prev parent of x (no compare needed).
+		if (rotate->parent->right == root) {
 			rotate->parent->right = rotate;
 		} else {
 			rotate->parent->left = rotate;
@@ -264,6 +433,11 @@ void avlRotateLeft(Tree *tree, TreeNode *root) {
 	// Update to all nodes the height.
 	updateHeight(root);
 	updateHeight(rotate);
+	// And their aggregates, the ancestors keep the same entries.
+	if (tree->aggregate) {
+		refreshNode(tree, root);
+		refreshNode(tree, rotate);
+	}
 }
 
 /**
@@ -300,8 +474,8 @@ void avlRotateRight(Tree *tree, TreeNode *root) {
 
 	// Update the parent nodes for x.
 	if (rotate->parent) {
-		// Check on which side x will be the children based on the prev parent of y.
-		if (COMPARE(rotate->elem, rotate->parent->elem) >= 1) {
+		// x takes the side of y under the prev parent of y (no compare needed).
+		if (rotate->parent->right == root) {
 			rotate->parent->right = rotate;
 		} else {
 			rotate->parent->left = rotate;
@@ -313,6 +487,86 @@ void avlRotateRight(Tree *tree, TreeNode *root) {
 	// Update to all nodes the height.
 	updateHeight(root);
 	updateHeight(rotate);
+	// And their aggregates, the ancestors keep the same entries.
+	if (tree->aggregate) {
+		refreshNode(tree, root);
+		refreshNode(tree, rotate);
+	}
+}
+
+/**
+ * @brief Take a snapshot of the statistics of a tree.
+ * The operation counters are copied when the library is built with AVL_STATS,
+ * the shape (height, depths, duplicate chains) is always measured, in O(n).
+ * 
+ * @param tree Pointer to a tree object.
+ * @param out  Where to store the snapshot.
+ */
+void getTreeStats(Tree *tree, TreeStats *out) {
+	// Check if input is valid.
+	if (!out) return;
+	memset(out, 0, sizeof(*out));
+	if (!tree) return;
+
+#ifdef AVL_STATS
+	// Readers may be counting, the counters are read atomically (the shape is measured below).
+	out->enabled = tree->stats.enabled;
+	for (int op = 0; op < STAT_OPS; op++) {
+		out->ops[op] = __atomic_load_n(&tree->stats.ops[op], __ATOMIC_RELAXED);
+		out->compares[op] = __atomic_load_n(&tree->stats.compares[op], __ATOMIC_RELAXED);
+	}
+	for (int rotate = 0; rotate < ROTATE_TYPES; rotate++)
+		out->rotations[rotate] = __atomic_load_n(&tree->stats.rotations[rotate], __ATOMIC_RELAXED);
+	out->totalCompares = __atomic_load_n(&tree->stats.totalCompares, __ATOMIC_RELAXED);
+	out->allocations = __atomic_load_n(&tree->stats.allocations, __ATOMIC_RELAXED);
+	out->frees = __atomic_load_n(&tree->stats.frees, __ATOMIC_RELAXED);
+	out->nodeBytes = __atomic_load_n(&tree->stats.nodeBytes, __ATOMIC_RELAXED);
+	out->peakNodeBytes = __atomic_load_n(&tree->stats.peakNodeBytes, __ATOMIC_RELAXED);
+#endif
+	if (!tree->root) return;
+
+	// Inorder walk with parent links, tracking the depth of each node.
+	TreeNode *node = tree->root;
+	size_t depth = 0;
+	while (node->left) node = node->left, depth++;
+
+	while (node) {
+		size_t chain = 0;
+		for (TreeNode *entry = node; entry != node->end->next; entry = entry->next) chain++;
+
+		size_t bucket = 0;
+		while (bucket + 1 < STATS_CHAINS && (chain >> (bucket + 1))) bucket++;
+
+		out->keys++;
+		out->entries += chain;
+		out->chains[bucket]++;
+		out->depth[depth < STATS_DEPTH ? depth : STATS_DEPTH - 1]++;
+		out->height = max(out->height, depth + 1);
+		out->longestChain = max(out->longestChain, chain);
+
+		if (node->right) {
+			node = node->right, depth++;
+			while (node->left) node = node->left, depth++;
+		} else {
+			while (node->parent && node->parent->right == node) node = node->parent, depth--;
+			node = node->parent;
+			if (depth) depth--;
+		}
+	}
+}
+
+/**
+ * @brief Get the bytes allocated by the tree allocator.
+ * The tree, its nodes, its payloads, its indexes and the ranges of its
+ * queries are counted, until they are released.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param live Where to store the bytes allocated now (may be NULL).
+ * @param peak Where to store the most bytes allocated at once (may be NULL).
+ */
+void getTreeMemory(Tree *tree, size_t *live, size_t *peak) {
+	if (live) *live = tree ? __atomic_load_n(&tree->memory.live, __ATOMIC_RELAXED) : 0;
+	if (peak) *peak = tree ? __atomic_load_n(&tree->memory.peak, __ATOMIC_RELAXED) : 0;
 }
 
 /**
@@ -330,12 +584,14 @@ int getBalanceTree(TreeNode *root) {
 
 /**
  * @brief Insert a new node into the tree obejct.
+ * If the allocator refuses the memory of the insert, the tree is left unchanged.
  * 
  * @param tree  Pointer to a tree object.
  * @param elem  Pointer to a elem data.
  * @param value Pointer to a value data.
  */
 void insertNode(Tree *tree, void *elem, void *value) {
+	TRACE_SCOPE("insertNode");
 	// Check if input is valid.
     if (!tree) return;
 
@@ -343,41 +599,53 @@ void insertNode(Tree *tree, void *elem, void *value) {
     TreeNode *node = createTreeNode(tree, elem, value);
     if (!node) return;
 
-	// Tree now has 1 node, the new one.
-    if (isEmpty(tree)) {
-        node->end = node;
-        tree->root = node;
-        tree->size = 1;
+	// Link the new node in the tree.
+    STAT_OP_BEGIN(tree);
+    int linked = attachNode(tree, node);
+    STAT_OP_END(tree, STAT_INSERT);
+    if (!linked) {
+        destroyTreeNode(tree, node);
         return;
     }
 
-	// Pass through each node from tree.
-    TreeNode *pass = tree->root;
-    TreeNode *parent = NULL;
-
-	// Find position to add new tree node.
-    while (pass) {
-        parent = pass;
-        int comp = COMPARE(elem, pass->elem);
-        if (comp > 0) pass = pass->right;
-        else if (comp < 0) pass = pass->left;
-        else break;
-    }
+	// Log the update, durable after `commitJournal`.
+    if (tree->journal) appendJournal(tree->journal, JOURNAL_INSERT, elem, value);
+}
 
-	// Node already exists, insert it in linked list.
-    if (pass) {
-        insertIntoLinkedList(pass, node);
-    } else {
-		// Otherwise insert it in the tree.
-        node->end = node;
-        node->parent = parent;
-        insertElement(tree, node, parent);
-        // Fix the AVL tree, balance factor moddified.
-		avlFixUp(tree, parent);
+/**
+ * @brief Insert a new node into the tree object, moving the data in it.
+ * The tree takes ownership of `elem` and `value`, no copies are made.
+ * On failure the data is still owned by the caller. The data must be
+ * released by the tree delete functions, the provided ones (`destroyInt`,
+ * `destroyStr`, ...) release malloc'd data.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param elem  Pointer to a heap elem data, owned by the tree afterwards.
+ * @param value Pointer to a heap value data, owned by the tree afterwards.
+ * @return 1 if the data was adopted by the tree, 0 otherwise.
+ */
+int insertNodeAdopt(Tree *tree, void *elem, void *value) {
+	TRACE_SCOPE("insertNodeAdopt");
+	// Check if input is valid.
+    if (!tree) return 0;
+
+	// Create new node around the given data.
+    TreeNode *node = createTreeNodeAdopt(tree, elem, value);
+    if (!node) return 0;
+
+	// Link the new node in the tree.
+    STAT_OP_BEGIN(tree);
+    int linked = attachNode(tree, node);
+    STAT_OP_END(tree, STAT_INSERT);
+    if (!linked) {
+        // The data goes back to the caller.
+        node->elem = node->value = NULL;
+        destroyTreeNode(tree, node);
+        return 0;
     }
 
-	// Increment the size of the tree.
-    tree->size++;
+    if (tree->journal) appendJournal(tree->journal, JOURNAL_INSERT, elem, value);
+    return 1;
 }
 
 /**
@@ -387,42 +655,45 @@ void insertNode(Tree *tree, void *elem, void *value) {
  * @param elem Pointer to element location to delete from tree.
  */
 void deleteNode(Tree *tree, void *elem) {
+	TRACE_SCOPE("deleteNode");
 	// Check if input is valid.
-    if (!tree || !elem) return;
-
-	// Create find node with given data.
-    TreeNode *found = search(tree, tree->root, elem);
-    if (!found) return;
-
-	// Check if the found node is the only one.
-    if (found->end == found) {
-		// The found node has left & right child.
-        if (found->left && found->right) {
-            TreeNode *minim = minimum(found->right);
-			// Delete the found node data.
-            DELETE.deleteElem(found->elem);
-            DELETE.deleteVal(found->value);
-			// Replace found node with the minimum one.
-            found->elem = CREATE.createElem(minim->elem);
-            found->value = CREATE.createVal(minim->value);
-			// Delete the minimum node.
-            deleteSingleNode(tree, minim);
-        } else {
-			// Delete the found node directly otherwise.
-			// Don't need to find replacement.
-            deleteSingleNode(tree, found);
-        }
-    } else {
-		// If the node is found in the linked list.
-        TreeNode *deleteNode = found->end;
-		// Remove it from the linked list.
-        if (deleteNode->prev) deleteNode->prev->next = deleteNode->next;
-        if (deleteNode->next) deleteNode->next->prev = deleteNode->prev;
-		// Update end point address with the previous node from list.
-	    found->end = deleteNode->prev;
-		// Free memory deleted node, value and element.
-        destroyTreeNode(tree, deleteNode);
-		// Decrement the tree size.
-        tree->size--;
-    }
+    if (!tree) return;
+
+	// Log the update first, `elem` may be the data being destroyed.
+    TreeNode *found = tree->journal ? findNode(tree, tree->root, elem) : NULL;
+    if (found && !found->dead)
+        appendJournal(tree->journal, JOURNAL_DELETE, elem, NULL);
+
+	// Remove the entry and destroy its data, or only mark it when deleting lazily.
+    STAT_OP_BEGIN(tree);
+    if (tree->maxTombstones > 0) buryEntry(tree, elem);
+    else detachEntry(tree, elem, NULL, NULL);
+    STAT_OP_END(tree, STAT_DELETE);
+}
+
+/**
+ * @brief Delete a node from tree and hand its data back to the caller.
+ * The element and value are not destroyed, the caller owns them afterwards
+ * and must release them with the tree delete functions (free for the
+ * provided ones), even after the tree is destroyed.
+ * 
+ * @param tree     Pointer to a tree object.
+ * @param elem     Pointer to element location to delete from tree.
+ * @param outElem  Where to store the removed element (may be NULL to destroy it).
+ * @param outValue Where to store the removed value (may be NULL to destroy it).
+ * @return 1 if an entry was removed, 0 otherwise.
+ */
+int deleteNodeExtract(Tree *tree, void *elem, void **outElem, void **outValue) {
+	// Check if input is valid.
+    if (!tree) return 0;
+
+	// Remove the entry and move its data out, a tombstone has no data to hand out.
+    STAT_OP_BEGIN(tree);
+    if (tree->tombstones) purgeEntry(tree, elem);
+    int removed = detachEntry(tree, elem, outElem, outValue);
+    STAT_OP_END(tree, STAT_DELETE);
+
+	// The data is handed out, not destroyed, so it can still be logged.
+    if (removed && tree->journal) appendJournal(tree->journal, JOURNAL_DELETE, elem, NULL);
+    return removed;
 }
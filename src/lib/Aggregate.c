@@ -0,0 +1,318 @@
+#include "../include/Aggregate.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Set an offset summary to the summary of no entries.
+ *
+ * @param ctx Unused.
+ * @param acc Pointer to an OffsetSummary.
+ */
+static void identityOffsets(void *ctx, void *acc) {
+    OffsetSummary *sum = (OffsetSummary *)acc;
+    sum->count = sum->letters = 0;
+    sum->min = INT64_MAX;
+    sum->max = INT64_MIN;
+}
+
+/**
+ * @brief Add an entry with a 64-bit index value to an offset summary.
+ *
+ * @param ctx   Unused.
+ * @param acc   Pointer to an OffsetSummary.
+ * @param entry The entry added.
+ */
+static void mapOffsets(void *ctx, void *acc, TreeNode *entry) {
+    OffsetSummary *sum = (OffsetSummary *)acc;
+    int64_t value = *(int64_t *)entry->value;
+    sum->count++;
+    sum->letters += value % LETTER_LEN;
+    if (value < sum->min) sum->min = value;
+    if (value > sum->max) sum->max = value;
+}
+
+/**
+ * @brief Add the entries of an offset summary to another.
+ *
+ * @param ctx   Unused.
+ * @param acc   Pointer to the OffsetSummary receiving the entries.
+ * @param other Pointer to the OffsetSummary added.
+ */
+static void combineOffsets(void *ctx, void *acc, const void *other) {
+    OffsetSummary *sum = (OffsetSummary *)acc;
+    const OffsetSummary *add = (const OffsetSummary *)other;
+    sum->count += add->count;
+    sum->letters += add->letters;
+    if (add->min < sum->min) sum->min = add->min;
+    if (add->max > sum->max) sum->max = add->max;
+}
+
+const Monoid offsetMonoid = { sizeof(OffsetSummary), identityOffsets, mapOffsets, combineOffsets, NULL };
+
+// Aggregates of a head node: its chain, then its whole sub-tree.
+#define CHAIN_OF(node) ((char *)(node)->summary)
+#define TREE_OF(agg, node) ((char *)(node)->summary + (agg)->stride)
+
+/**
+ * @brief Keep the aggregates of a monoid in each head node of a tree.
+ * Each head holds the aggregate of its duplicate chain and the one of its
+ * sub-tree, kept up to date by the inserts, deletes and rotations, so
+ * `rangeAggregate` answers in O(log n). A delete in a duplicate chain maps
+ * the chain again, in O(chain). Setting a monoid maps the tree in O(n).
+ * The summaries are allocated here and by `reserveSummary` before an
+ * insert, so no other change of the tree allocates.
+ *
+ * @param tree   Pointer to a tree object.
+ * @param monoid The monoid (copied in the tree), or NULL to drop the aggregates.
+ * @return 1 on success, 0 if the memory was refused (the tree has no aggregates then).
+ */
+int setTreeAggregate(Tree *tree, const Monoid *monoid) {
+    // Check if input is valid.
+    if (!tree) return 0;
+
+    // The summaries of the old monoid have its size.
+    for (TreeNode *head = tree->root ? minimum(tree->root) : NULL; head; head = head->end->next)
+        releaseSummary(tree, head);
+    if (tree->aggregate) memFree(&tree->memory, tree->aggregate, sizeof(Aggregate));
+    tree->aggregate = NULL;
+    if (!monoid || !monoid->size) return 1;
+
+    tree->aggregate = memAlloc(&tree->memory, sizeof(Aggregate));
+    if (!tree->aggregate) return 0;
+    tree->aggregate->monoid = *monoid;
+    tree->aggregate->stride = (monoid->size + 15) & ~(size_t)15;
+    tree->aggregate->memory = &tree->memory;
+
+    // Every head takes its summary first, a refusal leaves no aggregates.
+    for (TreeNode *head = tree->root ? minimum(tree->root) : NULL; head; head = head->end->next) {
+        head->summary = memAlloc(&tree->memory, tree->aggregate->stride * 2);
+        if (!head->summary) {
+            setTreeAggregate(tree, NULL);
+            return 0;
+        }
+    }
+    rebuildAggregates(tree);
+    return 1;
+}
+
+/**
+ * @brief Get the aggregate of the sub-tree of a head node.
+ * Lets a query prune the sub-trees whose aggregate rules them out.
+ *
+ * @param tree Pointer to a tree object.
+ * @param node A head node of the tree.
+ * @return The aggregate (`monoid.size` bytes), or NULL without aggregates.
+ */
+const void* nodeAggregate(Tree *tree, TreeNode *node) {
+    if (!tree->aggregate || !node || !node->summary) return NULL;
+
+    return TREE_OF(tree->aggregate, node);
+}
+
+/**
+ * @brief Allocate the aggregates of a new node, before it is linked in the tree.
+ * The chain aggregate holds the node alone, the one of a new key. A node
+ * joining a duplicate chain releases it once linked.
+ *
+ * @param tree Pointer to a tree object.
+ * @param node The new node, with its element and value set.
+ * @return 1 on success (or without aggregates), 0 if the memory was refused.
+ */
+int reserveSummary(Tree *tree, TreeNode *node) {
+    Aggregate *agg = tree->aggregate;
+    if (!agg || node->summary) return 1;
+
+    node->summary = memAlloc(agg->memory, agg->stride * 2);
+    if (!node->summary) return 0;
+    agg->monoid.identity(agg->monoid.ctx, CHAIN_OF(node));
+    agg->monoid.map(agg->monoid.ctx, CHAIN_OF(node), node);
+    return 1;
+}
+
+/**
+ * @brief Compute the chain aggregate of a head node again.
+ * The live entries of the chain are mapped in order, tombstones are skipped.
+ *
+ * @param tree Pointer to a tree object.
+ * @param head Head node whose chain changed.
+ */
+void refreshChain(Tree *tree, TreeNode *head) {
+    Aggregate *agg = tree->aggregate;
+    if (!agg || !head->summary) return;
+
+    Monoid *monoid = &agg->monoid;
+    void *chain = CHAIN_OF(head);
+    monoid->identity(monoid->ctx, chain);
+    for (TreeNode *entry = head; entry != head->end->next; entry = entry->next)
+        if (!entry->dead) monoid->map(monoid->ctx, chain, entry);
+}
+
+/**
+ * @brief Add an entry appended to a duplicate chain, in O(1 + log n).
+ * The entry comes after the other live entries of the chain.
+ *
+ * @param tree  Pointer to a tree object.
+ * @param head  Head node of the chain.
+ * @param entry The live entry appended.
+ */
+void appendChain(Tree *tree, TreeNode *head, TreeNode *entry) {
+    Aggregate *agg = tree->aggregate;
+    if (!agg) return;
+
+    if (head->summary) agg->monoid.map(agg->monoid.ctx, CHAIN_OF(head), entry);
+    refreshPath(tree, head);
+}
+
+/**
+ * @brief Compute the sub-tree aggregate of a node from its children and its chain.
+ * The aggregates of the children must be up to date.
+ *
+ * @param tree Pointer to a tree object.
+ * @param node Head node whose sub-tree changed.
+ */
+void refreshNode(Tree *tree, TreeNode *node) {
+    Aggregate *agg = tree->aggregate;
+    if (!agg || !node || !node->summary) return;
+
+    Monoid *monoid = &agg->monoid;
+    void *whole = TREE_OF(agg, node);
+    if (node->left) memcpy(whole, TREE_OF(agg, node->left), monoid->size);
+    else monoid->identity(monoid->ctx, whole);
+    monoid->combine(monoid->ctx, whole, CHAIN_OF(node));
+    if (node->right) monoid->combine(monoid->ctx, whole, TREE_OF(agg, node->right));
+}
+
+/**
+ * @brief Compute the sub-tree aggregates from a node up to the top of its tree.
+ * Used after a change below `node`, before the rotations of the fix up.
+ *
+ * @param tree Pointer to a tree object.
+ * @param node Lowest node whose sub-tree changed (may be NULL).
+ */
+void refreshPath(Tree *tree, TreeNode *node) {
+    if (!tree->aggregate) return;
+
+    for (; node; node = node->parent)
+        refreshNode(tree, node);
+}
+
+/**
+ * @brief Compute the aggregates of a sub-tree, children first.
+ *
+ * @param tree Pointer to a tree object.
+ * @param node Root of the sub-tree.
+ */
+static void rebuildNode(Tree *tree, TreeNode *node) {
+    if (!node) return;
+
+    rebuildNode(tree, node->left);
+    rebuildNode(tree, node->right);
+    refreshChain(tree, node);
+    refreshNode(tree, node);
+}
+
+/**
+ * @brief Compute every aggregate of a tree again, in O(n).
+ * Used when the tree is built again at once (see `compactTree`).
+ *
+ * @param tree Pointer to a tree object.
+ */
+void rebuildAggregates(Tree *tree) {
+    if (!tree->aggregate) return;
+
+    rebuildNode(tree, tree->root);
+}
+
+/**
+ * @brief Free the aggregates of a node, if it has any.
+ *
+ * @param tree Pointer to a tree object.
+ * @param node Pointer to a tree node.
+ */
+void releaseSummary(Tree *tree, TreeNode *node) {
+    if (!node->summary) return;
+
+    memFree(&tree->memory, node->summary, tree->aggregate->stride * 2);
+    node->summary = NULL;
+}
+
+/**
+ * @brief Aggregate the keys of a sub-tree not below a bound, in key order.
+ * The nodes of the search path add their chain and right sub-tree.
+ *
+ * @param tree Pointer to a tree object.
+ * @param node Root of the sub-tree.
+ * @param left The left boundary (inclusive).
+ * @param acc  The accumulator.
+ */
+static void aggregateAbove(Tree *tree, TreeNode *node, void *left, void *acc) {
+    Aggregate *agg = tree->aggregate;
+    Monoid *monoid = &agg->monoid;
+    while (node && COMPARE(node->elem, left) < 0) node = node->right;
+    if (!node) return;
+
+    aggregateAbove(tree, node->left, left, acc);
+    monoid->combine(monoid->ctx, acc, CHAIN_OF(node));
+    if (node->right) monoid->combine(monoid->ctx, acc, TREE_OF(agg, node->right));
+}
+
+/**
+ * @brief Aggregate the keys of a sub-tree not above a bound, in key order.
+ * The nodes of the search path add their left sub-tree and chain.
+ *
+ * @param tree  Pointer to a tree object.
+ * @param node  Root of the sub-tree.
+ * @param right The right boundary (inclusive).
+ * @param acc   The accumulator.
+ */
+static void aggregateBelow(Tree *tree, TreeNode *node, void *right, void *acc) {
+    Aggregate *agg = tree->aggregate;
+    Monoid *monoid = &agg->monoid;
+    while (node) {
+        if (COMPARE(node->elem, right) > 0) {
+            node = node->left;
+            continue;
+        }
+        if (node->left) monoid->combine(monoid->ctx, acc, TREE_OF(agg, node->left));
+        monoid->combine(monoid->ctx, acc, CHAIN_OF(node));
+        node = node->right;
+    }
+}
+
+/**
+ * @brief Aggregate the live entries with a key within a range.
+ * The search goes down to the first key within the bounds, then the two
+ * boundary paths add whole sub-trees, so the query takes O(log n)
+ * comparisons and combines, whatever the number of entries.
+ *
+ * @param tree   Pointer to a tree object.
+ * @param left   The left boundary (inclusive), NULL for no bound.
+ * @param right  The right boundary (inclusive), NULL for no bound.
+ * @param result Where to store the aggregate (`monoid.size` bytes).
+ * @return 0 on success, -1 if the tree keeps no aggregates.
+ */
+int rangeAggregate(Tree *tree, void *left, void *right, void *result) {
+    TRACE_SCOPE("rangeAggregate");
+    // Check if input is valid.
+    if (!tree || !tree->aggregate || !result) return -1;
+
+    Aggregate *agg = tree->aggregate;
+    Monoid *monoid = &agg->monoid;
+    monoid->identity(monoid->ctx, result);
+    if (left && right && COMPARE(left, right) > 0) return 0;
+
+    // Go down to the first node within both bounds, it splits the two paths.
+    TreeNode *node = tree->root;
+    while (node) {
+        if (left && COMPARE(node->elem, left) < 0) node = node->right;
+        else if (right && COMPARE(node->elem, right) > 0) node = node->left;
+        else break;
+    }
+    if (!node) return 0;
+
+    if (!left && node->left) monoid->combine(monoid->ctx, result, TREE_OF(agg, node->left));
+    else if (left) aggregateAbove(tree, node->left, left, result);
+    monoid->combine(monoid->ctx, result, CHAIN_OF(node));
+    if (!right && node->right) monoid->combine(monoid->ctx, result, TREE_OF(agg, node->right));
+    else if (right) aggregateBelow(tree, node->right, right, result);
+    return 0;
+}
@@ -0,0 +1,271 @@
+#include "../include/Bloom.h"
+#include "../utils/Utils.h"
+
+// Odd multipliers picking the bit of each word (as in split block Bloom filters).
+static const uint32_t bloomSalt[BLOOM_BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+/**
+ * @brief Find the block of a key and the seed of its bits.
+ * 
+ * @param filter Pointer to a Bloom filter.
+ * @param elem   Pointer to the key.
+ * @param seed   Where to store the seed of the bits.
+ * @return Pointer to the first word of the block.
+ */
+static uint64_t* bloomBlock(BloomFilter *filter, void *elem, uint32_t *seed) {
+    // Every bit of the hash must count, a multiply alone leaves the block
+    // and the bits correlated for weak hashes (e.g. small integers).
+    uint64_t mixed = filter->hash(elem);
+    mixed = (mixed ^ (mixed >> 33)) * 0xff51afd7ed558ccdull;
+    mixed = (mixed ^ (mixed >> 33)) * 0xc4ceb9fe1a85ec53ull;
+    mixed ^= mixed >> 33;
+    *seed = (uint32_t)mixed;
+    return filter->blocks + ((mixed >> 32) & (filter->count - 1)) * BLOOM_BLOCK_WORDS;
+}
+
+#ifdef BLOOM_AVX2
+/**
+ * @brief Test the 8 bits of a key in its block with AVX2.
+ * Compiled for AVX2 without -mavx2, called only when the CPU has it.
+ * 
+ * @param block Pointer to the 64-byte aligned block of the key.
+ * @param seed  Seed of the bits of the key.
+ * @return 0 if a bit is clear, 1 if all are set.
+ */
+__attribute__((target("avx2")))
+static int probeAvx2(const uint64_t *block, uint32_t seed) {
+    // Bit of each word: top 6 bits of seed * salt, widened to 64-bit lanes.
+    __m256i salt = _mm256_loadu_si256((const __m256i *)bloomSalt);
+    __m256i shift = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((int)seed), salt), 26);
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256i low = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(shift)));
+    __m256i high = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(shift, 1)));
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i *)block), low) &
+           _mm256_testc_si256(_mm256_load_si256((const __m256i *)(block + 4)), high);
+}
+#endif
+
+/**
+ * @brief Check if the CPU running the process has AVX2.
+ * 
+ * @return 1 if the AVX2 probe can run, 0 otherwise.
+ */
+static int hasAvx2(void) {
+#ifdef BLOOM_AVX2
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Release the blocks of a Bloom filter.
+ * 
+ * @param filter Pointer to a Bloom filter.
+ */
+static void freeBlocks(BloomFilter *filter) {
+    memFree(filter->memory, filter->raw, filter->count * BLOOM_BLOCK_WORDS * sizeof(uint64_t) + 63);
+    filter->raw = NULL;
+    filter->blocks = NULL;
+    filter->count = 0;
+}
+
+/**
+ * @brief Size the filter for a number of keys and add the keys of the tree.
+ * If the memory of the new size is refused, the blocks in use are kept:
+ * the filter stays correct, with more false positives.
+ * 
+ * @param tree     Pointer to a tree object, with a Bloom filter.
+ * @param capacity Keys the filter is sized for.
+ * @return 1 on success, 0 if the filter has no blocks.
+ */
+static int buildBloom(Tree *tree, size_t capacity) {
+    BloomFilter *filter = tree->bloom;
+    if (capacity < BLOOM_MIN_KEYS) capacity = BLOOM_MIN_KEYS;
+
+    size_t count = 1;
+    while (count * BLOOM_BLOCK_BITS < capacity * filter->bitsPerKey) count <<= 1;
+
+    if (count != filter->count) {
+        // The allocator doesn't align, the blocks start at the next cache line.
+        void *raw = memAlloc(filter->memory, count * BLOOM_BLOCK_WORDS * sizeof(uint64_t) + 63);
+        if (raw) {
+            freeBlocks(filter);
+            filter->raw = raw;
+            filter->blocks = (uint64_t *)(((uintptr_t)raw + 63) & ~(uintptr_t)63);
+            filter->count = count;
+        } else if (!filter->count) {
+            return 0;
+        }
+    }
+    memset(filter->blocks, 0, filter->count * BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+    filter->capacity = capacity;
+    filter->keys = 0;
+    filter->deletes = 0;
+
+    // Add the key of each duplicate chain once.
+    TreeNode *head = tree->root ? minimum(tree->root) : NULL;
+    while (head) {
+        bloomAdd(tree, head);
+        head = head->end->next;
+    }
+    return 1;
+}
+
+/**
+ * @brief Put a blocked Bloom filter in front of the lookups of a tree.
+ * Lookups of missing keys (`search`, `deleteNode`) are mostly answered
+ * by one cache line of the filter, without descending the tree.
+ * 
+ * @param tree       Pointer to a tree object.
+ * @param hash       Function hashing a key (consistent with the compare function),
+ *                   or NULL to drop the filter.
+ * @param bitsPerKey Bits of filter per key, 0 for BLOOM_BITS_PER_KEY.
+ * @return 1 on success, 0 if the memory was refused (the tree has no filter then).
+ */
+int setTreeBloom(Tree *tree, Hash hash, size_t bitsPerKey) {
+    // Check if input is valid.
+    if (!tree) return 0;
+
+    destroyBloom(tree->bloom);
+    tree->bloom = NULL;
+    if (!hash) return 1;
+
+    tree->bloom = memAlloc(&tree->memory, sizeof(BloomFilter));
+    if (!tree->bloom) return 0;
+    memset(tree->bloom, 0, sizeof(BloomFilter));
+    tree->bloom->memory = &tree->memory;
+    tree->bloom->hash = hash;
+    tree->bloom->bitsPerKey = bitsPerKey ? bitsPerKey : BLOOM_BITS_PER_KEY;
+    tree->bloom->simd = hasAvx2();
+    if (buildBloom(tree, tree->size * 2)) return 1;
+
+    destroyBloom(tree->bloom);
+    tree->bloom = NULL;
+    return 0;
+}
+
+/**
+ * @brief Choose how the filter of a tree probes the keys.
+ * A new filter uses AVX2 when the CPU has it, the scalar probe otherwise.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param simd 1 for the AVX2 probe, 0 for the scalar one.
+ * @return 1 on success, 0 if the tree has no filter or the CPU has no AVX2.
+ */
+int setBloomSimd(Tree *tree, int simd) {
+    // Check if input is valid.
+    if (!tree || !tree->bloom || (simd && !hasAvx2())) return 0;
+
+    tree->bloom->simd = simd != 0;
+    return 1;
+}
+
+/**
+ * @brief Check if a key may be in the tree.
+ * The 8 bits of the key, one per word of its block, are tested at once
+ * when the filter probes with AVX2.
+ * 
+ * @param filter Pointer to a Bloom filter.
+ * @param elem   Pointer to the key.
+ * @return 0 if the key is surely missing, 1 if it may be in the tree.
+ */
+int bloomMayContain(BloomFilter *filter, void *elem) {
+    uint32_t seed;
+    const uint64_t *block = bloomBlock(filter, elem, &seed);
+
+#ifdef BLOOM_AVX2
+    if (filter->simd) return probeAvx2(block, seed);
+#endif
+    for (int word = 0; word < BLOOM_BLOCK_WORDS; word++)
+        if (!(block[word] >> ((seed * bloomSalt[word]) >> 26) & 1)) return 0;
+    return 1;
+}
+
+/**
+ * @brief Add the key of a new head node, growing the filter when it is full.
+ * 
+ * @param tree Pointer to a tree object, with a Bloom filter.
+ * @param node The head node of a key.
+ */
+void bloomAdd(Tree *tree, TreeNode *node) {
+    BloomFilter *filter = tree->bloom;
+
+    // Past its capacity the false positive rate climbs, size it again.
+    if (filter->keys >= filter->capacity) {
+        filter->rebuilds++;
+        buildBloom(tree, filter->capacity * 2);
+        return;
+    }
+
+    uint32_t seed;
+    uint64_t *block = bloomBlock(filter, node->elem, &seed);
+    for (int word = 0; word < BLOOM_BLOCK_WORDS; word++)
+        block[word] |= (uint64_t)1 << ((seed * bloomSalt[word]) >> 26);
+    filter->keys++;
+}
+
+/**
+ * @brief Count a key removed from the tree.
+ * Its bits can't be cleared, so once the removed keys are half of the
+ * keys set, the filter is built again from the keys left in the tree.
+ * 
+ * @param tree Pointer to a tree object, with a Bloom filter.
+ */
+void bloomRemove(Tree *tree) {
+    BloomFilter *filter = tree->bloom;
+
+    if (++filter->deletes * 2 >= filter->keys && filter->deletes >= BLOOM_MIN_KEYS / 4) {
+        filter->rebuilds++;
+        buildBloom(tree, tree->size * 2);
+    }
+}
+
+/**
+ * @brief Count a lookup of a missing key.
+ * 
+ * @param filter   Pointer to a Bloom filter.
+ * @param rejected 1 if the filter rejected the key, 0 if the tree was descended.
+ */
+void bloomMiss(BloomFilter *filter, int rejected) {
+    __atomic_fetch_add(rejected ? &filter->negatives : &filter->falsePositives, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Take a snapshot of the memory use and measured accuracy of the filter.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param out  Where to store the statistics (zeroed without a filter).
+ */
+void getBloomStats(Tree *tree, BloomStats *out) {
+    // Check if input is valid.
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!tree || !tree->bloom) return;
+
+    BloomFilter *filter = tree->bloom;
+    out->bytes = filter->count * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+    out->keys = filter->keys;
+    out->rebuilds = filter->rebuilds;
+    out->negatives = __atomic_load_n(&filter->negatives, __ATOMIC_RELAXED);
+    out->falsePositives = __atomic_load_n(&filter->falsePositives, __ATOMIC_RELAXED);
+    if (out->negatives + out->falsePositives)
+        out->falsePositiveRate = (double)out->falsePositives /
+                                 (double)(out->negatives + out->falsePositives);
+}
+
+/**
+ * @brief Free the memory of a Bloom filter.
+ * 
+ * @param filter Pointer to a Bloom filter.
+ */
+void destroyBloom(BloomFilter *filter) {
+    // Check if input is valid.
+    if (!filter) return;
+
+    freeBlocks(filter);
+    memFree(filter->memory, filter, sizeof(BloomFilter));
+}
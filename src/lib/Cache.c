@@ -0,0 +1,247 @@
+#include "../include/Cache.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Check if an entry holds the result of a query.
+ *
+ * @param tree  Pointer to a tree object.
+ * @param entry Pointer to a cache entry in use.
+ * @param type  The query.
+ * @param left  The left bound of the query, or NULL.
+ * @param right The right bound of the query, or NULL.
+ * @return 1 if the entry has the same query and bounds, 0 otherwise.
+ */
+static int sameQuery(Tree *tree, CacheEntry *entry, QueryType type, void *left, void *right) {
+    if (entry->type != type) return 0;
+    if (!entry->left != !left || (left && COMPARE(entry->left, left))) return 0;
+    if (!entry->right != !right || (right && COMPARE(entry->right, right))) return 0;
+    return 1;
+}
+
+/**
+ * @brief Drop the result of an entry, the entry becomes free.
+ * Callers sharing the result keep it until they destroy it.
+ *
+ * @param cache Pointer to a query cache.
+ * @param entry Pointer to a cache entry in use.
+ */
+static void dropEntry(QueryCache *cache, CacheEntry *entry) {
+    if (entry->left) cache->release(entry->left);
+    if (entry->right) cache->release(entry->right);
+    memTransfer(cache->memory, NULL, entry->bytes);
+    destroyRange(entry->range);
+    memset(entry, 0, sizeof(*entry));
+}
+
+/**
+ * @brief Check if an entry should be taken for a new result before another.
+ * Free entries come first, then the results of an older version, then the
+ * least recently used results.
+ *
+ * @param entry   Pointer to a cache entry.
+ * @param other   Pointer to the entry chosen so far, or NULL.
+ * @param version The current version of the tree.
+ * @return 1 if `entry` is taken before `other`, 0 otherwise.
+ */
+static int evictBefore(CacheEntry *entry, CacheEntry *other, size_t version) {
+    if (!other) return 1;
+    if (!entry->range != !other->range) return !entry->range;
+    if ((entry->version != version) != (other->version != version)) return entry->version != version;
+    return entry->lastUse < other->lastUse;
+}
+
+/**
+ * @brief Share a cached result with a caller.
+ *
+ * @param range The cached result.
+ * @return The same result, destroyed by the caller like any other one.
+ */
+static Range* shareRange(Range *range) {
+    __atomic_add_fetch(&range->refs, 1, __ATOMIC_RELAXED);
+    return range;
+}
+
+/**
+ * @brief Keep the results of the key queries of a tree.
+ * `levelKeyQuery`, `inorderKeyQuery` and `rangeKeyQuery` (and their parallel
+ * versions) return the result kept for the same query and bounds as long as
+ * the tree has the same version, then build it again. Kept results are shared
+ * by all the callers, which must not change them. A new capacity drops the
+ * results kept so far. The bounds are copied like the ones of the views (see
+ * `copyBound`), the range queries of other borrowed keys aren't kept.
+ *
+ * @param tree     Pointer to a tree object.
+ * @param capacity Number of results kept, 0 drops the cache.
+ * @return 1 on success, 0 if the memory was refused (the tree has no cache then).
+ */
+int setTreeCache(Tree *tree, size_t capacity) {
+    // Check if input is valid.
+    if (!tree) return 0;
+
+    destroyCache(tree->cache);
+    tree->cache = NULL;
+    if (!capacity) return 1;
+
+    QueryCache *cache = memAlloc(&tree->memory, sizeof(QueryCache));
+    CacheEntry *entries = memAlloc(&tree->memory, sizeof(CacheEntry) * capacity);
+    if (!cache || !entries) {
+        memFree(&tree->memory, cache, sizeof(QueryCache));
+        memFree(&tree->memory, entries, sizeof(CacheEntry) * capacity);
+        return 0;
+    }
+    memset(cache, 0, sizeof(QueryCache));
+    memset(entries, 0, sizeof(CacheEntry) * capacity);
+    cache->entries = entries;
+    cache->capacity = capacity;
+    cache->memory = &tree->memory;
+    cache->release = boundRelease(tree);
+    pthread_mutex_init(&cache->lock, NULL);
+    tree->cache = cache;
+    return 1;
+}
+
+/**
+ * @brief Find the result of a query built at the current version of the tree.
+ * A result of an older version is dropped. The lookup scans the entries, so
+ * it takes O(capacity) comparisons of the bounds.
+ *
+ * @param tree  Pointer to a tree object.
+ * @param type  The query.
+ * @param left  The left bound of the query, or NULL.
+ * @param right The right bound of the query, or NULL.
+ * @return The shared result, or NULL if it must be built.
+ */
+Range* cacheLookup(Tree *tree, QueryType type, void *left, void *right) {
+    // Check if input is valid.
+    if (!tree || !tree->cache) return NULL;
+
+    QueryCache *cache = tree->cache;
+    Range *range = NULL;
+    pthread_mutex_lock(&cache->lock);
+    cache->clock++;
+    for (size_t i = 0; i < cache->capacity; i++) {
+        CacheEntry *entry = &cache->entries[i];
+        if (!entry->range || !sameQuery(tree, entry, type, left, right)) continue;
+
+        if (entry->version == tree->version) {
+            entry->lastUse = cache->clock;
+            range = shareRange(entry->range);
+        } else {
+            dropEntry(cache, entry);
+            cache->stale++;
+        }
+        break;
+    }
+    if (range) cache->hits++;
+    else cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    return range;
+}
+
+/**
+ * @brief Keep the result of a query built at the current version of the tree.
+ * The result takes a free entry, or the one of an older version, or the
+ * least recently used one. If another reader stored the same query since
+ * the lookup, its result is shared and the new one is destroyed.
+ *
+ * @param tree  Pointer to a tree object.
+ * @param type  The query.
+ * @param left  The left bound of the query, or NULL.
+ * @param right The right bound of the query, or NULL.
+ * @param range The result built by the caller (may be NULL).
+ * @return The result to hand to the caller, shared with the cache.
+ */
+Range* cacheStore(Tree *tree, QueryType type, void *left, void *right, Range *range) {
+    // Check if input is valid.
+    if (!tree || !tree->cache || !range) return range;
+
+    QueryCache *cache = tree->cache;
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *slot = NULL;
+    for (size_t i = 0; i < cache->capacity; i++) {
+        CacheEntry *entry = &cache->entries[i];
+        if (entry->range && entry->version == tree->version &&
+            sameQuery(tree, entry, type, left, right)) {
+            Range *kept = shareRange(entry->range);
+            pthread_mutex_unlock(&cache->lock);
+            destroyRange(range);
+            return kept;
+        }
+        if (evictBefore(entry, slot, tree->version)) slot = entry;
+    }
+
+    if (slot->range) {
+        if (slot->version != tree->version) cache->stale++;
+        else cache->evictions++;
+        dropEntry(cache, slot);
+    }
+
+    // The bounds are copied with their data, the caller keeps its own.
+    size_t bytes = 0;
+    void *leftCopy = left ? copyBound(tree, left, &bytes) : NULL;
+    void *rightCopy = right ? copyBound(tree, right, &bytes) : NULL;
+    if ((left && !leftCopy) || (right && !rightCopy)) {
+        // Out of memory, or borrowed keys that can't be copied, the result isn't kept.
+        if (leftCopy) cache->release(leftCopy);
+        if (rightCopy) cache->release(rightCopy);
+        memTransfer(cache->memory, NULL, bytes);
+        pthread_mutex_unlock(&cache->lock);
+        return range;
+    }
+
+    slot->type = type;
+    slot->left = leftCopy;
+    slot->right = rightCopy;
+    slot->bytes = bytes;
+    slot->version = tree->version;
+    slot->lastUse = cache->clock;
+    slot->range = shareRange(range);
+    pthread_mutex_unlock(&cache->lock);
+
+    return range;
+}
+
+/**
+ * @brief Take a snapshot of the use of the query cache of a tree.
+ *
+ * @param tree Pointer to a tree object.
+ * @param out  Where to store the statistics.
+ */
+void getCacheStats(Tree *tree, CacheStats *out) {
+    // Check if input is valid.
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!tree || !tree->cache) return;
+
+    QueryCache *cache = tree->cache;
+    pthread_mutex_lock(&cache->lock);
+    out->capacity = cache->capacity;
+    for (size_t i = 0; i < cache->capacity; i++)
+        if (cache->entries[i].range) out->entries++;
+    out->hits = cache->hits;
+    out->misses = cache->misses;
+    out->evictions = cache->evictions;
+    out->stale = cache->stale;
+    pthread_mutex_unlock(&cache->lock);
+
+    if (out->hits + out->misses)
+        out->hitRate = (double)out->hits / (double)(out->hits + out->misses);
+}
+
+/**
+ * @brief Free the memory of a query cache.
+ * The results still shared with callers are freed when they destroy them.
+ *
+ * @param cache Pointer to a query cache.
+ */
+void destroyCache(QueryCache *cache) {
+    // Check if input is valid.
+    if (!cache) return;
+
+    for (size_t i = 0; i < cache->capacity; i++)
+        if (cache->entries[i].range) dropEntry(cache, &cache->entries[i]);
+    pthread_mutex_destroy(&cache->lock);
+    memFree(cache->memory, cache->entries, sizeof(CacheEntry) * cache->capacity);
+    memFree(cache->memory, cache, sizeof(QueryCache));
+}
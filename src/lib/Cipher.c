@@ -9,27 +9,242 @@
  * @param tree A pointer to the AVL tree to build.
  */
 void buildTreeFromFile(const char *file, Tree *tree) {
+	TRACE_SCOPE("buildTreeFromFile");
 	// Check if input is valid.
     if (!file || !tree) {
         printf("Invalid file or tree pointer.\n");
         return;
     }
 
-    FILE *fin = fopen(file, "r");
+    const char *data = NULL;
+    size_t size = 0;
     // Handle [ERR]: file opening.
-    if (!fin) {
+    if (mapFile(file, &data, &size) < 0) {
         printf("[ERR]: opening the file for reading.\n");
         return;
     }
 
     // Determine size of each word.
-    int offset = 0;
-    char buff[BUFFER_LEN];
-    // Each line, and each word from each line is processed and added in AVL tree.
-    while (fgets(buff, sizeof(buff), fin))
-        processLine(tree, buff, &offset);
+    int64_t offset = 0;
+    char word[BUFFER_LEN];
+    WordSink sink = { tree, word, sizeof(word), 0 };
+    // The whole file is tokenized at once, words are never split between reads.
+    tokenize(data, size, &offset, insertSpan, &sink);
 
-    fclose(fin);
+    if (sink.owned) free(sink.word);
+    if (data) munmap((void *)data, size);
+}
+
+/**
+ * @brief Start a resumable build of an append-only file.
+ * The file is indexed like `buildTreeFromFile`, and the handle remembers the
+ * bytes read, the running word offset and the word cut off by the end of the
+ * file, so `resumeBuild` only reads the bytes appended afterwards.
+ * 
+ * @param file The name of the file to read data from.
+ * @param tree A pointer to the AVL tree to build.
+ * @return The build handle, or NULL if the file can't be read.
+ */
+Build* openBuild(const char *file, Tree *tree) {
+	// Check if input is valid.
+    if (!file || !tree) {
+        printf("Invalid file or tree pointer.\n");
+        return NULL;
+    }
+
+    Build *build = calloc(1, sizeof(Build));
+    char *path = malloc(strlen(file) + 1);
+    // Handle [ERR]: allocation.
+    if (!build || !path) {
+        printf("[ERR]: at malloc...\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(path, file);
+    build->file = path;
+    build->tree = tree;
+
+    if (resumeBuild(build) < 0) {
+        closeBuild(build);
+        return NULL;
+    }
+    return build;
+}
+
+/**
+ * @brief Add the words appended to the file since the last build.
+ * Only the bytes after the last complete word are mapped, so the call costs
+ * O(appended + cut word) whatever the size of the file. The word cut off by
+ * the end of the file is in the tree, like `buildTreeFromFile` leaves it; if
+ * the appended bytes go on with it, its entry is deleted and the whole word
+ * inserted instead. The tree is then the one `buildTreeFromFile` would build
+ * from the whole file.
+ * 
+ * @param build The build handle.
+ * @return The number of words inserted, or -1 if the file can't be read or got shorter.
+ */
+long resumeBuild(Build *build) {
+    TRACE_SCOPE("resumeBuild");
+    // Check if input is valid.
+    if (!build) return -1;
+
+    int fd = open(build->file, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0 || (size_t)info.st_size < build->done + build->tail) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    size_t size = (size_t)info.st_size;
+    if (size == build->done + build->tail) {
+        close(fd);
+        return 0;
+    }
+
+    // The mapping starts at the page holding the cut word.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t from = build->done - build->done % page;
+    void *map = mmap(NULL, size - from, PROT_READ, MAP_PRIVATE, fd, (off_t)from);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    const char *data = (const char *)map + (build->done - from);
+    size_t length = size - build->done;
+
+    char word[BUFFER_LEN];
+    WordSink sink = { build->tree, word, sizeof(word), 0 };
+    size_t start = 0;
+    if (build->tail && !isSeparator(data[build->tail])) {
+        // The cut word goes on, its entry is replaced by the whole word.
+        Span cut = { data, build->tail, build->offset };
+        deleteNode(build->tree, copySpan(&sink, &cut));
+    } else {
+        // The cut word was complete.
+        start = build->tail;
+        build->offset += (int64_t)build->tail;
+    }
+
+    long words = (long)tokenize(data + start, length - start, &build->offset, insertSpan, &sink);
+
+    // The last word may go on in the next append, it's read again then.
+    size_t tail = 0;
+    while (tail < length - start && !isSeparator(data[length - tail - 1])) tail++;
+    build->offset -= (int64_t)tail;
+    build->done = size - tail;
+    build->tail = tail;
+
+    if (sink.owned) free(sink.word);
+    munmap(map, size - from);
+    return words;
+}
+
+/**
+ * @brief Release a build handle, the tree it built is kept.
+ * 
+ * @param build The build handle (may be NULL).
+ */
+void closeBuild(Build *build) {
+    // Check if input is valid.
+    if (!build) return;
+
+    free(build->file);
+    free(build);
+}
+
+/**
+ * @brief Map a file in memory and split it into word views.
+ * The file stays mapped until `unmapCorpus`, each word is a (pointer, length)
+ * view into the mapping, so words are neither copied nor truncated.
+ * 
+ * @param file The name of the file to map.
+ * @return Corpus* pointer to the mapped corpus or NULL.
+ */
+Corpus* mapCorpus(const char *file) {
+    // Check if input is valid.
+    if (!file) {
+        printf("Invalid file.\n");
+        return NULL;
+    }
+
+    Corpus *corpus = calloc(1, sizeof(Corpus));
+    if (!corpus) return NULL;
+
+    // Handle [ERR]: file opening.
+    if (mapFile(file, &corpus->data, &corpus->size) < 0) {
+        printf("[ERR]: opening the file for reading.\n");
+        free(corpus);
+        return NULL;
+    }
+
+    // Count the words first, so the views are allocated only once.
+    corpus->count = countWords(corpus->data, corpus->size);
+    corpus->words = malloc(sizeof(View) * (corpus->count + 1));
+    corpus->offsets = malloc(sizeof(int64_t) * (corpus->count + 1));
+    if (!corpus->words || !corpus->offsets) {
+        printf("[ERR]: at malloc...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Fill the views, offsets follow the same rule as `insertWord`.
+    int64_t offset = 0;
+    corpus->count = 0;
+    tokenize(corpus->data, corpus->size, &offset, collectSpan, corpus);
+
+    return corpus;
+}
+
+/**
+ * @brief Store a word span as the next view of a corpus.
+ * 
+ * @param ctx  Pointer to the corpus being filled.
+ * @param span The word and its offset.
+ */
+void collectSpan(void *ctx, const Span *span) {
+    Corpus *corpus = (Corpus *)ctx;
+    corpus->words[corpus->count].data = span->word;
+    corpus->words[corpus->count].length = span->length;
+    corpus->offsets[corpus->count] = span->offset;
+    corpus->count++;
+}
+
+/**
+ * @brief Release a corpus created by `mapCorpus`.
+ * Trees holding views into the corpus must be destroyed before.
+ * 
+ * @param corpus Pointer to the corpus to release.
+ */
+void unmapCorpus(Corpus *corpus) {
+    // Check if input is valid.
+    if (!corpus) return;
+
+    if (corpus->data) munmap((void *)corpus->data, corpus->size);
+    free(corpus->words);
+    free(corpus->offsets);
+    free(corpus);
+}
+
+/**
+ * @brief Build an AVL tree of borrowed words from a memory mapped file.
+ * No word is allocated: the tree keys are the corpus views and the values its offsets.
+ * The tree must be created with `borrowElem`/`releaseElem` for both elements and values
+ * and `compareView`, and it must be destroyed before the returned corpus is unmapped.
+ * 
+ * @param file The name of the file to read data from.
+ * @param tree A pointer to the AVL tree to build.
+ * @return Corpus* the mapped corpus the tree borrows from, or NULL.
+ */
+Corpus* buildTreeFromMap(const char *file, Tree *tree) {
+	// Check if input is valid.
+    if (!file || !tree) {
+        printf("Invalid file or tree pointer.\n");
+        return NULL;
+    }
+
+    Corpus *corpus = mapCorpus(file);
+    if (!corpus) return NULL;
+
+    // Each word view is added in AVL tree.
+    for (size_t word = 0; word < corpus->count; word++)
+        insertNode(tree, corpus->words + word, corpus->offsets + word);
+
+    return corpus;
 }
 
 /**
@@ -44,6 +259,7 @@ void buildTreeFromFile(const char *file, Tree *tree) {
  * @param method  Set to 1 for encryption, 0 for decryption.
  */
 void processFile(const char *infile, const char *outfile, Range *elem, int method) {
+    TRACE_SCOPE("processFile");
     FILE *fin = fopen(infile, "r");
     FILE *fout = fopen(outfile, "w");
     // Handle [ERR]: files opening.
@@ -0,0 +1,139 @@
+#include "../include/Finger.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Descend from `root` to the node holding an element.
+ *
+ * @param tree Pointer to a tree object.
+ * @param root Pointer to the node to start descending from.
+ * @param elem Pointer to the element to find.
+ * @param last Where to store the last visited node.
+ * @return The node holding the element, or NULL.
+ */
+static TreeNode* descendFrom(Tree *tree, TreeNode *root, void *elem, TreeNode **last) {
+    while (root) {
+        *last = root;
+        int comp = COMPARE(root->elem, elem);
+        if (comp > 0) root = root->left;
+        else if (comp < 0) root = root->right;
+        else return root;
+    }
+
+    // Node wasn't found.
+    return NULL;
+}
+
+/**
+ * @brief Search for an element outward from a node of the tree.
+ * The neighbour key is checked first through the threaded list. Then the
+ * search hops up between the bounds of the subtree of the node, until the
+ * element falls between the node and its bound, and descends into one child.
+ * A far element climbs up to the root, like a plain descent from the root.
+ *
+ * @param finger Pointer to a finger.
+ * @param node   Tree node to start from.
+ * @param elem   Pointer to the element to find.
+ * @param last   Where to store the last visited node.
+ * @return The node holding the element, or NULL.
+ */
+static TreeNode* searchNear(Finger *finger, TreeNode *node, void *elem, TreeNode **last) {
+    Tree *tree = finger->tree;
+
+    *last = node;
+    int comp = COMPARE(node->elem, elem);
+    if (!comp) {
+        finger->near++;
+        return node;
+    }
+
+    // A key missing between the node and its neighbour is answered here.
+    int after = comp < 0;
+    TreeNode *neighbour = after ? node->end->next : node->prev;
+    int side = neighbour ? COMPARE(neighbour->elem, elem) : 0;
+    if (!neighbour || (after ? side > 0 : side < 0)) {
+        finger->near++;
+        return NULL;
+    }
+    if (!side) {
+        // The previous entry may be a duplicate, its key is headed by the predecessor.
+        *last = after ? neighbour : predecessor(node);
+        finger->near++;
+        return *last;
+    }
+
+    // Hop up to the bounds of the subtree until the element falls inside it.
+    TreeNode *bound = node;
+    while (bound) {
+        // The bound is the first ancestor on the side of the element.
+        TreeNode *child = node;
+        bound = node->parent;
+        while (bound && (after ? bound->right : bound->left) == child)
+            child = bound, bound = bound->parent;
+        if (!bound) break;
+
+        comp = COMPARE(bound->elem, elem);
+        if (!comp) {
+            *last = bound;
+            finger->near++;
+            return bound;
+        }
+        if (after ? comp > 0 : comp < 0) break;
+        node = bound;
+    }
+
+    // The element is between the node and its bound, so in one child subtree.
+    // Without a bound the climb went up to the root, which is a far lookup.
+    if (bound) finger->near++;
+    else finger->descents++;
+    *last = node;
+    return descendFrom(tree, after ? node->right : node->left, elem, last);
+}
+
+/**
+ * @brief Bind a finger to a tree.
+ * A finger is a search handle, each thread (or caller) keeps its own.
+ *
+ * @param finger Pointer to the finger to initialize.
+ * @param tree   Pointer to the tree searched through the finger.
+ */
+void initFinger(Finger *finger, Tree *tree) {
+    // Check if input is valid.
+    if (!finger) return;
+
+    memset(finger, 0, sizeof(*finger));
+    finger->tree = tree;
+}
+
+/**
+ * @brief Search for an element starting from the last visited node.
+ * Consecutive lookups of close keys take O(log d) steps, where d is the
+ * distance in key order, instead of a descent from `tree->root`. The finger
+ * moves to the node found, or to the last node visited for a missing key.
+ *
+ * @param finger Pointer to a finger bound to a tree.
+ * @param elem   Pointer to the element to find.
+ * @return The node holding the element, or NULL.
+ */
+TreeNode* fingerSearch(Finger *finger, void *elem) {
+    // Check if input is valid.
+    if (!finger || !finger->tree || !elem) return NULL;
+    Tree *tree = finger->tree;
+    if (!tree->root) return NULL;
+
+    STAT_OP_BEGIN(tree);
+    // The node may be freed if a node left the tree since, start from the root.
+    TreeNode *start = (finger->removals == tree->removals) ? finger->node : NULL;
+    TreeNode *last = NULL, *found = NULL;
+    if (start) {
+        found = searchNear(finger, start, elem, &last);
+    } else {
+        found = descendFrom(tree, tree->root, elem, &last);
+        finger->descents++;
+    }
+    STAT_OP_END(tree, STAT_SEARCH);
+
+    finger->node = last;
+    finger->removals = tree->removals;
+    // A key whose head is a tombstone has no live entries.
+    return (found && found->dead) ? NULL : found;
+}
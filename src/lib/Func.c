@@ -1,6 +1,133 @@
 #include "../include/Func.h"
 #include "../utils/Utils.h"
 
+// Bytes allocated by `allocPayload` on this thread, see `payloadBytes`.
+static _Thread_local size_t payloadTally = 0;
+
+/**
+ * @brief Count bytes allocated (or released) in a memory.
+ * Readers of a tree allocate their query ranges concurrently, the
+ * counters are updated with relaxed atomics.
+ * 
+ * @param memory The memory counting the bytes.
+ * @param added  Bytes allocated.
+ * @param freed  Bytes released.
+ */
+static void countMemory(Memory *memory, size_t added, size_t freed) {
+	size_t live = __atomic_add_fetch(&memory->live, added - freed, __ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&memory->peak, __ATOMIC_RELAXED);
+	while (live > peak && !__atomic_compare_exchange_n(&memory->peak, &peak, live, 1,
+													   __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * @brief Allocate memory through an allocator and count it.
+ * 
+ * @param memory The memory to allocate from.
+ * @param size   Number of bytes to allocate.
+ * @return A pointer to the allocated memory, or NULL (out of memory or budget).
+ */
+void* memAlloc(Memory *memory, size_t size) {
+	const Allocator *allocator = memory->allocator;
+	void *ptr = (allocator && allocator->alloc) ? allocator->alloc(allocator->ctx, size) : malloc(size);
+
+	if (ptr) countMemory(memory, size, 0);
+	return ptr;
+}
+
+/**
+ * @brief Resize memory allocated through an allocator and count it.
+ * On failure the memory is left as it was.
+ * 
+ * @param memory  The memory the block was allocated from.
+ * @param ptr     The block to resize.
+ * @param oldSize Current size of the block.
+ * @param size    New size of the block.
+ * @return A pointer to the resized memory, or NULL.
+ */
+void* memResize(Memory *memory, void *ptr, size_t oldSize, size_t size) {
+	const Allocator *allocator = memory->allocator;
+	void *resized = NULL;
+
+	if (!allocator || !allocator->alloc) {
+		resized = realloc(ptr, size);
+	} else if (allocator->resize) {
+		resized = allocator->resize(allocator->ctx, ptr, oldSize, size);
+	} else if ((resized = allocator->alloc(allocator->ctx, size))) {
+		// No resize function, move the data to a new block.
+		memcpy(resized, ptr, oldSize < size ? oldSize : size);
+		allocator->release(allocator->ctx, ptr, oldSize);
+	}
+
+	if (resized) countMemory(memory, size, oldSize);
+	return resized;
+}
+
+/**
+ * @brief Release memory allocated through an allocator.
+ * 
+ * @param memory The memory the block was allocated from.
+ * @param ptr    The block to release (may be NULL).
+ * @param size   Size of the block.
+ */
+void memFree(Memory *memory, void *ptr, size_t size) {
+	if (!ptr) return;
+
+	const Allocator *allocator = memory->allocator;
+	if (allocator && allocator->alloc) allocator->release(allocator->ctx, ptr, size);
+	else free(ptr);
+	countMemory(memory, 0, size);
+}
+
+/**
+ * @brief Move the count of a block from one memory to another.
+ * The block isn't touched, both memories must share its allocator.
+ * 
+ * @param from The memory counting the block until now, or NULL.
+ * @param to   The memory counting the block afterwards, or NULL.
+ * @param size Size of the block.
+ */
+void memTransfer(Memory *from, Memory *to, size_t size) {
+	if (from) countMemory(from, 0, size);
+	if (to) countMemory(to, size, 0);
+}
+
+/**
+ * @brief Get the bytes allocated by `allocPayload` on the current thread.
+ * The count only grows, the bytes of the payloads created between two
+ * calls are the difference. Trees count them in their memory with the
+ * node holding the payloads (see `createTreeNode`).
+ * 
+ * @return The bytes allocated so far.
+ */
+size_t payloadBytes(void) {
+	return payloadTally;
+}
+
+/**
+ * @brief Allocate a payload (an element or a value).
+ * Payloads are plain heap blocks, they don't depend on the tree that
+ * created them: the data handed out by `deleteNodeExtract` may outlive
+ * its tree, and malloc'd data may be handed to `insertNodeAdopt`.
+ * 
+ * @param size Number of bytes of the payload.
+ * @return A pointer to the payload, or NULL.
+ */
+void* allocPayload(size_t size) {
+	void *payload = malloc(size);
+	if (payload) payloadTally += size;
+	return payload;
+}
+
+/**
+ * @brief Release a payload, allocated with `allocPayload` or malloc.
+ * 
+ * @param payload A pointer to the payload (may be NULL).
+ */
+void freePayload(void *payload) {
+	free(payload);
+}
+
 /**
  * @brief Create an integer value.
  * 
@@ -8,8 +135,8 @@
  * @return A pointer to the created integer value.
  */
 void* createInt(void* value) {
-	int *l = malloc(sizeof(int));
-	*l = *((int *) (value));
+	int *l = allocPayload(sizeof(int));
+	if (l) *l = *((int *) (value));
 	return l;
 }
 
@@ -19,7 +146,7 @@ void* createInt(void* value) {
  * @param value A pointer to the integer value to destroy.
  */
 void destroyInt(void *value) {
-	free((int*)value);
+	freePayload(value);
 }
 
 /**
@@ -42,9 +169,11 @@ int compareInt(void *value1, void *value2) {
  * @return A pointer to the created string element.
  */
 void* createStr(void *str){
-	char *elem = malloc(LENGTH_ELEMENT + 1);
-	strncpy(elem, (char *)str, LENGTH_ELEMENT);
-	elem[LENGTH_ELEMENT] = '\0';
+	char *elem = allocPayload(LENGTH_ELEMENT + 1);
+	if (elem) {
+		strncpy(elem, (char *)str, LENGTH_ELEMENT);
+		elem[LENGTH_ELEMENT] = '\0';
+	}
 	return elem;
 }
 
@@ -54,7 +183,7 @@ void* createStr(void *str){
  * @param str A pointer to the string element to destroy.
  */
 void destroyStr(void *str){
-	free((char *)str);
+	freePayload(str);
 }
 
 /**
@@ -73,14 +202,14 @@ int compareStr(void *str1, void *str2) {
 }
 
 /**
- * @brief Create an integer index.
+ * @brief Create a 64-bit integer index.
  * 
- * @param index A pointer to the integer index.
+ * @param index A pointer to the 64-bit integer index.
  * @return A pointer to the created integer index.
  */
 void* createIdx(void *index){
-	int *idx = (int*) malloc(sizeof(int));
-	*idx = *((int*) index);
+	int64_t *idx = (int64_t*) allocPayload(sizeof(int64_t));
+	if (idx) *idx = *((int64_t*) index);
 	return idx;
 }
 
@@ -90,5 +219,168 @@ void* createIdx(void *index){
  * @param index A pointer to the integer index to destroy.
  */
 void destroyIdx(void *index){
-	free(index);
+	freePayload(index);
+}
+
+/**
+ * @brief Compare two 64-bit integer indexes.
+ * 
+ * @param index1 A pointer to the first integer index.
+ * @param index2 A pointer to the second integer index.
+ * @return -1 if index1 < index2, 0 if index1 == index2, 1 if index1 > index2.
+ */
+int compareIdx(void *index1, void *index2) {
+	if (*(int64_t*)index1 < *(int64_t*)index2) return -1;
+	if (*(int64_t*)index1 > *(int64_t*)index2) return  1;
+	return 0;
+}
+
+/**
+ * @brief Serialize an integer value.
+ * 
+ * @param value  A pointer to the integer value.
+ * @param buffer Where to write the value, or NULL to get its size.
+ * @return The size of the serialized value.
+ */
+size_t packInt(void *value, void *buffer) {
+	if (buffer) memcpy(buffer, value, sizeof(int));
+	return sizeof(int);
+}
+
+/**
+ * @brief Rebuild an integer value from its serialized bytes.
+ * 
+ * @param buffer The serialized value.
+ * @param size   The size of the serialized value.
+ * @return A pointer to the created integer value, or NULL.
+ */
+void* unpackInt(const void *buffer, size_t size) {
+	if (size != sizeof(int)) return NULL;
+	int *value = allocPayload(sizeof(int));
+	if (value) memcpy(value, buffer, sizeof(int));
+	return value;
+}
+
+/**
+ * @brief Serialize a string element (without its terminator).
+ * 
+ * @param str    A pointer to the string element.
+ * @param buffer Where to write the string, or NULL to get its size.
+ * @return The size of the serialized string.
+ */
+size_t packStr(void *str, void *buffer) {
+	size_t len = strlen((char *)str);
+	if (buffer) memcpy(buffer, str, len);
+	return len;
+}
+
+/**
+ * @brief Rebuild a string element from its serialized bytes.
+ * 
+ * @param buffer The serialized string.
+ * @param size   The length of the string.
+ * @return A pointer to the created string element, or NULL.
+ */
+void* unpackStr(const void *buffer, size_t size) {
+	char *elem = allocPayload(size + 1);
+	if (elem) {
+		memcpy(elem, buffer, size);
+		elem[size] = '\0';
+	}
+	return elem;
+}
+
+/**
+ * @brief Serialize a 64-bit integer index.
+ * 
+ * @param index  A pointer to the integer index.
+ * @param buffer Where to write the index, or NULL to get its size.
+ * @return The size of the serialized index.
+ */
+size_t packIdx(void *index, void *buffer) {
+	if (buffer) memcpy(buffer, index, sizeof(int64_t));
+	return sizeof(int64_t);
+}
+
+/**
+ * @brief Rebuild a 64-bit integer index from its serialized bytes.
+ * 
+ * @param buffer The serialized index.
+ * @param size   The size of the serialized index.
+ * @return A pointer to the created integer index, or NULL.
+ */
+void* unpackIdx(const void *buffer, size_t size) {
+	if (size != sizeof(int64_t)) return NULL;
+	int64_t *idx = allocPayload(sizeof(int64_t));
+	if (idx) memcpy(idx, buffer, sizeof(int64_t));
+	return idx;
+}
+
+/**
+ * @brief Hash an integer value.
+ * 
+ * @param value A pointer to the integer value.
+ * @return The hash of the value (the index spreads it over its slots).
+ */
+uint64_t hashInt(void *value) {
+	return (uint64_t)(uint32_t)*(int *)value;
+}
+
+/**
+ * @brief Hash a string element, like `compareStr` only its first characters count.
+ * 
+ * @param str A pointer to the string.
+ * @return The hash of the string.
+ */
+uint64_t hashStr(void *str) {
+	return fnv1a(FNV_OFFSET, str, strnlen((char *)str, LENGTH_ELEMENT));
+}
+
+/**
+ * @brief Hash a string view, the whole word counts.
+ * 
+ * @param view A pointer to the string view.
+ * @return The hash of the word.
+ */
+uint64_t hashView(void *view) {
+	return fnv1a(FNV_OFFSET, ((View *)view)->data, ((View *)view)->length);
+}
+
+/**
+ * @brief Borrow an element, the tree keeps the pointer itself.
+ * 
+ * @param elem A pointer to data owned by the caller.
+ * @return The same pointer, nothing is allocated.
+ */
+void* borrowElem(void *elem){
+	return elem;
+}
+
+/**
+ * @brief Release a borrowed element, the owner frees it.
+ * 
+ * @param elem A pointer to data owned by the caller.
+ */
+void releaseElem(void *elem){
+	(void)elem;
+}
+
+/**
+ * @brief Compare two string views on their whole length.
+ * 
+ * @param view1 A pointer to the first view.
+ * @param view2 A pointer to the second view.
+ * @return -1 if view1 < view2, 0 if view1 == view2, 1 if view1 > view2.
+ */
+int compareView(void *view1, void *view2) {
+	View *v1 = (View *)view1, *v2 = (View *)view2;
+	size_t len = (v1->length < v2->length) ? v1->length : v2->length;
+	int comp = memcmp(v1->data, v2->data, len);
+
+	if (comp > 0) return 1;
+	if (comp < 0) return -1;
+	// Same prefix, the shorter word is the smaller one.
+	if (v1->length > v2->length) return 1;
+	if (v1->length < v2->length) return -1;
+	return 0;
 }
@@ -0,0 +1,213 @@
+#include "../include/Hash.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Get the first slot probed for a hash.
+ * 
+ * @param index Pointer to a hash index.
+ * @param hash  The hash of a key.
+ * @return The position of the slot.
+ */
+static size_t homeSlot(HashIndex *index, uint64_t hash) {
+    return (size_t)((hash * HASH_SPREAD) >> index->shift);
+}
+
+/**
+ * @brief Allocate the slots of a hash index.
+ * 
+ * @param index    Pointer to a hash index.
+ * @param capacity Number of slots, a power of 2.
+ * @return 1 on success, 0 if refused (the index is left as it was).
+ */
+static int allocSlots(HashIndex *index, size_t capacity) {
+    HashSlot *slots = memAlloc(index->memory, capacity * sizeof(HashSlot));
+    if (!slots) return 0;
+    index->slots = slots;
+    memset(index->slots, 0, capacity * sizeof(HashSlot));
+    index->capacity = capacity;
+    index->shift = 64;
+    while (capacity > 1) {
+        capacity >>= 1;
+        index->shift--;
+    }
+    return 1;
+}
+
+/**
+ * @brief Place a slot in the table, the key isn't in it yet.
+ * 
+ * @param index Pointer to a hash index.
+ * @param slot  The slot to place.
+ */
+static void placeSlot(HashIndex *index, HashSlot slot) {
+    size_t mask = index->capacity - 1, pos = homeSlot(index, slot.hash);
+    while (index->slots[pos].node) pos = (pos + 1) & mask;
+    index->slots[pos] = slot;
+}
+
+/**
+ * @brief Find the slot of a head node.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param node The head node, in the index.
+ * @return The position of its slot.
+ */
+static size_t slotOf(Tree *tree, TreeNode *node) {
+    HashIndex *index = tree->index;
+    size_t mask = index->capacity - 1;
+    size_t pos = homeSlot(index, tree->lambda.hash(node->elem));
+    while (index->slots[pos].node != node) pos = (pos + 1) & mask;
+    return pos;
+}
+
+/**
+ * @brief Set the hash function of a tree and build the hash index of its keys.
+ * Point lookups (`search`, `deleteNode`, duplicate inserts) then find the head
+ * of a key without descending the tree, ordered operations still use the tree.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param hash Function hashing a key (consistent with the compare function),
+ *             or NULL to drop the index.
+ * @return 1 on success, 0 if the memory was refused (the tree has no index then).
+ */
+int setTreeHash(Tree *tree, Hash hash) {
+    // Check if input is valid.
+    if (!tree) return 0;
+
+    destroyHashIndex(tree->index);
+    tree->index = NULL;
+    tree->lambda.hash = hash;
+    if (!hash) return 1;
+
+    HashIndex *index = memAlloc(&tree->memory, sizeof(HashIndex));
+    if (!index) return 0;
+    memset(index, 0, sizeof(HashIndex));
+    index->memory = &tree->memory;
+
+    // Room for every key below the maximum load (3/4).
+    size_t capacity = HASH_MIN_CAPACITY;
+    while (capacity * 3 < tree->size * 4) capacity <<= 1;
+    if (!allocSlots(index, capacity)) {
+        memFree(&tree->memory, index, sizeof(HashIndex));
+        return 0;
+    }
+    tree->index = index;
+
+    // Index the head of each duplicate chain.
+    TreeNode *head = tree->root ? minimum(tree->root) : NULL;
+    while (head) {
+        HashSlot slot = { hash(head->elem), head };
+        placeSlot(tree->index, slot);
+        tree->index->count++;
+        head = head->end->next;
+    }
+    return 1;
+}
+
+/**
+ * @brief Find the head node holding a key.
+ * 
+ * @param tree Pointer to a tree object, with a hash index.
+ * @param elem Pointer to the key to find.
+ * @return The head node holding the key, or NULL.
+ */
+TreeNode* hashFind(Tree *tree, void *elem) {
+    HashIndex *index = tree->index;
+    uint64_t hash = tree->lambda.hash(elem);
+    size_t mask = index->capacity - 1, pos = homeSlot(index, hash);
+
+    // The key is compared only when the hashes match.
+    while (index->slots[pos].node) {
+        if (index->slots[pos].hash == hash && COMPARE(index->slots[pos].node->elem, elem) == 0)
+            return index->slots[pos].node;
+        pos = (pos + 1) & mask;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Make room in the hash index for one more key, before an insert.
+ * The table doubles above the maximum load. If the memory is refused the
+ * table fills up further, as long as a slot stays empty for the probes.
+ * 
+ * @param tree Pointer to a tree object, with a hash index.
+ * @return 1 if a key can be added, 0 if the insert must fail.
+ */
+int hashReserve(Tree *tree) {
+    HashIndex *index = tree->index;
+    if ((index->count + 1) * 4 <= index->capacity * 3) return 1;
+
+    // Hashes are kept in the slots, the keys aren't hashed again.
+    HashSlot *old = index->slots;
+    size_t capacity = index->capacity;
+    if (!allocSlots(index, capacity * 2)) return index->count + 2 <= capacity;
+    for (size_t pos = 0; pos < capacity; pos++)
+        if (old[pos].node) placeSlot(index, old[pos]);
+    memFree(index->memory, old, capacity * sizeof(HashSlot));
+    return 1;
+}
+
+/**
+ * @brief Add a new head node to the hash index, room was made by `hashReserve`.
+ * 
+ * @param tree Pointer to a tree object, with a hash index.
+ * @param node The head node of a new key.
+ */
+void hashInsert(Tree *tree, TreeNode *node) {
+    HashIndex *index = tree->index;
+    HashSlot slot = { tree->lambda.hash(node->elem), node };
+    placeSlot(index, slot);
+    index->count++;
+}
+
+/**
+ * @brief Remove a head node from the hash index.
+ * The following slots are shifted back, so no tombstones are left.
+ * 
+ * @param tree Pointer to a tree object, with a hash index.
+ * @param node The head node to remove.
+ */
+void hashRemove(Tree *tree, TreeNode *node) {
+    HashIndex *index = tree->index;
+    size_t mask = index->capacity - 1;
+    size_t hole = slotOf(tree, node);
+
+    for (size_t next = (hole + 1) & mask; index->slots[next].node; next = (next + 1) & mask) {
+        // Move the slot back if the hole is between its home and itself.
+        size_t home = homeSlot(index, index->slots[next].hash);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            index->slots[hole] = index->slots[next];
+            hole = next;
+        }
+    }
+
+    index->slots[hole].node = NULL;
+    index->count--;
+}
+
+/**
+ * @brief Exchange the nodes of two slots, before the keys of the nodes are swapped.
+ * 
+ * @param tree   Pointer to a tree object, with a hash index.
+ * @param first  A head node.
+ * @param second Another head node.
+ */
+void hashSwap(Tree *tree, TreeNode *first, TreeNode *second) {
+    size_t firstPos = slotOf(tree, first), secondPos = slotOf(tree, second);
+    tree->index->slots[firstPos].node = second;
+    tree->index->slots[secondPos].node = first;
+}
+
+/**
+ * @brief Free the memory of a hash index.
+ * 
+ * @param index Pointer to a hash index.
+ */
+void destroyHashIndex(HashIndex *index) {
+    // Check if input is valid.
+    if (!index) return;
+
+    memFree(index->memory, index->slots, index->capacity * sizeof(HashSlot));
+    memFree(index->memory, index, sizeof(HashIndex));
+}
@@ -0,0 +1,216 @@
+#include "../include/Interval.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Set a greatest end to the one of no intervals.
+ *
+ * @param ctx Unused.
+ * @param acc Pointer to an int64_t.
+ */
+static void identityEnd(void *ctx, void *acc) {
+    *(int64_t *)acc = INT64_MIN;
+}
+
+/**
+ * @brief Add the end of an interval entry to a greatest end.
+ *
+ * @param ctx   Unused.
+ * @param acc   Pointer to an int64_t.
+ * @param entry The entry added, its key is an Interval.
+ */
+static void mapEnd(void *ctx, void *acc, TreeNode *entry) {
+    int64_t end = ((Interval *)entry->elem)->end;
+    if (end > *(int64_t *)acc) *(int64_t *)acc = end;
+}
+
+/**
+ * @brief Add a greatest end to another.
+ *
+ * @param ctx   Unused.
+ * @param acc   Pointer to the int64_t receiving the end.
+ * @param other Pointer to the int64_t added.
+ */
+static void combineEnd(void *ctx, void *acc, const void *other) {
+    if (*(const int64_t *)other > *(int64_t *)acc) *(int64_t *)acc = *(const int64_t *)other;
+}
+
+const Monoid endMonoid = { sizeof(int64_t), identityEnd, mapEnd, combineEnd, NULL };
+
+/**
+ * @brief Create an interval key.
+ *
+ * @param interval A pointer to the Interval to copy.
+ * @return A pointer to the created interval.
+ */
+void* createInterval(void *interval) {
+    Interval *span = allocPayload(sizeof(Interval));
+    if (span) *span = *(Interval *)interval;
+    return span;
+}
+
+/**
+ * @brief Destroy an interval key.
+ *
+ * @param interval A pointer to the interval to destroy.
+ */
+void destroyInterval(void *interval) {
+    freePayload(interval);
+}
+
+/**
+ * @brief Compare two intervals by start, then by end.
+ *
+ * @param interval1 A pointer to the first interval.
+ * @param interval2 A pointer to the second interval.
+ * @return -1 if the first interval comes first, 1 if it comes last, 0 if they are equal.
+ */
+int compareInterval(void *interval1, void *interval2) {
+    const Interval *span1 = (const Interval *)interval1, *span2 = (const Interval *)interval2;
+    if (span1->start != span2->start) return span1->start < span2->start ? -1 : 1;
+    if (span1->end != span2->end) return span1->end < span2->end ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief Create an interval tree of word spans.
+ * The keys are the spans of the words, ordered by start offset, and the
+ * values are the words. Each node keeps the greatest end of its sub-tree
+ * (see `endMonoid`), updated by the inserts, deletes and rotations, which
+ * lets the overlap queries skip the sub-trees ending before their range.
+ *
+ * @return A pointer to the created tree, or NULL.
+ */
+Tree* createIntervalTree(void) {
+    Tree *tree = createTree(createInterval, destroyInterval, createStr, destroyStr, compareInterval);
+    if (tree && !setTreeAggregate(tree, &endMonoid)) {
+        destroyTree(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+/**
+ * @brief Insert a word into an interval tree.
+ * The word covers [offset, offset + strlen(word)), the offset is then
+ * moved after it, like `insertWord` does.
+ *
+ * @param tree   Pointer to an interval tree.
+ * @param word   The word to insert.
+ * @param offset A pointer to the 64-bit offset of the word.
+ */
+void insertWordInterval(Tree *tree, const char *word, int64_t *offset) {
+    Interval span = { *offset, *offset + (int64_t)strlen(word) };
+    insertNode(tree, &span, (void *)word);
+    *offset = span.end;
+}
+
+/**
+ * @brief Insert a word span of the tokenizer into an interval tree.
+ *
+ * @param ctx  Pointer to a `WordSink` with the tree and its buffer.
+ * @param span The word and its offset.
+ */
+static void insertIntervalSpan(void *ctx, const Span *span) {
+    WordSink *sink = (WordSink *)ctx;
+    Interval interval = { span->offset, span->offset + (int64_t)span->length };
+    insertNode(sink->tree, &interval, copySpan(sink, span));
+}
+
+/**
+ * @brief Build an interval tree from the words of a file.
+ * The words get the offsets of `buildTreeFromFile`, the sum of the lengths
+ * of the previous words.
+ *
+ * @param file The name of the file to read.
+ * @param tree Pointer to an interval tree.
+ */
+void buildIntervalsFromFile(const char *file, Tree *tree) {
+    // Check if input is valid.
+    if (!file || !tree) {
+        printf("Invalid file or tree pointer.\n");
+        return;
+    }
+
+    const char *data = NULL;
+    size_t size = 0;
+    // Handle [ERR]: file opening.
+    if (mapFile(file, &data, &size) < 0) {
+        printf("[ERR]: opening the file for reading.\n");
+        return;
+    }
+
+    int64_t offset = 0;
+    char word[BUFFER_LEN];
+    WordSink sink = { tree, word, sizeof(word), 0 };
+    tokenize(data, size, &offset, insertIntervalSpan, &sink);
+
+    if (sink.owned) free(sink.word);
+    if (data) munmap((void *)data, size);
+}
+
+/**
+ * @brief Visit the spans of a sub-tree overlapping a range, in start order.
+ * A sub-tree whose greatest end is not after `from` is skipped, and so
+ * are the nodes starting at or after `to` with their right sub-tree.
+ *
+ * @param tree  Pointer to an interval tree.
+ * @param node  Root of the sub-tree.
+ * @param from  First byte of the range.
+ * @param to    End of the range (excluded).
+ * @param visit Function called for each span found.
+ * @param ctx   State passed to `visit`.
+ * @return The number of spans found.
+ */
+static size_t overlapNode(Tree *tree, TreeNode *node, int64_t from, int64_t to, Visit visit, void *ctx) {
+    const int64_t *end = nodeAggregate(tree, node);
+    if (!end || *end <= from) return 0;
+
+    size_t count = overlapNode(tree, node->left, from, to, visit, ctx);
+    const Interval *span = (const Interval *)node->elem;
+    if (span->start >= to) return count;
+
+    // The duplicates of a chain share the span.
+    if (span->end > from) {
+        for (TreeNode *entry = node; entry != node->end->next; entry = entry->next) {
+            if (entry->dead) continue;
+            if (visit) visit(ctx, entry);
+            count++;
+        }
+    }
+    return count + overlapNode(tree, node->right, from, to, visit, ctx);
+}
+
+/**
+ * @brief Visit the live spans of an interval tree overlapping a range.
+ * The spans are visited in start order. The word spans don't overlap each
+ * other, so their ends grow with their starts and the query takes
+ * O(log n + k) for k spans found. Spans nested in long ones can take
+ * up to O(log n) per span found.
+ *
+ * @param tree  Pointer to an interval tree (see `createIntervalTree`).
+ * @param from  First byte of the range.
+ * @param to    End of the range (excluded).
+ * @param visit Function called for each span found (may be NULL to count them).
+ * @param ctx   State passed to `visit`.
+ * @return The number of spans found, 0 if the tree keeps no greatest ends.
+ */
+size_t overlapQuery(Tree *tree, int64_t from, int64_t to, Visit visit, void *ctx) {
+    TRACE_SCOPE("overlapQuery");
+    // Check if input is valid.
+    if (!tree || !tree->aggregate || tree->aggregate->monoid.map != endMonoid.map || from >= to) return 0;
+
+    return overlapNode(tree, tree->root, from, to, visit, ctx);
+}
+
+/**
+ * @brief Visit the live spans of an interval tree holding a byte.
+ *
+ * @param tree  Pointer to an interval tree (see `createIntervalTree`).
+ * @param point Offset of the byte.
+ * @param visit Function called for each span found (may be NULL to count them).
+ * @param ctx   State passed to `visit`.
+ * @return The number of spans found.
+ */
+size_t stabQuery(Tree *tree, int64_t point, Visit visit, void *ctx) {
+    return overlapQuery(tree, point, point + 1, visit, ctx);
+}
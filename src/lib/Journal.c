@@ -0,0 +1,502 @@
+#include <libgen.h>
+
+#include "../include/Journal.h"
+#include "../include/Snapshot.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Make room for more bytes at the end of a buffer.
+ *
+ * @param buffer   Pointer to the buffer, moved if it grows.
+ * @param capacity Pointer to the size of the buffer.
+ * @param needed   Bytes the buffer must hold.
+ * @return 0 on success, -1 otherwise.
+ */
+static int reserveBuffer(char **buffer, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) return 0;
+
+    size_t size = *capacity ? *capacity : JOURNAL_BUFFER;
+    while (size < needed) size *= 2;
+    char *grown = realloc(*buffer, size);
+    if (!grown) return -1;
+
+    *buffer = grown;
+    *capacity = size;
+    return 0;
+}
+
+/**
+ * @brief Write a whole buffer in a file.
+ *
+ * @param fd     The file descriptor.
+ * @param data   The bytes to write.
+ * @param length Number of bytes.
+ * @return 0 on success, -1 otherwise.
+ */
+static int writeAll(int fd, const char *data, size_t length) {
+    while (length) {
+        ssize_t done = write(fd, data, length);
+        if (done < 0) return -1;
+        data += done;
+        length -= (size_t)done;
+    }
+    return 0;
+}
+
+/**
+ * @brief Flush a file to disk, and the directory holding it.
+ * The directory is synced so that a rename of the file is durable.
+ *
+ * @param path The name of the file.
+ * @return 0 on success, -1 otherwise.
+ */
+static int syncPath(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    int err = fsync(fd);
+    close(fd);
+
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    fd = open(dirname(copy), O_RDONLY);
+    free(copy);
+    if (fd < 0) return -1;
+    err |= fsync(fd);
+    close(fd);
+
+    return err ? -1 : 0;
+}
+
+/**
+ * @brief Get the checksum of a snapshot, which identifies it in the journal.
+ *
+ * @param snapshot The name of the snapshot file.
+ * @param base     Where to store the checksum.
+ * @return 0 on success, -1 if the file can't be read.
+ */
+static int snapshotBase(const char *snapshot, uint64_t *base) {
+    FILE *fin = fopen(snapshot, "rb");
+    if (!fin) return -1;
+
+    SnapshotHeader header;
+    int err = fread(&header, sizeof(header), 1, fin) == 1 ? 0 : -1;
+    fclose(fin);
+    *base = header.checksum;
+
+    return err;
+}
+
+/**
+ * @brief Create an empty journal file on top of a snapshot.
+ *
+ * @param path The name of the journal file.
+ * @param base The checksum of the snapshot.
+ * @return The file opened for appending, or -1 on failure.
+ */
+static int createJournalFile(const char *path, uint64_t base) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) return -1;
+
+    JournalHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.version = JOURNAL_VERSION;
+    header.base = base;
+
+    if (writeAll(fd, (const char *)&header, sizeof(header)) < 0 || fdatasync(fd) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Read an element of a record body.
+ *
+ * @param body   The record body.
+ * @param size   Size of the body.
+ * @param pos    Position of the element, moved after it.
+ * @param unpack Function rebuilding the element.
+ * @return The rebuilt element, or NULL if the element is invalid.
+ */
+static void* readElement(const char *body, uint32_t size, uint32_t *pos, Unpack unpack) {
+    uint32_t length;
+    if (size - *pos < sizeof(length)) return NULL;
+    memcpy(&length, body + *pos, sizeof(length));
+    *pos += sizeof(length);
+
+    if (size - *pos < length) return NULL;
+    void *elem = unpack(body + *pos, length);
+    *pos += length;
+    return elem;
+}
+
+/**
+ * @brief Apply the records of a journal to its tree.
+ * Replay stops at the first truncated or corrupted record, which is
+ * what a crash in the middle of a write leaves at the end of the file.
+ *
+ * @param tree   The tree to update, with no journal attached.
+ * @param data    The records.
+ * @param length  Size of the records.
+ * @param refused Set to 1 if the memory of an insert was refused.
+ * @return Size of the valid records (replayed before a refusal).
+ */
+static size_t replayJournal(Tree *tree, const char *data, size_t length, int *refused) {
+    size_t pos = 0;
+
+    while (length - pos >= 2 * sizeof(uint32_t)) {
+        uint32_t size, check;
+        memcpy(&size, data + pos, sizeof(size));
+        memcpy(&check, data + pos + sizeof(size), sizeof(check));
+        const char *body = data + pos + 2 * sizeof(uint32_t);
+
+        if (size < 1 || length - pos - 2 * sizeof(uint32_t) < size) break;
+        if ((uint32_t)fnv1a(FNV_OFFSET, body, size) != check) break;
+
+        // The unpacked payloads are counted with the node adopting them.
+        size_t mark = payloadBytes();
+        uint32_t at = 1;
+        void *elem = readElement(body, size, &at, tree->lambda.io.unpackElem);
+        if (!elem) break;
+
+        if (body[0] == JOURNAL_INSERT) {
+            void *value = readElement(body, size, &at, tree->lambda.io.unpackVal);
+            TreeNode *node = value ? createTreeNodeAdopt(tree, elem, value) : NULL;
+            if (!node) {
+                DELETE.deleteElem(elem);
+                if (value) DELETE.deleteVal(value);
+                *refused = value != NULL;
+                break;
+            }
+            countPayload(tree, node, payloadBytes() - mark);
+            if (!attachNode(tree, node)) {
+                destroyTreeNode(tree, node);
+                *refused = 1;
+                break;
+            }
+        } else if (body[0] == JOURNAL_DELETE) {
+            deleteNode(tree, elem);
+            DELETE.deleteElem(elem);
+        } else {
+            DELETE.deleteElem(elem);
+            break;
+        }
+
+        pos += 2 * sizeof(uint32_t) + size;
+    }
+
+    return pos;
+}
+
+/**
+ * @brief Open the journal of a tree, loading the tree from its snapshot
+ * and replaying the updates logged since then.
+ * A journal written on top of another snapshot (a crash during compaction)
+ * is already part of the snapshot and is started again, and a torn record
+ * at the end of the journal is cut off.
+ *
+ * @param path     The name of the journal file.
+ * @param snapshot The name of the snapshot file (it may not exist yet).
+ * @param funcs    Functions of the tree, including the serialize functions.
+ * @return Journal* the journal, its tree is `journal->tree`, or NULL (the
+ *         journal is left as it was if the memory was refused).
+ */
+Journal* openJournal(const char *path, const char *snapshot, const Func *funcs) {
+    // Check if input is valid.
+    if (!path || !snapshot || !funcs || !funcs->io.packElem || !funcs->io.packVal ||
+        !funcs->io.unpackElem || !funcs->io.unpackVal) {
+        printf("Invalid path or serialize functions.\n");
+        return NULL;
+    }
+
+    // Start from the snapshot, or from an empty tree.
+    Tree *tree = NULL;
+    uint64_t base = 0;
+    int restored = access(snapshot, F_OK) == 0;
+    if (restored) {
+        tree = loadTree(snapshot, funcs);
+        if (!tree || snapshotBase(snapshot, &base) < 0) {
+            printf("[ERR]: loading the snapshot of the journal.\n");
+            destroyTree(tree);
+            return NULL;
+        }
+    } else {
+        tree = createTreeAlloc(funcs->create.createElem, funcs->delete.deleteElem,
+                               funcs->create.createVal, funcs->delete.deleteVal,
+                               funcs->compare, &funcs->alloc);
+        if (!tree) {
+            printf("[ERR]: at malloc...\n");
+            return NULL;
+        }
+        tree->lambda.io = funcs->io;
+        if (funcs->valueWidth && setTreeValueWidth(tree, funcs->valueWidth)) {
+            printf("[ERR]: invalid value width...\n");
+            destroyTree(tree);
+            return NULL;
+        }
+        if ((funcs->hash && !setTreeHash(tree, funcs->hash)) ||
+            (funcs->compareVal && !setTreeValueIndex(tree, funcs->compareVal))) {
+            printf("[ERR]: at malloc...\n");
+            destroyTree(tree);
+            return NULL;
+        }
+    }
+
+    // Replay the journal if it was written on top of this snapshot.
+    const char *data = NULL;
+    size_t size = 0, valid = 0;
+    int fresh = 1, lost = 0, refused = 0;
+    if (mapFile(path, &data, &size) == 0) {
+        JournalHeader header;
+        if (size >= sizeof(header)) {
+            memcpy(&header, data, sizeof(header));
+            fresh = memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) ||
+                    header.version != JOURNAL_VERSION || header.base != base;
+            // The journal needs a snapshot that is missing, don't drop its updates.
+            lost = fresh && !restored && header.base != 0;
+        }
+        if (!fresh)
+            valid = sizeof(header) + replayJournal(tree, data + sizeof(header), size - sizeof(header), &refused);
+        if (data) munmap((void *)data, size);
+    }
+    // The records after a refused insert aren't torn, they must not be cut off.
+    if (refused) {
+        printf("[ERR]: at malloc...\n");
+        destroyTree(tree);
+        return NULL;
+    }
+
+    int fd = -1;
+    if (fresh && !lost) {
+        fd = createJournalFile(path, base);
+    } else if (!fresh) {
+        // Cut off a torn record, new records are appended after the valid ones.
+        fd = open(path, O_WRONLY | O_APPEND);
+        if (fd >= 0 && valid < size && (ftruncate(fd, (off_t)valid) < 0 || fdatasync(fd) < 0)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    // Handle [ERR]: file opening.
+    if (fd < 0) {
+        printf("[ERR]: opening the journal.\n");
+        destroyTree(tree);
+        return NULL;
+    }
+
+    Journal *journal = calloc(1, sizeof(Journal));
+    if (!journal || !(journal->path = strdup(path)) || !(journal->snapshot = strdup(snapshot))) {
+        printf("[ERR]: at malloc...\n");
+        exit(EXIT_FAILURE);
+    }
+    journal->tree = tree;
+    journal->fd = fd;
+    pthread_mutex_init(&journal->lock, NULL);
+    pthread_cond_init(&journal->synced, NULL);
+
+    // From now on the updates of the tree are logged.
+    tree->journal = journal;
+    return journal;
+}
+
+/**
+ * @brief Log an update of the tree, in memory until the next commit.
+ * Records must be appended in the order the updates are applied, which
+ * the tree functions do while the caller holds the tree for writing.
+ *
+ * @param journal Pointer to a journal object.
+ * @param op      The update, insert or delete.
+ * @param elem    The element inserted or deleted.
+ * @param value   The value inserted (ignored for deletes).
+ * @return 0 on success, -1 otherwise.
+ */
+int appendJournal(Journal *journal, JournalOp op, void *elem, void *value) {
+    // Check if input is valid.
+    if (!journal || !elem) return -1;
+
+    Func *lambda = &journal->tree->lambda;
+    size_t elemSize = lambda->io.packElem(elem, NULL);
+    size_t valSize = op == JOURNAL_INSERT ? lambda->io.packVal(value, NULL) : 0;
+    size_t body = 1 + sizeof(uint32_t) + elemSize +
+                  (op == JOURNAL_INSERT ? sizeof(uint32_t) + valSize : 0);
+    if (body > UINT32_MAX) return -1;
+
+    pthread_mutex_lock(&journal->lock);
+    if (journal->failed ||
+        reserveBuffer(&journal->pending, &journal->capacity,
+                      journal->length + 2 * sizeof(uint32_t) + body) < 0) {
+        pthread_mutex_unlock(&journal->lock);
+        return -1;
+    }
+
+    // Body first, the checksum covers it.
+    char *record = journal->pending + journal->length;
+    char *pos = record + 2 * sizeof(uint32_t);
+    uint32_t length = (uint32_t)elemSize;
+    *pos++ = (char)op;
+    memcpy(pos, &length, sizeof(length));
+    pos += sizeof(length);
+    lambda->io.packElem(elem, pos);
+    pos += elemSize;
+    if (op == JOURNAL_INSERT) {
+        length = (uint32_t)valSize;
+        memcpy(pos, &length, sizeof(length));
+        pos += sizeof(length);
+        lambda->io.packVal(value, pos);
+    }
+
+    uint32_t size = (uint32_t)body, check = (uint32_t)fnv1a(FNV_OFFSET, record + 2 * sizeof(uint32_t), body);
+    memcpy(record, &size, sizeof(size));
+    memcpy(record + sizeof(size), &check, sizeof(check));
+
+    journal->length += 2 * sizeof(uint32_t) + body;
+    journal->appended++;
+    pthread_mutex_unlock(&journal->lock);
+
+    return 0;
+}
+
+/**
+ * @brief Make every update logged so far durable (group commit).
+ * The first waiting writer becomes the leader: it takes the records of
+ * every writer, writes them and syncs the file once, while the others
+ * wait for it. Writers arriving meanwhile are batched by the next leader.
+ * Call it after releasing the tree, so that other writers can go on.
+ *
+ * @param journal Pointer to a journal object.
+ * @return 0 once the updates are on disk, -1 if a write failed.
+ */
+int commitJournal(Journal *journal) {
+    // Check if input is valid.
+    if (!journal) return -1;
+
+    pthread_mutex_lock(&journal->lock);
+    uint64_t target = journal->appended;
+
+    while (journal->durable < target && !journal->failed) {
+        // A batch is being synced, it may already hold our records.
+        if (journal->syncing) {
+            pthread_cond_wait(&journal->synced, &journal->lock);
+            continue;
+        }
+
+        // Lead the next batch, appends go on in the other buffer.
+        char *batch = journal->pending;
+        size_t length = journal->length, capacity = journal->capacity;
+        uint64_t last = journal->appended;
+        journal->pending = journal->writing;
+        journal->capacity = journal->writeCapacity;
+        journal->length = 0;
+        journal->writing = batch;
+        journal->writeCapacity = capacity;
+        journal->syncing = 1;
+        pthread_mutex_unlock(&journal->lock);
+
+        int err = writeAll(journal->fd, batch, length);
+        if (!err) err = fdatasync(journal->fd);
+
+        pthread_mutex_lock(&journal->lock);
+        journal->syncing = 0;
+        if (err) {
+            journal->failed = 1;
+            // Handle [ERR]: writing.
+            printf("[ERR]: writing the journal.\n");
+        } else {
+            journal->durable = last;
+            journal->syncs++;
+        }
+        pthread_cond_broadcast(&journal->synced);
+    }
+
+    int err = journal->failed ? -1 : 0;
+    pthread_mutex_unlock(&journal->lock);
+
+    return err;
+}
+
+/**
+ * @brief Compact the journal: save the tree in a fresh snapshot and start
+ * an empty journal on top of it. Both are written aside then renamed, so a
+ * crash leaves either the old pair or the new one.
+ * No update of the tree may run meanwhile (hold the tree for writing).
+ *
+ * @param journal Pointer to a journal object.
+ * @return 0 on success, -1 otherwise (the old journal stays in use).
+ */
+int compactJournal(Journal *journal) {
+    // Check if input is valid.
+    if (!journal) return -1;
+
+    size_t pathLength = strlen(journal->path), snapLength = strlen(journal->snapshot);
+    char *tmpPath = malloc(pathLength + 5), *tmpSnap = malloc(snapLength + 5);
+    if (!tmpPath || !tmpSnap) {
+        printf("[ERR]: at malloc...\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(tmpPath, journal->path, pathLength);
+    memcpy(tmpPath + pathLength, ".tmp", 5);
+    memcpy(tmpSnap, journal->snapshot, snapLength);
+    memcpy(tmpSnap + snapLength, ".tmp", 5);
+
+    pthread_mutex_lock(&journal->lock);
+    while (journal->syncing)
+        pthread_cond_wait(&journal->synced, &journal->lock);
+
+    uint64_t base = 0;
+    int fd = -1;
+    int err = journal->failed ? -1 : 0;
+    if (!err) err = saveTree(journal->tree, tmpSnap);
+    if (!err) err = syncPath(tmpSnap);
+    if (!err) err = snapshotBase(tmpSnap, &base);
+    if (!err) err = (fd = createJournalFile(tmpPath, base)) < 0 ? -1 : 0;
+    if (!err) err = rename(tmpSnap, journal->snapshot);
+    if (!err) err = rename(tmpPath, journal->path);
+    if (!err) err = syncPath(journal->path);
+
+    if (err) {
+        // Handle [ERR]: compaction, keep logging in the old journal.
+        printf("[ERR]: compacting the journal.\n");
+        if (fd >= 0) close(fd);
+        remove(tmpSnap);
+        remove(tmpPath);
+    } else {
+        // The snapshot holds every update, pending records included.
+        close(journal->fd);
+        journal->fd = fd;
+        journal->length = 0;
+        journal->durable = journal->appended;
+        pthread_cond_broadcast(&journal->synced);
+    }
+    pthread_mutex_unlock(&journal->lock);
+
+    free(tmpPath);
+    free(tmpSnap);
+    return err ? -1 : 0;
+}
+
+/**
+ * @brief Commit the journal, detach it from its tree and free it.
+ * The tree stays valid and must be destroyed by the caller.
+ *
+ * @param journal Pointer to a journal object.
+ * @return 0 if every update is on disk, -1 otherwise.
+ */
+int closeJournal(Journal *journal) {
+    // Check if input is valid.
+    if (!journal) return -1;
+
+    int err = commitJournal(journal);
+    journal->tree->journal = NULL;
+    if (close(journal->fd) < 0) err = -1;
+
+    pthread_mutex_destroy(&journal->lock);
+    pthread_cond_destroy(&journal->synced);
+    free(journal->pending);
+    free(journal->writing);
+    free(journal->path);
+    free(journal->snapshot);
+    free(journal);
+
+    return err;
+}
@@ -0,0 +1,357 @@
+#include "../include/KeyView.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Check if a key is within the bounds of a view.
+ *
+ * @param view Pointer to a view.
+ * @param elem Pointer to the key.
+ * @return 1 if the view holds the entries of the key, 0 otherwise.
+ */
+static int inView(KeyView *view, void *elem) {
+    Tree *tree = view->tree;
+    if (view->left && COMPARE(elem, view->left) < 0) return 0;
+    if (view->right && COMPARE(elem, view->right) > 0) return 0;
+    return 1;
+}
+
+/**
+ * @brief Find the first entry of a view after (or at) a key.
+ * The chunks are searched by their last key, then the entries of one chunk,
+ * so the search takes O(log n) comparisons.
+ *
+ * @param view  Pointer to a view.
+ * @param elem  Pointer to the key.
+ * @param upper 1 for the first entry above the key, 0 for the first not below it.
+ * @param chunk Where to store the chunk of the entry (`view->count` at the end).
+ * @param index Where to store the index of the entry in its chunk.
+ */
+static void locateEntry(KeyView *view, void *elem, int upper, size_t *chunk, size_t *index) {
+    Tree *tree = view->tree;
+    size_t low = 0, high = view->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        ViewChunk *part = view->chunks[mid];
+        int comp = COMPARE(part->elems[part->count - 1], elem);
+        if (comp > 0 || (!upper && !comp)) high = mid;
+        else low = mid + 1;
+    }
+    *chunk = low;
+    *index = 0;
+    if (low == view->count) return;
+
+    ViewChunk *part = view->chunks[low];
+    size_t first = 0, last = part->count - 1;
+    while (first < last) {
+        size_t mid = first + (last - first) / 2;
+        int comp = COMPARE(part->elems[mid], elem);
+        if (comp > 0 || (!upper && !comp)) last = mid;
+        else first = mid + 1;
+    }
+    *index = first;
+}
+
+/**
+ * @brief Make room for one more chunk in the chunk array of a view.
+ *
+ * @param view Pointer to a view.
+ * @return 1 on success, 0 if the memory was refused.
+ */
+static int growChunks(KeyView *view) {
+    if (view->count < view->capacity) return 1;
+
+    Memory *memory = &view->tree->memory;
+    size_t capacity = view->capacity ? view->capacity * 2 : INIT_LEN;
+    ViewChunk **chunks = view->chunks ? memResize(memory, view->chunks, sizeof(ViewChunk *) * view->capacity,
+                                                  sizeof(ViewChunk *) * capacity)
+                                      : memAlloc(memory, sizeof(ViewChunk *) * capacity);
+    if (!chunks) return 0;
+    view->chunks = chunks;
+    view->capacity = capacity;
+    return 1;
+}
+
+/**
+ * @brief Add an empty chunk to a view, the spare one if there is one.
+ *
+ * @param view Pointer to a view.
+ * @param at   Position of the new chunk.
+ * @return The new chunk, or NULL if the memory was refused.
+ */
+static ViewChunk* addChunk(KeyView *view, size_t at) {
+    if (!growChunks(view)) return NULL;
+
+    ViewChunk *chunk = view->spare;
+    if (chunk) view->spare = NULL;
+    else if (!(chunk = memAlloc(&view->tree->memory, sizeof(ViewChunk)))) return NULL;
+    chunk->count = 0;
+    memmove(view->chunks + at + 1, view->chunks + at, sizeof(ViewChunk *) * (view->count - at));
+    view->chunks[at] = chunk;
+    view->count++;
+    return chunk;
+}
+
+/**
+ * @brief Remove the entries [from, to) of a chunk, and the chunk once empty.
+ *
+ * @param view  Pointer to a view.
+ * @param chunk Position of the chunk.
+ * @param from  First entry removed.
+ * @param to    End of the entries removed.
+ */
+static void removeEntries(KeyView *view, size_t chunk, size_t from, size_t to) {
+    ViewChunk *part = view->chunks[chunk];
+    size_t tail = part->count - to;
+    memmove(part->elems + from, part->elems + to, sizeof(void *) * tail);
+    memmove(part->letters + from, part->letters + to, sizeof(int) * tail);
+    part->count -= to - from;
+    view->size -= to - from;
+    if (part->count) return;
+
+    // An emptied chunk is kept for the next split.
+    if (view->spare) memFree(&view->tree->memory, part, sizeof(ViewChunk));
+    else view->spare = part;
+    memmove(view->chunks + chunk, view->chunks + chunk + 1, sizeof(ViewChunk *) * (view->count - chunk - 1));
+    view->count--;
+}
+
+/**
+ * @brief Add an entry to a view, after the entries with the same key.
+ * A full chunk is split in two halves first, so an insert moves at most
+ * VIEW_CHUNK entries, plus one chunk pointer per chunk for a split. The
+ * new chunk was reserved by `viewReserve`.
+ *
+ * @param view   Pointer to a view.
+ * @param elem   Key of the entry.
+ * @param letter Value of the entry.
+ */
+static void insertEntry(KeyView *view, void *elem, int letter) {
+    size_t chunk, index;
+    locateEntry(view, elem, 1, &chunk, &index);
+    if (chunk == view->count) {
+        // Keys above the last one go at the end of the last chunk.
+        if (!view->count) addChunk(view, 0);
+        chunk = view->count - 1;
+        index = view->chunks[chunk]->count;
+    }
+
+    ViewChunk *part = view->chunks[chunk];
+    if (part->count == VIEW_CHUNK) {
+        ViewChunk *half = addChunk(view, chunk + 1);
+        half->count = VIEW_CHUNK / 2;
+        part->count = VIEW_CHUNK - half->count;
+        memcpy(half->elems, part->elems + part->count, sizeof(void *) * half->count);
+        memcpy(half->letters, part->letters + part->count, sizeof(int) * half->count);
+        if (index > part->count) {
+            index -= part->count;
+            part = half;
+        }
+    }
+
+    memmove(part->elems + index + 1, part->elems + index, sizeof(void *) * (part->count - index));
+    memmove(part->letters + index + 1, part->letters + index, sizeof(int) * (part->count - index));
+    part->elems[index] = elem;
+    part->letters[index] = letter;
+    part->count++;
+    view->size++;
+}
+
+/**
+ * @brief Register a materialized in-order key query of a tree.
+ * The view holds the values of the live entries with a key within the
+ * bounds, in key order, in chunks of up to VIEW_CHUNK entries. Each insert
+ * or delete of the tree updates its views in O(log n + VIEW_CHUNK), so a
+ * read copies the chunks without walking the tree (see `keyViewRange`).
+ * The bounds are copied, with their words for the trees of borrowed views
+ * (see `copyBound`). Other borrowed keys can't be bounds.
+ *
+ * @param tree  Pointer to a tree object.
+ * @param left  The left boundary (inclusive), NULL for no bound.
+ * @param right The right boundary (inclusive), NULL for no bound.
+ * @return The view, kept up to date until it is destroyed, or NULL.
+ */
+KeyView* createKeyView(Tree *tree, void *left, void *right) {
+    // Check if input is valid.
+    if (!tree) return NULL;
+
+    KeyView *view = memAlloc(&tree->memory, sizeof(KeyView));
+    if (!view) return NULL;
+    memset(view, 0, sizeof(KeyView));
+    view->tree = tree;
+
+    // The bounds are copied with their data, the caller keeps its own.
+    view->left = left ? copyBound(tree, left, &view->bytes) : NULL;
+    view->right = right ? copyBound(tree, right, &view->bytes) : NULL;
+    if ((left && !view->left) || (right && !view->right)) {
+        destroyKeyView(view);
+        return NULL;
+    }
+
+    // One walk of the list fills the chunks.
+    TreeNode *entry = tree->root ? minimum(tree->root) : NULL;
+    while (entry && !inView(view, entry->elem)) {
+        if (view->right && COMPARE(entry->elem, view->right) > 0) entry = NULL;
+        else entry = entry->end->next;
+    }
+    for (; entry && inView(view, entry->elem); entry = entry->next) {
+        if (entry->dead) continue;
+        if ((!view->count || view->chunks[view->count - 1]->count == VIEW_CHUNK) && !addChunk(view, view->count)) {
+            destroyKeyView(view);
+            return NULL;
+        }
+        ViewChunk *part = view->chunks[view->count - 1];
+        part->elems[part->count] = entry->elem;
+        part->letters[part->count] = letterKey(tree, entry);
+        part->count++;
+        view->size++;
+    }
+
+    view->next = tree->views;
+    tree->views = view;
+    return view;
+}
+
+/**
+ * @brief Copy the values of a view to a Range.
+ * The Range is allocated once with the exact size and filled chunk by chunk,
+ * it is the same as the in-order (or range) key query of the tree.
+ *
+ * @param view Pointer to a view.
+ * @return A Range with the values of the view, or NULL (also if the memory was refused).
+ */
+Range* keyViewRange(KeyView *view) {
+    TRACE_SCOPE("keyViewRange");
+    // Check if input is valid.
+    if (!view) return NULL;
+
+    Range *range = createRange(&view->tree->lambda.alloc);
+    if (!range || !reserveRange(range, view->size)) {
+        destroyRange(range);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < view->count; i++) {
+        ViewChunk *part = view->chunks[i];
+        memcpy(range->index + range->size, part->letters, sizeof(int) * part->count);
+        range->size += part->count;
+    }
+    return range;
+}
+
+/**
+ * @brief Unregister a view from its tree and free its memory.
+ *
+ * @param view Pointer to a view (may be NULL).
+ */
+void destroyKeyView(KeyView *view) {
+    // Check if input is valid.
+    if (!view) return;
+
+    Tree *tree = view->tree;
+    for (KeyView **link = &tree->views; *link; link = &(*link)->next) {
+        if (*link == view) {
+            *link = view->next;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < view->count; i++)
+        memFree(&tree->memory, view->chunks[i], sizeof(ViewChunk));
+    memFree(&tree->memory, view->spare, sizeof(ViewChunk));
+    memFree(&tree->memory, view->chunks, sizeof(ViewChunk *) * view->capacity);
+    Delete release = boundRelease(tree);
+    if (view->left) release(view->left);
+    if (view->right) release(view->right);
+    memTransfer(&tree->memory, NULL, view->bytes);
+    memFree(&tree->memory, view, sizeof(KeyView));
+}
+
+/**
+ * @brief Make room in the views for a new entry, before an insert.
+ * Each view holding the key gets room for one more chunk and a spare
+ * chunk, so the split of a full chunk doesn't allocate.
+ *
+ * @param tree Pointer to a tree object.
+ * @param elem Key of the new entry.
+ * @return 1 if the entry can be added, 0 if the insert must fail.
+ */
+int viewReserve(Tree *tree, void *elem) {
+    for (KeyView *view = tree->views; view; view = view->next) {
+        if (!inView(view, elem)) continue;
+        if (!growChunks(view)) return 0;
+        if (!view->spare && !(view->spare = memAlloc(&tree->memory, sizeof(ViewChunk)))) return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Add a live entry of the tree to its views.
+ * Called for each new entry (or revived tombstone), the entry comes after
+ * the entries with the same key, as in the threaded list.
+ *
+ * @param tree  Pointer to a tree object.
+ * @param entry The entry, with its key and value set.
+ */
+void viewInsert(Tree *tree, TreeNode *entry) {
+    for (KeyView *view = tree->views; view; view = view->next)
+        if (inView(view, entry->elem)) insertEntry(view, entry->elem, letterKey(tree, entry));
+}
+
+/**
+ * @brief Remove a live entry of the tree from its views.
+ * Called before the entry is unlinked or buried, while its key is valid.
+ * The entry is found by its key pointer among the entries of its key,
+ * from the last one, which is the one removed by a delete.
+ *
+ * @param tree Pointer to a tree object.
+ * @param elem Key of the entry.
+ */
+void viewRemove(Tree *tree, void *elem) {
+    for (KeyView *view = tree->views; view; view = view->next) {
+        if (!inView(view, elem)) continue;
+
+        size_t chunk, index, atChunk = view->count, atIndex = 0;
+        locateEntry(view, elem, 1, &chunk, &index);
+        while (chunk || index) {
+            // Step back to the previous entry, the last one of the key is taken if none matches.
+            if (index) index--;
+            else index = view->chunks[--chunk]->count - 1;
+
+            ViewChunk *part = view->chunks[chunk];
+            if (COMPARE(part->elems[index], elem)) break;
+            if (atChunk == view->count || part->elems[index] == elem) atChunk = chunk, atIndex = index;
+            if (part->elems[index] == elem) break;
+        }
+        if (atChunk < view->count) removeEntries(view, atChunk, atIndex, atIndex + 1);
+    }
+}
+
+/**
+ * @brief Remove the entries with a key within a range from the views.
+ * Each chunk of the range loses its entries at once.
+ *
+ * @param tree  Pointer to a tree object.
+ * @param left  The left boundary (inclusive), NULL for no bound.
+ * @param right The right boundary (inclusive), NULL for no bound.
+ */
+void viewRemoveRange(Tree *tree, void *left, void *right) {
+    for (KeyView *view = tree->views; view; view = view->next) {
+        size_t chunk = 0, index = 0;
+        if (left) locateEntry(view, left, 0, &chunk, &index);
+
+        while (chunk < view->count) {
+            ViewChunk *part = view->chunks[chunk];
+            size_t end = index;
+            while (end < part->count && (!right || COMPARE(part->elems[end], right) <= 0)) end++;
+            if (end == index) break;
+
+            // An emptied chunk is freed, the next one takes its place.
+            size_t before = view->count;
+            int last = end < part->count;
+            removeEntries(view, chunk, index, end);
+            if (last) break;
+            if (view->count == before) chunk++;
+            index = 0;
+        }
+    }
+}
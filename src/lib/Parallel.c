@@ -0,0 +1,412 @@
+#include "../include/Parallel.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Make room for tasks at the bottom of a deque, its lock held.
+ * 
+ * @param walk  The parallel traversal.
+ * @param deque The deque.
+ * @param count Number of tasks to make room for.
+ * @return 1 on success, 0 if the memory was refused.
+ */
+static int roomForTasks(Walk *walk, Deque *deque, size_t count) {
+    if (deque->tail + count <= deque->capacity) return 1;
+
+    // Stolen tasks leave room at the top, it is reused first.
+    memmove(deque->tasks, deque->tasks + deque->head, sizeof(Task) * (deque->tail - deque->head));
+    deque->tail -= deque->head;
+    deque->head = 0;
+    if (deque->tail + count <= deque->capacity) return 1;
+
+    size_t capacity = deque->capacity * 2;
+    Task *tasks = memResize(walk->memory, deque->tasks, sizeof(Task) * deque->capacity, sizeof(Task) * capacity);
+    if (!tasks) return 0;
+    deque->tasks = tasks;
+    deque->capacity = capacity;
+    return 1;
+}
+
+/**
+ * @brief Make room for tasks at the bottom of the deque of a worker.
+ * Only the owner adds tasks to its deque, so the room stays until it does.
+ * 
+ * @param walk   The parallel traversal.
+ * @param worker The worker owning the deque.
+ * @param count  Number of tasks to make room for.
+ * @return 1 on success, 0 if the memory was refused.
+ */
+static int reserveTasks(Walk *walk, size_t worker, size_t count) {
+    Deque *deque = walk->deques + worker;
+    pthread_mutex_lock(&deque->lock);
+    int room = roomForTasks(walk, deque, count);
+    pthread_mutex_unlock(&deque->lock);
+    return room;
+}
+
+/**
+ * @brief Add a task at the bottom of the deque of a worker.
+ * 
+ * @param walk   The parallel traversal.
+ * @param worker The worker owning the deque.
+ * @param task   The task to add.
+ * @return 1 on success, 0 if the memory was refused (the caller keeps the task).
+ */
+static int pushTask(Walk *walk, size_t worker, Task task) {
+    Deque *deque = walk->deques + worker;
+
+    pthread_mutex_lock(&deque->lock);
+    int room = roomForTasks(walk, deque, 1);
+    if (room) {
+        __atomic_add_fetch(&walk->pending, 1, __ATOMIC_RELAXED);
+        deque->tasks[deque->tail++] = task;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return room;
+}
+
+/**
+ * @brief Take a task from a deque, the newest from the bottom or the oldest from the top.
+ * The owner takes its newest task, the closest to the last one. Thieves
+ * take the oldest, the biggest sub-trees.
+ * 
+ * @param deque  The deque.
+ * @param bottom 1 for the owner of the deque, 0 for a thief.
+ * @param task   Where to store the task.
+ * @return 1 if a task was taken, 0 if the deque is empty.
+ */
+static int takeTask(Deque *deque, int bottom, Task *task) {
+    pthread_mutex_lock(&deque->lock);
+    int taken = deque->head < deque->tail;
+    if (taken) *task = bottom ? deque->tasks[--deque->tail] : deque->tasks[deque->head++];
+    if (deque->head == deque->tail) deque->head = deque->tail = 0;
+    pthread_mutex_unlock(&deque->lock);
+
+    return taken;
+}
+
+/**
+ * @brief Check if a worker waits for a task, the others then hand some out.
+ * 
+ * @param walk The parallel traversal.
+ * @return 1 if a thief found nothing to steal lately.
+ */
+static int isHungry(Walk *walk) {
+    return __atomic_load_n(&walk->hungry, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Visit a slice of a duplicate chain.
+ * A long chain is visited by batches, after each batch the rest is handed
+ * out if a worker waits for a task.
+ * 
+ * @param walk   The parallel traversal.
+ * @param worker The worker visiting the slice.
+ * @param entry  First entry of the slice.
+ * @param stop   Entry after the slice.
+ */
+static void visitSlice(Walk *walk, size_t worker, TreeNode *entry, TreeNode *stop) {
+    // Entries may be released by the visit, the next one is read first.
+    for (size_t batch = 1; entry != stop; batch++) {
+        TreeNode *next = entry->next;
+        walk->visit(walk, worker, entry);
+        entry = next;
+
+        if (batch % WALK_BATCH == 0 && entry != stop && isHungry(walk) &&
+            pushTask(walk, worker, (Task){ NULL, entry, stop }))
+            return;
+    }
+}
+
+/**
+ * @brief Push a node and its left spine on the stack of a worker.
+ * If the stack can't grow, the sub-tree left is visited at once through
+ * the threaded list, it comes before the nodes of the stack.
+ * 
+ * @param walk The parallel traversal.
+ * @param self The worker.
+ * @param top  Top of the stack, updated.
+ * @param node Root of the sub-tree to walk, or NULL.
+ */
+static void pushSpine(Walk *walk, Worker *self, size_t *top, TreeNode *node) {
+    for (; node; node = node->left) {
+        if (*top == self->capacity) {
+            size_t capacity = self->capacity * 2;
+            TreeNode **stack = memResize(walk->memory, self->stack, sizeof(TreeNode *) * self->capacity,
+                                         sizeof(TreeNode *) * capacity);
+            if (!stack) {
+                visitSlice(walk, self->id, minimum(node), maximum(node)->end->next);
+                return;
+            }
+            self->stack = stack;
+            self->capacity = capacity;
+        }
+        self->stack[(*top)++] = node;
+    }
+}
+
+/**
+ * @brief Run one task: a sub-tree, or a slice of a duplicate chain.
+ * A sub-tree is walked in order with the stack of the worker, without
+ * synchronization, so the entries are visited in key order. The stack
+ * holds the nodes whose chain and right sub-tree are left. When a worker
+ * waits for a task, the oldest of them, the one with the biggest right
+ * sub-tree, is handed out.
+ * 
+ * @param walk The parallel traversal.
+ * @param self The worker running the task.
+ * @param task The task.
+ */
+static void runTask(Walk *walk, Worker *self, Task task) {
+    if (!task.root) {
+        visitSlice(walk, self->id, task.first, task.stop);
+        return;
+    }
+
+    size_t bottom = 0, top = 0;
+    pushSpine(walk, self, &top, task.root);
+    while (bottom < top) {
+        if (bottom + 1 < top && isHungry(walk) && reserveTasks(walk, self->id, 2)) {
+            TreeNode *node = self->stack[bottom++];
+            if (node->right) pushTask(walk, self->id, (Task){ node->right, NULL, NULL });
+            pushTask(walk, self->id, (Task){ NULL, node, node->end->next });
+            continue;
+        }
+
+        // The links are read before the visit, which may release the node.
+        TreeNode *node = self->stack[--top];
+        TreeNode *right = node->right;
+        visitSlice(walk, self->id, node, node->end->next);
+        pushSpine(walk, self, &top, right);
+    }
+}
+
+/**
+ * @brief Body of the workers of a parallel traversal.
+ * A worker runs its own tasks, then steals from the others, until no task
+ * is left anywhere.
+ * 
+ * @param arg Pointer to the worker.
+ * @return NULL.
+ */
+static void* runWorker(void *arg) {
+    Worker *self = (Worker *)arg;
+    Walk *walk = self->walk;
+
+    Task task;
+    while (__atomic_load_n(&walk->pending, __ATOMIC_ACQUIRE)) {
+        int taken = takeTask(walk->deques + self->id, 1, &task);
+        for (size_t i = 1; !taken && i < walk->workers; i++)
+            taken = takeTask(walk->deques + (self->id + i) % walk->workers, 0, &task);
+
+        // Nothing to steal, the busy workers hand out some of their work.
+        __atomic_store_n(&walk->hungry, !taken, __ATOMIC_RELAXED);
+        if (!taken) {
+            sched_yield();
+            continue;
+        }
+        runTask(walk, self, task);
+        __atomic_sub_fetch(&walk->pending, 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Release the deques and stacks of the first workers of a traversal.
+ * 
+ * @param walk    The parallel traversal.
+ * @param workers The workers.
+ * @param count   Number of workers whose deque and stack were allocated.
+ */
+static void releaseWorkers(Walk *walk, Worker *workers, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        pthread_mutex_destroy(&walk->deques[i].lock);
+        memFree(walk->memory, walk->deques[i].tasks, sizeof(Task) * walk->deques[i].capacity);
+        memFree(walk->memory, workers[i].stack, sizeof(TreeNode *) * workers[i].capacity);
+    }
+    memFree(walk->memory, walk->deques, sizeof(Deque) * walk->workers);
+    memFree(walk->memory, workers, sizeof(Worker) * walk->workers);
+}
+
+/**
+ * @brief Run a parallel traversal of the whole tree.
+ * The root is the first task, on the deque of the calling thread, the
+ * other workers steal their first tasks from it. If the memory of the
+ * workers is refused, the calling thread walks the threaded list alone.
+ * 
+ * @param tree    Pointer to a tree object, not empty.
+ * @param walk    The traversal, with its visit function set.
+ * @param threads Number of threads, the calling one included.
+ */
+static void runWalk(Tree *tree, Walk *walk, int threads) {
+    walk->workers = threads > 1 ? (size_t)threads : 1;
+    walk->memory = &tree->memory;
+    walk->pending = 0;
+    walk->hungry = 0;
+
+    Worker *workers = memAlloc(walk->memory, sizeof(Worker) * walk->workers);
+    walk->deques = memAlloc(walk->memory, sizeof(Deque) * walk->workers);
+    size_t ready = 0;
+    for (; workers && walk->deques && ready < walk->workers; ready++) {
+        Deque *deque = walk->deques + ready;
+        deque->head = deque->tail = 0;
+        deque->capacity = WALK_BATCH;
+        deque->tasks = memAlloc(walk->memory, sizeof(Task) * deque->capacity);
+        workers[ready].walk = walk;
+        workers[ready].id = ready;
+        workers[ready].capacity = WALK_BATCH;
+        workers[ready].stack = memAlloc(walk->memory, sizeof(TreeNode *) * workers[ready].capacity);
+        if (!deque->tasks || !workers[ready].stack) {
+            memFree(walk->memory, deque->tasks, sizeof(Task) * deque->capacity);
+            memFree(walk->memory, workers[ready].stack, sizeof(TreeNode *) * workers[ready].capacity);
+            break;
+        }
+        pthread_mutex_init(&deque->lock, NULL);
+    }
+    // Handle [ERR]: allocation, the entries are visited in order, with no memory.
+    if (ready < walk->workers) {
+        releaseWorkers(walk, workers, ready);
+        for (TreeNode *entry = minimum(tree->root), *next; entry; entry = next) {
+            next = entry->next;
+            walk->visit(walk, 0, entry);
+        }
+        return;
+    }
+
+    pushTask(walk, 0, (Task){ tree->root, NULL, NULL });
+
+    // A worker that can't be started leaves its share to the others.
+    size_t started = 1;
+    for (; started < walk->workers; started++)
+        if (pthread_create(&workers[started].thread, NULL, runWorker, workers + started) != 0) break;
+    runWorker(workers);
+    for (size_t i = 1; i < started; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    releaseWorkers(walk, workers, walk->workers);
+}
+
+/**
+ * @brief Visit of `treeForEachParallel`, tombstones are skipped.
+ */
+static void visitEntry(Walk *walk, size_t worker, TreeNode *entry) {
+    if (!entry->dead) walk->visitFunc(walk->ctx, entry);
+}
+
+/**
+ * @brief Visit of `treeReduceParallel`, into the accumulator of the worker.
+ */
+static void mapEntry(Walk *walk, size_t worker, TreeNode *entry) {
+    if (!entry->dead) walk->map(walk->ctx, walk->accs + worker * walk->stride, entry);
+}
+
+/**
+ * @brief Visit of `destroyTreeParallel`, the entry is released.
+ * The statistics counters aren't shared by threads, they go with the tree.
+ */
+static void releaseEntry(Walk *walk, size_t worker, TreeNode *entry) {
+    Tree *tree = walk->tree;
+    if (entry->elem) DELETE.deleteElem(entry->elem);
+    if (entry->value) DELETE.deleteVal(entry->value);
+    uncountPayload(tree, entry);
+    if (entry->summary) releaseSummary(tree, entry);
+    memFree(walk->memory, entry, sizeof(TreeNode));
+}
+
+/**
+ * @brief Visit every live entry of a tree with several threads.
+ * The threads split the tree by sub-trees and steal work from each other,
+ * so big sub-trees and long duplicate chains are shared out. A worker only
+ * hands work out when another one waits, so a single thread walks the tree
+ * without synchronization. `visit` is
+ * called concurrently, in no particular order, and must not change the
+ * tree. Readers may share the tree, it isn't changed.
+ * 
+ * @param tree    Pointer to a tree object.
+ * @param visit   Function called for each live entry.
+ * @param ctx     State passed to `visit`.
+ * @param threads Number of threads, the calling one included.
+ */
+void treeForEachParallel(Tree *tree, Visit visit, void *ctx, int threads) {
+    // Check if input is valid.
+    if (!tree || !tree->root || !visit) return;
+
+    Walk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.tree = tree;
+    walk.visit = visitEntry;
+    walk.visitFunc = visit;
+    walk.ctx = ctx;
+    runWalk(tree, &walk, threads);
+}
+
+/**
+ * @brief Reduce the live entries of a tree with several threads.
+ * Each thread folds its entries with `map` into its own copy of `result`,
+ * then the copies are folded into `result` with `combine`. `result` must
+ * hold the identity of `combine` (e.g. 0 for a sum), and `combine` must be
+ * associative and commutative, the entries come in no particular order.
+ * 
+ * @param tree    Pointer to a tree object.
+ * @param result  The accumulator, the identity on input and the result on output.
+ * @param size    Size of the accumulator, in bytes.
+ * @param map     Function folding an entry into an accumulator.
+ * @param combine Function folding an accumulator into another.
+ * @param ctx     State passed to `map` and `combine`.
+ * @param threads Number of threads, the calling one included.
+ */
+void treeReduceParallel(Tree *tree, void *result, size_t size, Map map,
+                        Combine combine, void *ctx, int threads) {
+    // Check if input is valid.
+    if (!tree || !tree->root || !result || !size || !map || !combine) return;
+
+    // One accumulator per worker, on its own cache lines.
+    Walk walk;
+    memset(&walk, 0, sizeof(walk));
+    size_t workers = threads > 1 ? (size_t)threads : 1;
+    walk.stride = (size + 63) & ~(size_t)63;
+    walk.accs = memAlloc(&tree->memory, walk.stride * workers);
+    // Handle [ERR]: allocation, the calling thread folds the entries into `result`.
+    if (!walk.accs) {
+        for (TreeNode *entry = minimum(tree->root); entry; entry = entry->next)
+            if (!entry->dead) map(ctx, result, entry);
+        return;
+    }
+    for (size_t i = 0; i < workers; i++)
+        memcpy(walk.accs + i * walk.stride, result, size);
+
+    walk.tree = tree;
+    walk.visit = mapEntry;
+    walk.map = map;
+    walk.ctx = ctx;
+    runWalk(tree, &walk, threads);
+
+    for (size_t i = 0; i < workers; i++)
+        combine(ctx, result, walk.accs + i * walk.stride);
+    memFree(&tree->memory, walk.accs, walk.stride * workers);
+}
+
+/**
+ * @brief Free all memory loaded for the tree object, with several threads.
+ * The nodes and their data are released like by a parallel traversal, so
+ * the delete functions and the allocator of the tree must be thread safe.
+ * 
+ * @param tree    Pointer to an allocated tree object.
+ * @param threads Number of threads, the calling one included.
+ */
+void destroyTreeParallel(Tree *tree, int threads) {
+    // Check if input is valid.
+    if (!tree) return;
+
+    if (tree->root) {
+        Walk walk;
+        memset(&walk, 0, sizeof(walk));
+        walk.tree = tree;
+        walk.visit = releaseEntry;
+        runWalk(tree, &walk, threads);
+        tree->root = NULL;
+    }
+
+    // The nodes are gone, the rest of the tree is released as usual.
+    destroyTree(tree);
+}
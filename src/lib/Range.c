@@ -1,4 +1,6 @@
 #include "../include/Range.h"
+#include "../include/Journal.h"
+#include "../include/Cache.h"
 #include "../utils/Utils.h"
 
 /**
@@ -7,32 +9,43 @@
  * It extracts values from nodes at the same level as the maximum frequency node.
  * 
  * @param tree A pointer to the AVL tree to query.
- * @return A Range containing values based on the level of nodes.
+ * @return A Range containing values based on the level of nodes, or NULL if the memory was refused.
  */
 Range* levelKeyQuery(Tree* tree) {
+    TRACE_SCOPE("levelKeyQuery");
     // Check if input is valid.
     if (!tree || !tree->root) return NULL;
-    
+
+    // The result may be kept since the last change of the tree.
+    Range* range = cacheLookup(tree, QUERY_LEVEL, NULL, NULL);
+    if (range) return range;
+
     // Create a Range to store the result.
-    Range* range = createRange();
+    range = createRange(&tree->lambda.alloc);
+    if (!range) return NULL;
     // Find the minimum node in the tree.
     TreeNode* minNode = minimum(tree->root);
 
-    // Get the level of the maximum frequency node.
-    int levelMax = levelNode(tree, maxFreqNode(tree)->elem);
+    // Get the level of the maximum frequency node (none if every key was deleted lazily).
+    TreeNode* maxNode = maxFreqNode(tree);
+    if (!maxNode) return cacheStore(tree, QUERY_LEVEL, NULL, NULL, range);
+    int levelMax = levelNode(tree, maxNode->elem);
 
     while (minNode) {
-        if (levelNode(tree, minNode->elem) != levelMax) {
+        if (minNode->dead || levelNode(tree, minNode->elem) != levelMax) {
             minNode = minNode->end->next;
         } else {
             // Add the value from the current node to the Range.
-            addToRangeIndex(range, (*(int*)minNode->value) % LETTER_LEN);
+            if (!addToRangeIndex(range, letterKey(tree, minNode))) {
+                destroyRange(range);
+                return NULL;
+            }
             minNode = minNode->next;
         }
     }
 
     // Return the generated Range.
-    return range;
+    return cacheStore(tree, QUERY_LEVEL, NULL, NULL, range);
 }
 
 /**
@@ -42,14 +55,20 @@ Range* levelKeyQuery(Tree* tree) {
  * @param tree  A pointer to the AVL tree to query.
  * @param left  The left boundary of the key range (inclusive).
  * @param right The right boundary of the key range (inclusive).
- * @return A Range containing values within the specified key range.
+ * @return A Range containing values within the specified key range, or NULL if the memory was refused.
  */
 Range* rangeKeyQuery(Tree* tree, const char* const left, const char* const right) {
+    TRACE_SCOPE("rangeKeyQuery");
     // Check if input is valid.
     if (!tree || !tree->root) return NULL;
 
+    // The result may be kept since the last change of the tree.
+    Range* range = cacheLookup(tree, QUERY_RANGE, (void*)left, (void*)right);
+    if (range) return range;
+
     // Create a Range to store the result.
-    Range* range = createRange();
+    range = createRange(&tree->lambda.alloc);
+    if (!range) return NULL;
     // Find the minimum node in the tree.
     TreeNode* minNode = minimum(tree->root);
 
@@ -59,12 +78,16 @@ Range* rangeKeyQuery(Tree* tree, const char* const left, const char* const right
     }
     // Add values to the Range from nodes within the key range.
     while (minNode && COMPARE(minNode->elem, (void*)right) <= 0) {
-        addToRangeIndex(range, (*(int*)minNode->value) % LETTER_LEN);
+        // Tombstones were deleted lazily, they are skipped.
+        if (!minNode->dead && !addToRangeIndex(range, letterKey(tree, minNode))) {
+            destroyRange(range);
+            return NULL;
+        }
         minNode = minNode->next;
     }
 
     // Return the generated Range.
-    return range;
+    return cacheStore(tree, QUERY_RANGE, (void*)left, (void*)right, range);
 }
 
 /**
@@ -72,23 +95,434 @@ Range* rangeKeyQuery(Tree* tree, const char* const left, const char* const right
  * Generates a Range containing values by traversing the tree in in-order.
  * 
  * @param tree A pointer to the AVL tree to query.
- * @return A Range containing values based on an in-order traversal of the tree.
+ * @return A Range containing values based on an in-order traversal of the tree, or NULL if the memory was refused.
  */
 Range* inorderKeyQuery(Tree* tree) {
+    TRACE_SCOPE("inorderKeyQuery");
     // Check if input is valid.
     if (!tree || !tree->root) return NULL;
 
+    // The result may be kept since the last change of the tree.
+    Range* range = cacheLookup(tree, QUERY_INORDER, NULL, NULL);
+    if (range) return range;
+
     // Create a Range to store the result.
-    Range* range = createRange();
+    range = createRange(&tree->lambda.alloc);
+    if (!range) return NULL;
     // Find the minimum node in the tree.
     TreeNode* minNode = minimum(tree->root);
 
     // Traverse the tree in in-order and add values to the Range.
     while (minNode) {
-        addToRangeIndex(range, (*(int*)minNode->value) % LETTER_LEN);
+        if (!minNode->dead && !addToRangeIndex(range, letterKey(tree, minNode))) {
+            destroyRange(range);
+            return NULL;
+        }
         minNode = minNode->next;
     }
 
     // Return the generated Range.
-    return range;
+    return cacheStore(tree, QUERY_INORDER, NULL, NULL, range);
+}
+
+/**
+ * @brief Add a piece to a parallel query, growing its array when full.
+ * 
+ * @param job   The parallel query.
+ * @param node  The key of the piece, or the root of its sub-tree.
+ * @param whole 1 for the whole sub-tree of `node`, 0 for its key only.
+ * @return 1 on success, 0 if the memory was refused.
+ */
+static int addPiece(RangeJob* job, TreeNode* node, int whole) {
+    if (job->count == job->capacity) {
+        size_t capacity = job->capacity ? job->capacity * 2 : RANGE_PIECES;
+        Piece* pieces = job->pieces ? memResize(job->memory, job->pieces, sizeof(Piece) * job->capacity,
+                                                sizeof(Piece) * capacity)
+                                    : memAlloc(job->memory, sizeof(Piece) * capacity);
+        if (!pieces) return 0;
+        job->pieces = pieces;
+        job->capacity = capacity;
+    }
+    job->pieces[job->count].node = node;
+    job->pieces[job->count].whole = whole;
+    job->pieces[job->count].offset = 0;
+    job->count++;
+    return 1;
+}
+
+/**
+ * @brief Cover the keys within [left, right] with disjoint pieces, in key order.
+ * A sub-tree known to be inside both bounds is one piece, so only the two
+ * boundary paths are descended and O(log n) pieces are made.
+ * 
+ * @param tree  A pointer to the AVL tree.
+ * @param job   The parallel query receiving the pieces.
+ * @param node  Root of the sub-tree to cover.
+ * @param left  The left boundary (inclusive), NULL for no bound.
+ * @param right The right boundary (inclusive), NULL for no bound.
+ * @return 1 on success, 0 if the memory was refused.
+ */
+static int collectPieces(Tree* tree, RangeJob* job, TreeNode* node, void* left, void* right) {
+    if (!node) return 1;
+    if (!left && !right) return addPiece(job, node, 1);
+
+    if (left && COMPARE(node->elem, left) < 0) return collectPieces(tree, job, node->right, left, right);
+    if (right && COMPARE(node->elem, right) > 0) return collectPieces(tree, job, node->left, left, right);
+
+    // The keys of the left sub-tree are below `right`, the ones of the right sub-tree above `left`.
+    return collectPieces(tree, job, node->left, left, NULL) && addPiece(job, node, 0) &&
+           collectPieces(tree, job, node->right, NULL, right);
+}
+
+/**
+ * @brief Split the sub-tree pieces until there are enough pieces for the workers.
+ * Sub-trees have unknown sizes, each round splits all of them in their two
+ * children and their key, so the big ones are split as much as the others.
+ * If the memory of a round is refused, the pieces of the last round are kept.
+ * 
+ * @param job    The parallel query.
+ * @param wanted Number of pieces to reach.
+ */
+static void expandPieces(RangeJob* job, size_t wanted) {
+    while (job->count < wanted) {
+        RangeJob round = *job;
+        round.pieces = NULL;
+        round.count = round.capacity = 0;
+
+        int split = 0, added = 1;
+        for (size_t i = 0; i < job->count && added; i++) {
+            TreeNode* node = job->pieces[i].node;
+            if (!job->pieces[i].whole || (!node->left && !node->right)) {
+                added = addPiece(&round, node, job->pieces[i].whole);
+                continue;
+            }
+            added = (!node->left || addPiece(&round, node->left, 1)) && addPiece(&round, node, 0) &&
+                    (!node->right || addPiece(&round, node->right, 1));
+            split = 1;
+        }
+        if (!added) {
+            memFree(job->memory, round.pieces, sizeof(Piece) * round.capacity);
+            break;
+        }
+
+        memFree(job->memory, job->pieces, sizeof(Piece) * job->capacity);
+        *job = round;
+        if (!split) break;
+    }
+}
+
+/**
+ * @brief Body of the workers of a parallel query.
+ * Each worker takes the next piece until there are none left, then counts
+ * its live entries or writes them at the offset of the piece.
+ * 
+ * @param arg Pointer to the parallel query.
+ * @return NULL.
+ */
+static void* runRangeJob(void* arg) {
+    RangeJob* job = (RangeJob*)arg;
+
+    size_t next;
+    while ((next = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+        Piece* piece = job->pieces + next;
+        TreeNode* entry = piece->whole ? minimum(piece->node) : piece->node;
+        TreeNode* stop = (piece->whole ? maximum(piece->node) : piece->node)->end->next;
+
+        size_t at = piece->offset, live = 0;
+        for (; entry != stop; entry = entry->next) {
+            if (entry->dead) continue;
+            if (job->index) job->index[at++] = letterKey(job->tree, entry);
+            live++;
+        }
+        // Counting, the offset holds the entries of the piece until the prefix sum.
+        if (!job->index) piece->offset = live;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Run one pass of a parallel query on the workers and the calling thread.
+ * A worker that can't be started leaves its pieces to the others.
+ * 
+ * @param job     The parallel query.
+ * @param workers Threads started, besides the calling one.
+ * @param ids     Where to store the thread ids.
+ */
+static void runRangePass(RangeJob* job, size_t workers, pthread_t* ids) {
+    job->next = 0;
+
+    size_t started = 0;
+    for (; started < workers; started++)
+        if (pthread_create(ids + started, NULL, runRangeJob, job) != 0) break;
+    runRangeJob(job);
+    for (size_t i = 0; i < started; i++)
+        pthread_join(ids[i], NULL);
+}
+
+/**
+ * @brief Perform a key query on the AVL tree with several threads.
+ * The keys within the bounds are covered with disjoint pieces (sub-trees
+ * and single keys). The workers count the entries of each piece, the
+ * offsets of the pieces are their prefix sums, so the Range is allocated
+ * once with the exact size, then the workers write their pieces at their
+ * offsets. Readers may share the tree, it isn't changed.
+ * 
+ * @param tree    A pointer to the AVL tree to query.
+ * @param left    The left boundary (inclusive), NULL for no bound.
+ * @param right   The right boundary (inclusive), NULL for no bound.
+ * @param threads Number of threads, the calling one included (at least 2).
+ * @return A Range containing the values of the keys, in order, or NULL if the memory was refused.
+ */
+static Range* parallelKeyQuery(Tree* tree, void* left, void* right, int threads) {
+    // Same results as the sequential queries, they share the cached ones.
+    QueryType type = (left || right) ? QUERY_RANGE : QUERY_INORDER;
+    Range* range = cacheLookup(tree, type, left, right);
+    if (range) return range;
+    range = createRange(&tree->lambda.alloc);
+    if (!range) return NULL;
+
+    RangeJob job;
+    memset(&job, 0, sizeof(job));
+    job.memory = &tree->memory;
+    job.tree = tree;
+    if (!collectPieces(tree, &job, tree->root, left, right)) {
+        memFree(job.memory, job.pieces, sizeof(Piece) * job.capacity);
+        destroyRange(range);
+        return NULL;
+    }
+    expandPieces(&job, (size_t)threads * RANGE_PIECES);
+
+    size_t workers = (size_t)threads - 1;
+    pthread_t* ids = workers ? memAlloc(job.memory, sizeof(pthread_t) * workers) : NULL;
+    // Handle [ERR]: allocation, the calling thread does the work alone.
+    if (!ids) workers = 0;
+
+    // Count the entries of each piece, then turn the counts into offsets.
+    runRangePass(&job, workers, ids);
+    size_t total = 0;
+    for (size_t i = 0; i < job.count; i++) {
+        size_t live = job.pieces[i].offset;
+        job.pieces[i].offset = total;
+        total += live;
+    }
+
+    // The index is sized once, exactly.
+    int sized = reserveRange(range, total);
+    if (sized) {
+        job.index = range->index;
+        runRangePass(&job, workers, ids);
+        range->size = total;
+    }
+
+    memFree(job.memory, ids, sizeof(pthread_t) * workers);
+    memFree(job.memory, job.pieces, sizeof(Piece) * job.capacity);
+    if (!sized) {
+        destroyRange(range);
+        return NULL;
+    }
+    return cacheStore(tree, type, left, right, range);
+}
+
+/**
+ * @brief Perform an in-order key query on the AVL tree with several threads.
+ * Same result as `inorderKeyQuery`, see `parallelKeyQuery`. One thread
+ * runs `inorderKeyQuery`, a single walk of the list.
+ * 
+ * @param tree    A pointer to the AVL tree to query.
+ * @param threads Number of threads, the calling one included.
+ * @return A Range containing the values of all the keys, in order.
+ */
+Range* inorderKeyQueryParallel(Tree* tree, int threads) {
+    TRACE_SCOPE("inorderKeyQueryParallel");
+    // Check if input is valid.
+    if (!tree || !tree->root) return NULL;
+
+    if (threads <= 1) return inorderKeyQuery(tree);
+    return parallelKeyQuery(tree, NULL, NULL, threads);
+}
+
+/**
+ * @brief Perform a range key query on the AVL tree with several threads.
+ * Same result as `rangeKeyQuery`, see `parallelKeyQuery`. One thread
+ * runs `rangeKeyQuery`, a single walk of the list.
+ * 
+ * @param tree    A pointer to the AVL tree to query.
+ * @param left    The left boundary of the key range (inclusive).
+ * @param right   The right boundary of the key range (inclusive).
+ * @param threads Number of threads, the calling one included.
+ * @return A Range containing values within the specified key range.
+ */
+Range* rangeKeyQueryParallel(Tree* tree, const char* const left, const char* const right, int threads) {
+    TRACE_SCOPE("rangeKeyQueryParallel");
+    // Check if input is valid.
+    if (!tree || !tree->root) return NULL;
+
+    if (threads <= 1) return rangeKeyQuery(tree, left, right);
+    return parallelKeyQuery(tree, (void*)left, (void*)right, threads);
+}
+
+/**
+ * @brief Cut the keys within [left, right] out of the tree.
+ * Two splits take the keys out as one sub-tree, the keys left are merged
+ * back, and the threaded list is patched once at both boundaries.
+ * 
+ * @param tree  A pointer to the AVL tree.
+ * @param left  The left boundary of the key range (inclusive), NULL for no bound.
+ * @param right The right boundary of the key range (inclusive), NULL for no bound.
+ * @return The root of the cut sub-tree, its first and last entries linked to NULL.
+ */
+static TreeNode* cutRange(Tree* tree, void* left, void* right) {
+    TreeNode *below = NULL, *rest = tree->root, *inside = NULL, *above = NULL;
+    if (left) splitTree(tree, rest, left, 0, &below, &rest);
+    if (right) splitTree(tree, rest, right, 1, &inside, &above);
+    else inside = rest;
+    tree->root = mergeTrees(tree, below, above);
+    if (!inside) return NULL;
+
+    // The entries of the range are a slice of the list, link its neighbours.
+    TreeNode *first = minimum(inside), *last = maximum(inside)->end;
+    if (first->prev) first->prev->next = last->next;
+    if (last->next) last->next->prev = first->prev;
+    first->prev = last->next = NULL;
+
+    // Fingers holding a node of the range must not use it anymore.
+    tree->removals++;
+    tree->version++;
+    if (tree->views) viewRemoveRange(tree, left, right);
+    if (tree->values)
+        for (TreeNode *entry = first; entry; entry = entry->next)
+            if (!entry->dead) valueRemove(tree, entry);
+    return inside;
+}
+
+/**
+ * @brief Delete every entry with a key within a range from the tree.
+ * The keys are cut out with split and join, in O(log n), instead of one
+ * search and one fix up per key. Then the k entries are released, so the
+ * delete takes O(log n + k). Tombstones of the range are released too.
+ * 
+ * @param tree  A pointer to the AVL tree.
+ * @param left  The left boundary of the key range (inclusive), NULL for no bound.
+ * @param right The right boundary of the key range (inclusive), NULL for no bound.
+ * @return The number of (live) entries deleted.
+ */
+size_t deleteRange(Tree* tree, void* left, void* right) {
+    TRACE_SCOPE("deleteRange");
+    // Check if input is valid.
+    if (!tree || !tree->root) return 0;
+    if (left && right && COMPARE(left, right) > 0) return 0;
+
+    STAT_OP_BEGIN(tree);
+    TreeNode* entry = cutRange(tree, left, right);
+    entry = entry ? minimum(entry) : NULL;
+    STAT_OP_END(tree, STAT_DELETE);
+
+    size_t deleted = 0, keys = 0;
+    while (entry) {
+        TreeNode* next = entry->next;
+        // Heads leave the index, each entry is logged as one delete.
+        if (entry->end) {
+            if (tree->index) hashRemove(tree, entry);
+            keys++;
+        }
+        if (entry->dead) {
+            tree->tombstones--;
+        } else {
+            if (tree->journal) appendJournal(tree->journal, JOURNAL_DELETE, entry->elem, NULL);
+            deleted++;
+        }
+        tree->size--;
+        destroyTreeNode(tree, entry);
+        entry = next;
+    }
+
+    // The filter may be built again, from the keys left.
+    if (tree->bloom)
+        for (; keys; keys--) bloomRemove(tree);
+
+    return deleted;
+}
+
+/**
+ * @brief Move every entry with a key within a range to a new tree.
+ * The keys are cut out like in `deleteRange` and become the new tree as
+ * they are, in O(log n + k), with no copies of the data. The new tree has
+ * the functions, the allocator and the policies of `tree`, but no journal,
+ * index, filter, aggregates or value index. The nodes move to the memory of the new
+ * tree with their payloads, so either tree may be destroyed first.
+ * 
+ * @param tree  A pointer to the AVL tree.
+ * @param left  The left boundary of the key range (inclusive), NULL for no bound.
+ * @param right The right boundary of the key range (inclusive), NULL for no bound.
+ * @return A tree holding the entries of the range (maybe empty), or NULL.
+ */
+Tree* extractRange(Tree* tree, void* left, void* right) {
+    TRACE_SCOPE("extractRange");
+    // Check if input is valid.
+    if (!tree) return NULL;
+
+    // The new tree shares the allocator, the nodes and payloads move from one count to the other.
+    Tree* out = createTreeAlloc(CREATE.createElem, DELETE.deleteElem, CREATE.createVal,
+                                DELETE.deleteVal, tree->lambda.compare, &tree->lambda.alloc);
+    if (!out) return NULL;
+    out->lambda.io = tree->lambda.io;
+    out->lambda.hash = tree->lambda.hash;
+    out->lambda.compareVal = tree->lambda.compareVal;
+    out->balance = tree->balance;
+    out->lambda.valueWidth = tree->lambda.valueWidth;
+    out->maxTombstones = tree->maxTombstones;
+    if (!tree->root || (left && right && COMPARE(left, right) > 0)) return out;
+
+    STAT_OP_BEGIN(tree);
+    out->root = cutRange(tree, left, right);
+    STAT_OP_END(tree, STAT_DELETE);
+
+    size_t keys = 0;
+    for (TreeNode* entry = out->root ? minimum(out->root) : NULL; entry; entry = entry->next) {
+        if (entry->end) {
+            if (tree->index) hashRemove(tree, entry);
+            keys++;
+        }
+        if (entry->dead) {
+            tree->tombstones--;
+            out->tombstones++;
+        } else if (tree->journal) {
+            appendJournal(tree->journal, JOURNAL_DELETE, entry->elem, NULL);
+        }
+        tree->size--;
+        out->size++;
+        // The new tree keeps no aggregates.
+        if (entry->summary) releaseSummary(tree, entry);
+        countNodeFree(tree);
+        countNodeAlloc(out);
+        memTransfer(&tree->memory, &out->memory, sizeof(TreeNode) + entry->payload);
+    }
+
+    if (tree->bloom)
+        for (; keys; keys--) bloomRemove(tree);
+
+    // The tombstones were deleted entries, they don't leave with the range.
+    compactTree(out);
+    return out;
+}
+
+/**
+ * @brief Free a range returned by a query.
+ * The range is released to its copy of the allocator of its tree, so the
+ * tree may be destroyed first. A range shared with the query cache is
+ * freed by its last owner.
+ * 
+ * @param range A pointer to the range to free (may be NULL).
+ */
+void destroyRange(Range* range) {
+    // Check if input is valid.
+    if (!range) return;
+    if (__atomic_sub_fetch(&range->refs, 1, __ATOMIC_ACQ_REL)) return;
+
+    memFree(&range->memory, range->index, sizeof(*range->index) * range->capacity);
+    // The allocator is copied out of the range before the range is released.
+    Allocator alloc = range->allocator;
+    Memory memory = { &alloc, range->memory.live, range->memory.peak };
+    memFree(&memory, range, sizeof(*range));
 }
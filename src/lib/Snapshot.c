@@ -0,0 +1,297 @@
+#include "../include/Snapshot.h"
+#include "../utils/Utils.h"
+
+// Least payload bytes of a key (chain length and key size) and of an entry (value size).
+#define SNAPSHOT_KEY_BYTES (sizeof(uint64_t) + sizeof(uint32_t))
+#define SNAPSHOT_ENTRY_BYTES sizeof(uint32_t)
+
+// Snapshot file being written, the checksum follows the payload.
+typedef struct SnapshotWriter {
+    FILE *fout;
+    uint64_t bytes;
+    uint64_t checksum;
+    char *scratch;
+    size_t capacity;
+} SnapshotWriter;
+
+/**
+ * @brief Write bytes of the payload.
+ * 
+ * @param writer Pointer to the snapshot writer.
+ * @param data   The bytes to write.
+ * @param length Number of bytes.
+ * @return 0 on success, -1 otherwise.
+ */
+static int writeBytes(SnapshotWriter *writer, const void *data, size_t length) {
+    writer->checksum = fnv1a(writer->checksum, data, length);
+    writer->bytes += length;
+    return fwrite(data, 1, length, writer->fout) == length ? 0 : -1;
+}
+
+/**
+ * @brief Write an element of the payload, as its size followed by its bytes.
+ * 
+ * @param writer Pointer to the snapshot writer.
+ * @param pack   Function serializing the element.
+ * @param elem   The element to write.
+ * @return 0 on success, -1 otherwise.
+ */
+static int writeRecord(SnapshotWriter *writer, Pack pack, void *elem) {
+    size_t size = pack(elem, NULL);
+    if (size > UINT32_MAX) return -1;
+
+    // Grow the scratch buffer if the element doesn't fit.
+    if (size > writer->capacity) {
+        char *scratch = realloc(writer->scratch, size);
+        if (!scratch) return -1;
+        writer->scratch = scratch;
+        writer->capacity = size;
+    }
+    pack(elem, writer->scratch);
+
+    uint32_t length = (uint32_t)size;
+    if (writeBytes(writer, &length, sizeof(length)) < 0) return -1;
+    return writeBytes(writer, writer->scratch, size);
+}
+
+/**
+ * @brief Set the functions used to serialize the elements and values of a tree.
+ * 
+ * @param tree       Pointer to a tree object.
+ * @param packElem   Function serializing an element.
+ * @param unpackElem Function rebuilding an element.
+ * @param packVal    Function serializing a value.
+ * @param unpackVal  Function rebuilding a value.
+ */
+void setTreeIO(Tree *tree, Pack packElem, Unpack unpackElem, Pack packVal, Unpack unpackVal) {
+    // Check if input is valid.
+    if (!tree) return;
+
+    tree->lambda.io.packElem = packElem;
+    tree->lambda.io.unpackElem = unpackElem;
+    tree->lambda.io.packVal = packVal;
+    tree->lambda.io.unpackVal = unpackVal;
+}
+
+/**
+ * @brief Save a tree in a binary snapshot file.
+ * Keys are written in order, once per duplicate chain, each followed by the values
+ * of its chain. The header holds the counts, the payload size and its checksum.
+ * 
+ * @param tree Pointer to a tree object, with its serialize functions set.
+ * @param path The name of the snapshot file.
+ * @return 0 on success, -1 otherwise.
+ */
+int saveTree(Tree *tree, const char *path) {
+    // Check if input is valid.
+    if (!tree || !path || !tree->lambda.io.packElem || !tree->lambda.io.packVal) {
+        printf("Invalid tree, path or serialize functions.\n");
+        return -1;
+    }
+
+    SnapshotWriter writer = { fopen(path, "wb"), 0, FNV_OFFSET, NULL, 0 };
+    // Handle [ERR]: file opening.
+    if (!writer.fout) {
+        printf("[ERR]: opening the snapshot for writing.\n");
+        return -1;
+    }
+    setvbuf(writer.fout, NULL, _IOFBF, SNAPSHOT_BUFFER);
+
+    // The header is written again once the payload is known.
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    int err = fwrite(&header, sizeof(header), 1, writer.fout) == 1 ? 0 : -1;
+
+    TreeNode *head = tree->root ? minimum(tree->root) : NULL;
+    while (head && !err) {
+        // Tombstones are not saved, they come after the live entries of a chain.
+        uint64_t chain = 0;
+        for (TreeNode *entry = head; entry != head->end->next && !entry->dead; entry = entry->next) chain++;
+        if (!chain) {
+            head = head->end->next;
+            continue;
+        }
+
+        err |= writeBytes(&writer, &chain, sizeof(chain));
+        err |= writeRecord(&writer, tree->lambda.io.packElem, head->elem);
+        for (TreeNode *entry = head; entry != head->end->next && !entry->dead && !err; entry = entry->next)
+            err |= writeRecord(&writer, tree->lambda.io.packVal, entry->value);
+
+        header.keys++;
+        header.entries += chain;
+        head = head->end->next;
+    }
+
+    header.bytes = writer.bytes;
+    header.checksum = writer.checksum;
+    if (!err) err = fseek(writer.fout, 0, SEEK_SET);
+    if (!err) err = fwrite(&header, sizeof(header), 1, writer.fout) == 1 ? 0 : -1;
+
+    free(writer.scratch);
+    if (fclose(writer.fout) != 0) err = -1;
+    // Handle [ERR]: writing.
+    if (err) printf("[ERR]: writing the snapshot.\n");
+
+    return err ? -1 : 0;
+}
+
+/**
+ * @brief Read an element of the payload.
+ * 
+ * @param data   The payload.
+ * @param bytes  Size of the payload.
+ * @param pos    Position of the record, moved after it.
+ * @param unpack Function rebuilding the element.
+ * @return The rebuilt element, or NULL if the record is invalid.
+ */
+static void* readRecord(const char *data, uint64_t bytes, uint64_t *pos, Unpack unpack) {
+    uint32_t size;
+    if (bytes - *pos < sizeof(size)) return NULL;
+    memcpy(&size, data + *pos, sizeof(size));
+    *pos += sizeof(size);
+
+    if (bytes - *pos < size) return NULL;
+    void *elem = unpack(data + *pos, size);
+    *pos += size;
+    return elem;
+}
+
+/**
+ * @brief Load a tree from a binary snapshot file.
+ * The payload is read at once and checked before anything is built. Entries come
+ * sorted, so the threaded list is linked while reading and the balanced tree is
+ * built over the keys in linear time, without calling the compare function.
+ * 
+ * @param path  The name of the snapshot file.
+ * @param funcs Functions of the tree, including the unpack functions.
+ * @return Tree* the loaded tree, or NULL if the snapshot is invalid or the memory was refused.
+ */
+Tree* loadTree(const char *path, const Func *funcs) {
+    // Check if input is valid.
+    if (!path || !funcs || !funcs->io.unpackElem || !funcs->io.unpackVal) {
+        printf("Invalid path or serialize functions.\n");
+        return NULL;
+    }
+
+    FILE *fin = fopen(path, "rb");
+    // Handle [ERR]: file opening.
+    if (!fin) {
+        printf("[ERR]: opening the snapshot for reading.\n");
+        return NULL;
+    }
+
+    SnapshotHeader header;
+    char *data = NULL;
+    int err = fread(&header, sizeof(header), 1, fin) == 1 ? 0 : -1;
+    // The checksum doesn't cover the header, the counts are bounded by the payload:
+    // each key takes at least SNAPSHOT_KEY_BYTES and each entry SNAPSHOT_ENTRY_BYTES.
+    if (!err && (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) ||
+                 header.version != SNAPSHOT_VERSION || header.keys > header.entries ||
+                 header.bytes > SIZE_MAX || header.keys > header.bytes / SNAPSHOT_KEY_BYTES ||
+                 header.entries > (header.bytes - header.keys * SNAPSHOT_KEY_BYTES) / SNAPSHOT_ENTRY_BYTES))
+        err = -1;
+    if (!err) {
+        data = malloc(header.bytes ? (size_t)header.bytes : 1);
+        err = (!data || fread(data, 1, (size_t)header.bytes, fin) != header.bytes) ? -1 : 0;
+    }
+    fclose(fin);
+
+    // Handle [ERR]: corrupted snapshot.
+    if (err || fnv1a(FNV_OFFSET, data, (size_t)header.bytes) != header.checksum) {
+        printf("[ERR]: invalid snapshot.\n");
+        free(data);
+        return NULL;
+    }
+
+    Tree *tree = createTreeAlloc(funcs->create.createElem, funcs->delete.deleteElem,
+                                 funcs->create.createVal, funcs->delete.deleteVal,
+                                 funcs->compare, &funcs->alloc);
+    TreeNode **heads = malloc(sizeof(TreeNode *) * (header.keys ? header.keys : 1));
+    // Handle [ERR]: out of memory (or budget) for the tree.
+    if (!tree || !heads) {
+        printf("[ERR]: at malloc...\n");
+        free(heads);
+        free(data);
+        destroyTree(tree);
+        return NULL;
+    }
+    tree->lambda.io = funcs->io;
+
+    // Rebuild the entries in order, linking the threaded list.
+    uint64_t pos = 0, keys = 0, entries = 0;
+    TreeNode *first = NULL, *last = NULL;
+    while (!err && keys < header.keys) {
+        uint64_t chain;
+        if (header.bytes - pos < sizeof(chain)) { err = -1; break; }
+        memcpy(&chain, data + pos, sizeof(chain));
+        pos += sizeof(chain);
+        if (!chain || chain > header.entries - entries) { err = -1; break; }
+
+        // Each entry owns a copy of the key, like after `insertNode`.
+        uint64_t keyPos = pos;
+        TreeNode *head = NULL;
+        for (uint64_t entry = 0; entry < chain && !err; entry++) {
+            // The unpacked payloads are counted with the node adopting them.
+            size_t mark = payloadBytes();
+            uint64_t at = keyPos;
+            void *elem = readRecord(data, header.bytes, &at, funcs->io.unpackElem);
+            if (!entry) pos = at;
+            void *value = readRecord(data, header.bytes, &pos, funcs->io.unpackVal);
+            TreeNode *node = (elem && value) ? createTreeNodeAdopt(tree, elem, value) : NULL;
+            if (!node) {
+                if (elem) funcs->delete.deleteElem(elem);
+                if (value) funcs->delete.deleteVal(value);
+                err = -1;
+                break;
+            }
+            countPayload(tree, node, payloadBytes() - mark);
+
+            node->prev = last;
+            if (last) last->next = node;
+            else first = node;
+            last = node;
+            if (!head) head = node;
+            head->end = node;
+        }
+        if (head) heads[keys++] = head;
+        entries += chain;
+    }
+    if (!err && (entries != header.entries || pos != header.bytes)) err = -1;
+    free(data);
+
+    // Handle [ERR]: corrupted snapshot, release what was built.
+    if (err) {
+        printf("[ERR]: invalid snapshot.\n");
+        while (first) {
+            TreeNode *next = first->next;
+            destroyTreeNode(tree, first);
+            first = next;
+        }
+        free(heads);
+        destroyTree(tree);
+        return NULL;
+    }
+
+    tree->root = buildBalanced(heads, (size_t)keys, NULL);
+    tree->size = (size_t)entries;
+    free(heads);
+
+    // Read wider values if the functions say so.
+    if (funcs->valueWidth && setTreeValueWidth(tree, funcs->valueWidth)) {
+        printf("[ERR]: invalid value width...\n");
+        destroyTree(tree);
+        return NULL;
+    }
+
+    // Index the keys if the tree hashes them, and the values if it orders them.
+    if ((funcs->hash && !setTreeHash(tree, funcs->hash)) ||
+        (funcs->compareVal && !setTreeValueIndex(tree, funcs->compareVal))) {
+        printf("[ERR]: at malloc...\n");
+        destroyTree(tree);
+        return NULL;
+    }
+
+    return tree;
+}
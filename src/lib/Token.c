@@ -0,0 +1,115 @@
+#include "../include/Token.h"
+#include "../include/Cipher.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Classify a block of `TOKEN_BLOCK` bytes.
+ * Each separator byte from the block sets its bit in the returned mask.
+ * The bytes are compared against every `WORD_SEPARATOR` character at once.
+ * 
+ * @param data Pointer to at least `TOKEN_BLOCK` readable bytes.
+ * @return The separator bit mask of the block.
+ */
+uint64_t separatorMask(const char *data) {
+#if defined(__AVX2__)
+    __m256i block = _mm256_loadu_si256((const __m256i *)data);
+    __m256i match = _mm256_setzero_si256();
+    for (const char *sep = WORD_SEPARATOR; *sep; sep++)
+        match = _mm256_or_si256(match, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(*sep)));
+    return (uint32_t)_mm256_movemask_epi8(match);
+#elif defined(__SSE2__)
+    __m128i block = _mm_loadu_si128((const __m128i *)data);
+    __m128i match = _mm_setzero_si128();
+    for (const char *sep = WORD_SEPARATOR; *sep; sep++)
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(block, _mm_set1_epi8(*sep)));
+    return (uint32_t)_mm_movemask_epi8(match);
+#else
+    uint64_t mask = 0;
+    for (size_t pos = 0; pos < TOKEN_BLOCK; pos++)
+        if (isSeparator(data[pos])) mask |= (uint64_t)1 << pos;
+    return mask;
+#endif
+}
+
+/**
+ * @brief Emit the word between `start` and `end`.
+ * 
+ * @param data   The buffer being tokenized.
+ * @param start  Position of the first character of the word.
+ * @param end    Position after the last character of the word.
+ * @param offset The running offset, moved past the word.
+ * @param emit   Callback receiving the word.
+ * @param ctx    Context passed to the callback.
+ */
+static void emitSpan(const char *data, size_t start, size_t end, int64_t *offset,
+                     SpanFn emit, void *ctx) {
+    Span span = { data + start, end - start, *offset };
+    *offset += (int64_t)(end - start);
+    emit(ctx, &span);
+}
+
+/**
+ * @brief Split a buffer into words.
+ * The buffer is classified `TOKEN_BLOCK` bytes at a time (SIMD when available),
+ * word boundaries are then read from the separator bit masks. The buffer is
+ * never modified, each word is emitted as a span with its 64-bit offset.
+ * 
+ * @param data   The buffer to split.
+ * @param length Number of bytes in the buffer.
+ * @param offset The running offset, incremented by the length of each word.
+ * @param emit   Callback receiving each word.
+ * @param ctx    Context passed to the callback.
+ * @return The number of words emitted.
+ */
+size_t tokenize(const char *data, size_t length, int64_t *offset, SpanFn emit, void *ctx) {
+    TRACE_SCOPE("tokenize");
+    // Check if input is valid.
+    if (!data || !offset || !emit) return 0;
+
+    size_t words = 0, start = 0, base = 0;
+    int inWord = 0;
+
+    // Classify full blocks, walking the boundaries with bit scans.
+    for (; base + TOKEN_BLOCK <= length; base += TOKEN_BLOCK) {
+        uint64_t full = (TOKEN_BLOCK == 64) ? ~(uint64_t)0 : (((uint64_t)1 << TOKEN_BLOCK) - 1);
+        uint64_t sep = separatorMask(data + base);
+
+        // Skip blocks that don't change the current state.
+        if ((inWord && !sep) || (!inWord && sep == full)) continue;
+
+        size_t pos = 0;
+        while (pos < TOKEN_BLOCK) {
+            // Look for the end of the word, or the start of the next one.
+            uint64_t rest = (inWord ? sep : (~sep & full)) >> pos;
+            if (!rest) break;
+            pos += (size_t)__builtin_ctzll(rest);
+            if (inWord) {
+                emitSpan(data, start, base + pos, offset, emit, ctx);
+                words++;
+            } else {
+                start = base + pos;
+            }
+            inWord = !inWord;
+        }
+    }
+
+    // Classify the remaining bytes one by one.
+    for (; base < length; base++) {
+        int separator = isSeparator(data[base]);
+        if (inWord && separator) {
+            emitSpan(data, start, base, offset, emit, ctx);
+            words++;
+        } else if (!inWord && !separator) {
+            start = base;
+        }
+        inWord = !separator;
+    }
+
+    // The buffer ends inside a word.
+    if (inWord) {
+        emitSpan(data, start, length, offset, emit, ctx);
+        words++;
+    }
+
+    return words;
+}
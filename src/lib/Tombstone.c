@@ -0,0 +1,291 @@
+#include "../include/Tombstone.h"
+#include "../utils/Utils.h"
+
+/**
+ * @brief Start a compaction once the tombstones pass the ratio of the tree.
+ * With a compactor the thread is woken up, the caller doesn't wait for it.
+ *
+ * @param tree Pointer to a tree object.
+ */
+static void checkTombstones(Tree *tree) {
+    if (tree->tombstones < TOMBSTONE_MIN ||
+        (double)tree->tombstones <= tree->maxTombstones * (double)tree->size) return;
+
+    Compactor *compactor = tree->compactor;
+    if (!compactor) {
+        compactTree(tree);
+        return;
+    }
+
+    pthread_mutex_lock(&compactor->mutex);
+    compactor->pending = 1;
+    pthread_cond_signal(&compactor->wake);
+    pthread_mutex_unlock(&compactor->mutex);
+}
+
+/**
+ * @brief Choose between lazy and eager deletes.
+ * Lazy `deleteNode` calls mark the entry as a tombstone in O(log n), without
+ * unlinking it or rebalancing the tree. Searches and range queries skip the
+ * tombstones, a compaction frees them once they are more than `ratio` of the
+ * entries. `tree->size` counts the tombstones until then.
+ *
+ * @param tree  Pointer to a tree object.
+ * @param ratio Ratio of tombstones starting a compaction (e.g. 0.25), or 0
+ *              to compact now and delete eagerly again (the deletes stay
+ *              lazy if the memory of the compaction is refused).
+ */
+void setTreeTombstones(Tree *tree, double ratio) {
+    // Check if input is valid.
+    if (!tree) return;
+
+    // Eager deletes don't expect tombstones in the chains.
+    if (ratio <= 0) compactTree(tree);
+    if (ratio <= 0 && tree->tombstones) return;
+    tree->maxTombstones = ratio > 0 ? ratio : 0;
+}
+
+/**
+ * @brief Mark the last live entry of an element as a tombstone.
+ * The live entries of a key always come first in its duplicate chain, so a
+ * key is missing exactly when its head is a tombstone.
+ *
+ * @param tree Pointer to a tree object.
+ * @param elem Pointer to the element to delete.
+ * @return 1 if an entry was marked, 0 if the element is missing.
+ */
+int buryEntry(Tree *tree, void *elem) {
+    // Check if input is valid.
+    if (!tree || !elem) return 0;
+
+    TreeNode *head = findNode(tree, tree->root, elem);
+    if (!head || head->dead) return 0;
+
+    // The tombstones are at the end of the chain, bury the entry before them.
+    TreeNode *entry = head->end;
+    while (entry->dead) entry = entry->prev;
+    if (tree->views) viewRemove(tree, entry->elem);
+    if (tree->values) valueRemove(tree, entry);
+    entry->dead = 1;
+    tree->tombstones++;
+    tree->version++;
+    if (tree->aggregate) {
+        refreshChain(tree, head);
+        refreshPath(tree, head);
+    }
+
+    checkTombstones(tree);
+    return 1;
+}
+
+/**
+ * @brief Give the first tombstone of a key the data of a new node.
+ * The chain keeps its live entries first, and the tree isn't changed.
+ *
+ * @param tree Pointer to a tree object.
+ * @param head Head of the key, with a tombstone at the end of its chain.
+ * @param node New node with the same key, freed once its data is moved.
+ */
+void reviveEntry(Tree *tree, TreeNode *head, TreeNode *node) {
+    TreeNode *grave = head;
+    while (!grave->dead) grave = grave->next;
+
+    // The old data is destroyed, the new data is moved without copies.
+    DELETE.deleteElem(grave->elem);
+    DELETE.deleteVal(grave->value);
+    uncountPayload(tree, grave);
+    grave->elem = node->elem;
+    grave->value = node->value;
+    grave->payload = node->payload;
+    grave->dead = 0;
+    tree->tombstones--;
+    if (tree->values) valueMove(tree, node, grave);
+
+    node->elem = NULL;
+    node->value = NULL;
+    node->payload = 0;
+    destroyTreeNode(tree, node);
+
+    if (tree->aggregate) {
+        refreshChain(tree, head);
+        refreshPath(tree, head);
+    }
+}
+
+/**
+ * @brief Remove the tombstones of one key from the tree.
+ * Used before an eager removal of an entry of the key.
+ *
+ * @param tree Pointer to a tree object.
+ * @param elem Pointer to the element whose tombstones are removed.
+ */
+void purgeEntry(Tree *tree, void *elem) {
+    // Check if input is valid.
+    if (!tree || !elem) return;
+
+    TreeNode *head;
+    while ((head = findNode(tree, tree->root, elem)) && head->end->dead) {
+        detachEntry(tree, elem, NULL, NULL);
+        tree->tombstones--;
+    }
+}
+
+/**
+ * @brief Free every tombstone and rebuild the tree from the live keys.
+ * One walk of the threaded list frees the tombstones and links the live
+ * entries again, then the live heads are rebuilt in a balanced tree (ordered
+ * by access count for a weighted tree), so the compaction takes O(n) and no
+ * rotations. Fingers fall back to the root. If the memory is refused the
+ * tree is left as it was, the next delete past the ratio tries again.
+ *
+ * @param tree Pointer to a tree object.
+ * @return The number of tombstones freed.
+ */
+size_t compactTree(Tree *tree) {
+    // Check if input is valid.
+    if (!tree || !tree->tombstones) return 0;
+
+    size_t live = tree->size - tree->tombstones;
+    TreeNode **heads = (TreeNode **)memAlloc(&tree->memory, sizeof(TreeNode *) * (live ? live : 1));
+    if (!heads) return 0;
+
+    size_t keys = 0, freed = 0, gone = 0;
+    TreeNode *last = NULL;
+    TreeNode *head = minimum(tree->root);
+    while (head) {
+        TreeNode *nextHead = head->end->next;
+
+        // Free the tombstones, the live entries before them stay linked.
+        TreeNode *end = NULL;
+        for (TreeNode *entry = head; entry != nextHead;) {
+            TreeNode *following = entry->next;
+            if (!entry->dead) {
+                end = entry;
+            } else {
+                if (entry == head && tree->index) hashRemove(tree, head);
+                destroyTreeNode(tree, entry);
+                freed++;
+            }
+            entry = following;
+        }
+
+        // Link the live chain after the previous one.
+        if (end) {
+            head->end = end;
+            head->prev = last;
+            if (last) last->next = head;
+            last = end;
+            heads[keys++] = head;
+        } else {
+            gone++;
+        }
+        head = nextHead;
+    }
+    if (last) last->next = NULL;
+
+    // A weighted tree keeps the access counts of its keys.
+    tree->root = tree->balance == BALANCE_WEIGHT ? buildWeighted(heads, keys) : buildBalanced(heads, keys, NULL);
+    rebuildAggregates(tree);
+    tree->size -= freed;
+    tree->tombstones = 0;
+    tree->removals++;
+    tree->version++;
+    memFree(&tree->memory, heads, sizeof(TreeNode *) * (live ? live : 1));
+
+    // The filter may be built again, from the whole tree.
+    if (tree->bloom)
+        for (; gone; gone--) bloomRemove(tree);
+
+    return freed;
+}
+
+/**
+ * @brief Body of the compaction thread.
+ *
+ * @param arg Pointer to the compactor.
+ * @return NULL.
+ */
+static void* runCompactor(void *arg) {
+    Compactor *compactor = (Compactor *)arg;
+
+    pthread_mutex_lock(&compactor->mutex);
+    while (1) {
+        while (!compactor->pending && !compactor->stop)
+            pthread_cond_wait(&compactor->wake, &compactor->mutex);
+        if (compactor->stop) break;
+        compactor->pending = 0;
+
+        // Writers signal under the mutex while they hold the tree lock, so take it without the mutex.
+        pthread_mutex_unlock(&compactor->mutex);
+        pthread_rwlock_wrlock(compactor->lock);
+        compactTree(compactor->tree);
+        pthread_rwlock_unlock(compactor->lock);
+        pthread_mutex_lock(&compactor->mutex);
+        compactor->runs++;
+    }
+    pthread_mutex_unlock(&compactor->mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief Run the compactions of a tree on a background thread.
+ * The deletes past the ratio only wake the thread up, which compacts the tree
+ * holding `lock` for writing. Every other use of the tree must hold `lock`.
+ *
+ * @param tree Pointer to a tree object, deleting lazily.
+ * @param lock Lock of the tree, shared by its readers and writers.
+ * @return The compactor, or NULL if the memory was refused or the thread couldn't be started.
+ */
+Compactor* startCompactor(Tree *tree, pthread_rwlock_t *lock) {
+    // Check if input is valid.
+    if (!tree || !lock || tree->compactor) return NULL;
+
+    Compactor *compactor = (Compactor *)memAlloc(&tree->memory, sizeof(Compactor));
+    if (!compactor) return NULL;
+    memset(compactor, 0, sizeof(*compactor));
+    compactor->tree = tree;
+    compactor->lock = lock;
+    pthread_mutex_init(&compactor->mutex, NULL);
+    pthread_cond_init(&compactor->wake, NULL);
+
+    // Handle [ERR]: thread creation.
+    if (pthread_create(&compactor->thread, NULL, runCompactor, compactor) != 0) {
+        printf("[ERR]: starting the compaction thread.\n");
+        pthread_mutex_destroy(&compactor->mutex);
+        pthread_cond_destroy(&compactor->wake);
+        memFree(&tree->memory, compactor, sizeof(Compactor));
+        return NULL;
+    }
+
+    pthread_rwlock_wrlock(lock);
+    tree->compactor = compactor;
+    pthread_rwlock_unlock(lock);
+    return compactor;
+}
+
+/**
+ * @brief Stop the compaction thread and detach it from the tree.
+ * A compaction still pending is left to the next delete, done inline.
+ *
+ * @param compactor Pointer to a compactor (may be NULL).
+ */
+void stopCompactor(Compactor *compactor) {
+    // Check if input is valid.
+    if (!compactor) return;
+
+    Tree *tree = compactor->tree;
+    pthread_rwlock_wrlock(compactor->lock);
+    tree->compactor = NULL;
+    pthread_rwlock_unlock(compactor->lock);
+
+    pthread_mutex_lock(&compactor->mutex);
+    compactor->stop = 1;
+    pthread_cond_signal(&compactor->wake);
+    pthread_mutex_unlock(&compactor->mutex);
+    pthread_join(compactor->thread, NULL);
+
+    pthread_mutex_destroy(&compactor->mutex);
+    pthread_cond_destroy(&compactor->wake);
+    memFree(&tree->memory, compactor, sizeof(Compactor));
+}
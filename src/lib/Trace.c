@@ -0,0 +1,185 @@
+#include <time.h>
+
+#include "../include/Trace.h"
+
+// Recording state, shared by every thread.
+static int traceOn = 0;
+static uint64_t traceBase = 0;
+static char *tracePath = NULL;
+
+// Registry of the ring buffers, in the order the threads first traced a scope.
+static TraceBuffer *traceBuffers = NULL;
+static int traceThreads = 0;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t traceOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t traceKey;
+
+// Ring buffer of the calling thread, registered on its first event.
+static _Thread_local TraceBuffer *localBuffer = NULL;
+
+/**
+ * @brief Read the monotonic clock.
+ *
+ * @return The time in nanoseconds.
+ */
+static uint64_t traceClock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Mark the buffer of an exiting thread, the next stop frees it.
+ *
+ * @param buffer The ring buffer of the thread.
+ */
+static void retireBuffer(void *buffer) {
+    pthread_mutex_lock(&traceLock);
+    ((TraceBuffer *)buffer)->retired = 1;
+    pthread_mutex_unlock(&traceLock);
+}
+
+/**
+ * @brief Create the thread key whose destructor retires the buffers.
+ */
+static void createTraceKey(void) {
+    pthread_key_create(&traceKey, retireBuffer);
+}
+
+/**
+ * @brief Get the ring buffer of the calling thread, registered on first use.
+ *
+ * @return The ring buffer.
+ */
+static TraceBuffer* threadBuffer(void) {
+    if (localBuffer) return localBuffer;
+
+    TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+    if (!buffer) {
+        printf("[ERR]: at malloc...\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_once(&traceOnce, createTraceKey);
+    pthread_setspecific(traceKey, buffer);
+
+    pthread_mutex_lock(&traceLock);
+    buffer->tid = ++traceThreads;
+    buffer->next = traceBuffers;
+    traceBuffers = buffer;
+    pthread_mutex_unlock(&traceLock);
+
+    localBuffer = buffer;
+    return buffer;
+}
+
+/**
+ * @brief Start recording the traced scopes of every thread.
+ * Each thread records its events in its own ring buffer, without locks,
+ * the last TRACE_EVENTS events of each thread are kept. The scopes are
+ * only compiled in with AVL_TRACE (`make TRACE=1`), otherwise the trace
+ * stays empty and the traced calls cost nothing.
+ *
+ * @param path The file receiving the trace when it stops.
+ * @return 0 on success, -1 if a trace is already running.
+ */
+int startTrace(const char *path) {
+    // Check if input is valid.
+    if (!path) return -1;
+
+    pthread_mutex_lock(&traceLock);
+    if (tracePath) {
+        pthread_mutex_unlock(&traceLock);
+        return -1;
+    }
+    tracePath = malloc(strlen(path) + 1);
+    if (!tracePath) {
+        printf("[ERR]: at malloc...\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(tracePath, path);
+    traceBase = traceClock();
+    pthread_mutex_unlock(&traceLock);
+
+    __atomic_store_n(&traceOn, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Stop recording and write the trace as Chrome trace-event JSON.
+ * The file can be opened in chrome://tracing or Perfetto, each event is a
+ * complete ("X") event of its thread. The buffers of the exited threads are
+ * freed, the others are emptied. It must be called once the traced work is
+ * done, a thread still inside a traced call may lose its event.
+ *
+ * @return The number of events written, or -1 if no trace runs or the file can't be written.
+ */
+long stopTrace(void) {
+    __atomic_store_n(&traceOn, 0, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&traceLock);
+    if (!tracePath) {
+        pthread_mutex_unlock(&traceLock);
+        return -1;
+    }
+    FILE *out = fopen(tracePath, "w");
+    free(tracePath);
+    tracePath = NULL;
+
+    long events = 0;
+    if (out) fprintf(out, "{\"traceEvents\":[");
+    for (TraceBuffer **link = &traceBuffers; *link;) {
+        TraceBuffer *buffer = *link;
+        // A full ring starts at its oldest event.
+        size_t count = buffer->written < TRACE_EVENTS ? buffer->written : TRACE_EVENTS;
+        size_t first = buffer->written - count;
+        for (size_t i = 0; out && i < count; i++, events++) {
+            TraceEvent *event = &buffer->events[(first + i) % TRACE_EVENTS];
+            fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"avl\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                    events ? "," : "", event->name, (double)(event->start - traceBase) / 1000.0,
+                    (double)event->duration / 1000.0, buffer->tid);
+        }
+        buffer->written = 0;
+
+        if (buffer->retired) {
+            *link = buffer->next;
+            free(buffer);
+        } else {
+            link = &buffer->next;
+        }
+    }
+    pthread_mutex_unlock(&traceLock);
+
+    if (!out) return -1;
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(out);
+    return events;
+}
+
+/**
+ * @brief Open a traced scope.
+ *
+ * @param name Name of the scope (a string literal).
+ * @return The scope, with no start time while tracing is off.
+ */
+TraceScope traceEnter(const char *name) {
+    TraceScope scope = { name, 0 };
+    if (__atomic_load_n(&traceOn, __ATOMIC_ACQUIRE)) scope.start = traceClock();
+    return scope;
+}
+
+/**
+ * @brief Close a traced scope, its event goes to the ring of the thread.
+ *
+ * @param scope The scope, closed when it goes out of scope (see TRACE_SCOPE).
+ */
+void traceLeave(TraceScope *scope) {
+    // Scopes opened before the trace started aren't recorded.
+    if (!scope->start || !__atomic_load_n(&traceOn, __ATOMIC_ACQUIRE) || scope->start < traceBase) return;
+
+    TraceBuffer *buffer = threadBuffer();
+    TraceEvent *event = &buffer->events[buffer->written % TRACE_EVENTS];
+    event->name = scope->name;
+    event->start = scope->start;
+    event->duration = traceClock() - scope->start;
+    buffer->written++;
+}
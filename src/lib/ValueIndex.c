@@ -0,0 +1,363 @@
+#include "../include/ValueIndex.h"
+#include "../utils/Utils.h"
+
+// Compare the values of two entries.
+#define COMPARE_VAL(a, b) tree->lambda.compareVal((a), (b))
+
+/**
+ * @brief Find the first entry of the index after (or at) a value.
+ * The chunks are searched by their last value, then the entries of one
+ * chunk, so the search takes O(log n) comparisons.
+ *
+ * @param tree  Pointer to a tree object with a value index.
+ * @param value Pointer to the value.
+ * @param upper 1 for the first entry above the value, 0 for the first not below it.
+ * @param chunk Where to store the chunk of the entry (`index->count` at the end).
+ * @param at    Where to store the position of the entry in its chunk.
+ */
+static void locateValue(Tree *tree, void *value, int upper, size_t *chunk, size_t *at) {
+    ValueIndex *index = tree->values;
+    size_t low = 0, high = index->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        ValueChunk *part = index->chunks[mid];
+        int comp = COMPARE_VAL(part->entries[part->count - 1]->value, value);
+        if (comp > 0 || (!upper && !comp)) high = mid;
+        else low = mid + 1;
+    }
+    *chunk = low;
+    *at = 0;
+    if (low == index->count) return;
+
+    ValueChunk *part = index->chunks[low];
+    size_t first = 0, last = part->count - 1;
+    while (first < last) {
+        size_t mid = first + (last - first) / 2;
+        int comp = COMPARE_VAL(part->entries[mid]->value, value);
+        if (comp > 0 || (!upper && !comp)) last = mid;
+        else first = mid + 1;
+    }
+    *at = first;
+}
+
+/**
+ * @brief Find the position of an entry in the index.
+ * The entries with the same value are searched for the node itself.
+ *
+ * @param tree  Pointer to a tree object with a value index.
+ * @param entry The entry, with its value set.
+ * @param chunk Where to store the chunk of the entry.
+ * @param at    Where to store the position of the entry in its chunk.
+ * @return 1 if the entry was found, 0 otherwise.
+ */
+static int findEntry(Tree *tree, TreeNode *entry, size_t *chunk, size_t *at) {
+    ValueIndex *index = tree->values;
+    locateValue(tree, entry->value, 0, chunk, at);
+    while (*chunk < index->count) {
+        ValueChunk *part = index->chunks[*chunk];
+        if (part->entries[*at] == entry) return 1;
+        if (COMPARE_VAL(part->entries[*at]->value, entry->value)) return 0;
+        if (++*at == part->count) {
+            (*chunk)++;
+            *at = 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Make room for one more chunk in the chunk array of a value index.
+ *
+ * @param index Pointer to a value index.
+ * @return 1 on success, 0 if the memory was refused.
+ */
+static int growChunks(ValueIndex *index) {
+    if (index->count < index->capacity) return 1;
+
+    size_t capacity = index->capacity ? index->capacity * 2 : INIT_LEN;
+    ValueChunk **chunks = index->chunks ? memResize(index->memory, index->chunks, sizeof(ValueChunk *) * index->capacity,
+                                                    sizeof(ValueChunk *) * capacity)
+                                        : memAlloc(index->memory, sizeof(ValueChunk *) * capacity);
+    if (!chunks) return 0;
+    index->chunks = chunks;
+    index->capacity = capacity;
+    return 1;
+}
+
+/**
+ * @brief Add an empty chunk to a value index, the spare one if there is one.
+ *
+ * @param index Pointer to a value index.
+ * @param at    Position of the new chunk.
+ * @return The new chunk, or NULL if the memory was refused.
+ */
+static ValueChunk* addChunk(ValueIndex *index, size_t at) {
+    if (!growChunks(index)) return NULL;
+
+    ValueChunk *chunk = index->spare;
+    if (chunk) index->spare = NULL;
+    else if (!(chunk = memAlloc(index->memory, sizeof(ValueChunk)))) return NULL;
+    chunk->count = 0;
+    memmove(index->chunks + at + 1, index->chunks + at, sizeof(ValueChunk *) * (index->count - at));
+    index->chunks[at] = chunk;
+    index->count++;
+    return chunk;
+}
+
+/**
+ * @brief Sort entries by value, keeping the order of equal values.
+ *
+ * @param tree    Pointer to a tree object with a value compare function.
+ * @param entries The entries to sort.
+ * @param buffer  Room for as many entries.
+ * @param count   Number of entries.
+ */
+static void sortEntries(Tree *tree, TreeNode **entries, TreeNode **buffer, size_t count) {
+    if (count < 2) return;
+
+    size_t half = count / 2;
+    sortEntries(tree, entries, buffer, half);
+    sortEntries(tree, entries + half, buffer, count - half);
+
+    memcpy(buffer, entries, sizeof(TreeNode *) * half);
+    size_t i = 0, j = half, k = 0;
+    while (i < half && j < count)
+        entries[k++] = COMPARE_VAL(entries[j]->value, buffer[i]->value) < 0 ? entries[j++] : buffer[i++];
+    while (i < half) entries[k++] = buffer[i++];
+}
+
+/**
+ * @brief Set the value compare function of a tree and build its value index.
+ * The index keeps pointers to the live entries of the tree in value order,
+ * in chunks of up to VALUE_CHUNK entries, so lookups by value take O(log n)
+ * instead of a walk of every node. Each insert or delete of the tree updates
+ * it in O(log n + VALUE_CHUNK). Entries with the same value keep their key
+ * order, later inserts come after them.
+ *
+ * @param tree       Pointer to a tree object.
+ * @param compareVal Function comparing two values (`compareIdx` for the word
+ *                   offsets), or NULL to drop the index.
+ * @return 1 on success, 0 if the memory was refused (the tree has no value index then).
+ */
+int setTreeValueIndex(Tree *tree, Compare compareVal) {
+    // Check if input is valid.
+    if (!tree) return 0;
+
+    destroyValueIndex(tree->values);
+    tree->values = NULL;
+    tree->lambda.compareVal = compareVal;
+    if (!compareVal) return 1;
+
+    ValueIndex *index = memAlloc(&tree->memory, sizeof(ValueIndex));
+    if (!index) return 0;
+    memset(index, 0, sizeof(ValueIndex));
+    index->memory = &tree->memory;
+
+    // The live entries are sorted once, then cut into full chunks.
+    size_t count = tree->size - tree->tombstones;
+    TreeNode **entries = count ? memAlloc(&tree->memory, sizeof(TreeNode *) * count * 2) : NULL;
+    if (count && !entries) {
+        destroyValueIndex(index);
+        return 0;
+    }
+    size_t filled = 0;
+    for (TreeNode *entry = count ? minimum(tree->root) : NULL; entry; entry = entry->next)
+        if (!entry->dead) entries[filled++] = entry;
+    sortEntries(tree, entries, entries + count, count);
+
+    for (size_t i = 0; i < count; i += VALUE_CHUNK) {
+        ValueChunk *part = addChunk(index, index->count);
+        if (!part) {
+            memFree(&tree->memory, entries, sizeof(TreeNode *) * count * 2);
+            destroyValueIndex(index);
+            return 0;
+        }
+        part->count = count - i < VALUE_CHUNK ? count - i : VALUE_CHUNK;
+        memcpy(part->entries, entries + i, sizeof(TreeNode *) * part->count);
+    }
+    index->size = count;
+    memFree(&tree->memory, entries, sizeof(TreeNode *) * count * 2);
+    tree->values = index;
+    return 1;
+}
+
+/**
+ * @brief Find the first live entry of a tree with a value, in O(log n).
+ *
+ * @param tree  Pointer to a tree object with a value index.
+ * @param value Pointer to the value.
+ * @return The entry, or NULL if none has the value (or the tree has no value index).
+ */
+TreeNode* valueSearch(Tree *tree, void *value) {
+    // Check if input is valid.
+    if (!tree || !tree->values || !value) return NULL;
+
+    size_t chunk, at;
+    locateValue(tree, value, 0, &chunk, &at);
+    if (chunk == tree->values->count) return NULL;
+
+    TreeNode *entry = tree->values->chunks[chunk]->entries[at];
+    return COMPARE_VAL(entry->value, value) ? NULL : entry;
+}
+
+/**
+ * @brief Find the live entry with the greatest value not above a value, in O(log n).
+ * With the word offsets as values, it is the word at (or before) a byte.
+ *
+ * @param tree  Pointer to a tree object with a value index.
+ * @param value Pointer to the value.
+ * @return The last entry with that greatest value, or NULL if every value is above.
+ */
+TreeNode* valueFloor(Tree *tree, void *value) {
+    // Check if input is valid.
+    if (!tree || !tree->values || !value) return NULL;
+
+    size_t chunk, at;
+    locateValue(tree, value, 1, &chunk, &at);
+    // Step back to the entry before the first one above the value.
+    if (at) return tree->values->chunks[chunk]->entries[at - 1];
+    if (!chunk) return NULL;
+    ValueChunk *part = tree->values->chunks[chunk - 1];
+    return part->entries[part->count - 1];
+}
+
+/**
+ * @brief Visit the live entries of a tree with a value within a range.
+ * The first entry is found in O(log n), then the chunks are read in order,
+ * so the query takes O(log n + k) for k entries.
+ *
+ * @param tree  Pointer to a tree object with a value index.
+ * @param low   The low boundary (inclusive), NULL for no bound.
+ * @param high  The high boundary (inclusive), NULL for no bound.
+ * @param visit Function called for each entry, in value order (may be NULL to count them).
+ * @param ctx   State passed to `visit`.
+ * @return The number of entries found, 0 if the tree has no value index.
+ */
+size_t valueRangeQuery(Tree *tree, void *low, void *high, Visit visit, void *ctx) {
+    TRACE_SCOPE("valueRangeQuery");
+    // Check if input is valid.
+    if (!tree || !tree->values) return 0;
+    if (low && high && COMPARE_VAL(low, high) > 0) return 0;
+
+    ValueIndex *index = tree->values;
+    size_t chunk = 0, at = 0, count = 0;
+    if (low) locateValue(tree, low, 0, &chunk, &at);
+    for (; chunk < index->count; chunk++, at = 0) {
+        ValueChunk *part = index->chunks[chunk];
+        for (; at < part->count; at++) {
+            if (high && COMPARE_VAL(part->entries[at]->value, high) > 0) return count;
+            if (visit) visit(ctx, part->entries[at]);
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Free the memory of a value index, the entries are the tree ones.
+ *
+ * @param index Pointer to a value index (may be NULL).
+ */
+void destroyValueIndex(ValueIndex *index) {
+    // Check if input is valid.
+    if (!index) return;
+
+    Memory *memory = index->memory;
+    for (size_t i = 0; i < index->count; i++)
+        memFree(memory, index->chunks[i], sizeof(ValueChunk));
+    memFree(memory, index->spare, sizeof(ValueChunk));
+    memFree(memory, index->chunks, sizeof(ValueChunk *) * index->capacity);
+    memFree(memory, index, sizeof(ValueIndex));
+}
+
+/**
+ * @brief Make room in the value index for a new entry, before an insert.
+ * The index gets room for one more chunk and a spare chunk, so the split
+ * of a full chunk doesn't allocate.
+ *
+ * @param tree Pointer to a tree object with a value index.
+ * @return 1 if the entry can be added, 0 if the insert must fail.
+ */
+int valueReserve(Tree *tree) {
+    ValueIndex *index = tree->values;
+    if (!growChunks(index)) return 0;
+    if (!index->spare && !(index->spare = memAlloc(index->memory, sizeof(ValueChunk)))) return 0;
+    return 1;
+}
+
+/**
+ * @brief Add a live entry of the tree to its value index.
+ * The entry comes after the entries with the same value. A full chunk is
+ * split in two halves first, so an insert moves at most VALUE_CHUNK entries.
+ * The new chunk was reserved by `valueReserve`.
+ *
+ * @param tree  Pointer to a tree object with a value index.
+ * @param entry The entry, with its value set.
+ */
+void valueInsert(Tree *tree, TreeNode *entry) {
+    ValueIndex *index = tree->values;
+    size_t chunk, at;
+    locateValue(tree, entry->value, 1, &chunk, &at);
+    if (chunk == index->count) {
+        // Values above the last one go at the end of the last chunk.
+        if (!index->count) addChunk(index, 0);
+        chunk = index->count - 1;
+        at = index->chunks[chunk]->count;
+    }
+
+    ValueChunk *part = index->chunks[chunk];
+    if (part->count == VALUE_CHUNK) {
+        ValueChunk *half = addChunk(index, chunk + 1);
+        half->count = VALUE_CHUNK / 2;
+        part->count = VALUE_CHUNK - half->count;
+        memcpy(half->entries, part->entries + part->count, sizeof(TreeNode *) * half->count);
+        if (at > part->count) {
+            at -= part->count;
+            part = half;
+        }
+    }
+
+    memmove(part->entries + at + 1, part->entries + at, sizeof(TreeNode *) * (part->count - at));
+    part->entries[at] = entry;
+    part->count++;
+    index->size++;
+}
+
+/**
+ * @brief Remove a live entry of the tree from its value index.
+ * Called before the entry is unlinked or buried, while its value is valid.
+ *
+ * @param tree  Pointer to a tree object with a value index.
+ * @param entry The entry.
+ */
+void valueRemove(Tree *tree, TreeNode *entry) {
+    ValueIndex *index = tree->values;
+    size_t chunk, at;
+    if (!findEntry(tree, entry, &chunk, &at)) return;
+
+    ValueChunk *part = index->chunks[chunk];
+    memmove(part->entries + at, part->entries + at + 1, sizeof(TreeNode *) * (part->count - at - 1));
+    part->count--;
+    index->size--;
+    if (part->count) return;
+
+    // An emptied chunk is kept for the next split.
+    if (index->spare) memFree(index->memory, part, sizeof(ValueChunk));
+    else index->spare = part;
+    memmove(index->chunks + chunk, index->chunks + chunk + 1, sizeof(ValueChunk *) * (index->count - chunk - 1));
+    index->count--;
+}
+
+/**
+ * @brief Point the value index to the node now holding the data of another one.
+ * Called when a delete or a revive moves the data of an entry to another
+ * node, while `from` still holds its value.
+ *
+ * @param tree Pointer to a tree object with a value index.
+ * @param from The node whose data moves.
+ * @param to   The node receiving the data.
+ */
+void valueMove(Tree *tree, TreeNode *from, TreeNode *to) {
+    size_t chunk, at;
+    if (findEntry(tree, from, &chunk, &at)) tree->values->chunks[chunk]->entries[at] = to;
+}
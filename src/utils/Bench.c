@@ -0,0 +1,373 @@
+#include "Bench.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/* -------------------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Read the monotonic clock.
+ * 
+ * @return The current time in nanoseconds.
+ */
+uint64_t nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * (uint64_t)NS_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Seed a random generator.
+ * 
+ * @param rng  Pointer to the generator.
+ * @param seed The seed, 0 is replaced since xorshift can't leave it.
+ */
+void seedRng(Rng *rng, uint64_t seed) {
+    rng->state = seed ? seed : 0x9E3779B97F4A7C15ull;
+}
+
+/**
+ * @brief Next 64-bit random number (xorshift64*).
+ * 
+ * @param rng Pointer to the generator.
+ * @return A random 64-bit number.
+ */
+uint64_t nextRng(Rng *rng) {
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 0x2545F4914F6CDD1Dull;
+}
+
+/**
+ * @brief Next random number in [0, 1).
+ * 
+ * @param rng Pointer to the generator.
+ * @return A random double in [0, 1).
+ */
+double nextUnit(Rng *rng) {
+    return (double)(nextRng(rng) >> 11) / (double)(1ull << 53);
+}
+
+/**
+ * @brief Prepare a Zipfian generator (Gray et al., as used by YCSB).
+ * 
+ * @param zipf  Pointer to the generator.
+ * @param items Number of distinct items, item 0 is the most frequent.
+ * @param theta Skew of the distribution (0.99 in YCSB).
+ */
+void initZipf(Zipf *zipf, size_t items, double theta) {
+    zipf->items = items ? items : 1;
+    zipf->theta = theta;
+    zipf->zetan = 0;
+    for (size_t i = 1; i <= zipf->items; i++)
+        zipf->zetan += 1.0 / pow((double)i, theta);
+
+    double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->eta = (1.0 - pow(2.0 / (double)zipf->items, 1.0 - theta)) / (1.0 - zeta2 / zipf->zetan);
+}
+
+/**
+ * @brief Next Zipfian item.
+ * 
+ * @param zipf Pointer to the generator.
+ * @param rng  Pointer to the random generator.
+ * @return An item in [0, items).
+ */
+size_t nextZipf(Zipf *zipf, Rng *rng) {
+    double u = nextUnit(rng);
+    double uz = u * zipf->zetan;
+
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + pow(0.5, zipf->theta)) return zipf->items > 1 ? 1 : 0;
+
+    size_t item = (size_t)((double)zipf->items * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return item < zipf->items ? item : zipf->items - 1;
+}
+
+/**
+ * @brief Name of a key distribution.
+ * 
+ * @param dist The distribution.
+ * @return Its name, as written in the reports.
+ */
+const char* distName(Dist dist) {
+    switch (dist) {
+        case DIST_SEQUENTIAL: return "sequential";
+        case DIST_UNIFORM: return "uniform";
+        case DIST_ZIPFIAN: return "zipfian";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief Generate keys following a distribution.
+ * Keys are taken from [0, distinct), the duplicates ratio is 1 - distinct / count.
+ * Zipfian ranks are scattered over the key space, so hot keys aren't neighbours.
+ * 
+ * @param dist     The distribution of the keys.
+ * @param count    Number of keys to generate.
+ * @param distinct Size of the key space.
+ * @param seed     Seed of the random generator.
+ * @return An allocated array of `count` keys.
+ */
+int* generateKeys(Dist dist, size_t count, size_t distinct, uint64_t seed) {
+    int *keys = malloc(sizeof(int) * (count ? count : 1));
+    if (!keys) {
+        printf("[ERR]: at malloc...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Rng rng;
+    Zipf zipf;
+    seedRng(&rng, seed);
+    if (!distinct) distinct = 1;
+    if (dist == DIST_ZIPFIAN) initZipf(&zipf, distinct, ZIPF_THETA);
+
+    for (size_t i = 0; i < count; i++) {
+        switch (dist) {
+            case DIST_SEQUENTIAL:
+                keys[i] = (int)(i % distinct);
+                break;
+            case DIST_UNIFORM:
+                keys[i] = (int)(nextRng(&rng) % distinct);
+                break;
+            default:
+                // Multiply by an odd constant to scatter the ranks (bijective modulo 2^64).
+                keys[i] = (int)((nextZipf(&zipf, &rng) * 0x9E3779B97F4A7C15ull) % distinct);
+                break;
+        }
+    }
+
+    return keys;
+}
+
+/**
+ * @brief Write keys as words (base 26 letters) in a text file.
+ * 
+ * @param file  The name of the file to write.
+ * @param keys  The keys to write.
+ * @param count Number of keys.
+ */
+void writeWords(const char *file, const int *keys, size_t count) {
+    FILE *fout = fopen(file, "w");
+    if (!fout) {
+        printf("[ERR]: opening output file.\n");
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        char word[16];
+        size_t len = 0;
+        unsigned key = (unsigned)keys[i];
+        // Letters from the least significant digit.
+        do {
+            word[len++] = (char)('A' + key % 26);
+            key /= 26;
+        } while (key);
+        word[len] = '\0';
+        fprintf(fout, "%s%c", word, (i + 1) % 12 ? ' ' : '\n');
+    }
+
+    fclose(fout);
+}
+
+/* -------------------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Reset a latency histogram.
+ * 
+ * @param hist Pointer to the histogram.
+ */
+void initHistogram(Histogram *hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+/**
+ * @brief Bucket of a value: exact below `HIST_SUB`, then `HIST_SUB` buckets per power of two.
+ * 
+ * @param value The value to place.
+ * @return Its bucket index.
+ */
+static size_t histogramBucket(uint64_t value) {
+    if (value < HIST_SUB) return (size_t)value;
+    int msb = 63 - __builtin_clzll(value);
+    size_t level = (size_t)(msb - HIST_SUB_BITS + 1);
+    return level * HIST_SUB + (size_t)((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/**
+ * @brief Smallest value of a bucket.
+ * 
+ * @param bucket The bucket index.
+ * @return The lowest value falling in the bucket.
+ */
+static uint64_t histogramValue(size_t bucket) {
+    if (bucket < HIST_SUB) return bucket;
+    size_t level = bucket / HIST_SUB, sub = bucket % HIST_SUB;
+    return (uint64_t)(HIST_SUB + sub) << (level - 1);
+}
+
+/**
+ * @brief Record one latency in a histogram.
+ * 
+ * @param hist Pointer to the histogram.
+ * @param ns   The latency in nanoseconds.
+ */
+void recordLatency(Histogram *hist, uint64_t ns) {
+    hist->counts[histogramBucket(ns)]++;
+    hist->total++;
+    if (ns < hist->min) hist->min = ns;
+    if (ns > hist->max) hist->max = ns;
+}
+
+/**
+ * @brief Add the counts of a histogram into another one.
+ * 
+ * @param into Pointer to the histogram receiving the counts.
+ * @param from Pointer to the histogram to add.
+ */
+void mergeHistogram(Histogram *into, const Histogram *from) {
+    for (size_t bucket = 0; bucket < HIST_BUCKETS; bucket++)
+        into->counts[bucket] += from->counts[bucket];
+    into->total += from->total;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+/**
+ * @brief Value at a percentile of a histogram.
+ * 
+ * @param hist       Pointer to the histogram.
+ * @param percentile The percentile, in [0, 100].
+ * @return The latency at the percentile (lowest value of its bucket, `max` for 100).
+ */
+uint64_t histogramPercentile(const Histogram *hist, double percentile) {
+    if (!hist->total) return 0;
+    if (percentile >= 100.0) return hist->max;
+
+    uint64_t rank = (uint64_t)ceil(percentile / 100.0 * (double)hist->total);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+        seen += hist->counts[bucket];
+        if (seen >= rank && seen) {
+            uint64_t value = histogramValue(bucket);
+            return value < hist->min ? hist->min : value;
+        }
+    }
+
+    return hist->max;
+}
+
+/* -------------------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Bytes currently allocated on the heap.
+ * 
+ * @return The bytes in use (0 when the C library can't tell).
+ */
+size_t heapInUse(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+/* -------------------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Start a JSON report.
+ * 
+ * @param report Pointer to the report.
+ * @param out    Where the JSON is written.
+ * @param name   Name of the benchmark.
+ */
+void openReport(Report *report, FILE *out, const char *name) {
+    report->out = out;
+    report->results = 0;
+    fprintf(out, "{\n  \"benchmark\": \"%s\",\n  \"results\": [", name);
+}
+
+/**
+ * @brief Add one measured operation to a JSON report.
+ * 
+ * @param report      Pointer to the report.
+ * @param op          Name of the operation.
+ * @param size        Number of keys in the tree.
+ * @param dist        Distribution of the keys.
+ * @param dup         Ratio of duplicate keys.
+ * @param ops         Number of operations measured.
+ * @param ns          Total time of the operations.
+ * @param bytesPerKey Heap bytes used per key by the tree.
+ */
+void reportResult(Report *report, const char *op, size_t size, Dist dist, double dup,
+                  size_t ops, uint64_t ns, double bytesPerKey) {
+    double nsPerOp = ops ? (double)ns / (double)ops : 0;
+    double opsPerSec = ns ? (double)ops * NS_PER_SEC / (double)ns : 0;
+
+    fprintf(report->out, "%s\n    {\"op\": \"%s\", \"size\": %zu, \"dist\": \"%s\", \"dup\": %.2f, "
+            "\"ops\": %zu, \"ns_per_op\": %.1f, \"ops_per_s\": %.0f, \"bytes_per_key\": %.1f}",
+            report->results ? "," : "", op, size, distName(dist), dup,
+            ops, nsPerOp, opsPerSec, bytesPerKey);
+    report->results++;
+    fflush(report->out);
+}
+
+/**
+ * @brief Add a counted event of an operation to a JSON report.
+ * 
+ * @param report Pointer to the report.
+ * @param op     Name of the counter.
+ * @param size   Number of keys in the tree.
+ * @param dist   Distribution of the keys.
+ * @param ops    Number of operations measured.
+ * @param count  Events counted during the operations.
+ */
+void reportCount(Report *report, const char *op, size_t size, Dist dist, size_t ops, size_t count) {
+    double perOp = ops ? (double)count / (double)ops : 0;
+
+    fprintf(report->out, "%s\n    {\"op\": \"%s\", \"size\": %zu, \"dist\": \"%s\", "
+            "\"ops\": %zu, \"count\": %zu, \"per_op\": %.3f}",
+            report->results ? "," : "", op, size, distName(dist), ops, count, perOp);
+    report->results++;
+    fflush(report->out);
+}
+
+/**
+ * @brief Add the latency distribution of an operation to a JSON report.
+ * 
+ * @param report Pointer to the report.
+ * @param op     Name of the operation.
+ * @param hist   Latencies recorded for the operation.
+ * @param ns     Wall clock time of the whole run.
+ */
+void reportLatency(Report *report, const char *op, const Histogram *hist, uint64_t ns) {
+    double opsPerSec = ns ? (double)hist->total * NS_PER_SEC / (double)ns : 0;
+
+    fprintf(report->out, "%s\n    {\"op\": \"%s\", \"ops\": %llu, \"ops_per_s\": %.0f, "
+            "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+            report->results ? "," : "", op, (unsigned long long)hist->total, opsPerSec,
+            (unsigned long long)histogramPercentile(hist, 50.0),
+            (unsigned long long)histogramPercentile(hist, 99.0),
+            (unsigned long long)histogramPercentile(hist, 99.9),
+            (unsigned long long)(hist->total ? hist->max : 0));
+    report->results++;
+    fflush(report->out);
+}
+
+/**
+ * @brief End a JSON report.
+ * 
+ * @param report Pointer to the report.
+ */
+void closeReport(Report *report) {
+    fprintf(report->out, "\n  ]\n}\n");
+    fflush(report->out);
+}
@@ -0,0 +1,80 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+
+#define ZIPF_THETA 0.99
+#define NS_PER_SEC 1e9
+
+// Log-linear histogram: 64 sub-buckets for each power of two (about 1.5% precision).
+#define HIST_SUB_BITS 6
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+// Key distributions used by the benchmarks.
+typedef enum Dist {
+    DIST_SEQUENTIAL,
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,
+    DIST_COUNT
+} Dist;
+
+// Random generator (xorshift64*), deterministic for a given seed.
+typedef struct Rng {
+    uint64_t state;
+} Rng;
+
+// Zipfian generator over [0, items), YCSB style.
+typedef struct Zipf {
+    size_t items;
+    double theta, alpha, zetan, eta;
+} Zipf;
+
+// Latency histogram (HDR style), values are nanoseconds.
+typedef struct Histogram {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total, min, max;
+} Histogram;
+
+// JSON report, one object per measured operation.
+typedef struct Report {
+    FILE *out;
+    size_t results;
+} Report;
+
+// Timing
+uint64_t nowNs(void);
+
+// Random keys
+void seedRng(Rng *rng, uint64_t seed);
+uint64_t nextRng(Rng *rng);
+double nextUnit(Rng *rng);
+void initZipf(Zipf *zipf, size_t items, double theta);
+size_t nextZipf(Zipf *zipf, Rng *rng);
+const char* distName(Dist dist);
+int* generateKeys(Dist dist, size_t count, size_t distinct, uint64_t seed);
+void writeWords(const char *file, const int *keys, size_t count);
+
+// Latency histograms
+void initHistogram(Histogram *hist);
+void recordLatency(Histogram *hist, uint64_t ns);
+void mergeHistogram(Histogram *into, const Histogram *from);
+uint64_t histogramPercentile(const Histogram *hist, double percentile);
+
+// Memory
+size_t heapInUse(void);
+
+// Report
+void openReport(Report *report, FILE *out, const char *name);
+void reportResult(Report *report, const char *op, size_t size, Dist dist, double dup,
+                  size_t ops, uint64_t ns, double bytesPerKey);
+void reportCount(Report *report, const char *op, size_t size, Dist dist, size_t ops, size_t count);
+void reportLatency(Report *report, const char *op, const Histogram *hist, uint64_t ns);
+void closeReport(Report *report);
+
+#endif /* _BENCH_H_ */
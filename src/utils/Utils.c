@@ -1,5 +1,10 @@
 #include "Utils.h"
 
+#ifdef AVL_STATS
+// Compares of the calling thread, see STAT_OP_BEGIN.
+_Thread_local size_t statCompares = 0;
+#endif
+
 /* -------------------------------------------------------------------------------------------------------- */
 
 /**
@@ -9,6 +14,7 @@
  * @param root Pointer to a tree node, address to start fixing the AVL Tree.
  */
 void avlFixUp(Tree *tree, TreeNode *root) {
+	TRACE_SCOPE("avlFixUp");
 	// Check if input is valid.
 	if (!tree || !root) return;
 
@@ -21,25 +27,336 @@ void avlFixUp(Tree *tree, TreeNode *root) {
 		// Left sub-tree is unbalanced.
 		if (balance > 1 && leftBalance >= 0) {
 			avlRotateRight(tree, root);
+			STAT_INC(tree, rotations[ROTATE_LL]);
 		}
 		// Right sub-tree is unbalanced.
 		if (balance < -1 && rightBalance <= 0) {
 			avlRotateLeft(tree, root);
+			STAT_INC(tree, rotations[ROTATE_RR]);
 		}
 		// Left-Right sub-tree is unbalanced.
 		if (balance > 1 && leftBalance < 0) {
 			avlRotateLeft(tree, root->left);
 			avlRotateRight(tree, root);
+			STAT_INC(tree, rotations[ROTATE_LR]);
 		}
 		// Right-Left sub-tree is unbalanced.
 		if (balance < -1 && rightBalance > 0) {
 			avlRotateRight(tree, root->right);
 			avlRotateLeft(tree, root);
+			STAT_INC(tree, rotations[ROTATE_RL]);
 		}
 		root = root->parent;
 	}
 }
 
+/**
+ * @brief Rank of a node in the weak AVL tree, stored in its height.
+ * Missing children have rank 0 and leaves rank 1, as for the AVL heights.
+ * 
+ * @param node Pointer to a tree node, or NULL.
+ * @return The rank of the node.
+ */
+static int rankOf(TreeNode *node) {
+	return node ? node->height : 0;
+}
+
+/**
+ * @brief Fix the weak AVL tree after insertion of one node.
+ * Every rank difference (parent minus child) must be 1 or 2. The walk
+ * promotes parents while the new rank equals the parent rank, and ends
+ * at the first node left unchanged or with at most two rotations.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param node Pointer to the tree node just linked in the tree.
+ */
+void wavlInsertFixUp(Tree *tree, TreeNode *node) {
+	TRACE_SCOPE("wavlInsertFixUp");
+	// Check if input is valid.
+	if (!tree || !node) return;
+
+	TreeNode *parent = node->parent;
+	while (parent && rankOf(parent) == rankOf(node)) {
+		int left = (parent->left == node);
+		TreeNode *sibling = left ? parent->right : parent->left;
+
+		// The sibling is a 1-child, promote the parent and go up.
+		if (rankOf(parent) - rankOf(sibling) == 1) {
+			parent->height++;
+			node = parent;
+			parent = node->parent;
+			continue;
+		}
+
+		// The sibling is a 2-child, the rotations end the walk.
+		// Rotations compute heights, the ranks are set again after them.
+		TreeNode *inner = left ? node->right : node->left;
+		int rankParent = parent->height, rankNode = node->height;
+		if (rankNode - rankOf(inner) == 2) {
+			// Outer sub-tree is the higher one.
+			if (left) avlRotateRight(tree, parent);
+			else avlRotateLeft(tree, parent);
+			STAT_INC(tree, rotations[left ? ROTATE_LL : ROTATE_RR]);
+			node->height = rankNode;
+			parent->height = rankParent - 1;
+		} else {
+			// Inner sub-tree is the higher one.
+			int rankInner = inner->height;
+			if (left) {
+				avlRotateLeft(tree, node);
+				avlRotateRight(tree, parent);
+			} else {
+				avlRotateRight(tree, node);
+				avlRotateLeft(tree, parent);
+			}
+			STAT_INC(tree, rotations[left ? ROTATE_LR : ROTATE_RL]);
+			inner->height = rankInner + 1;
+			node->height = rankNode - 1;
+			parent->height = rankParent - 1;
+		}
+		break;
+	}
+}
+
+/**
+ * @brief Fix the weak AVL tree after a node left it.
+ * The walk demotes parents with a 3-child and ends at the first node
+ * left unchanged or with at most two rotations.
+ * 
+ * @param tree   Pointer to a tree object.
+ * @param parent Parent of the unlinked node.
+ * @param node   Child that took the place of the unlinked node, or NULL.
+ */
+void wavlDeleteFixUp(Tree *tree, TreeNode *parent, TreeNode *node) {
+	TRACE_SCOPE("wavlDeleteFixUp");
+	// Check if input is valid.
+	if (!tree || !parent) return;
+
+	// A parent left without children is a leaf again.
+	if (!parent->left && !parent->right) {
+		parent->height = INIT_LEN;
+		node = parent;
+		parent = node->parent;
+	}
+
+	while (parent && rankOf(parent) - rankOf(node) == 3) {
+		// The other child of the parent exists, its rank is at least 1.
+		int left = (parent->left == node);
+		TreeNode *sibling = left ? parent->right : parent->left;
+		int rankParent = parent->height, rankSibling = sibling->height;
+
+		// The sibling is a 2-child, demote the parent and go up.
+		if (rankParent - rankSibling == 2) {
+			parent->height--;
+			node = parent;
+			parent = node->parent;
+			continue;
+		}
+
+		// The sibling is a 1-child with two 2-children, demote both and go up.
+		TreeNode *outer = left ? sibling->right : sibling->left;
+		TreeNode *inner = left ? sibling->left : sibling->right;
+		if (rankSibling - rankOf(outer) == 2 && rankSibling - rankOf(inner) == 2) {
+			parent->height--;
+			sibling->height--;
+			node = parent;
+			parent = node->parent;
+			continue;
+		}
+
+		// Otherwise the rotations end the walk.
+		if (rankSibling - rankOf(outer) == 1) {
+			if (left) avlRotateLeft(tree, parent);
+			else avlRotateRight(tree, parent);
+			STAT_INC(tree, rotations[left ? ROTATE_RR : ROTATE_LL]);
+			sibling->height = rankSibling + 1;
+			parent->height = rankParent - 1;
+			// The parent may become a leaf.
+			if (!parent->left && !parent->right) parent->height = INIT_LEN;
+		} else {
+			int rankInner = inner->height;
+			if (left) {
+				avlRotateRight(tree, sibling);
+				avlRotateLeft(tree, parent);
+			} else {
+				avlRotateLeft(tree, sibling);
+				avlRotateRight(tree, parent);
+			}
+			STAT_INC(tree, rotations[left ? ROTATE_RL : ROTATE_LR]);
+			inner->height = rankInner + 2;
+			sibling->height = rankSibling - 1;
+			parent->height = rankParent - 2;
+		}
+		break;
+	}
+}
+
+/**
+ * @brief Weight of a node in the weighted tree, parents outweigh their children.
+ * The access count (kept in the height) comes first, then a hash of the node
+ * address, which breaks the ties like the random priorities of a treap.
+ * 
+ * @param node Pointer to a tree node.
+ * @return The weight of the node.
+ */
+static uint64_t weightOf(TreeNode *node) {
+	uint64_t mix = (uint64_t)(uintptr_t)node * 0x9E3779B97F4A7C15ull;
+	mix ^= mix >> 29;
+	return ((uint64_t)(unsigned)node->height << 32) | (uint32_t)mix;
+}
+
+/**
+ * @brief Move a node up the weighted tree until its parent outweighs it.
+ * A new node (count 1) mostly stays a leaf, a key searched often climbs
+ * above the keys searched less, toward the root.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param node Pointer to the tree node whose weight grew.
+ */
+void raiseNode(Tree *tree, TreeNode *node) {
+	// Check if input is valid.
+	if (!tree || !node) return;
+
+	while (node->parent && weightOf(node->parent) < weightOf(node)) {
+		TreeNode *parent = node->parent;
+		int left = (parent->left == node);
+		// Rotations compute heights, the counts are set again after them.
+		int countNode = node->height, countParent = parent->height;
+		if (left) avlRotateRight(tree, parent);
+		else avlRotateLeft(tree, parent);
+		STAT_INC(tree, rotations[left ? ROTATE_LL : ROTATE_RR]);
+		node->height = countNode;
+		parent->height = countParent;
+		// The levels of the keys changed, see `levelKeyQuery`.
+		tree->version++;
+	}
+}
+
+/**
+ * @brief Move a node down the weighted tree until it outweighs its children.
+ * The node whose count dropped (it took the key of another one) goes under
+ * its heavier child until the counts are ordered again.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param node Pointer to the tree node whose weight dropped.
+ */
+static void sinkNode(Tree *tree, TreeNode *node) {
+	for (;;) {
+		TreeNode *child = node->left;
+		if (node->right && (!child || weightOf(node->right) > weightOf(child))) child = node->right;
+		if (!child || weightOf(child) < weightOf(node)) return;
+
+		int left = (node->left == child);
+		// Rotations compute heights, the counts are set again after them.
+		int countNode = node->height, countChild = child->height;
+		if (left) avlRotateRight(tree, node);
+		else avlRotateLeft(tree, node);
+		STAT_INC(tree, rotations[left ? ROTATE_LL : ROTATE_RR]);
+		node->height = countNode;
+		child->height = countChild;
+		// The levels of the keys changed, see `levelKeyQuery`.
+		tree->version++;
+	}
+}
+
+/**
+ * @brief Descend from `root` to the node holding an element.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param root Pointer to the node to start searching from.
+ * @param elem Pointer to the element to find.
+ * @return The node holding the element, or NULL.
+ */
+static TreeNode* descendNode(Tree *tree, TreeNode *root, void *elem) {
+	// Find the desired tree node, comparing once per level.
+	while (root) {
+		int comp = COMPARE(root->elem, elem);
+		if (comp > 0) root = root->left;
+		else if (comp < 0) root = root->right;
+		else return root;
+	}
+
+	// Node wasn't found.
+	return NULL;
+}
+
+/**
+ * @brief Find a node holding an element, starting from `root`.
+ * Lookups of the whole tree go through its Bloom filter, which rejects
+ * most missing keys, then through its hash index if it has one.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param root Pointer to the node to start searching from.
+ * @param elem Pointer to the element to find.
+ * @return The node holding the element, or NULL.
+ */
+TreeNode* findNode(Tree *tree, TreeNode *root, void *elem) {
+	if (root != tree->root || (!tree->bloom && !tree->index))
+		return descendNode(tree, root, elem);
+
+	// A missing key is mostly rejected without descending the tree.
+	if (tree->bloom && !bloomMayContain(tree->bloom, elem)) {
+		bloomMiss(tree->bloom, 1);
+		return NULL;
+	}
+
+	// The hash index answers for the whole tree without descending it.
+	TreeNode *found = tree->index ? hashFind(tree, elem) : descendNode(tree, root, elem);
+	if (!found && tree->bloom) bloomMiss(tree->bloom, 0);
+
+	return found;
+}
+
+/**
+ * @brief Count a tree node allocation in the tree statistics.
+ * 
+ * @param tree Pointer to a tree object.
+ */
+void countNodeAlloc(Tree *tree) {
+	STAT_INC(tree, allocations);
+#ifdef AVL_STATS
+	size_t bytes = STAT_ADD(tree, nodeBytes, sizeof(TreeNode));
+	size_t peak = __atomic_load_n(&tree->stats.peakNodeBytes, __ATOMIC_RELAXED);
+	while (bytes > peak && !__atomic_compare_exchange_n(&tree->stats.peakNodeBytes, &peak, bytes, 1,
+														__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#endif
+}
+
+/**
+ * @brief Count a tree node release in the tree statistics.
+ * 
+ * @param tree Pointer to a tree object.
+ */
+void countNodeFree(Tree *tree) {
+	STAT_INC(tree, frees);
+	STAT_SUB(tree, nodeBytes, sizeof(TreeNode));
+}
+
+/**
+ * @brief Count the payloads of a node in the tree memory.
+ * The node keeps their bytes, so they are uncounted when its data is
+ * released or handed out, without looking at the data.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param node  The node holding the payloads.
+ * @param bytes Bytes of the payloads (see `payloadBytes`).
+ */
+void countPayload(Tree *tree, TreeNode *node, size_t bytes) {
+	node->payload = bytes;
+	memTransfer(NULL, &tree->memory, bytes);
+}
+
+/**
+ * @brief Remove the payloads of a node from the tree memory.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param node The node whose data is released or handed out.
+ */
+void uncountPayload(Tree *tree, TreeNode *node) {
+	memTransfer(&tree->memory, NULL, node->payload);
+	node->payload = 0;
+}
+
 /**
  * @brief Calculate the frequency of a node with the same element in the tree.
  * Counts the number of nodes in the tree that have the same element as the provided root node.
@@ -81,7 +398,7 @@ TreeNode* maxFreqNode(Tree *tree) {
 	while (minNode) {
 		int freq = freqNode(tree, minNode);
 
-		if (freq >= maxFreq) {
+		if (freq >= maxFreq && !minNode->dead) {
 			maxFreqNode = minNode;
 			maxFreq = freq;
 		}
@@ -152,14 +469,14 @@ char transformCharacter(char character, Range *elem, size_t *idx, int method) {
 /* -------------------------------------------------------------------------------------------------------- */
 
 /**
- * @brief Deletes a single node from the tree.
+ * @brief Unlinks a single node from the tree.
  * Removes a single node from the tree, updating its parent and child pointers
- * as well as the linked list of nodes.
+ * as well as the linked list of nodes. The node data is left untouched.
  * 
- * @param tree The tree from which to delete the node.
- * @param node The node to be deleted.
+ * @param tree The tree from which to unlink the node.
+ * @param node The node to be unlinked.
  */
-void deleteSingleNode(Tree *tree, TreeNode *node) {
+void unlinkSingleNode(Tree *tree, TreeNode *node) {
     // Get the parent and the child of the node to be deleted.
     TreeNode *parent = node->parent;
     TreeNode *child = (node->left) ? node->left : node->right;
@@ -175,16 +492,141 @@ void deleteSingleNode(Tree *tree, TreeNode *node) {
     // (or NULL if there's no parent).
     if (child) child->parent = parent;
 
+    // The node no longer heads a key.
+    if (tree->index) hashRemove(tree, node);
+
     // Update the linked list of nodes, removing the node from it.
-    node->prev ? (node->prev->next = node->next) : (tree->root = node->next);
+    if (node->prev) node->prev->next = node->next;
     if (node->next) node->next->prev = node->prev;
 
-    // Destroy the node and rebalance the AVL tree.
-    destroyTreeNode(tree, node);
-    avlFixUp(tree, parent);
+    // The ancestors lose the entries of the node, before the rotations.
+    refreshPath(tree, parent);
+
+    // Rebalance the tree, with the fix up of its policy.
+    // A weighted tree stays ordered by weight, the child of the node takes its place.
+    if (tree->balance == BALANCE_WAVL) wavlDeleteFixUp(tree, parent, child);
+    else if (tree->balance != BALANCE_WEIGHT) avlFixUp(tree, parent);
 
     // Decrease the size of the tree.
     tree->size--;
+    // Fingers holding the node must not use it anymore.
+    tree->removals++;
+
+    // The key stays in the Bloom filter until it is built again.
+    if (tree->bloom) bloomRemove(tree);
+}
+
+/**
+ * @brief Deletes a single node from the tree.
+ * Removes a single node from the tree, updating its parent and child pointers
+ * as well as the linked list of nodes.
+ * 
+ * @param tree The tree from which to delete the node.
+ * @param node The node to be deleted.
+ */
+void deleteSingleNode(Tree *tree, TreeNode *node) {
+    // Unlink the node and rebalance the AVL tree.
+    unlinkSingleNode(tree, node);
+    // Destroy the node.
+    destroyTreeNode(tree, node);
+}
+
+/**
+ * @brief Removes one entry with the given element from the tree.
+ * The last entry of a duplicate chain is removed first. Its data is either
+ * destroyed or, when `outElem`/`outValue` are given, handed back to the caller.
+ * 
+ * @param tree     The tree from which to remove the entry.
+ * @param elem     The element to remove.
+ * @param outElem  Where to move the removed element, or NULL to destroy it.
+ * @param outValue Where to move the removed value, or NULL to destroy it.
+ * @return 1 if an entry was removed, 0 otherwise.
+ */
+int detachEntry(Tree *tree, void *elem, void **outElem, void **outValue) {
+    // Check if input is valid.
+    if (!tree || !elem) return 0;
+
+    // Find the node with given data.
+    TreeNode *found = findNode(tree, tree->root, elem);
+    if (!found) return 0;
+    tree->version++;
+    // The last entry of the key is removed, views drop it while its key is valid.
+    if (tree->views && !found->end->dead) viewRemove(tree, found->end->elem);
+    if (tree->values && !found->end->dead) valueRemove(tree, found->end);
+
+    // Node whose memory is released, its data is the one being removed.
+    TreeNode *removed = NULL;
+
+    // Check if the found node is the only one.
+    if (found->end == found) {
+        // The found node has left & right child.
+        if (found->left && found->right) {
+            TreeNode *minim = minimum(found->right);
+            // The index follows the keys to their new nodes.
+            if (tree->index) hashSwap(tree, found, minim);
+            if (tree->values && !minim->dead) valueMove(tree, minim, found);
+            // Swap the data, found node takes over the minimum one (no copies).
+            void *swapElem = found->elem, *swapValue = found->value;
+            found->elem = minim->elem; found->value = minim->value;
+            minim->elem = swapElem; minim->value = swapValue;
+            size_t swapPayload = found->payload;
+            found->payload = minim->payload;
+            minim->payload = swapPayload;
+            found->dead = minim->dead;
+            // A weighted tree keeps the access count with its key.
+            if (tree->balance == BALANCE_WEIGHT) {
+                int swapCount = found->height;
+                found->height = minim->height;
+                minim->height = swapCount;
+            }
+            // Found node takes over the duplicate chain of the minimum node.
+            found->end = (minim->end == minim) ? found : minim->end;
+            // And over its chain aggregate, the sub-tree ones are computed again.
+            void *swapSummary = found->summary;
+            found->summary = minim->summary;
+            minim->summary = swapSummary;
+            removed = minim;
+        } else {
+            // Delete the found node directly otherwise.
+            // Don't need to find replacement.
+            removed = found;
+        }
+        unlinkSingleNode(tree, removed);
+        // The node took a lighter key, it goes down under the heavier ones.
+        if (tree->balance == BALANCE_WEIGHT && removed != found) sinkNode(tree, found);
+    } else {
+        // If the node is found in the linked list.
+        removed = found->end;
+        // Remove it from the linked list.
+        if (removed->prev) removed->prev->next = removed->next;
+        if (removed->next) removed->next->prev = removed->prev;
+        // Update end point address with the previous node from list.
+        found->end = removed->prev;
+        // Decrement the tree size.
+        tree->size--;
+        // Tombstones aren't aggregated, a live entry leaves the chain aggregate.
+        if (tree->aggregate && !removed->dead) {
+            refreshChain(tree, found);
+            refreshPath(tree, found);
+        }
+    }
+
+    // Hand the data back to the caller or destroy it.
+    if (outElem || outValue) {
+        if (outElem) *outElem = removed->elem;
+        else DELETE.deleteElem(removed->elem);
+        if (outValue) *outValue = removed->value;
+        else DELETE.deleteVal(removed->value);
+        // The data handed out leaves the tree memory, it doesn't depend on the tree.
+        uncountPayload(tree, removed);
+        if (removed->summary) releaseSummary(tree, removed);
+        countNodeFree(tree);
+        memFree(&tree->memory, removed, sizeof(TreeNode));
+    } else {
+        destroyTreeNode(tree, removed);
+    }
+
+    return 1;
 }
 
 /* -------------------------------------------------------------------------------------------------------- */
@@ -237,7 +679,7 @@ void insertElement(Tree *tree, TreeNode *node, TreeNode *parent) {
         parent->right = node;
         // Update the previous and next pointers of the new node.
         // Maintain the linked list.
-        node->prev = parent;
+        node->prev = parent->end;
         node->next = parent->end->next;
 
         // If there's a next node.
@@ -248,53 +690,528 @@ void insertElement(Tree *tree, TreeNode *node, TreeNode *parent) {
     }
 }
 
+/**
+ * @brief Make room in the indexes, views and aggregates of a tree for a new node.
+ * Every allocation of an insert is made here, before the tree is changed.
+ * 
+ * @param tree The tree where the node will be linked.
+ * @param node The allocated node, with its element and value set.
+ * @return 1 if the node can be linked, 0 if the memory was refused.
+ */
+static int reserveNode(Tree *tree, TreeNode *node) {
+    if (tree->index && !hashReserve(tree)) return 0;
+    if (tree->views && !viewReserve(tree, node->elem)) return 0;
+    if (tree->values && !valueReserve(tree)) return 0;
+    return reserveSummary(tree, node);
+}
+
+/**
+ * @brief Links a new node into the tree.
+ * The node is placed in the AVL tree, or appended to the duplicate chain
+ * of the node holding the same element, then the tree is rebalanced.
+ * If the memory is refused, the tree is left unchanged and the caller
+ * still owns the node.
+ * 
+ * @param tree The tree where the node should be linked.
+ * @param node The allocated node, with its element and value set.
+ * @return 1 if the node was linked, 0 if the memory was refused.
+ */
+int attachNode(Tree *tree, TreeNode *node) {
+    if (!reserveNode(tree, node)) return 0;
+
+    // Cached query results are built again, views and the value index take the new entry.
+    tree->version++;
+    if (tree->views) viewInsert(tree, node);
+    if (tree->values) valueInsert(tree, node);
+
+    // Tree now has 1 node, the new one.
+    if (isEmpty(tree)) {
+        node->end = node;
+        tree->root = node;
+        tree->size = 1;
+        if (tree->index) hashInsert(tree, node);
+        if (tree->bloom) bloomAdd(tree, node);
+        refreshPath(tree, node);
+        return 1;
+    }
+
+    // A known key only needs its duplicate chain, found through the hash index.
+    TreeNode *head = tree->index ? hashFind(tree, node->elem) : NULL;
+    if (head && head->end->dead) {
+        reviveEntry(tree, head, node);
+        return 1;
+    }
+    if (head) {
+        insertIntoLinkedList(head, node);
+        releaseSummary(tree, node);
+        appendChain(tree, head, node);
+        tree->size++;
+        return 1;
+    }
+
+    // Pass through each node from tree.
+    TreeNode *pass = tree->root;
+    TreeNode *parent = NULL;
+
+    // Find position to add new tree node.
+    while (pass) {
+        parent = pass;
+        int comp = COMPARE(node->elem, pass->elem);
+        if (comp > 0) pass = pass->right;
+        else if (comp < 0) pass = pass->left;
+        else break;
+    }
+
+    // A tombstone of the key takes the data, the tree is unchanged.
+    if (pass && pass->end->dead) {
+        reviveEntry(tree, pass, node);
+        return 1;
+    }
+
+    // Node already exists, insert it in linked list.
+    if (pass) {
+        insertIntoLinkedList(pass, node);
+        // Only heads keep aggregates.
+        releaseSummary(tree, node);
+        appendChain(tree, pass, node);
+    } else {
+        // Otherwise insert it in the tree.
+        node->end = node;
+        node->parent = parent;
+        insertElement(tree, node, parent);
+        if (tree->index) hashInsert(tree, node);
+        // The ancestors take the new entry, before the rotations.
+        refreshPath(tree, node);
+        // Fix the tree, balance factor moddified.
+        if (tree->balance == BALANCE_WAVL) wavlInsertFixUp(tree, node);
+        else if (tree->balance == BALANCE_WEIGHT) raiseNode(tree, node);
+        else avlFixUp(tree, parent);
+        if (tree->bloom) bloomAdd(tree, node);
+    }
+
+    // Increment the size of the tree.
+    tree->size++;
+    return 1;
+}
+
+/**
+ * @brief Builds a balanced tree over sorted duplicate chain heads.
+ * The middle head becomes the root of each sub-tree, so no comparison
+ * and no rotation is needed.
+ * 
+ * @param heads  The heads of the duplicate chains, in order.
+ * @param count  Number of heads.
+ * @param parent Parent of the built sub-tree.
+ * @return TreeNode* the root of the built sub-tree, NULL if `count` is 0.
+ */
+TreeNode* buildBalanced(TreeNode **heads, size_t count, TreeNode *parent) {
+    if (!count) return NULL;
+
+    size_t middle = count / 2;
+    TreeNode *root = heads[middle];
+    root->parent = parent;
+    root->left = buildBalanced(heads, middle, root);
+    root->right = buildBalanced(heads + middle + 1, count - middle - 1, root);
+    updateHeight(root);
+
+    return root;
+}
+
+/**
+ * @brief Builds a weighted tree over sorted duplicate chain heads.
+ * The heads keep their access counts, each one goes under the last head
+ * outweighing it on the right spine, so the build takes O(n) and no
+ * comparison of the keys, like `buildBalanced`.
+ * 
+ * @param heads The heads of the duplicate chains, in order.
+ * @param count Number of heads.
+ * @return TreeNode* the root of the built tree, NULL if `count` is 0.
+ */
+TreeNode* buildWeighted(TreeNode **heads, size_t count) {
+    TreeNode *root = NULL, *last = NULL;
+    for (size_t i = 0; i < count; i++) {
+        TreeNode *node = heads[i], *child = NULL;
+        // The lighter heads of the right spine become the left sub-tree of the node.
+        while (last && weightOf(last) < weightOf(node)) {
+            child = last;
+            last = last->parent;
+        }
+        node->left = child;
+        node->right = NULL;
+        if (child) child->parent = node;
+        node->parent = last;
+        if (last) last->right = node;
+        else root = node;
+        last = node;
+    }
+
+    return root;
+}
+
+/**
+ * @brief Hang two detached sub-trees under a node.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param node  The new root of the sub-trees.
+ * @param left  Sub-tree with the smaller keys, or NULL.
+ * @param right Sub-tree with the greater keys, or NULL.
+ */
+static void linkChildren(Tree *tree, TreeNode *node, TreeNode *left, TreeNode *right) {
+    node->left = left;
+    node->right = right;
+    if (left) left->parent = node;
+    if (right) right->parent = node;
+    refreshNode(tree, node);
+}
+
+/**
+ * @brief Join two AVL (or WAVL) sub-trees around a node, by their ranks.
+ * The node hangs from the spine of the higher sub-tree, at the rank of the
+ * lower one, then the AVL fix up walks back to the top, so it takes
+ * O(|rank difference| + 1). The ranks of the nodes walked become heights
+ * again, which are valid WAVL ranks too.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param left  Sub-tree with the smaller keys, or NULL.
+ * @param node  Detached node, between the two sub-trees.
+ * @param right Sub-tree with the greater keys, or NULL.
+ * @return The root of the joined sub-tree.
+ */
+static TreeNode* joinRanks(Tree *tree, TreeNode *left, TreeNode *node, TreeNode *right) {
+    int rankLeft = rankOf(left), rankRight = rankOf(right);
+    node->parent = NULL;
+    if (abs(rankLeft - rankRight) <= 1) {
+        linkChildren(tree, node, left, right);
+        updateHeight(node);
+        return node;
+    }
+
+    // Go down the inner spine of the higher sub-tree, to the rank of the lower one.
+    int high = rankLeft > rankRight;
+    int rank = high ? rankRight : rankLeft;
+    TreeNode *parent = NULL, *spine = high ? left : right;
+    while (spine && rankOf(spine) > rank + 1) {
+        parent = spine;
+        spine = high ? spine->right : spine->left;
+    }
+
+    if (high) {
+        linkChildren(tree, node, spine, right);
+        parent->right = node;
+    } else {
+        linkChildren(tree, node, left, spine);
+        parent->left = node;
+    }
+    node->parent = parent;
+    updateHeight(node);
+    refreshPath(tree, parent);
+    avlFixUp(tree, parent);
+
+    // The rotations may have moved the top, find it from the node.
+    while (node->parent) node = node->parent;
+    return node;
+}
+
+/**
+ * @brief Join two weighted sub-trees around a node, by their weights.
+ * The heaviest of the three roots stays on top, so the walk follows the
+ * spines down to the weight of the node, like a treap merge.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param left  Sub-tree with the smaller keys, or NULL.
+ * @param node  Detached node, between the two sub-trees.
+ * @param right Sub-tree with the greater keys, or NULL.
+ * @return The root of the joined sub-tree.
+ */
+static TreeNode* joinWeights(Tree *tree, TreeNode *left, TreeNode *node, TreeNode *right) {
+    uint64_t weight = weightOf(node);
+    int leftHeavier = left && weightOf(left) > weight;
+    int rightHeavier = right && weightOf(right) > weight;
+
+    if (!leftHeavier && !rightHeavier) {
+        node->parent = NULL;
+        linkChildren(tree, node, left, right);
+        return node;
+    }
+
+    // The heavier root keeps its outer child, the join goes on inside.
+    if (leftHeavier && (!rightHeavier || weightOf(left) > weightOf(right))) {
+        TreeNode *inner = left->right;
+        if (inner) inner->parent = NULL;
+        linkChildren(tree, left, left->left, joinWeights(tree, inner, node, right));
+        return left;
+    }
+    TreeNode *inner = right->left;
+    if (inner) inner->parent = NULL;
+    linkChildren(tree, right, joinWeights(tree, left, node, inner), right->right);
+    return right;
+}
+
+/**
+ * @brief Join two detached sub-trees around a node, with the balancing policy of the tree.
+ * Every key of `left` is smaller than the key of `node`, every key of `right`
+ * greater. The threaded list isn't changed, and rotations at the top of a
+ * sub-tree may overwrite `tree->root`, which the caller sets afterwards.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param left  Sub-tree with the smaller keys, or NULL.
+ * @param node  Detached node, between the two sub-trees.
+ * @param right Sub-tree with the greater keys, or NULL.
+ * @return The root of the joined sub-tree, its parent is NULL.
+ */
+TreeNode* joinTrees(Tree *tree, TreeNode *left, TreeNode *node, TreeNode *right) {
+    if (tree->balance == BALANCE_WEIGHT) return joinWeights(tree, left, node, right);
+    return joinRanks(tree, left, node, right);
+}
+
+/**
+ * @brief Split a detached sub-tree into the keys before and after an element.
+ * Each node of the search path joins the side of its key, so the split takes
+ * O(log n) joins of O(log n) in total. Like `joinTrees`, the threaded list
+ * is unchanged and `tree->root` must be set by the caller.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param root  Root of the sub-tree to split, or NULL.
+ * @param elem  The element splitting the keys.
+ * @param equal 1 if the key equal to `elem` goes left, 0 if it goes right.
+ * @param left  Where to store the sub-tree of the keys before `elem`.
+ * @param right Where to store the sub-tree of the keys after `elem`.
+ */
+void splitTree(Tree *tree, TreeNode *root, void *elem, int equal,
+               TreeNode **left, TreeNode **right) {
+    if (!root) {
+        *left = *right = NULL;
+        return;
+    }
+
+    // Detach both children, the node joins one side again.
+    TreeNode *lower = root->left, *upper = root->right;
+    if (lower) lower->parent = NULL;
+    if (upper) upper->parent = NULL;
+    root->left = root->right = NULL;
+
+    int comp = COMPARE(root->elem, elem);
+    TreeNode *inner = NULL;
+    if (comp < 0 || (!comp && equal)) {
+        // The node goes left, with the keys of its right sub-tree before `elem`.
+        if (comp) splitTree(tree, upper, elem, equal, &inner, right);
+        else *right = upper;
+        *left = joinTrees(tree, lower, root, inner);
+    } else {
+        // The node goes right, with the keys of its left sub-tree after `elem`.
+        if (comp) splitTree(tree, lower, elem, equal, left, &inner);
+        else *left = lower;
+        *right = joinTrees(tree, inner, root, upper);
+    }
+}
+
+/**
+ * @brief Remove the node with the greatest key from a detached sub-tree.
+ * 
+ * @param tree Pointer to a tree object.
+ * @param root Root of the sub-tree, not NULL.
+ * @param last Where to store the removed node.
+ * @return The root of the sub-tree left, or NULL.
+ */
+static TreeNode* splitLast(Tree *tree, TreeNode *root, TreeNode **last) {
+    TreeNode *lower = root->left, *upper = root->right;
+    if (lower) lower->parent = NULL;
+    root->left = root->right = NULL;
+
+    if (!upper) {
+        *last = root;
+        return lower;
+    }
+    upper->parent = NULL;
+    TreeNode *rest = splitLast(tree, upper, last);
+    return joinTrees(tree, lower, root, rest);
+}
+
+/**
+ * @brief Join two detached sub-trees, every key of `left` before every key of `right`.
+ * The greatest node of `left` is taken out and joins the two sub-trees.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param left  Sub-tree with the smaller keys, or NULL.
+ * @param right Sub-tree with the greater keys, or NULL.
+ * @return The root of the joined sub-tree, its parent is NULL.
+ */
+TreeNode* mergeTrees(Tree *tree, TreeNode *left, TreeNode *right) {
+    if (!left) return right;
+    if (!right) return left;
+
+    TreeNode *last = NULL;
+    TreeNode *rest = splitLast(tree, left, &last);
+    return joinTrees(tree, rest, last, right);
+}
+
 /* -------------------------------------------------------------------------------------------------------- */
 
+/**
+ * @brief Continue a FNV-1a 64 checksum over a buffer.
+ * 
+ * @param hash   The checksum so far.
+ * @param data   The bytes to add.
+ * @param length Number of bytes.
+ * @return The updated checksum.
+ */
+uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t pos = 0; pos < length; pos++)
+        hash = (hash ^ bytes[pos]) * FNV_PRIME;
+    return hash;
+}
+
+/* -------------------------------------------------------------------------------------------------------- */
+
+/**
+ * @brief Check if a character separates two words.
+ * 
+ * @param character The character to check.
+ * @return 1 if the character is one of `WORD_SEPARATOR`, 0 otherwise.
+ */
+int isSeparator(char character) {
+    return character != '\0' && strchr(WORD_SEPARATOR, character) != NULL;
+}
+
+/**
+ * @brief Count the words of a span, used while counting a buffer.
+ * 
+ * @param ctx  Pointer to the word counter.
+ * @param span The word found (unused).
+ */
+void countSpan(void *ctx, const Span *span) {
+    (void)span;
+    (*(size_t *)ctx)++;
+}
+
+/**
+ * @brief Count the words from a buffer.
+ * 
+ * @param data   The buffer to scan.
+ * @param length Number of characters in the buffer.
+ * @return The number of words separated by `WORD_SEPARATOR`.
+ */
+size_t countWords(const char *data, size_t length) {
+    size_t words = 0;
+    int64_t offset = 0;
+    tokenize(data, length, &offset, countSpan, &words);
+    return words;
+}
+
+/**
+ * @brief Copy a word span in the reusable buffer of a sink.
+ * The word is NUL terminated for the create functions of the tree.
+ * 
+ * @param sink Pointer to a `WordSink` with the tree and its buffer.
+ * @param span The word and its offset.
+ * @return The copy of the word, valid until the next span.
+ */
+char* copySpan(WordSink *sink, const Span *span) {
+    // Grow the buffer if the word doesn't fit.
+    if (span->length + 1 > sink->capacity) {
+        char *word = malloc(span->length + 1);
+        // Handle [ERR]: allocation.
+        if (!word) {
+            printf("[ERR]: at malloc...\n");
+            exit(EXIT_FAILURE);
+        }
+        if (sink->owned) free(sink->word);
+        sink->word = word;
+        sink->capacity = span->length + 1;
+        sink->owned = 1;
+    }
+
+    memcpy(sink->word, span->word, span->length);
+    sink->word[span->length] = '\0';
+    return sink->word;
+}
+
+/**
+ * @brief Insert a word span into the AVL tree.
+ * The span is copied in the reusable buffer of the sink (see `copySpan`),
+ * then inserted with the span offset.
+ * 
+ * @param ctx  Pointer to a `WordSink` with the tree and its buffer.
+ * @param span The word and its offset.
+ */
+void insertSpan(void *ctx, const Span *span) {
+    WordSink *sink = (WordSink *)ctx;
+    int64_t offset = span->offset;
+    insertNode(sink->tree, copySpan(sink, span), &offset);
+}
+
+/**
+ * @brief Map a whole file in memory (read only).
+ * 
+ * @param file The name of the file to map.
+ * @param data Where to store the mapped content (NULL for an empty file).
+ * @param size Where to store the size of the file.
+ * @return 0 on success, -1 if the file can't be opened or mapped.
+ */
+int mapFile(const char *file, const char **data, size_t *size) {
+    TRACE_SCOPE("mapFile");
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    *data = NULL;
+    *size = (size_t)info.st_size;
+    // An empty file has nothing to map.
+    if (*size) {
+        void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        // Words are read front to back.
+        madvise(map, *size, MADV_SEQUENTIAL);
+        *data = map;
+    }
+
+    // The mapping stays valid after closing the descriptor.
+    close(fd);
+    return 0;
+}
+
 /**
  * @brief Insert a word into the AVL tree.
  * Inserts a word (string) into the AVL tree, associating it with an offset value.
  * 
  * @param tree   Pointer to an tree object.
  * @param word   The word (string) to insert into the tree.
- * @param offset A pointer to an integer that represents the offset value to associate with the word.
+ * @param offset A pointer to the 64-bit offset value to associate with the word.
  */
-void insertWord(Tree *tree, const char *word, int *offset) {
+void insertWord(Tree *tree, const char *word, int64_t *offset) {
     insertNode(tree, (void *)word, (void *)offset);
     // After the word is inserted, modify the offset.
-    *offset += (int)strlen(word);
+    *offset += (int64_t)strlen(word);
 }
 
 /**
  * @brief Process a line of text and insert words into the AVL tree.
  * Processes a line of text, tokenizes it into words, and inserts each word into the AVL tree.
- * It also updates the offset value for each inserted word.
+ * It also updates the offset value for each inserted word. The line is not modified.
  * 
  * @param tree   Pointer to an tree object.
  * @param line   The line of text to process.
- * @param offset A pointer to an integer that represents the current offset value.
+ * @param offset A pointer to the 64-bit offset value of the next word.
  */
-void processLine(Tree *tree, const char *line, int *offset) {
-    // Make a copy of the line to avoid modifying the original string.
-    char *lineCopy = strdup(line);
-
-    if (!lineCopy) {
-        // Handle memory allocation [ERR]:.
-        printf("[ERR]: at strdup...\n");
-        exit(EXIT_FAILURE);
-    }
-
-    char *word = NULL;
-    word = strtok(lineCopy, WORD_SEPARATOR);
+void processLine(Tree *tree, const char *line, int64_t *offset) {
+    TRACE_SCOPE("processLine");
+    // Words are copied one by one in a stack buffer (heap for longer words).
+    char word[BUFFER_LEN];
+    WordSink sink = { tree, word, sizeof(word), 0 };
 
-    while (word) {
-        // Insert the word into the tree.
-        insertWord(tree, word, offset);
-        // Get the next word.
-        word = strtok(NULL, WORD_SEPARATOR);
-    }
+    tokenize(line, strlen(line), offset, insertSpan, &sink);
 
-    // Free the copy of the line.
-    free(lineCopy);
+    // Free the buffer if a longer word needed one.
+    if (sink.owned) free(sink.word);
 }
 
 /* -------------------------------------------------------------------------------------------------------- */
@@ -303,42 +1220,119 @@ void processLine(Tree *tree, const char *line, int *offset) {
  * @brief Create a new Range structure.
  * Allocates memory for a Range structure and initializes its fields.
  * 
+ * @param allocator The allocator of the queried tree, the range is allocated from it.
  * @return A pointer to the newly created Range structure, or NULL if memory allocation fails.
  */
-Range* createRange(void) {
-    Range* range =(Range *)malloc(sizeof(*range));
+Range* createRange(const Allocator *allocator) {
+    // The range counts its own bytes, it may outlive the tree queried.
+    Memory memory = { allocator, 0, 0 };
+    Range* range =(Range *)memAlloc(&memory, sizeof(*range));
 
 	// Check if range was allocated successfully.
     if (range) {
-		// Default values new range allocated.
+		// Default values new range allocated, with its own copy of the allocator.
         range->size = 0;
         range->capacity = INIT_LEN;
-        range->index = malloc(sizeof(*range->index) * range->capacity);
-        // Handle [ERR]: reallocation.
+        range->allocator = *allocator;
+        range->memory = memory;
+        range->memory.allocator = &range->allocator;
+        range->refs = 1;
+        range->index = memAlloc(&range->memory, sizeof(*range->index) * range->capacity);
+        // Handle [ERR]: allocation, the range is released.
         if (!range->index) {
-            printf("[ERR]: at malloc...\n");
-            exit(EXIT_FAILURE);
+            range->capacity = 0;
+            destroyRange(range);
+            return NULL;
         }
     }
 
     return range;
 }
 
+/**
+ * @brief Grow the index array of a Range structure to a capacity.
+ * 
+ * @param range    A pointer to the Range structure to grow.
+ * @param capacity Number of values the index must hold.
+ * @return 1 on success, 0 if the memory was refused (the range is left as it was).
+ */
+int reserveRange(Range* range, size_t capacity) {
+    if (capacity <= range->capacity) return 1;
+
+    int *index = memResize(&range->memory, range->index, sizeof(*range->index) * range->capacity,
+                           sizeof(*range->index) * capacity);
+    if (!index) return 0;
+    range->index = index;
+    range->capacity = capacity;
+    return 1;
+}
+
 /**
  * @brief Expand the index array of a Range structure.
  * Increases the capacity of the index array in a Range structure by doubling its size.
  * 
  * @param range A pointer to the Range structure to expand.
+ * @return 1 on success, 0 if the memory was refused.
  */
-void expandRangeIndex(Range* range) {
+int expandRangeIndex(Range* range) {
     // Double capacity size and reallocate range size.
-    range->capacity *= 2;
-    range->index = realloc(range->index, sizeof(*range->index) * range->capacity);
-    // Handle [ERR]: reallocation.
-    if (!range->index) {
-        printf("[ERR]: at realloc...\n");
-        exit(EXIT_FAILURE);
+    return reserveRange(range, range->capacity * 2);
+}
+
+/**
+ * @brief Get the key letter stored by an entry.
+ * Entry values are integers, or 64-bit indexes (see `createIdx`) for the
+ * trees setting that width (see `setTreeValueWidth`), reduced to a letter shift.
+ * 
+ * @param tree Pointer to the tree of the entry.
+ * @param node The entry to read.
+ * @return The value of the entry modulo `LETTER_LEN`.
+ */
+int letterKey(Tree *tree, TreeNode *node) {
+    if (tree->lambda.valueWidth == sizeof(int)) return *(int *)node->value % LETTER_LEN;
+    return (int)(*(int64_t *)node->value % LETTER_LEN);
+}
+
+/**
+ * @brief Copy a query bound, the copy is kept by a cache or a view.
+ * The keys of the trees borrowing their words (see `buildTreeFromMap`) are
+ * views into a buffer of the caller, so the view and its word are copied
+ * together. Other borrowed keys can't be copied. The copy is counted in
+ * the tree memory, its owner uncounts `bytes` when it releases it.
+ * 
+ * @param tree  Pointer to a tree object.
+ * @param bound The bound to copy.
+ * @param bytes Where to add the bytes of the copy.
+ * @return The copy, released with the function of `boundRelease`, or NULL.
+ */
+void* copyBound(Tree *tree, void *bound, size_t *bytes) {
+    size_t mark = payloadBytes();
+    void *copy = NULL;
+    if (CREATE.createElem != borrowElem) {
+        copy = CREATE.createElem(bound);
+    } else if (tree->lambda.compare == compareView) {
+        const View *word = (const View *)bound;
+        View *owned = allocPayload(sizeof(View) + word->length);
+        if (owned) {
+            memcpy(owned + 1, word->data, word->length);
+            owned->data = (const char *)(owned + 1);
+            owned->length = word->length;
+        }
+        copy = owned;
     }
+    *bytes += payloadBytes() - mark;
+    memTransfer(NULL, &tree->memory, payloadBytes() - mark);
+    return copy;
+}
+
+/**
+ * @brief Get the function releasing the bound copies of a tree.
+ * 
+ * @param tree Pointer to a tree object.
+ * @return The function releasing the copies of `copyBound`.
+ */
+Delete boundRelease(Tree *tree) {
+    return CREATE.createElem == borrowElem ? freePayload : DELETE.deleteElem;
 }
 
 /**
@@ -348,14 +1342,14 @@ void expandRangeIndex(Range* range) {
  * 
  * @param range A pointer to the Range structure to which the value should be added.
  * @param value The integer value to add to the index array.
+ * @return 1 on success, 0 if the memory was refused.
  */
-void addToRangeIndex(Range* range, int value) {
+int addToRangeIndex(Range* range, int value) {
     // The maximum capacity was 
-    if (range->size == range->capacity) {
-        expandRangeIndex(range);
-    }
+    if (range->size == range->capacity && !expandRangeIndex(range)) return 0;
     range->index[range->size] = value;
     range->size++;
+    return 1;
 }
 
 /* -------------------------------------------------------------------------------------------------------- */
@@ -8,26 +8,134 @@
 #include "../include/AVLTree.h"
 #include "../include/Cipher.h"
 #include "../include/Range.h"
+#include "../include/Token.h"
+#include "../include/Hash.h"
+#include "../include/Bloom.h"
+#include "../include/Tombstone.h"
+#include "../include/Parallel.h"
+#include "../include/KeyView.h"
+#include "../include/Aggregate.h"
+#include "../include/ValueIndex.h"
+#include "../include/Trace.h"
 
 // AVLTree 
 void avlFixUp(Tree *tree, TreeNode *root);
+void wavlInsertFixUp(Tree *tree, TreeNode *node);
+void wavlDeleteFixUp(Tree *tree, TreeNode *parent, TreeNode *node);
+void raiseNode(Tree *tree, TreeNode *node);
+TreeNode* findNode(Tree *tree, TreeNode *root, void *elem);
+void countNodeAlloc(Tree *tree);
+void countNodeFree(Tree *tree);
+void countPayload(Tree *tree, TreeNode *node, size_t bytes);
+void uncountPayload(Tree *tree, TreeNode *node);
 int levelNode(Tree *tree, void *elem);
 
 int freqNode(Tree *tree, TreeNode *root);
 TreeNode* maxFreqNode(Tree *tree);
 
+void unlinkSingleNode(Tree *tree, TreeNode *node);
 void deleteSingleNode(Tree *tree, TreeNode *node);
+int detachEntry(Tree *tree, void *elem, void **outElem, void **outValue);
 void insertIntoLinkedList(TreeNode *list, TreeNode *node);
 void insertElement(Tree *tree, TreeNode *node, TreeNode *parent);
+int attachNode(Tree *tree, TreeNode *node);
+TreeNode* buildBalanced(TreeNode **heads, size_t count, TreeNode *parent);
+TreeNode* buildWeighted(TreeNode **heads, size_t count);
+TreeNode* joinTrees(Tree *tree, TreeNode *left, TreeNode *node, TreeNode *right);
+void splitTree(Tree *tree, TreeNode *root, void *elem, int equal, TreeNode **left, TreeNode **right);
+TreeNode* mergeTrees(Tree *tree, TreeNode *left, TreeNode *right);
+
+// Snapshot and Journal
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t length);
 
 // Range
-void insertWord(Tree *tree, const char *word, int *startOffset);
-void processLine(Tree *tree, const char *line, int *startOffset);
+typedef struct WordSink {
+    Tree *tree;        /* Tree receiving the words.                 */
+    char *word;        /* Buffer holding the current word.          */
+    size_t capacity;   /* Size of the buffer.                       */
+    int owned;         /* The buffer was allocated and must be freed. */
+} WordSink;
+
+// Piece of a parallel query, one key with its duplicates or a whole sub-tree.
+typedef struct Piece {
+    TreeNode *node;    /* The key, or the root of the sub-tree.              */
+    int whole;         /* 1 for the whole sub-tree of `node`.                */
+    size_t offset;     /* Offset of the piece in the result (its count first). */
+} Piece;
+
+// Parallel query, shared by its workers.
+typedef struct RangeJob {
+    Piece *pieces;     /* Pieces covering the keys, in order.                */
+    size_t count;      /* Number of pieces.                                  */
+    size_t capacity;   /* Size of the pieces array.                          */
+    size_t next;       /* Next piece to take, taken atomically.              */
+    int *index;        /* Result written by the workers, NULL while counting. */
+    Tree *tree;        /* Tree queried.                                      */
+    Memory *memory;    /* Memory of the tree queried.                        */
+} RangeJob;
+
+int isSeparator(char character);
+void countSpan(void *ctx, const Span *span);
+size_t countWords(const char *data, size_t length);
+char* copySpan(WordSink *sink, const Span *span);
+void insertSpan(void *ctx, const Span *span);
+int mapFile(const char *file, const char **data, size_t *size);
+void insertWord(Tree *tree, const char *word, int64_t *startOffset);
+void processLine(Tree *tree, const char *line, int64_t *startOffset);
+int letterKey(Tree *tree, TreeNode *node);
+void* copyBound(Tree *tree, void *bound, size_t *bytes);
+Delete boundRelease(Tree *tree);
 
 char transformCharacter(char character, Range *elem, size_t *idx, int encrypt);
 
-Range* createRange(void);
-void expandRangeIndex(Range* range);
-void addToRangeIndex(Range* range, int value);
+Range* createRange(const Allocator *allocator);
+int reserveRange(Range* range, size_t capacity);
+int expandRangeIndex(Range* range);
+int addToRangeIndex(Range* range, int value);
+
+// Parallel traversal
+// Task of a parallel traversal, a whole sub-tree or a slice of a duplicate chain.
+typedef struct Task {
+    TreeNode *root;    /* Root of the sub-tree, or NULL for a slice.         */
+    TreeNode *first;   /* First entry of the slice.                          */
+    TreeNode *stop;    /* Entry after the slice.                             */
+} Task;
+
+// Tasks of a worker, it takes from the bottom and thieves from the top.
+typedef struct Deque {
+    Task *tasks;            /* Tasks, from `head` to `tail`.                 */
+    size_t head, tail;      /* Oldest task and end of the tasks.             */
+    size_t capacity;        /* Size of the tasks array.                      */
+    pthread_mutex_t lock;   /* Protects the fields above.                    */
+} Deque;
+
+// Parallel traversal, shared by its workers.
+typedef struct Walk {
+    Tree *tree;             /* Tree traversed.                               */
+    Memory *memory;         /* Memory of the tree.                           */
+    Deque *deques;          /* Deque of each worker.                         */
+    size_t workers;         /* Number of workers, the calling thread first.  */
+    size_t pending;         /* Tasks added and not done yet, atomic.         */
+    int hungry;             /* A worker found no task to steal, atomic.      */
+    // Called by the workers for each entry of their tasks.
+    void (*visit)(struct Walk *walk, size_t worker, TreeNode *entry);
+    Visit visitFunc;        /* User visit of `treeForEachParallel`.          */
+    Map map;                /* User map of `treeReduceParallel`.             */
+    void *ctx;              /* State of the user functions.                  */
+    char *accs;             /* Accumulators of the workers.                  */
+    size_t stride;          /* Distance between two accumulators.            */
+} Walk;
+
+// Worker of a parallel traversal.
+typedef struct Worker {
+    Walk *walk;             /* The traversal.                                */
+    size_t id;              /* Index of the worker and of its deque.         */
+    pthread_t thread;       /* Thread running the worker.                    */
+    TreeNode **stack;       /* Sub-trees left to walk in the current task.   */
+    size_t capacity;        /* Size of the stack.                            */
+} Worker;
 
 #endif /* _UTILS_H_ */